@@ -1,98 +1,210 @@
+#include <algorithm>
 #include <iostream>
 #include <set>
+#include <vector>
 
 #include "mcds_io.h"
 #include "lattice_util.h"
 
+namespace {
+
+struct bounding_box{
+	int lowest_x;
+	int lowest_y;
+	int highest_x;
+	int highest_y;
+};
+
+// Bounding boxes of the cells on the lattice, indexed by cell id. Cells that
+// are not on the lattice get highest_x == -1.
+std::vector<bounding_box> cell_boxes(int ** lattice, int size_x, int size_y){
+	int bands = std::min(worker_threads(), size_x);
+	std::vector<std::vector<bounding_box>> band_boxes(bands);
+	parallel_for(bands, [&](int band){
+		std::vector<bounding_box> & boxes = band_boxes[band];
+		for (int x = band * size_x / bands; x < (band+1) * size_x / bands; x++){
+			for (int y = 0; y < size_y; y++){
+				int id = lattice[x][y];
+				if (id <= 0) continue;
+				if (id >= (int) boxes.size()) boxes.resize(id + 1, {0, 0, -1, -1});
+				bounding_box & box = boxes[id];
+				if (box.highest_x == -1){
+					box = {x, y, x, y};
+					continue;
+				}
+				box.lowest_x  = std::min(box.lowest_x, x);
+				box.lowest_y  = std::min(box.lowest_y, y);
+				box.highest_x = std::max(box.highest_x, x);
+				box.highest_y = std::max(box.highest_y, y);
+			}
+		}
+	});
+	std::vector<bounding_box> boxes;
+	for (std::vector<bounding_box> & band : band_boxes){
+		if (band.size() > boxes.size()) boxes.resize(band.size(), {0, 0, -1, -1});
+		for (unsigned int id = 0; id < band.size(); id++){
+			if (band[id].highest_x == -1) continue;
+			if (boxes[id].highest_x == -1){
+				boxes[id] = band[id];
+				continue;
+			}
+			boxes[id].lowest_x  = std::min(boxes[id].lowest_x, band[id].lowest_x);
+			boxes[id].lowest_y  = std::min(boxes[id].lowest_y, band[id].lowest_y);
+			boxes[id].highest_x = std::max(boxes[id].highest_x, band[id].highest_x);
+			boxes[id].highest_y = std::max(boxes[id].highest_y, band[id].highest_y);
+		}
+	}
+	return boxes;
+}
+
+// Corner (x, y) lies between pixels a = (x-1, y-1), b = (x, y-1),
+// c = (x-1, y) and d = (x, y). Pixels outside of the lattice count as 0.
+void corner_pixels(int ** lattice, int size_x, int size_y, int x, int y, int * pixels){
+	int & a = pixels[0], & b = pixels[1], & c = pixels[2], & d = pixels[3];
+	a = 0; b = 0; c = 0; d = 0;
+	if (x > 0 && y > 0 && x <= size_x && y <= size_y){a = lattice[x-1][y-1];}
+	if (y > 0 && x < size_x && y <= size_y){          b = lattice[x][y-1];}
+	if (x > 0 && y < size_y && x <= size_x){          c = lattice[x-1][y];}
+	if (x < size_x && y < size_y){                    d = lattice[x][y];}
+}
+
+// A corner is a node unless the cell boundary runs straight through it, or
+// there is no boundary at all.
+bool is_node(const int * pixels){
+	int a = pixels[0], b = pixels[1], c = pixels[2], d = pixels[3];
+	if (a <= 0 && b <= 0 && c <= 0 && d <= 0) return false;
+	return !((a == b && a != c && c == d) ||
+	         (b == d && b != a && a == c) ||
+	         (d == c && d != b && b == a) ||
+	         (c == a && c != d && d == b) ||
+	         (a == b && a == c && a == d));
+}
+
+}
+
 void MCDS_io::nodes_from_lattice(){
-	int node_id = 0;
-	for (int y = 0; y < size_x; y++){
-		for (int x = 0; x < size_y; x++){
-			//std::cout << "X: " << x << " Y:" << y << std::endl; 
-			//std::cout << "Lattice: " << lattice[x][y] << std::endl;
-			double a = 0, b = 0, c = 0, d = 0;
-			if (x > 0 && y > 0){          a = lattice[x-1][y-1];}
-			if (y > 0 && x < size_x){     b = lattice[x][y-1];}
-			if (x > 0 && y < size_y){     c = lattice[x-1][y];}
-			if (x < size_x && y < size_y){d = lattice[x][y];}
-			if (a > 0 || b > 0 || c > 0 || d > 0){
-				std::set<int> cells;
-				if(a > 0) {cells.insert(a);}    
-				if(b > 0) {cells.insert(b);}
-				if(c > 0) {cells.insert(c);}
-				if(d > 0) {cells.insert(d);}
-				if (cells.size() > 0){
-					if (!((a == b && a != c && c == d) ||
-					      (b == d && b != a && a == c) ||
-					      (d == c && d != b && b == a) ||
-					      (c == a && c != d && d == b) ||
-					      (a == b && a == c && a == d))){
-						io_node * node = get_new_node(node_id);
-						node->x = x -0.5;
-						node->y = y -0.5;
-						for(int cell_id : cells){
-							std::cout << "Adding node " << node_id << " to " << cell_id << "" << std::endl;
-							cell_by_id(cell_id)->node_ids.push_back(node_id);
-						}
-						node->cell_ids = std::vector<int>(cells.begin(), cells.end()); 
-						node_id ++;
-					}
+	std::vector<bounding_box> boxes = cell_boxes(lattice, size_x, size_y);
+	std::vector<int> cell_ids;
+	for (unsigned int id = 0; id < boxes.size(); id++){
+		if (boxes[id].highest_x != -1) cell_ids.push_back(id);
+	}
+
+	// Nodes are numbered in the order of their corners, row by row. Each
+	// cell finds the nodes on its own boundary by looking at the corners in
+	// its bounding box, and the corners of all cells are merged afterwards.
+	long row = size_x + 1;
+	std::vector<std::vector<long>> cell_corners(cell_ids.size());
+	parallel_for(cell_ids.size(), [&](int index){
+		int cell_id = cell_ids[index];
+		const bounding_box & box = boxes[cell_id];
+		int pixels[4];
+		for (int y = box.lowest_y; y <= box.highest_y + 1; y++){
+			for (int x = box.lowest_x; x <= box.highest_x + 1; x++){
+				corner_pixels(lattice, size_x, size_y, x, y, pixels);
+				if (std::find(pixels, pixels + 4, cell_id) != pixels + 4 &&
+				    is_node(pixels)){
+					cell_corners[index].push_back(y * row + x);
 				}
 			}
 		}
+	});
+
+	std::vector<long> corners;
+	for (const std::vector<long> & cell_corner : cell_corners){
+		corners.insert(corners.end(), cell_corner.begin(), cell_corner.end());
+	}
+	std::sort(corners.begin(), corners.end());
+	corners.erase(std::unique(corners.begin(), corners.end()), corners.end());
+
+	for (unsigned int node_id = 0; node_id < corners.size(); node_id++){
+		int x = corners[node_id] % row, y = corners[node_id] / row;
+		int pixels[4];
+		corner_pixels(lattice, size_x, size_y, x, y, pixels);
+		std::set<int> node_cells;
+		for (int pixel : pixels){
+			if (pixel > 0) node_cells.insert(pixel);
+		}
+		io_node * node = get_new_node(node_id);
+		node->x = x -0.5;
+		node->y = y -0.5;
+		node->cell_ids = std::vector<int>(node_cells.begin(), node_cells.end());
+	}
+
+	std::vector<io_cell *> cell_list;
+	for (int cell_id : cell_ids){
+		cell_list.push_back(cell_by_id(cell_id));
 	}
+	parallel_for(cell_ids.size(), [&](int index){
+		for (long corner : cell_corners[index]){
+			int node_id = std::lower_bound(corners.begin(), corners.end(), corner) - corners.begin();
+			cell_list[index]->node_ids.push_back(node_id);
+		}
+	});
 }
 
 void MCDS_io::edges_from_lattice(){
-	for (auto cell_i : cells){
-		int cell_id = cell_i.first;
-		io_cell * cell = cell_by_id(cell_id); 
-		for(int node_id_a : cell->node_ids) {
-			io_node * node_a = node_by_id(node_id_a);
+	std::vector<int> cell_ids;
+	std::vector<io_cell *> cell_list;
+	for (auto & cell_i : cells){
+		cell_ids.push_back(cell_i.first);
+		cell_list.push_back(&cell_i.second);
+	}
+
+	// For every node, a cell has an edge to the nearest node to the right
+	// and the nearest node below along its boundary. These are found for
+	// all cells in parallel, and then numbered in the order of the cells.
+	std::vector<std::vector<std::pair<int, int>>> cell_edges(cell_ids.size());
+	parallel_for(cell_ids.size(), [&](int index){
+		int cell_id = cell_ids[index];
+		const std::vector<int> & node_ids = cell_list[index]->node_ids;
+		std::vector<int> node_x, node_y;
+		for (int node_id : node_ids){
+			const io_node & node = nodes.at(node_id);
+			node_x.push_back(node.x +0.5);
+			node_y.push_back(node.y +0.5);
+		}
+		for (unsigned int a = 0; a < node_ids.size(); a++){
+			int sx = node_x[a], sy = node_y[a];
+			int b = 0, c = 0, d = 0;
+			if (sy > 0 && sx < size_x){      b = lattice[sx][sy-1];}
+			if (sx > 0 && sy < size_y){      c = lattice[sx-1][sy];}
+			if (sx < size_x && sy < size_y){ d = lattice[sx][sy];  }
+			bool edge_right = (b != d) && (b == cell_id || d == cell_id);
+			bool edge_down  = (c != d) && (c == cell_id || d == cell_id);
 			int closest_x = -1, distance_x = -1, closest_y = -1, distance_y = -1;
-			int sx = node_a->x +0.5, sy = node_a->y +0.5;
-			for(int node_id_b : cell->node_ids){
-				io_node * node_b = node_by_id(node_id_b);
-				double dx = node_a->x - node_b->x;
-				double dy = node_a->y - node_b->y;
-				int  b = 0, c = 0, d = 0;
-				if (sy > 0 && sx < size_x){                  b = lattice[sx][sy-1];}
-				if (sx > 0 && sy < size_y){                  c = lattice[sx-1][sy];}
-				if (sx < size_x && sy < size_y){ d = lattice[sx][sy];  }
-				bool going_right = dx < 0 && dy == 0;
-				bool going_down  = dy < 0 && dx == 0;
-				bool is_on_edge_down  = going_down  && ((c != d) && (c == cell_id || d == cell_id));
-				bool is_on_edge_right = going_right && ((b != d) && (b == cell_id || d == cell_id));
-				if ((abs(dx) < distance_x || closest_x == -1) && is_on_edge_right){
-					distance_x = abs(dx); closest_x = node_id_b;
+			for (unsigned int other = 0; other < node_ids.size(); other++){
+				int dx = node_x[a] - node_x[other];
+				int dy = node_y[a] - node_y[other];
+				if (edge_right && dx < 0 && dy == 0 &&
+				    (-dx < distance_x || closest_x == -1)){
+					distance_x = -dx; closest_x = node_ids[other];
 				}
-				if((abs(dy) < distance_y || closest_y == -1) && is_on_edge_down){
-					distance_y = abs(dy); closest_y = node_id_b;
+				if (edge_down && dy < 0 && dx == 0 &&
+				    (-dy < distance_y || closest_y == -1)){
+					distance_y = -dy; closest_y = node_ids[other];
 				}
 			}
-			if(closest_x != -1){
-				int edge_id = get_new_edge_uniq(node_id_a, closest_x);
-				cell->edge_ids.push_back(edge_id);
-				edge_by_id(edge_id)->cell_ids.push_back(cell_i.first);  
-			}
-			if(closest_y != -1){
-				int edge_id = get_new_edge_uniq(node_id_a, closest_y);
-				cell->edge_ids.push_back(edge_id);
-				edge_by_id(edge_id)->cell_ids.push_back(cell_i.first);
-			}
+			if (closest_x != -1) cell_edges[index].emplace_back(node_ids[a], closest_x);
+			if (closest_y != -1) cell_edges[index].emplace_back(node_ids[a], closest_y);
+		}
+	});
+
+	for (unsigned int index = 0; index < cell_ids.size(); index++){
+		for (const std::pair<int, int> & nodes_ab : cell_edges[index]){
+			int edge_id = get_new_edge_uniq(nodes_ab.first, nodes_ab.second);
+			cell_list[index]->edge_ids.push_back(edge_id);
+			edge_by_id(edge_id)->cell_ids.push_back(cell_ids[index]);
 		}
 	}
 }
 
 void MCDS_io::faces_from_lattice(){
 	int face_id = 0;
-	for (auto cell_i : cells){
-		io_cell * cell = cell_by_id(cell_i.first);
+	for (auto & cell_i : cells){
+		io_cell & cell = cell_i.second;
 		io_face * face = get_new_face(face_id);
-		for (int edge_id : cell->edge_ids){
-			face->edge_ids.push_back(edge_id);
-		}
-		cell->face_ids.push_back(face_id);
+		face->edge_ids = cell.edge_ids;
+		cell.face_ids.push_back(face_id);
 		face_id++;
 	}
 }
@@ -103,23 +215,21 @@ void MCDS_io::vector_from_lattice(){
 	faces_from_lattice();
 }
 
-void MCDS_io::lattice_from_face(int face_id, int id, int offset_x, int offset_y){
-	io_face * face = face_by_id(face_id);
-	double intersection_points[face->edge_ids.size()+1];
-	std::cout << "poly_add face: " << face_id << std::endl; 
-	for (int y = face->lowest_y; y < face->highest_y; y++){
+int MCDS_io::lattice_from_face(int face_id, int offset_x, int offset_y,
+                               std::vector<int> & sites) const {
+	const io_face & face = faces.at(face_id);
+	std::vector<double> intersection_points;
+	int outside = 0;
+	for (int y = face.lowest_y; y < face.highest_y; y++){
 		double ym = y + 0.5, lowest = -1, highest = -1;
-		int point_index = 0; 
-		std:: cout << "Y level: " << y << std::endl;
-		for (int edge_id : face->edge_ids){
-			io_edge * edge = edge_by_id(edge_id);
-			if(y > edge->lowest_y  && y < edge->highest_y ){
-				std::cout << "Edge_id: " << edge_id << std::endl; 
-				double x1 = node_by_id(edge->node_ids[0])->x;
-				double x2 = node_by_id(edge->node_ids[1])->x;
-				double y1 = node_by_id(edge->node_ids[0])->y;
-				double y2 = node_by_id(edge->node_ids[1])->y;
-				std::cout << "x1: " << x1 << " y1: " << y1 <<  " x2: " << x2 << " y2: " << y2 << std::endl;
+		intersection_points.clear();
+		for (int edge_id : face.edge_ids){
+			const io_edge & edge = edges.at(edge_id);
+			if(y > edge.lowest_y  && y < edge.highest_y ){
+				double x1 = nodes.at(edge.node_ids[0]).x;
+				double x2 = nodes.at(edge.node_ids[1]).x;
+				double y1 = nodes.at(edge.node_ids[0]).y;
+				double y2 = nodes.at(edge.node_ids[1]).y;
 				if (y1 != y2){
 					double res;
 					if(x1 == x2){
@@ -130,23 +240,20 @@ void MCDS_io::lattice_from_face(int face_id, int id, int offset_x, int offset_y)
 						double a = y1 - x1*f;
 						res = (ym-a)/((y2-y1)/(x2-x1));
 					}
-					if (res < face->lowest_x){ res = face->lowest_x;}
-					if (res > face->highest_x){ res = face->highest_x;}
-					if (edge_id == *face->edge_ids.begin()){lowest = res; highest = res;}
+					if (res < face.lowest_x){ res = face.lowest_x;}
+					if (res > face.highest_x){ res = face.highest_x;}
+					if (intersection_points.empty()){lowest = res; highest = res;}
 					if (res < lowest){ lowest = res;}
 					if (res > highest){ highest = res;}
-					std::cout << "Intersection point: " << res << std::endl;
-					intersection_points[point_index] = res;
-					point_index++;
+					intersection_points.push_back(res);
 				} 
 			}
 		}
-		intersection_points[point_index+1] = -1;
 		for (int x = lowest; x <= highest; x++){
 			double xm = x + 0.5;
 			int evenodd = 0;
-			for (int index =0; index < point_index && intersection_points[index] != -1; index++){ 
-				if ((xm - intersection_points[index]) > 0){
+			for (double point : intersection_points){ 
+				if ((xm - point) > 0){
 					evenodd++;
 				}
 			}
@@ -154,12 +261,12 @@ void MCDS_io::lattice_from_face(int face_id, int id, int offset_x, int offset_y)
 				int fx = x + offset_x;
 				int fy = y + offset_y;
 				if (fx < 0 || fy < 0 || fx > size_x-1 || fy > size_y-1){ 
-					std::cerr << "OOPS! Polygon outside of mesh!" << std::endl ;continue;} 
-				std::cout << "lattice X:" << x << " Y: " << y << " val: "<< id << std::endl;
-				lattice[fx][fy] = id;
+					outside++; continue;}
+				sites.push_back(fx * size_y + fy);
 			} 
 		}
 	}
+	return outside;
 }
 
 void MCDS_io::lattice_from_vector(){
@@ -169,19 +276,32 @@ void MCDS_io::lattice_from_vector(){
 	int offset_y = (size_y / 2) - (highest_y - ((highest_y - lowest_y) / 2));
 	int add_id = 0;
 	lattice = make_lattice(size_x, size_y);	
-	for (auto iocell : cells){
-		if (iocell.second.mcds_obj->ID() == 0) {add_id = 1;  break;}
+	std::vector<io_cell *> cell_list;
+	for (auto & iocell : cells){
+		if (iocell.second.mcds_obj->ID() == 0) {add_id = 1;}
+		cell_list.push_back(&iocell.second);
 	}
-	for (auto iocell : cells){
-		for (int face_id : iocell.second.face_ids){
-			iocell.second.lattice_id =  iocell.second.mcds_obj->ID() + add_id;
-			lattice_from_face(face_id, iocell.second.lattice_id, offset_x, offset_y);
+
+	// The faces are rasterised in parallel, and then drawn in the order of
+	// the cells, so that overlapping cells end up the same as before.
+	std::vector<std::vector<int>> cell_sites(cell_list.size());
+	std::vector<int> outside(cell_list.size(), 0);
+	parallel_for(cell_list.size(), [&](int index){
+		for (int face_id : cell_list[index]->face_ids){
+			outside[index] += lattice_from_face(face_id, offset_x, offset_y,
+			                                    cell_sites[index]);
 		}
-	}
-	for (int x = 0; x < size_x; x++){
-		for (int y = 0; y < size_y; y++ ){
-			std::cout << "X:" << x << " Y: " << y << " val: " << lattice[x][y] << std::endl; 	
+	});
+	for (unsigned int index = 0; index < cell_list.size(); index++){
+		io_cell & cell = *cell_list[index];
+		cell.lattice_id = cell.mcds_obj->ID() + add_id;
+		if (outside[index] > 0){
+			std::cerr << "OOPS! Polygon outside of mesh! " << outside[index]
+			          << " pixels of cell " << cell.mcds_obj->ID()
+			          << " were not drawn." << std::endl;
+		}
+		for (int site : cell_sites[index]){
+			lattice[0][site] = cell.lattice_id;
 		}
 	}
 }
-
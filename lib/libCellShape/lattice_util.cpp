@@ -1,5 +1,11 @@
-#include <iostream>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lattice_util.h"
 
 int ** make_lattice(int size_x, int size_y){
 	int *  content = new int  [size_x * size_y]{0};
@@ -10,28 +16,112 @@ int ** make_lattice(int size_x, int size_y){
 	return lattice;
 }
 
-void denoise_lattice(int ** lattice_in, int ** lattice_out, int size_x, int size_y){
-	for (int y = 0; y < size_y; y++){
-		for (int x = 0; x < size_x; x++){
-			int most = 0;
-			std::map<int, int> count;
-			for (int y_eye = y-1; y_eye <= y+1; y_eye++){
-				for (int x_eye = x-1; x_eye <= x+1; x_eye++){
-					int val = -1;
-					if (x_eye < size_x && x_eye > 0 && y_eye < size_y && x_eye > 0)
-						val = lattice_in[x_eye][y_eye];
-					if (count.find(val) == count.end()) count[val] = 0;
-					else count[val] += 1;
-					if (count[val] >= count[most]){most = val;}
-				}
-			}
-			if(most != -1 && most != lattice_in[x][y] && count[most] > 5){
-				lattice_out[x][y] = most;
-			}
-			else{
-				lattice_out[x][y] = lattice_in[x][y];
+void free_lattice(int ** lattice){
+	delete[] lattice[0];
+	delete[] lattice;
+}
+
+namespace {
+
+std::atomic<int> configured_threads(0);
+
+}
+
+int worker_threads(){
+	if (configured_threads > 0) return configured_threads;
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void set_worker_threads(int n_threads){
+	configured_threads = std::max(0, n_threads);
+}
+
+void parallel_for(int n, const std::function<void(int)> & body, int n_threads){
+	std::atomic<int> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto work = [&](){
+		try {
+			for (int i = next++; i < n; i = next++){
+				body(i);
 			}
+		} catch (...) {
+			// keep the first exception, and hand out no more indices
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (!error) error = std::current_exception();
+			next = n;
+		}
+	};
+	if (n_threads <= 0) n_threads = worker_threads();
+	n_threads = std::min(n_threads, n);
+	if (n_threads <= 1){
+		for (int i = 0; i < n; i++){
+			body(i);
 		}
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (int index = 1; index < n_threads; index++){
+		threads.emplace_back(work);
+	}
+	work();
+	for (std::thread & thread : threads){
+		thread.join();
 	}
+	if (error) std::rethrow_exception(error);
 }
 
+namespace {
+
+// Counts the values around a site. It behaves like the std::map<int, int>
+// that was used here before: looking up a value that is not there yet adds
+// it with count 0.
+struct neighbour_count{
+	int values[10];
+	int counts[10];
+	int size = 0;
+
+	bool contains(int val){
+		for (int index = 0; index < size; index++)
+			if (values[index] == val) return true;
+		return false;
+	}
+
+	int & operator[](int val){
+		for (int index = 0; index < size; index++)
+			if (values[index] == val) return counts[index];
+		values[size] = val;
+		counts[size] = 0;
+		return counts[size++];
+	}
+};
+
+int denoise_site(int ** lattice_in, int size_x, int size_y, int x, int y){
+	int most = 0;
+	neighbour_count count;
+	for (int y_eye = y-1; y_eye <= y+1; y_eye++){
+		for (int x_eye = x-1; x_eye <= x+1; x_eye++){
+			int val = -1;
+			if (x_eye < size_x && x_eye > 0 && y_eye < size_y && y_eye >= 0)
+				val = lattice_in[x_eye][y_eye];
+			if (!count.contains(val)) count[val] = 0;
+			else count[val] += 1;
+			if (count[val] >= count[most]){most = val;}
+		}
+	}
+	if(most != -1 && most != lattice_in[x][y] && count[most] > 5){
+		return most;
+	}
+	return lattice_in[x][y];
+}
+
+}
+
+void denoise_lattice(int ** lattice_in, int ** lattice_out, int size_x, int size_y){
+	// every site only depends on lattice_in, so the columns are independent
+	parallel_for(size_x, [&](int x){
+		for (int y = 0; y < size_y; y++){
+			lattice_out[x][y] = denoise_site(lattice_in, size_x, size_y, x, y);
+		}
+	});
+}
@@ -1,2 +1,18 @@
+#pragma once
+
+#include <functional>
+
 int ** make_lattice(int size_x, int size_y);
+void free_lattice(int ** lattice);
 void denoise_lattice(int ** lattice_in, int ** lattice_out, int size_x, int size_y);
+
+// Number of threads used by parallel_for, by default the number of cores
+int worker_threads();
+// Sets the number of threads used by parallel_for, 0 restores the default
+void set_worker_threads(int n_threads);
+// Calls body(i) for i = 0 .. n-1 on n_threads threads, or on
+// worker_threads() threads if n_threads is 0. Indices are handed out one at a
+// time, so uneven amounts of work per index are fine. If body throws, no
+// more indices are handed out, and the first exception is rethrown once all
+// threads have stopped.
+void parallel_for(int n, const std::function<void(int)> & body, int n_threads = 0);
@@ -1,10 +1,12 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
 #include <chrono>
 #include <ctime>
 #include <string>
 #include <locale.h>
+#include <vector>
 
 #include "MultiCellDS.hpp"
 #include "MultiCellDS-pimpl.hpp"
@@ -94,7 +96,7 @@ mesh::nodes_edges_faces* MCDS_io::finalize_shape(io_cell& cell){
 }
 
 cell::cell* MCDS_io::finalize_cell(int id){
-	io_cell cell = cells[id];
+	io_cell & cell = cells.at(id);
 	cell::cell * cell_ds = new cell::cell;
 	cell_ds->ID(id);
 	
@@ -125,7 +127,7 @@ cell::cell* MCDS_io::finalize_cell(int id){
 	target_volume->units(unit_n + " squared");
 	target_volume->base_value(cell.target_area);
 	volumes_target->total_volume(target_volume);
-	gp_target->volumes(volumes);
+	gp_target->volumes(volumes_target);
 	phenotype_target_ds->geometrical_properties(gp_target);
 	
 	phenotype_common::lengths * lengths = new phenotype_common::lengths();
@@ -146,7 +148,7 @@ cell::cell* MCDS_io::finalize_cell(int id){
 }
 
 mesh::face* MCDS_io::finalize_face(int id){
-	io_face face = faces[id];
+	const io_face & face = faces.at(id);
 	mesh::face * face_ds = new mesh::face;
 	face_ds->ID(id);
 	for (int edge_id : face.edge_ids){
@@ -158,13 +160,14 @@ mesh::face* MCDS_io::finalize_face(int id){
 mesh::edge* MCDS_io::finalize_edge(int id){
 	mesh::edge * edge_ds = new mesh::edge;
 	edge_ds->ID(id);
-	edge_ds->node_ID().push_back(edges[id].node_ids[0]);
-	edge_ds->node_ID().push_back(edges[id].node_ids[1]);
+	const io_edge & edge = edges.at(id);
+	edge_ds->node_ID().push_back(edge.node_ids[0]);
+	edge_ds->node_ID().push_back(edge.node_ids[1]);
 	return edge_ds;
 }
 
 mesh::node * MCDS_io::finalize_node(int id){
-	io_node node = nodes[id];
+	const io_node & node = nodes.at(id);
 	mesh::node * node_ds = new mesh::node;
 	node_ds->ID(id);
 	common::units_double_list * node_position = new common::units_double_list;
@@ -175,10 +178,10 @@ mesh::node * MCDS_io::finalize_node(int id){
 }
 
 int MCDS_io::get_new_edge_uniq(int node1, int node2){
-	std::string key;
+	long long key;
 	int id;
-	if (node1 > node2) key = std::to_string(node2) + std::to_string(node1);
-	else key = std::to_string(node1) + std::to_string(node2);
+	if (node1 > node2) key = (long long) node2 << 32 | (unsigned int) node1;
+	else key = (long long) node1 << 32 | (unsigned int) node2;
 	if (edge_by_nodes.find(key) == edge_by_nodes.end()){
 		id = edges.size();
 		edge_by_nodes[key] = id;
@@ -197,9 +200,18 @@ void MCDS_io::finalize_cellshapes(){
 	cell::cell_populations * cell_populations = new cell::cell_populations;
 	cellular_information->cell_populations(cell_populations);
 	cell_populations->cell_population(cell_population_individual); 
-	for(auto cell_it : cells){
-		int cell_id = cell_it.first;
-		cell_population_individual->cell().push_back(finalize_cell(cell_id));
+
+	// The cells only read the shapes, so they can be built in parallel
+	std::vector<int> cell_ids;
+	for(auto & cell_it : cells){
+		cell_ids.push_back(cell_it.first);
+	}
+	std::vector<cell::cell*> cells_ds(cell_ids.size());
+	parallel_for(cell_ids.size(), [&](int index){
+		cells_ds[index] = finalize_cell(cell_ids[index]);
+	});
+	for(cell::cell* cell_ds : cells_ds){
+		cell_population_individual->cell().push_back(cell_ds);
 	}
 }
 
@@ -220,10 +232,18 @@ void MCDS_io::write(std::string filename){
 	xml_schema::document_simpl doc_s (MultiCellDS_s.root_serializer (),
 			MultiCellDS_s.root_name ());
 	MultiCellDS_s.pre (*multicellds);
-	std::ofstream ofs(filename);
+	// The serializer writes the document to the file as it goes, through a
+	// large buffer, rather than building it in memory first
+	std::vector<char> buffer(1 << 20);
+	std::ofstream ofs;
+	ofs.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+	ofs.open(filename);
 	doc_s.serialize (ofs, xml_schema::document_simpl::pretty_print);
 	ofs << std::endl;
 	MultiCellDS_s.post (); 
+	ofs.close();
+	if (ofs.fail())
+		std::cerr << "Could not write MultiCellDS file " << filename << std::endl;
 }
 
 void MCDS_io::process_edges(cell::cell* cell_ds){
@@ -327,12 +347,15 @@ void MCDS_io::denoise(int repeats){
 		lattice = tmp_lattice;
 		tmp_lattice = swap;
 	}
+	// The result has to end up in the lattice we were given
 	if (repeats%2 != 0){
+		for (int x = 0; x < size_x; x++)
+			std::copy(lattice[x], lattice[x] + size_y, tmp_lattice[x]);
 		swap = lattice;
-                lattice = tmp_lattice;
-                tmp_lattice = swap;
+		lattice = tmp_lattice;
+		tmp_lattice = swap;
 	}
-	delete tmp_lattice;
+	free_lattice(tmp_lattice);
 }
 
 void MCDS_io::highlow_xy(double* lowest_x, double* highest_x,
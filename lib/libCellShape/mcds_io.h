@@ -1,5 +1,8 @@
+#pragma once
+
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -124,7 +127,8 @@ class MCDS_io{
 		std::map<int, io_node> nodes;
 		std::map<int, io_cell> cells;
 		
-		std::map<std::string, int> edge_by_nodes;
+		// edge ids by their two node ids, lowest first, packed into one key
+		std::unordered_map<long long, int> edge_by_nodes;
 		
 		cell::cell* finalize_cell(int id);
 		mesh::nodes_edges_faces* finalize_shape(io_cell& cell);
@@ -149,6 +153,9 @@ class MCDS_io{
 		void edges_from_lattice();
 		void faces_from_lattice();
 
-		void lattice_from_face(int face_id, int id, int offset_x, int offset_y);
+		// Adds the lattice sites inside a face to sites, as x * size_y + y,
+		// and returns the number of sites that fall outside of the lattice
+		int lattice_from_face(int face_id, int offset_x, int offset_y,
+		                      std::vector<int> & sites) const;
 };
 
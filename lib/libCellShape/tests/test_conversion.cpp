@@ -0,0 +1,145 @@
+// Load the code to be tested
+#include "conversion.cpp"
+#include "lattice_util.cpp"
+#include "mcds_io.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string const mcds_file = "build/test_conversion.xml";
+
+// A lattice with a grid of cells with ragged borders, and some medium
+int ** cell_grid(int size_x, int size_y, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    int ** lattice = make_lattice(size_x, size_y);
+    for (int x = 0; x < size_x; x++) {
+        for (int y = 0; y < size_y; y++) {
+            int column = (x + rng() % 3) / 9, row = (y + rng() % 3) / 7;
+            lattice[x][y] = (column + row) % 5 == 4 ? 0 : 1 + column * 20 + row;
+        }
+    }
+    return lattice;
+}
+
+// Everything vector_from_lattice computes, in a form that can be compared
+struct Shapes {
+    std::vector<std::vector<double>> nodes;
+    std::vector<std::vector<int>> node_cells, edges, edge_cells, cells;
+
+    bool operator==(Shapes const & other) const {
+        return nodes == other.nodes && node_cells == other.node_cells &&
+               edges == other.edges && edge_cells == other.edge_cells &&
+               cells == other.cells;
+    }
+};
+
+Shapes shapes(MCDS_io & mcds)
+{
+    Shapes result;
+    for (auto & node : *mcds.get_nodes()) {
+        result.nodes.push_back({(double) node.first, node.second.x, node.second.y});
+        result.node_cells.push_back(node.second.cell_ids);
+    }
+    for (auto & edge : *mcds.get_edges()) {
+        result.edges.push_back(edge.second.node_ids);
+        result.edges.back().push_back(edge.first);
+        result.edge_cells.push_back(edge.second.cell_ids);
+    }
+    for (auto & cell : *mcds.get_cells()) {
+        result.cells.push_back({cell.first});
+        for (auto ids : {cell.second.node_ids, cell.second.edge_ids, cell.second.face_ids}) {
+            result.cells.back().push_back(-1);
+            result.cells.back().insert(result.cells.back().end(), ids.begin(), ids.end());
+        }
+    }
+    return result;
+}
+
+// Converts the lattice into shapes on n_threads threads
+Shapes export_shapes(int ** lattice, int size_x, int size_y, int n_threads)
+{
+    set_worker_threads(n_threads);
+    int ** copy = make_lattice(size_x, size_y);
+    std::copy(lattice[0], lattice[0] + size_x * size_y, copy[0]);
+
+    MCDS_io mcds;
+    mcds.set_lattice(copy, size_x, size_y);
+    mcds.denoise(3);
+    mcds.vector_from_lattice();
+    mcds.finalize_cellshapes();
+    mcds.write(mcds_file);
+    Shapes result = shapes(mcds);
+
+    free_lattice(mcds.get_lattice());
+    set_worker_threads(0);
+    return result;
+}
+
+// Reads the shapes written by export_shapes back into a lattice
+std::vector<int> import_lattice(int n_threads, int & size_x, int & size_y)
+{
+    set_worker_threads(n_threads);
+    MCDS_io mcds(mcds_file);
+    mcds.process_cellshapes();
+    mcds.lattice_from_vector();
+    size_x = mcds.get_size_x();
+    size_y = mcds.get_size_y();
+    int ** lattice = mcds.get_lattice();
+    std::vector<int> result(lattice[0], lattice[0] + size_x * size_y);
+    free_lattice(lattice);
+    set_worker_threads(0);
+    return result;
+}
+
+} // namespace
+
+
+TEST_CASE("Converting a lattice gives the same shapes on any number of threads", "[conversion]")
+{
+    int size_x = 95, size_y = 64;
+    int ** lattice = cell_grid(size_x, size_y, 3);
+
+    Shapes serial = export_shapes(lattice, size_x, size_y, 1);
+    REQUIRE(serial.nodes.size() > 100);
+    REQUIRE(serial.cells.size() > 50);
+
+    // every edge connects two nodes
+    for (auto const & edge : serial.edges)
+        REQUIRE(edge.size() == 3);
+
+    for (int n_threads : {2, 4}) {
+        Shapes parallel = export_shapes(lattice, size_x, size_y, n_threads);
+        REQUIRE(parallel == serial);
+    }
+    free_lattice(lattice);
+}
+
+
+TEST_CASE("Converting shapes gives the same lattice on any number of threads", "[conversion]")
+{
+    int size_x = 95, size_y = 64;
+    int ** lattice = cell_grid(size_x, size_y, 5);
+    export_shapes(lattice, size_x, size_y, 1);
+    free_lattice(lattice);
+
+    int serial_x, serial_y;
+    std::vector<int> serial = import_lattice(1, serial_x, serial_y);
+    REQUIRE(serial_x > 0);
+    REQUIRE(serial_y > 0);
+    REQUIRE(std::count_if(serial.begin(), serial.end(), [](int id) { return id > 0; }) > 0);
+
+    for (int n_threads : {2, 4}) {
+        int parallel_x, parallel_y;
+        std::vector<int> parallel = import_lattice(n_threads, parallel_x, parallel_y);
+        REQUIRE(parallel_x == serial_x);
+        REQUIRE(parallel_y == serial_y);
+        REQUIRE(parallel == serial);
+    }
+}
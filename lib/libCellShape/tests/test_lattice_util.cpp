@@ -0,0 +1,146 @@
+// Load the code to be tested
+#include "lattice_util.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// A lattice of blobs of cells 1 .. n_cells with noise on their boundaries
+int ** random_lattice(int size_x, int size_y, int n_cells, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<int> seed_x, seed_y;
+    for (int cell = 0; cell < n_cells; cell++) {
+        seed_x.push_back(rng() % size_x);
+        seed_y.push_back(rng() % size_y);
+    }
+    int ** lattice = make_lattice(size_x, size_y);
+    for (int x = 0; x < size_x; x++) {
+        for (int y = 0; y < size_y; y++) {
+            int closest = 0;
+            long distance = -1;
+            for (int cell = 0; cell < n_cells; cell++) {
+                long dx = x - seed_x[cell], dy = y - seed_y[cell];
+                long d = dx * dx + dy * dy + rng() % 20;
+                if (distance == -1 || d < distance) {
+                    distance = d;
+                    closest = cell + 1;
+                }
+            }
+            lattice[x][y] = distance < 60 ? closest : 0;
+        }
+    }
+    return lattice;
+}
+
+// The original serial implementation of denoise_lattice
+void reference_denoise(int ** lattice_in, int ** lattice_out, int size_x, int size_y)
+{
+    for (int y = 0; y < size_y; y++) {
+        for (int x = 0; x < size_x; x++) {
+            int most = 0;
+            std::map<int, int> count;
+            for (int y_eye = y-1; y_eye <= y+1; y_eye++) {
+                for (int x_eye = x-1; x_eye <= x+1; x_eye++) {
+                    int val = -1;
+                    if (x_eye < size_x && x_eye > 0 && y_eye < size_y && y_eye >= 0)
+                        val = lattice_in[x_eye][y_eye];
+                    if (count.find(val) == count.end()) count[val] = 0;
+                    else count[val] += 1;
+                    if (count[val] >= count[most]) most = val;
+                }
+            }
+            if (most != -1 && most != lattice_in[x][y] && count[most] > 5)
+                lattice_out[x][y] = most;
+            else
+                lattice_out[x][y] = lattice_in[x][y];
+        }
+    }
+}
+
+std::vector<int> contents(int ** lattice, int size_x, int size_y)
+{
+    return std::vector<int>(lattice[0], lattice[0] + size_x * size_y);
+}
+
+} // namespace
+
+
+TEST_CASE("parallel_for calls the body once for every index", "[lattice_util]")
+{
+    for (int n : {0, 1, 5, 1000}) {
+        for (int n_threads : {0, 1, 2, 7}) {
+            std::vector<std::atomic<int>> calls(n);
+            parallel_for(n, [&](int i) {
+                // uneven work, so that the threads interleave
+                volatile int spin = 0;
+                for (int j = 0; j < (i % 13) * 100; j++) spin = spin + 1;
+                calls[i]++;
+            }, n_threads);
+            for (int i = 0; i < n; i++)
+                REQUIRE(calls[i] == 1);
+        }
+    }
+}
+
+
+TEST_CASE("parallel_for passes exceptions to the caller", "[lattice_util]")
+{
+    for (int n_threads : {1, 4}) {
+        std::atomic<int> calls(0);
+        REQUIRE_THROWS_AS(parallel_for(100, [&](int i) {
+            calls++;
+            if (i == 10) throw std::runtime_error("Failed");
+        }, n_threads), std::runtime_error);
+        // indices that were handed out before are still done, and serially
+        // the remaining ones are skipped
+        REQUIRE(calls >= 11);
+        if (n_threads == 1)
+            REQUIRE(calls == 11);
+    }
+}
+
+
+TEST_CASE("The number of worker threads can be set", "[lattice_util]")
+{
+    int cores = worker_threads();
+    REQUIRE(cores >= 1);
+
+    set_worker_threads(3);
+    REQUIRE(worker_threads() == 3);
+
+    std::vector<std::atomic<int>> calls(10);
+    parallel_for(10, [&](int i) { calls[i]++; });
+    for (int i = 0; i < 10; i++)
+        REQUIRE(calls[i] == 1);
+
+    set_worker_threads(0);
+    REQUIRE(worker_threads() == cores);
+}
+
+
+TEST_CASE("Denoising gives the same result on any number of threads", "[lattice_util]")
+{
+    int size_x = 73, size_y = 41;
+    int ** lattice = random_lattice(size_x, size_y, 12, 1);
+    int ** expected = make_lattice(size_x, size_y);
+    int ** result = make_lattice(size_x, size_y);
+
+    reference_denoise(lattice, expected, size_x, size_y);
+    for (int n_threads : {1, 2, 4}) {
+        set_worker_threads(n_threads);
+        denoise_lattice(lattice, result, size_x, size_y);
+        REQUIRE(contents(result, size_x, size_y) == contents(expected, size_x, size_y));
+    }
+    set_worker_threads(0);
+
+    free_lattice(result);
+    free_lattice(expected);
+    free_lattice(lattice);
+}
@@ -5,6 +5,7 @@ CONFIG -= app_bundle
 #CONFIG += release
 CONFIG += debug
 CONFIG += c++17
+CONFIG += thread
 
 # Select the graphics backend by uncommenting it.
 # - GL graphics requires the GLUT and GLEW libraries.
@@ -18,15 +19,52 @@ CONFIG += c++17
 # - X11 graphics (no longer supported) requires X11 development libraries
 #     Old graphics backend, Qt can also use X11.
 #     Generally only works on unix systems.
-GRAPHICS = qt
+# - Headless graphics requires no libraries and opens no window.
+#     Use this for batch runs, e.g. on a cluster. Plots are drawn
+#     in memory and can be written as PNG images.
+#
+# The backend can also be selected on the command line, as in
+# qmake GRAPHICS=headless sorting.pro, or make GRAPHICS=headless
+isEmpty( GRAPHICS ) {
+  GRAPHICS = qt
+}
 #GRAPHICS = gl
 #GRAPHICS = qtgl
+#GRAPHICS = headless
+
+# Build the model as a Python module instead of an executable, as in
+# qmake PYTHON_MODULE=enabled sorting.pro, or make bin/sorting.so. This uses
+# the headless backend. See doc/source/python_module.rst.
+contains( PYTHON_MODULE, enabled ) {
+  message("Building a Python module")
+  TEMPLATE = lib
+  CONFIG += plugin no_plugin_name_prefix
+  QMAKE_EXTENSION_SHLIB = so
+  GRAPHICS = headless
+  SOURCES += python_module/python_module.cpp
+  DEFINES += TST_MODULE=$$TARGET
+  QMAKE_CXXFLAGS += $$system(python3-config --includes)
+  INCLUDEPATH += $$system("python3 -c \"import numpy; print(numpy.get_include())\"")
+  macx {
+    QMAKE_LFLAGS += -undefined dynamic_lookup
+  }
+}
 
 # Enable or disable the profiling macros
-# defined in util/profiler.h.
+# defined in util/profiler.hpp. The results are
+# printed and written at the end of the run, see
+# the profile_output parameter.
 #PROFILING = enabled
 PROFILING = disabled
 
+# Integer type to store the CPM lattice in, as in
+# qmake SPINS=int16 sorting.pro. int16 halves the
+# memory traffic of the Monte Carlo steps on large
+# lattices, but allows at most 32767 cells.
+isEmpty( SPINS ) {
+  SPINS = int32
+}
+
 #USECUDA = enabled
 USECUDA = disabled
 
@@ -42,6 +80,7 @@ LIBCS_DIR = $$LIBDIR/libCellShape
 LIBS += -L$$LIBCS_DIR -lcellshape
 LIBS += -L$$MCDS_DIR/mcds_api -lmcds
 LIBS += -L$$XSDE_DIR/xsde/ -lxsde
+LIBS += -lz
 
 macx {
   QMAKE_LFLAGS += -framework OpenCL
@@ -169,7 +208,21 @@ contains( GRAPHICS, x11 ) {
    unix:LIBS += -lpng
 }
 
+contains( GRAPHICS, headless ) {
+   message("Using headless graphics")
+   SOURCES += graphics/headlessgraph.cpp
+   HEADERS += graphics/headlessgraph.hpp
+   QMAKE_CXXFLAGS_RELEASE += -DHEADLESSGRAPHICS
+   QMAKE_CXXFLAGS_DEBUG += -DHEADLESSGRAPHICS
+   CONFIG -= qt
+}
+
 contains( PROFILING, enabled ) {
   QMAKE_CXXFLAGS_RELEASE += -DPROFILING_ENABLED
   QMAKE_CXXFLAGS_DEBUG += -DPROFILING_ENABLED
+}
+
+contains( SPINS, int16 ) {
+  message("Using 16-bit spins")
+  DEFINES += TST_SPIN16
 }
\ No newline at end of file
@@ -3,54 +3,177 @@
 #include "parameter.hpp"
 #include "sqr.hpp"
 #include "vec2.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
 
 extern Parameter par;
 
-/* Return a list of coordinates of pixels in range.
+namespace {
+
+double const infinity = std::numeric_limits<double>::infinity();
+
+/* A rectangle of pixels, from (x0, y0) up to but not including (x1, y1). */
+struct Box {
+  int x0, y0, x1, y1;
+};
+
+/* Scratch space for distance_transform_1d(). */
+struct Scratch {
+  std::vector<double> f, d, z;
+  std::vector<int> v;
+
+  void resize(std::size_t n) {
+    f.resize(n);
+    d.resize(n);
+    z.resize(n + 1u);
+    v.resize(n);
+  }
+};
+
+/* Squared Euclidean distance transform of a sampled function in 1D.
  *
- * The range is set by the **adhesion_zone_radius** parameter.
+ * For each i in [0, n), this sets s.d[i] to the minimum over j of
+ * (i - j)^2 + s.f[j], by computing the lower envelope of the parabolas
+ * rooted at each j, as in Felzenszwalb and Huttenlocher, Distance Transforms
+ * of Sampled Functions, Theory of Computing 8 (2012). Entries of s.f may be
+ * infinity, and if all of them are, so is the result.
+ */
+void distance_transform_1d(Scratch &s, int n) {
+  auto intersection = [&s](int q, int p) {
+    return ((s.f[q] + sqr(q)) - (s.f[p] + sqr(p))) / (2.0 * (q - p));
+  };
+
+  int k = -1;
+  for (int q = 0; q < n; ++q) {
+    if (s.f[q] == infinity)
+      continue;
+    if (k < 0) {
+      k = 0;
+      s.v[0] = q;
+      s.z[0] = -infinity;
+      s.z[1] = infinity;
+      continue;
+    }
+    double z = intersection(q, s.v[k]);
+    while (z <= s.z[k]) {
+      --k;
+      z = intersection(q, s.v[k]);
+    }
+    ++k;
+    s.v[k] = q;
+    s.z[k] = z;
+    s.z[k + 1] = infinity;
+  }
+
+  if (k < 0) {
+    std::fill(s.d.begin(), s.d.begin() + n, infinity);
+    return;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; ++q) {
+    while (s.z[k + 1] < q)
+      ++k;
+    s.d[q] = sqr(q - s.v[k]) + s.f[s.v[k]];
+  }
+}
+
+/* Mark the pixels of a cell that are in the adhesion zone.
  *
- * Note that there's some overlap in functionality between this an the
- * Neighbours class in adhesion_movement.cpp. They're kept separate however
- * because that class is very performance-sensitive, and calculating the list
- * dynamically as is done here will likely be quite a bit slower. That doesn't
- * matter here, but it does there, so we have one fast and one flexible
- * implementation.
+ * This computes the squared distance from each pixel in the box to the
+ * nearest pixel in the box that is not in the cell, first along the columns
+ * and then along the rows. The box must contain the cell with a margin of
+ * the adhesion zone radius, or up to the edge of the lattice, so that the
+ * nearest pixel is in it if it is within range.
  */
-std::vector<PixelDisplacement> neighbour_list() {
-  std::vector<PixelDisplacement> result;
-  int radius = static_cast<int>(ceil(par.adhesion_zone_radius));
-  for (int dy = -radius; dy <= radius; ++dy) {
-    for (int dx = -radius; dx <= radius; ++dx) {
-      if (sqr(dy) + sqr(dx) <= sqr(par.adhesion_zone_radius))
-        result.emplace_back(dx, dy);
+void mark_cell_zone(std::vector<int> const &sigma, int cell, Box const &box,
+                    double max_dist2, std::vector<double> &dist2,
+                    Scratch &scratch, std::vector<char> &in_zone) {
+  int width = box.x1 - box.x0, height = box.y1 - box.y0;
+  dist2.resize(static_cast<std::size_t>(width) * height);
+  scratch.resize(std::max(width, height));
+
+  for (int x = 0; x < width; ++x) {
+    for (int y = 0; y < height; ++y) {
+      int s = sigma[(box.y0 + y) * par.sizex + box.x0 + x];
+      scratch.f[y] = s == cell ? infinity : 0.0;
+    }
+    distance_transform_1d(scratch, height);
+    for (int y = 0; y < height; ++y)
+      dist2[y * width + x] = scratch.d[y];
+  }
+
+  for (int y = 0; y < height; ++y) {
+    std::copy_n(dist2.begin() + y * width, width, scratch.f.begin());
+    distance_transform_1d(scratch, width);
+    for (int x = 0; x < width; ++x) {
+      int i = (box.y0 + y) * par.sizex + box.x0 + x;
+      if (sigma[i] == cell && scratch.d[x] <= max_dist2)
+        in_zone[i] = 1;
     }
   }
-  return result;
 }
 
-std::vector<PixelPos> adhesion_zone(CellularPotts const &ca) {
-  std::vector<PixelPos> result;
+} // namespace
 
-  auto neighbours = neighbour_list();
-
-  for (int y = 0; y < par.sizey; ++y) {
-    for (int x = 0; x < par.sizex; ++x) {
-      PixelPos pixel(x, y);
-
-      int cur_cell = ca.Sigma(x, y);
-      if (cur_cell > 0) {
-        for (PixelDisplacement nb : neighbours) {
-          PixelPos np = pixel + nb;
-          if ((np.x >= 0) && (np.x < par.sizex) && (np.y >= 0) &&
-              (np.y < par.sizey) && (ca.Sigma(np.x, np.y) != cur_cell)) {
-            result.push_back(pixel);
-            break;
-          }
-        }
-      }
+std::vector<PixelPos> adhesion_zone(CellularPotts const &ca,
+                                    WorkerPool &workers) {
+  int const sizex = par.sizex, sizey = par.sizey;
+
+  // Copy the lattice, and find the bounding box of each cell
+  std::vector<int> sigma(static_cast<std::size_t>(sizex) * sizey);
+  std::vector<Box> boxes;
+  for (int y = 0; y < sizey; ++y) {
+    for (int x = 0; x < sizex; ++x) {
+      int cell = ca.Sigma(x, y);
+      sigma[y * sizex + x] = cell;
+      if (cell <= 0)
+        continue;
+      if (static_cast<std::size_t>(cell) >= boxes.size())
+        boxes.resize(cell + 1, Box{sizex, sizey, 0, 0});
+      Box &box = boxes[cell];
+      box.x0 = std::min(box.x0, x);
+      box.y0 = std::min(box.y0, y);
+      box.x1 = std::max(box.x1, x + 1);
+      box.y1 = std::max(box.y1, y + 1);
     }
   }
 
+  std::vector<int> cells;
+  for (std::size_t cell = 1u; cell < boxes.size(); ++cell)
+    if (boxes[cell].x0 < boxes[cell].x1)
+      cells.push_back(static_cast<int>(cell));
+
+  // Pixels further away than this can't be within the radius
+  int margin = static_cast<int>(ceil(par.adhesion_zone_radius));
+  double max_dist2 = sqr(par.adhesion_zone_radius);
+
+  // Each cell only marks its own pixels, so they can be done in parallel
+  std::vector<char> in_zone(sigma.size(), 0);
+  workers.parallel_for(cells.size(), [&](std::size_t begin, std::size_t end) {
+    std::vector<double> dist2;
+    Scratch scratch;
+    for (std::size_t i = begin; i < end; ++i) {
+      Box box = boxes[cells[i]];
+      box.x0 = std::max(box.x0 - margin, 0);
+      box.y0 = std::max(box.y0 - margin, 0);
+      box.x1 = std::min(box.x1 + margin, sizex);
+      box.y1 = std::min(box.y1 + margin, sizey);
+      mark_cell_zone(sigma, cells[i], box, max_dist2, dist2, scratch,
+                     in_zone);
+    }
+  });
+
+  std::vector<PixelPos> result;
+  for (int y = 0; y < sizey; ++y)
+    for (int x = 0; x < sizex; ++x)
+      if (in_zone[y * sizex + x])
+        result.emplace_back(x, y);
+
   return result;
 }
@@ -2,6 +2,7 @@
 
 #include "ca.hpp"
 #include "vec2.hpp"
+#include "worker_pool.hpp"
 
 #include <vector>
 
@@ -16,7 +17,12 @@
  * we already have a boundary around the edge of the box containing boundary
  * particles that are fixed in place. To avoid confusion, it's been renamed.
  *
+ * The cells are divided over the threads of the given pool, which must not
+ * be running another loop at the same time.
+ *
  * @param ca The (initialised) CPM to calculate the adhesion zone of
+ * @param workers Threads to find the zone with
  * @return The list of all pixels in the adhesion zone
  */
-std::vector<PixelPos> adhesion_zone(CellularPotts const &ca);
+std::vector<PixelPos> adhesion_zone(CellularPotts const &ca,
+                                    WorkerPool &workers);
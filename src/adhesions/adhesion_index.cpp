@@ -2,6 +2,12 @@
 
 #include "sqr.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
 AttachedBond::AttachedBond(ParPos const &neighbour, BondType const &bond_type)
     : neighbour(neighbour), bond_type(bond_type) {}
 
@@ -63,61 +69,98 @@ double AdhesionWithEnvironment::move_dh(PixelDisplacement move) const {
 }
 
 namespace {
-// Helper functions for rebuild(), only visible within this file because of
-// the anonymous namespace.
+// Helper functions for rebuild() and update(), only visible within this file
+// because of the anonymous namespace.
+
+// Row of a particle that can be on the other side of a bond or angle
+// constraint of an adhesion, or npos if it cannot. Adhesions and excluded
+// particles cannot.
+std::size_t fitting_row(ECMParticles const &particles, ParId pid) {
+  std::size_t row = particles.find(pid);
+  if (row == ECMTable::npos)
+    throw std::out_of_range("Particle " + std::to_string(pid) +
+                            " not found in ECM boundary state");
+  ParticleType type = particles.type(row);
+  if (type == ParticleType::adhesion || type == ParticleType::excluded)
+    return ECMTable::npos;
+  return row;
+}
 
-// Map adhesion particles to bonds attached to them
-std::unordered_map<ParId, std::vector<BondId>>
-make_bond_index(ECMBoundaryState const &ecm_boundary) {
-  std::unordered_map<ParId, std::vector<BondId>> bond_index;
-  for (auto const &id_bond : ecm_boundary.bonds) {
-    BondId bid = id_bond.first;
-    Bond const &bond = id_bond.second;
+// Whether a particle is an adhesion particle in the given state
+bool is_adhesion(ECMBoundaryState const &ecm_boundary, ParId pid) {
+  std::size_t row = ecm_boundary.particles.find(pid);
+  return row != ECMTable::npos &&
+         ecm_boundary.particles.type(row) == ParticleType::adhesion;
+}
 
-    ParticleType p1_type = ecm_boundary.particles.at(bond.p1).type;
-    bool p1_adh = p1_type == ParticleType::adhesion;
-    bool p1_unfit = p1_adh || (p1_type == ParticleType::excluded);
+// Looks up types, remembering the last one, since there are usually few
+template <typename Id, typename Type> class TypeCache {
+public:
+  TypeCache(std::unordered_map<Id, Type> const &types) : types_(types) {}
 
-    ParticleType p2_type = ecm_boundary.particles.at(bond.p2).type;
-    bool p2_adh = p2_type == ParticleType::adhesion;
-    bool p2_unfit = p2_adh || (p2_type == ParticleType::excluded);
+  Type const &operator()(Id id) {
+    if (!last_ || id != last_id_) {
+      last_ = &types_.at(id);
+      last_id_ = id;
+    }
+    return *last_;
+  }
 
-    if (p1_adh && !p2_unfit)
-      bond_index[bond.p1].push_back(bid);
+private:
+  std::unordered_map<Id, Type> const &types_;
+  Type const *last_ = nullptr;
+  Id last_id_;
+};
 
-    if (p2_adh && !p1_unfit)
-      bond_index[bond.p2].push_back(bid);
-  }
-  return bond_index;
+template <typename Id>
+void remove_id(std::vector<Id> &ids, Id id) {
+  ids.erase(std::find(ids.begin(), ids.end(), id));
 }
 
-// Map adhesion particles to angle constraints attached to them
-std::unordered_map<ParId, std::vector<AngleCstId>>
-make_angle_cst_index(ECMBoundaryState const &ecm_boundary) {
-  std::unordered_map<ParId, std::vector<AngleCstId>> angle_cst_index;
-  for (auto const &id_angle_cst : ecm_boundary.angle_csts) {
-    AngleCstId aid = id_angle_cst.first;
-    AngleCst const &angle_cst = id_angle_cst.second;
-
-    ParticleType p1_type = ecm_boundary.particles.at(angle_cst.p1).type;
-    bool p1_adh = p1_type == ParticleType::adhesion;
-    bool p1_unfit = p1_adh || (p1_type == ParticleType::excluded);
+void add_bond(std::unordered_map<ParId, std::vector<BondId>> &bonds_of,
+              BondId bid, Bond const &bond) {
+  bonds_of[bond.p1].push_back(bid);
+  if (bond.p2 != bond.p1)
+    bonds_of[bond.p2].push_back(bid);
+}
 
-    ParticleType p3_type = ecm_boundary.particles.at(angle_cst.p3).type;
-    bool p3_adh = p3_type == ParticleType::adhesion;
-    bool p3_unfit = p3_adh || (p3_type == ParticleType::excluded);
+void remove_bond(std::unordered_map<ParId, std::vector<BondId>> &bonds_of,
+                 BondId bid, Bond const &bond) {
+  remove_id(bonds_of[bond.p1], bid);
+  if (bond.p2 != bond.p1)
+    remove_id(bonds_of[bond.p2], bid);
+}
 
-    if (p1_adh && !p3_unfit)
-      angle_cst_index[angle_cst.p1].push_back(aid);
+void add_angle_cst(
+    std::unordered_map<ParId, std::vector<AngleCstId>> &angle_csts_of,
+    AngleCstId aid, AngleCst const &angle_cst) {
+  angle_csts_of[angle_cst.p1].push_back(aid);
+  if (angle_cst.p2 != angle_cst.p1)
+    angle_csts_of[angle_cst.p2].push_back(aid);
+  if (angle_cst.p3 != angle_cst.p1 && angle_cst.p3 != angle_cst.p2)
+    angle_csts_of[angle_cst.p3].push_back(aid);
+}
 
-    if (p3_adh && !p1_unfit)
-      angle_cst_index[angle_cst.p3].push_back(aid);
-  }
-  return angle_cst_index;
+void remove_angle_cst(
+    std::unordered_map<ParId, std::vector<AngleCstId>> &angle_csts_of,
+    AngleCstId aid, AngleCst const &angle_cst) {
+  remove_id(angle_csts_of[angle_cst.p1], aid);
+  if (angle_cst.p2 != angle_cst.p1)
+    remove_id(angle_csts_of[angle_cst.p2], aid);
+  if (angle_cst.p3 != angle_cst.p1 && angle_cst.p3 != angle_cst.p2)
+    remove_id(angle_csts_of[angle_cst.p3], aid);
 }
+
 } // namespace
 
 void AdhesionIndex::rebuild(ECMBoundaryState const &ecm_boundary) {
+  rebuild_(ecm_boundary, false);
+}
+
+void AdhesionIndex::rebuild_(ECMBoundaryState const &ecm_boundary,
+                             bool track_changes) {
+  ECMParticles const &particles = ecm_boundary.particles;
+
   // Adhesion particles' positions are sent along by the other side,
   // but the adhesion particles are part of our state, so they don't
   // get to say where they are, we decided that. Unless they have
@@ -126,94 +169,434 @@ void AdhesionIndex::rebuild(ECMBoundaryState const &ecm_boundary) {
   // generation algorithm. So we save our existing adhesion
   // particles' positions here, and keep them, only using the sent
   // positions for adhesions particles we didn't have yet.
-  std::unordered_map<ParId, ParPos> adh_par_pos;
-  for (auto const &pixel_awes : adhesions_by_pixel_)
-    for (auto const &awe : pixel_awes.second)
-      adh_par_pos[awe.par_id] = awe.position;
-
-  auto bonds_for = make_bond_index(ecm_boundary);
-  auto angle_csts_for = make_angle_cst_index(ecm_boundary);
-
-  adhesions_by_pixel_.clear();
-  for (auto const id_par : ecm_boundary.particles) {
-    ParId pid = id_par.first;
-    Particle const &par = id_par.second;
-
-    if (par.type == ParticleType::adhesion) {
-      ParPos pos = adh_par_pos.count(pid) ? adh_par_pos[pid] : par.pos;
-      PixelPos containing_pixel(floor(pos.x), floor(pos.y));
-      adhesions_by_pixel_[containing_pixel].emplace_back(pid, pos);
-      auto &awe = adhesions_by_pixel_[containing_pixel].back();
-
-      for (BondId bid : bonds_for[pid]) {
-        auto const &bond = ecm_boundary.bonds.at(bid);
-
-        ParPos neighbour_pos;
-        if (bond.p1 == pid)
-          neighbour_pos = ecm_boundary.particles.at(bond.p2).pos;
-        else
-          neighbour_pos = ecm_boundary.particles.at(bond.p1).pos;
-
-        awe.bonds.emplace_back(neighbour_pos,
-                               ecm_boundary.bond_types.at(bond.type));
-      }
+  std::vector<bool> ours(particles.size(), false);
+  std::vector<ParPos> our_pos(particles.size());
+  for (std::size_t i = 0; i < adhesions_.size(); ++i) {
+    if (removed_[i])
+      continue;
+    std::size_t row = particles.find(adhesions_[i].par_id);
+    if (row != ECMTable::npos) {
+      ours[row] = true;
+      our_pos[row] = adhesions_[i].position;
+    }
+  }
 
-      for (AngleCstId aid : angle_csts_for[pid]) {
-        auto const &angle_cst = ecm_boundary.angle_csts.at(aid);
+  // Empty the lists in use, which are the ones containing an adhesion
+  for (auto const &awe : adhesions_) {
+    PixelPos pixel(floor(awe.position.x), floor(awe.position.y));
+    list_(pixel) = PixelList();
+  }
+  outside_grid_.clear();
+  adhesions_.clear();
+  slot_of_.clear();
+
+  std::vector<std::int32_t> slot_of_row(particles.size(), -1);
+  for (std::size_t row = 0; row < particles.size(); ++row) {
+    if (particles.type(row) != ParticleType::adhesion)
+      continue;
+
+    ParId pid = particles.id(row);
+    slot_of_row[row] = static_cast<std::int32_t>(adhesions_.size());
+    if (track_changes)
+      slot_of_[pid] = slot_of_row[row];
+    adhesions_.emplace_back(pid, ours[row] ? our_pos[row] : particles.pos(row));
+  }
 
-        ParPos middle_pos = ecm_boundary.particles.at(angle_cst.p2).pos;
+  add_environments_(ecm_boundary, slot_of_row);
+  index_constraints_(ecm_boundary, track_changes);
 
-        ParPos far_pos;
-        if (angle_cst.p1 == pid)
-          far_pos = ecm_boundary.particles.at(angle_cst.p3).pos;
-        else
-          far_pos = ecm_boundary.particles.at(angle_cst.p1).pos;
+  resize_grid_();
 
-        awe.angle_csts.emplace_back(
-            middle_pos, far_pos,
-            ecm_boundary.angle_cst_types.at(angle_cst.type));
-      }
-    }
+  next_.assign(adhesions_.size(), -1);
+  removed_.assign(adhesions_.size(), false);
+  num_removed_ = 0u;
+  for (std::size_t i = 0; i < adhesions_.size(); ++i) {
+    ParPos const &pos = adhesions_[i].position;
+    append_(static_cast<std::int32_t>(i),
+            PixelPos(floor(pos.x), floor(pos.y)));
   }
 }
 
-std::vector<AdhesionWithEnvironment> const &
-AdhesionIndex::get_adhesions(PixelPos pixel) const {
-  auto it = adhesions_by_pixel_.find(pixel);
-  if (it != adhesions_by_pixel_.end())
-    return it->second;
-  return no_adhesions_;
+void AdhesionIndex::update(ECMBoundaryState const &ecm_boundary,
+                           ECMBoundaryChanges const &changes) {
+  // Patching an adhesion costs a few hash table lookups per changed item,
+  // while rebuilding costs more than that per adhesion, so patch only if
+  // a small part changed. Removed adhesions keep their slot until the next
+  // rebuild, so rebuild if there are many of those too.
+  if (!tracking_changes_ || changes.everything || changes.types ||
+      changes.size() > adhesions_.size() / 4u ||
+      num_removed_ > adhesions_.size() / 2u) {
+    rebuild_(ecm_boundary, true);
+    return;
+  }
+
+  // Find the adhesions whose environment changed, updating our copy of
+  // the constraints on the way
+  std::vector<ParId> affected;
+  for (BondId bid : changes.bonds) {
+    std::size_t old_row = bonds_.find(bid);
+    if (old_row != ECMTable::npos) {
+      Bond old_bond = bonds_.get(old_row);
+      affected.push_back(old_bond.p1);
+      affected.push_back(old_bond.p2);
+      remove_bond(bonds_of_, bid, old_bond);
+      bonds_.erase(bid);
+    }
+    std::size_t new_row = ecm_boundary.bonds.find(bid);
+    if (new_row != ECMTable::npos) {
+      Bond new_bond = ecm_boundary.bonds.get(new_row);
+      affected.push_back(new_bond.p1);
+      affected.push_back(new_bond.p2);
+      add_bond(bonds_of_, bid, new_bond);
+      bonds_.set(bid, new_bond);
+    }
+  }
+
+  for (AngleCstId aid : changes.angle_csts) {
+    std::size_t old_row = angle_csts_.find(aid);
+    if (old_row != ECMTable::npos) {
+      AngleCst old_cst = angle_csts_.get(old_row);
+      affected.push_back(old_cst.p1);
+      affected.push_back(old_cst.p3);
+      remove_angle_cst(angle_csts_of_, aid, old_cst);
+      angle_csts_.erase(aid);
+    }
+    std::size_t new_row = ecm_boundary.angle_csts.find(aid);
+    if (new_row != ECMTable::npos) {
+      AngleCst new_cst = ecm_boundary.angle_csts.get(new_row);
+      affected.push_back(new_cst.p1);
+      affected.push_back(new_cst.p3);
+      add_angle_cst(angle_csts_of_, aid, new_cst);
+      angle_csts_.set(aid, new_cst);
+    }
+  }
+
+  // A changed particle affects itself and the adhesions it's attached to
+  for (ParId pid : changes.particles) {
+    affected.push_back(pid);
+    auto bids = bonds_of_.find(pid);
+    if (bids != bonds_of_.end())
+      for (BondId bid : bids->second) {
+        Bond bond = bonds_.at(bid);
+        affected.push_back(bond.p1 == pid ? bond.p2 : bond.p1);
+      }
+    auto aids = angle_csts_of_.find(pid);
+    if (aids != angle_csts_of_.end())
+      for (AngleCstId aid : aids->second) {
+        AngleCst angle_cst = angle_csts_.at(aid);
+        affected.push_back(angle_cst.p1);
+        affected.push_back(angle_cst.p3);
+      }
+  }
+
+  std::sort(affected.begin(), affected.end());
+  affected.erase(std::unique(affected.begin(), affected.end()),
+                 affected.end());
+
+  for (ParId pid : affected) {
+    auto slot = slot_of_.find(pid);
+    bool now_adhesion = is_adhesion(ecm_boundary, pid);
+
+    if (slot == slot_of_.end()) {
+      if (now_adhesion) {
+        // new adhesion, positioned by the ECM
+        auto i = static_cast<std::int32_t>(adhesions_.size());
+        ParPos pos = ecm_boundary.particles.at(pid).pos;
+        adhesions_.emplace_back(pid, pos);
+        set_environment_(adhesions_.back(), ecm_boundary);
+        next_.push_back(-1);
+        removed_.push_back(false);
+        slot_of_[pid] = i;
+        append_(i, PixelPos(floor(pos.x), floor(pos.y)));
+      }
+      continue;
+    }
+
+    std::int32_t i = slot->second;
+    if (!now_adhesion) {
+      // no longer an adhesion, leave the slot until the next rebuild
+      if (!removed_[i]) {
+        unlink_(i);
+        removed_[i] = true;
+        ++num_removed_;
+      }
+      slot_of_.erase(slot);
+      continue;
+    }
+
+    auto &awe = adhesions_[i];
+    if (removed_[i]) {
+      // removed by us, but the ECM still has it, so put it back as
+      // rebuild() would
+      awe.position = ecm_boundary.particles.at(pid).pos;
+      removed_[i] = false;
+      --num_removed_;
+      append_(i, PixelPos(floor(awe.position.x), floor(awe.position.y)));
+    }
+    set_environment_(awe, ecm_boundary);
+  }
 }
 
 void AdhesionIndex::move_adhesions(PixelPos from, PixelPos to) {
   if (from == to)
     return;
-  auto it = adhesions_by_pixel_.find(from);
-  if (it != adhesions_by_pixel_.end()) {
-    for (auto &awe : it->second) {
-      awe.position += to - from;
-      ecm_interaction_tracker_.record_move_particle(awe.par_id, awe.position);
-      adhesions_by_pixel_[to].push_back(awe);
-    }
-    it->second.clear();
+  // Node-based, so this stays valid if list_() adds to outside_grid_
+  PixelList *source = find_list_(from);
+  if (!source || source->count == 0)
+    return;
+
+  for (std::int32_t i = source->head; i != -1; i = next_[i]) {
+    auto &awe = adhesions_[i];
+    awe.position += to - from;
+    awe.clear_dh_cache();
+    ecm_interaction_tracker_.record_move_particle(awe.par_id, awe.position);
   }
+
+  PixelList &target = list_(to);
+  if (target.count == 0)
+    target.head = source->head;
+  else
+    next_[target.tail] = source->head;
+  target.tail = source->tail;
+  target.count += source->count;
+  *source = PixelList();
 }
 
 void AdhesionIndex::remove_adhesions(PixelPos pixel) {
-  auto it = adhesions_by_pixel_.find(pixel);
-  if (it != adhesions_by_pixel_.end()) {
-    for (auto &awe : it->second)
-      ecm_interaction_tracker_.record_remove_particle(awe.par_id);
-    it->second.clear();
+  PixelList *list = find_list_(pixel);
+  if (!list)
+    return;
+  for (std::int32_t i = list->head; i != -1; i = next_[i]) {
+    ecm_interaction_tracker_.record_remove_particle(adhesions_[i].par_id);
+    removed_[i] = true;
   }
+  *list = PixelList();
 }
 
 CellECMInteractions AdhesionIndex::get_cell_ecm_interactions() const {
   return ecm_interaction_tracker_.get_changes();
 }
 
+void AdhesionIndex::take_cell_ecm_interactions(
+    CellECMInteractions &interactions) {
+  ecm_interaction_tracker_.take_changes(interactions);
+}
+
 void AdhesionIndex::reset_cell_ecm_interactions() {
   ecm_interaction_tracker_.reset();
 }
 
-std::vector<AdhesionWithEnvironment> AdhesionIndex::no_adhesions_;
+AdhesionIndex::PixelList &AdhesionIndex::list_(PixelPos pixel) {
+  std::uint32_t dx = pixel.x - grid_origin_.x;
+  std::uint32_t dy = pixel.y - grid_origin_.y;
+  if (dx < grid_width_ && dy < grid_height_)
+    return grid_[std::size_t(dx) * grid_height_ + dy];
+  return outside_grid_[pixel];
+}
+
+void AdhesionIndex::append_(std::int32_t i, PixelPos pixel) {
+  PixelList &list = list_(pixel);
+  next_[i] = -1;
+  if (list.count == 0)
+    list.head = i;
+  else
+    next_[list.tail] = i;
+  list.tail = i;
+  ++list.count;
+}
+
+void AdhesionIndex::unlink_(std::int32_t i) {
+  ParPos const &pos = adhesions_[i].position;
+  PixelList &list = list_(PixelPos(floor(pos.x), floor(pos.y)));
+
+  std::int32_t prev = -1;
+  std::int32_t j = list.head;
+  while (j != i) {
+    prev = j;
+    j = next_[j];
+  }
+
+  if (prev == -1)
+    list.head = next_[i];
+  else
+    next_[prev] = next_[i];
+  if (list.tail == i)
+    list.tail = prev;
+  next_[i] = -1;
+  --list.count;
+}
+
+void AdhesionIndex::resize_grid_() {
+  if (adhesions_.empty())
+    return;
+
+  // Adhesions move at most one pixel per copy, so leave some room around
+  // them, and keep the area covered so far so that this rarely reallocates.
+  int const margin = 16;
+  int min_x = grid_origin_.x, min_y = grid_origin_.y;
+  int max_x = grid_origin_.x + int(grid_width_) - 1;
+  int max_y = grid_origin_.y + int(grid_height_) - 1;
+  if (grid_.empty()) {
+    min_x = min_y = std::numeric_limits<int>::max();
+    max_x = max_y = std::numeric_limits<int>::min();
+  }
+  bool grow = false;
+  for (auto const &awe : adhesions_) {
+    int x = floor(awe.position.x), y = floor(awe.position.y);
+    if (x < min_x) {
+      min_x = x - margin;
+      grow = true;
+    }
+    if (x > max_x) {
+      max_x = x + margin;
+      grow = true;
+    }
+    if (y < min_y) {
+      min_y = y - margin;
+      grow = true;
+    }
+    if (y > max_y) {
+      max_y = y + margin;
+      grow = true;
+    }
+  }
+  if (!grow)
+    return;
+
+  // Don't let a few far-away adhesions make a huge grid, they can live in
+  // outside_grid_ instead
+  std::size_t const max_area = std::size_t(1) << 22;
+  if (std::size_t(max_x - min_x + 1) * std::size_t(max_y - min_y + 1) >
+      max_area)
+    return;
+
+  // All lists are empty at this point, so we can just start over
+  grid_origin_ = PixelPos(min_x, min_y);
+  grid_width_ = max_x - min_x + 1;
+  grid_height_ = max_y - min_y + 1;
+  grid_.assign(std::size_t(grid_width_) * grid_height_, PixelList());
+}
+
+void AdhesionIndex::add_environments_(
+    ECMBoundaryState const &ecm_boundary,
+    std::vector<std::int32_t> const &slot_of_row) {
+  ECMParticles const &particles = ecm_boundary.particles;
+  TypeCache<BondTypeId, BondType> bond_type(ecm_boundary.bond_types);
+  TypeCache<AngleCstTypeId, AngleCstType> angle_cst_type(
+      ecm_boundary.angle_cst_types);
+
+  // Slot of the adhesion with the given id, or -1 if it isn't one
+  auto slot_of = [&](ParId pid) {
+    std::size_t row = particles.find(pid);
+    return row == ECMTable::npos ? -1 : slot_of_row[row];
+  };
+
+  ECMBonds const &bonds = ecm_boundary.bonds;
+  for (std::size_t row = 0u; row < bonds.size(); ++row) {
+    Bond bond = bonds.get(row);
+    for (int end = 0; end < 2; ++end) {
+      ParId pid = end == 0 ? bond.p1 : bond.p2;
+      ParId neighbour = end == 0 ? bond.p2 : bond.p1;
+      if (end == 1 && bond.p2 == bond.p1)
+        break;
+
+      std::int32_t slot = slot_of(pid);
+      if (slot < 0)
+        continue;
+      std::size_t neighbour_row = fitting_row(particles, neighbour);
+      if (neighbour_row == ECMTable::npos)
+        continue;
+
+      adhesions_[slot].bonds.emplace_back(particles.pos(neighbour_row),
+                                          bond_type(bond.type));
+    }
+  }
+
+  // Only the particles at the ends are affected by an angle constraint
+  ECMAngleCsts const &angle_csts = ecm_boundary.angle_csts;
+  for (std::size_t row = 0u; row < angle_csts.size(); ++row) {
+    AngleCst angle_cst = angle_csts.get(row);
+    for (int end = 0; end < 2; ++end) {
+      ParId pid = end == 0 ? angle_cst.p1 : angle_cst.p3;
+      ParId far = end == 0 ? angle_cst.p3 : angle_cst.p1;
+      if (end == 1 && angle_cst.p3 == angle_cst.p1)
+        break;
+
+      std::int32_t slot = slot_of(pid);
+      if (slot < 0)
+        continue;
+      std::size_t far_row = fitting_row(particles, far);
+      if (far_row == ECMTable::npos)
+        continue;
+
+      adhesions_[slot].angle_csts.emplace_back(
+          particles.at(angle_cst.p2).pos, particles.pos(far_row),
+          angle_cst_type(angle_cst.type));
+    }
+  }
+}
+
+void AdhesionIndex::index_constraints_(ECMBoundaryState const &ecm_boundary,
+                                       bool track_changes) {
+  bonds_of_.clear();
+  angle_csts_of_.clear();
+  tracking_changes_ = track_changes;
+
+  if (!track_changes) {
+    bonds_ = ECMBonds();
+    angle_csts_ = ECMAngleCsts();
+    return;
+  }
+
+  bonds_ = ecm_boundary.bonds;
+  angle_csts_ = ecm_boundary.angle_csts;
+  for (std::size_t row = 0u; row < bonds_.size(); ++row)
+    add_bond(bonds_of_, bonds_.id(row), bonds_.get(row));
+  for (std::size_t row = 0u; row < angle_csts_.size(); ++row)
+    add_angle_cst(angle_csts_of_, angle_csts_.id(row), angle_csts_.get(row));
+}
+
+void AdhesionIndex::set_environment_(
+    AdhesionWithEnvironment &awe, ECMBoundaryState const &ecm_boundary) const {
+  ECMParticles const &particles = ecm_boundary.particles;
+  ParId pid = awe.par_id;
+  awe.bonds.clear();
+  awe.angle_csts.clear();
+  awe.clear_dh_cache();
+
+  auto bids = bonds_of_.find(pid);
+  if (bids != bonds_of_.end())
+    for (BondId bid : bids->second) {
+      Bond bond = ecm_boundary.bonds.at(bid);
+      ParId neighbour = bond.p1 == pid ? bond.p2 : bond.p1;
+      std::size_t neighbour_row = fitting_row(particles, neighbour);
+      if (neighbour_row == ECMTable::npos)
+        continue;
+
+      awe.bonds.emplace_back(particles.pos(neighbour_row),
+                             ecm_boundary.bond_types.at(bond.type));
+    }
+
+  auto aids = angle_csts_of_.find(pid);
+  if (aids != angle_csts_of_.end())
+    for (AngleCstId aid : aids->second) {
+      AngleCst angle_cst = ecm_boundary.angle_csts.at(aid);
+
+      // if we're only the middle particle, then this doesn't apply
+      ParId far;
+      if (angle_cst.p1 == pid)
+        far = angle_cst.p3;
+      else if (angle_cst.p3 == pid)
+        far = angle_cst.p1;
+      else
+        continue;
+
+      std::size_t far_row = fitting_row(particles, far);
+      if (far_row == ECMTable::npos)
+        continue;
+
+      awe.angle_csts.emplace_back(
+          particles.at(angle_cst.p2).pos, particles.pos(far_row),
+          ecm_boundary.angle_cst_types.at(angle_cst.type));
+    }
+}
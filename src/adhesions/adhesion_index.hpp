@@ -8,6 +8,10 @@
 #include "ecm_interaction_tracker.hpp"
 #include "vec2.hpp"
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <unordered_map>
 #include <vector>
 
@@ -97,6 +101,127 @@ struct AdhesionWithEnvironment {
    * @return The required work (energy difference)
    */
   double move_dh(PixelDisplacement move) const;
+
+  /** Calculate the work required to move the particle, using a cache.
+   *
+   * This returns the same as move_dh(), but remembers the result for moves
+   * of at most one pixel in each direction, so that it only needs to be
+   * calculated once for each of them. The cache must be cleared with
+   * clear_dh_cache() when the position, bonds or angle constraints change.
+   *
+   * Since this updates the cache, it must not be called concurrently on the
+   * same object.
+   *
+   * @param move The move to calculate the work for
+   * @return The required work (energy difference)
+   */
+  double cached_move_dh(PixelDisplacement move) const {
+    unsigned dx = move.x + 1, dy = move.y + 1;
+    if (dx > 2u || dy > 2u)
+      return move_dh(move);
+
+    unsigned i = dx * 3u + dy;
+    if (!(dh_known_ & (1u << i))) {
+      dh_cache_[i] = move_dh(move);
+      dh_known_ |= 1u << i;
+    }
+    return dh_cache_[i];
+  }
+
+  /// Forget the results remembered by cached_move_dh().
+  void clear_dh_cache() { dh_known_ = 0u; }
+
+private:
+  /// Work for moves of at most one pixel, by (move.x + 1) * 3 + move.y + 1
+  mutable std::array<double, 9> dh_cache_;
+
+  /// Bit mask of the entries of dh_cache_ that have been calculated
+  mutable std::uint16_t dh_known_ = 0u;
+};
+
+/** The adhesions in a single pixel, as returned by AdhesionIndex.
+ *
+ * This is a view into the index, so nothing is copied. It is invalidated by
+ * any subsequent call to rebuild(), move_adhesions() or remove_adhesions() on
+ * the index it came from.
+ */
+class AdhesionRange {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = AdhesionWithEnvironment;
+    using difference_type = std::ptrdiff_t;
+    using pointer = AdhesionWithEnvironment const *;
+    using reference = AdhesionWithEnvironment const &;
+
+    iterator(AdhesionWithEnvironment const *adhesions,
+             std::int32_t const *next, std::int32_t i)
+        : adhesions_(adhesions), next_(next), i_(i) {}
+
+    AdhesionWithEnvironment const &operator*() const { return adhesions_[i_]; }
+
+    AdhesionWithEnvironment const *operator->() const {
+      return adhesions_ + i_;
+    }
+
+    iterator &operator++() {
+      i_ = next_[i_];
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator old(*this);
+      i_ = next_[i_];
+      return old;
+    }
+
+    bool operator==(iterator const &rhs) const { return i_ == rhs.i_; }
+
+    bool operator!=(iterator const &rhs) const { return i_ != rhs.i_; }
+
+  private:
+    AdhesionWithEnvironment const *adhesions_;
+    std::int32_t const *next_;
+    std::int32_t i_;
+  };
+
+  /// Create an empty range.
+  AdhesionRange() = default;
+
+  /** Create a range.
+   *
+   * @param adhesions Array of adhesions of the index
+   * @param next For each adhesion, the next one in the same pixel, or -1
+   * @param head Index of the first adhesion in the pixel, or -1
+   * @param count Number of adhesions in the pixel
+   */
+  AdhesionRange(AdhesionWithEnvironment const *adhesions,
+                std::int32_t const *next, std::int32_t head,
+                std::int32_t count)
+      : adhesions_(adhesions), next_(next), head_(head), count_(count) {}
+
+  std::size_t size() const { return count_; }
+
+  bool empty() const { return count_ == 0; }
+
+  iterator begin() const { return iterator(adhesions_, next_, head_); }
+
+  iterator end() const { return iterator(adhesions_, next_, -1); }
+
+  /// Return the i'th adhesion, in linear time.
+  AdhesionWithEnvironment const &operator[](std::size_t i) const {
+    std::int32_t j = head_;
+    for (; i > 0; --i)
+      j = next_[j];
+    return adhesions_[j];
+  }
+
+private:
+  AdhesionWithEnvironment const *adhesions_ = nullptr;
+  std::int32_t const *next_ = nullptr;
+  std::int32_t head_ = -1;
+  std::int32_t count_ = 0;
 };
 
 /** Tracks location of adhesions in the ECM grid.
@@ -105,6 +230,13 @@ struct AdhesionWithEnvironment {
  * constraints per ECM pixel, in a format that allows for efficient force
  * calculations. Bonds or angle constraints involving other particles that
  * are themselves adhesions or that are excluded are ignored.
+ *
+ * The adhesions are stored in a single array, and the adhesions in each pixel
+ * form a linked list through it. The heads of these lists are stored in a
+ * dense grid covering the area around the adhesions, so that finding the
+ * adhesions in a pixel takes a few array reads, and moving them to another
+ * pixel just splices the lists. Pixels outside of the grid, which adhesions
+ * can only reach by moving after the last rebuild, are kept in a sparse map.
  */
 class AdhesionIndex {
 public:
@@ -118,16 +250,40 @@ public:
    */
   void rebuild(ECMBoundaryState const &ecm_boundary);
 
+  /** Update the cached data for changes to the ECM boundary.
+   *
+   * This patches only the adhesions affected by the given changes, which
+   * is much faster than rebuild() if few things changed. If there are many
+   * changes, or the bond or angle constraint types changed, then it calls
+   * rebuild() instead.
+   *
+   * As with rebuild(), adhesions that we already have keep the position we
+   * gave them. Adhesions removed by remove_adhesions() stay removed until
+   * their particle changes, which is expected to happen anyway as the ECM
+   * processes the removal.
+   *
+   * @param ecm_boundary The current state of the ECM boundary
+   * @param changes The changes since the state passed to the previous call
+   *      to rebuild() or update()
+   */
+  void update(ECMBoundaryState const &ecm_boundary,
+              ECMBoundaryChanges const &changes);
+
   /** Get adhesions at a given pixel.
    *
-   * Note that this function returns a reference to a vector. This
-   * reference will be invalidated by any subsequent call to update() or
-   * move_adhesions() on this object.
+   * Note that this function returns a view into the index. It will be
+   * invalidated by any subsequent call to rebuild(), move_adhesions() or
+   * remove_adhesions() on this object.
    *
    * @param pixel Pixel for which to get adhesions.
    */
-  std::vector<AdhesionWithEnvironment> const &
-  get_adhesions(PixelPos pixel) const;
+  AdhesionRange get_adhesions(PixelPos pixel) const {
+    PixelList const *list = find_list_(pixel);
+    if (!list)
+      return AdhesionRange();
+    return AdhesionRange(adhesions_.data(), next_.data(), list->head,
+                         list->count);
+  }
 
   /** Move adhesions from one pixel to another.
    *
@@ -155,6 +311,14 @@ public:
    */
   CellECMInteractions get_cell_ecm_interactions() const;
 
+  /** Take accumulated changes to the adhesions, and reset.
+   *
+   * See ECMInteractionTracker::take_changes().
+   *
+   * @param interactions Object to move the changes into
+   */
+  void take_cell_ecm_interactions(CellECMInteractions &interactions);
+
   /** Reset the adhesion change administration.
    *
    * This clears the recorded adhesion change history.
@@ -162,20 +326,104 @@ public:
   void reset_cell_ecm_interactions();
 
 private:
-  // TODO: short string optimisation?
-  /// Index of adhesion beads per grid cell, (re)created by update().
-  std::unordered_map<PixelPos, std::vector<AdhesionWithEnvironment>>
-      adhesions_by_pixel_;
+  /// Linked list of the adhesions in a pixel
+  struct PixelList {
+    std::int32_t head = -1;
+    std::int32_t tail = -1;
+    std::int32_t count = 0;
+  };
+
+  /// Return the list for a pixel, or nullptr if it has never had any.
+  PixelList const *find_list_(PixelPos pixel) const {
+    std::uint32_t dx = pixel.x - grid_origin_.x;
+    std::uint32_t dy = pixel.y - grid_origin_.y;
+    if (dx < grid_width_ && dy < grid_height_)
+      return &grid_[std::size_t(dx) * grid_height_ + dy];
+    auto it = outside_grid_.find(pixel);
+    return it == outside_grid_.end() ? nullptr : &it->second;
+  }
+
+  PixelList *find_list_(PixelPos pixel) {
+    auto const &self = *this;
+    return const_cast<PixelList *>(self.find_list_(pixel));
+  }
+
+  /// Return the list for a pixel, creating it if necessary.
+  PixelList &list_(PixelPos pixel);
+
+  /// Add adhesion i to the end of the list of its pixel.
+  void append_(std::int32_t i, PixelPos pixel);
+
+  /** Rebuild, optionally keeping enough information for update().
+   *
+   * @param ecm_boundary The current state of the ECM boundary
+   * @param track_changes Whether to index the constraints of all particles
+   *      so that update() can patch the index afterwards
+   */
+  void rebuild_(ECMBoundaryState const &ecm_boundary, bool track_changes);
+
+  /// Remove adhesion i from the list of its pixel.
+  void unlink_(std::int32_t i);
+
+  /// Grow the grid if needed to cover the adhesions, with all lists empty.
+  void resize_grid_();
+
+  /// Add the bonds and angle constraints of all adhesions, given the slot
+  /// of the adhesion in each row of the particle table, or -1.
+  void add_environments_(ECMBoundaryState const &ecm_boundary,
+                         std::vector<std::int32_t> const &slot_of_row);
+
+  /// Record the bonds and angle constraints of all particles if needed for
+  /// update(), or clear them if not.
+  void index_constraints_(ECMBoundaryState const &ecm_boundary,
+                          bool track_changes);
+
+  /// Set the bonds and angle constraints of an adhesion from the ECM.
+  void set_environment_(AdhesionWithEnvironment &awe,
+                        ECMBoundaryState const &ecm_boundary) const;
+
+  /// All adhesions, including removed ones until the next rebuild
+  std::vector<AdhesionWithEnvironment> adhesions_;
+
+  /// Next adhesion in the same pixel, or -1, per adhesion
+  std::vector<std::int32_t> next_;
+
+  /// Whether the adhesion has been removed, per adhesion
+  std::vector<bool> removed_;
+
+  /// Number of removed adhesions
+  std::size_t num_removed_ = 0u;
+
+  /// Bonds and angle constraints involving each particle, if
+  /// tracking_changes_
+  std::unordered_map<ParId, std::vector<BondId>> bonds_of_;
+  std::unordered_map<ParId, std::vector<AngleCstId>> angle_csts_of_;
+
+  /// Whether the below are up to date, so that update() can patch
+  bool tracking_changes_ = false;
+
+  /// Index into adhesions_ for each adhesion particle
+  std::unordered_map<ParId, std::int32_t> slot_of_;
+
+  /// Bonds and angle constraints of the last state, for finding what a
+  /// change affects
+  ECMBonds bonds_;
+  ECMAngleCsts angle_csts_;
+
+  /// Lists per pixel, column by column, see find_list_()
+  std::vector<PixelList> grid_;
+  PixelPos grid_origin_{0, 0};
+  std::uint32_t grid_width_ = 0u;
+  std::uint32_t grid_height_ = 0u;
+
+  /// Lists for pixels outside of the grid
+  std::unordered_map<PixelPos, PixelList> outside_grid_;
 
   // Tracks changes for later communication with ECM
   ECMInteractionTracker ecm_interaction_tracker_;
 
-  // Return value for get_adhesions if there are none
-  static std::vector<AdhesionWithEnvironment> no_adhesions_;
-
   // accessor for tests
-  friend std::unordered_map<PixelPos,
-                            std::vector<AdhesionWithEnvironment>> const &
+  friend std::unordered_map<PixelPos, std::vector<AdhesionWithEnvironment>>
   adhesions_by_pixel(AdhesionIndex const &index);
 };
 
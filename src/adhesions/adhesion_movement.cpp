@@ -4,13 +4,14 @@
 #include "random.hpp"
 
 #include <algorithm>
+#include <array>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <string>
 
 extern Parameter par;
 
-using namespace std::string_literals;
-
 int annihilation_penalty(int num_destroyed) {
   return num_destroyed * par.adhesion_annihilation_penalty;
 }
@@ -22,10 +23,42 @@ int overflow_penalty(int num_present) {
   return 0;
 }
 
-std::vector<PixelDisplacement> retraction_displacements(CellularPotts const &ca,
-                                                        PixelPos source_pixel,
-                                                        PixelPos target_pixel) {
-  std::vector<PixelDisplacement> displacements;
+ExtensionMechanism parse_extension_mechanism(std::string const &name) {
+  if (name == "lazy")
+    return ExtensionMechanism::lazy;
+  if (name == "sticky")
+    return ExtensionMechanism::sticky;
+  if (name == "mixed")
+    return ExtensionMechanism::mixed;
+  if (name == "random")
+    return ExtensionMechanism::random;
+
+  throw std::runtime_error(
+      "Parameter adhesion_extension_mechanism must be one of \"lazy\","
+      " \"sticky\", \"mixed\" or \"random\"");
+}
+
+DisplacementSelection parse_displacement_selection(std::string const &name) {
+  if (name == "uniform")
+    return DisplacementSelection::uniform;
+  if (name == "gradient")
+    return DisplacementSelection::gradient;
+
+  throw std::runtime_error(
+      "Parameter adhesion_displacement_selection must be either \"uniform\""
+      " or \"gradient\"");
+}
+
+DisplacementList::DisplacementList(
+    std::initializer_list<PixelDisplacement> displacements) {
+  for (PixelDisplacement const &displacement : displacements)
+    push_back(displacement);
+}
+
+DisplacementList retraction_displacements(CellularPotts const &ca,
+                                          PixelPos source_pixel,
+                                          PixelPos target_pixel) {
+  DisplacementList displacements;
 
   int target_cell_id = ca.Sigma(target_pixel.x, target_pixel.y);
   for (PixelPos nb : Neighbours(target_pixel))
@@ -39,10 +72,10 @@ std::vector<PixelDisplacement> retraction_displacements(CellularPotts const &ca,
   return displacements;
 }
 
-std::vector<PixelDisplacement>
-extension_displacements_all(CellularPotts const &ca, PixelPos source_pixel,
-                            PixelPos target_pixel) {
-  std::vector<PixelDisplacement> displacements = {{0, 0}};
+DisplacementList extension_displacements_all(CellularPotts const &ca,
+                                             PixelPos source_pixel,
+                                             PixelPos target_pixel) {
+  DisplacementList displacements = {{0, 0}};
 
   int source_cell = ca.Sigma(source_pixel.x, source_pixel.y);
   for (PixelPos nb : Neighbours(source_pixel)) {
@@ -53,86 +86,128 @@ extension_displacements_all(CellularPotts const &ca, PixelPos source_pixel,
   return displacements;
 }
 
-/* Lazy, sticky and mixed are inlined here, because they're really short. That
- * does put this function at the edge of how complex a function should be, so if
- * you add anything more, you should split some part off into a new function.
+/* Lazy, sticky and mixed are inlined here, because they're really short. The
+ * mechanism is a template parameter, so the compiler removes the checks.
  */
-std::vector<PixelDisplacement> extension_displacements(CellularPotts const &ca,
-                                                       PixelPos source_pixel,
-                                                       PixelPos target_pixel) {
-  std::vector<PixelDisplacement> displacements;
-
-  std::string mechanism(par.adhesion_extension_mechanism);
-
-  if (mechanism == "random")
+template <ExtensionMechanism mechanism>
+DisplacementList extension_displacements(CellularPotts const &ca,
+                                         PixelPos source_pixel,
+                                         PixelPos target_pixel) {
+  if (mechanism == ExtensionMechanism::random)
     // We return all possible displacements here, select_displacement()
     // below will later pick one at random (if it's set to "uniform"),
     // thus justifying the name of the mechanism.
     return extension_displacements_all(ca, source_pixel, target_pixel);
-  else {
-    if (mechanism == "lazy" || mechanism == "mixed")
-      displacements.emplace_back(0, 0);
 
-    if (mechanism == "sticky" || mechanism == "mixed")
-      displacements.emplace_back(target_pixel - source_pixel);
-  }
+  DisplacementList displacements;
+  if (mechanism == ExtensionMechanism::lazy ||
+      mechanism == ExtensionMechanism::mixed)
+    displacements.emplace_back(0, 0);
+
+  if (mechanism == ExtensionMechanism::sticky ||
+      mechanism == ExtensionMechanism::mixed)
+    displacements.push_back(target_pixel - source_pixel);
 
   return displacements;
 }
 
-std::tuple<PixelDisplacement, double> select_displacement_uniform(
-    std::vector<AdhesionWithEnvironment> const &adhesions,
-    std::vector<PixelDisplacement> const &possibilities) {
+template DisplacementList extension_displacements<ExtensionMechanism::lazy>(
+    CellularPotts const &, PixelPos, PixelPos);
+template DisplacementList extension_displacements<ExtensionMechanism::sticky>(
+    CellularPotts const &, PixelPos, PixelPos);
+template DisplacementList extension_displacements<ExtensionMechanism::mixed>(
+    CellularPotts const &, PixelPos, PixelPos);
+template DisplacementList extension_displacements<ExtensionMechanism::random>(
+    CellularPotts const &, PixelPos, PixelPos);
+
+namespace {
+
+/* Implementations of the selection algorithms below, for any range of
+ * adhesions and of displacements, so that they can work directly on the index
+ * and on a DisplacementList.
+ */
+template <typename Adhesions, typename Displacements>
+std::tuple<PixelDisplacement, double>
+select_uniform(Adhesions const &adhesions, Displacements const &possibilities) {
   // RandomNumber has range [1..max] inclusive
   long int item = RandomNumber(possibilities.size()) - 1;
   PixelDisplacement chosen = possibilities[item];
 
   double dh = 0.0;
   for (auto const &adhesion : adhesions)
-    dh += adhesion.move_dh(chosen);
+    dh += adhesion.cached_move_dh(chosen);
   return std::make_tuple(chosen, dh);
 }
 
-std::tuple<PixelDisplacement, double> select_displacement_gradient(
-    std::vector<AdhesionWithEnvironment> const &adhesions,
-    std::vector<PixelDisplacement> const &possibilities) {
-  // calculate DH for each possibility
-  std::vector<double> displacement_dh;
-  for (PixelDisplacement displacement : possibilities) {
+template <typename Adhesions, typename Displacements>
+std::tuple<PixelDisplacement, double>
+select_gradient(Adhesions const &adhesions,
+                Displacements const &possibilities) {
+  // There are at most 9 possibilities (the neighbours and staying put), so
+  // avoid allocating if we can
+  std::size_t const num_possibilities = possibilities.size();
+  std::array<double, DisplacementList::capacity> local_dh;
+  std::vector<double> more_dh;
+  double *displacement_dh = local_dh.data();
+  if (num_possibilities > local_dh.size()) {
+    more_dh.resize(num_possibilities);
+    displacement_dh = more_dh.data();
+  }
+
+  // calculate DH for each possibility, and find the minimum
+  double min_dh = std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0u; i < num_possibilities; ++i) {
     double total_dh = 0.0;
     for (auto const &awe : adhesions)
-      total_dh += awe.move_dh(displacement);
-    displacement_dh.emplace_back(total_dh);
+      total_dh += awe.cached_move_dh(possibilities[i]);
+    displacement_dh[i] = total_dh;
+    min_dh = std::min(min_dh, total_dh);
   }
 
-  // find minimum DH
-  double min_dh =
-      *std::min_element(displacement_dh.cbegin(), displacement_dh.cend());
+  // pick one of the possibilities with the minimum DH at random
+  long int num_chosen = std::count(
+      displacement_dh, displacement_dh + num_possibilities, min_dh);
+  long int item = RandomNumber(num_chosen) - 1;
+  for (std::size_t i = 0u; i < num_possibilities; ++i)
+    if (displacement_dh[i] == min_dh && item-- == 0)
+      return std::make_tuple(possibilities[i], displacement_dh[i]);
 
-  // find possibilities with the minimum DH
-  std::vector<std::size_t> chosen;
-  for (std::size_t i = 0u; i < displacement_dh.size(); ++i)
-    if (displacement_dh[i] == min_dh)
-      chosen.push_back(i);
+  // not reached
+  return std::make_tuple(possibilities[0], displacement_dh[0]);
+}
 
-  // pick one of those at random
-  long int item = RandomNumber(chosen.size()) - 1;
-  return std::make_tuple(possibilities[chosen[item]],
-                         displacement_dh[chosen[item]]);
+} // namespace
+
+std::tuple<PixelDisplacement, double> select_displacement_uniform(
+    std::vector<AdhesionWithEnvironment> const &adhesions,
+    std::vector<PixelDisplacement> const &possibilities) {
+  return select_uniform(adhesions, possibilities);
+}
+
+std::tuple<PixelDisplacement, double> select_displacement_gradient(
+    std::vector<AdhesionWithEnvironment> const &adhesions,
+    std::vector<PixelDisplacement> const &possibilities) {
+  return select_gradient(adhesions, possibilities);
 }
 
+template <DisplacementSelection selection>
 std::tuple<PixelDisplacement, double>
 select_displacement(AdhesionIndex const &index, PixelPos target_pixel,
-                    std::vector<PixelDisplacement> const &possibilities) {
-  auto target_adhesions = index.get_adhesions(target_pixel);
-
-  if (par.adhesion_displacement_selection == "uniform"s)
-    return select_displacement_uniform(target_adhesions, possibilities);
+                    DisplacementList const &possibilities) {
+  // A view, so this doesn't copy the adhesions
+  auto const &target_adhesions = index.get_adhesions(target_pixel);
 
-  if (par.adhesion_displacement_selection == "gradient"s)
-    return select_displacement_gradient(target_adhesions, possibilities);
+  if (selection == DisplacementSelection::uniform)
+    return select_uniform(target_adhesions, possibilities);
 
-  throw std::runtime_error(
-      "Parameter displacement_selection must be either \"uniform\" or"
-      " \"gradient\"");
+  return select_gradient(target_adhesions, possibilities);
 }
+
+template std::tuple<PixelDisplacement, double>
+select_displacement<DisplacementSelection::uniform>(AdhesionIndex const &,
+                                                    PixelPos,
+                                                    DisplacementList const &);
+template std::tuple<PixelDisplacement, double>
+select_displacement<DisplacementSelection::gradient>(AdhesionIndex const &,
+                                                     PixelPos,
+                                                     DisplacementList const &);
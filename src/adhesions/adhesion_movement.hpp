@@ -11,6 +11,84 @@
 #include "adhesion_index.hpp"
 #include "ca.hpp"
 
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/** How adhesions in the source pixel of a copy move along.
+ *
+ * See the adhesion_extension_mechanism parameter for a description.
+ */
+enum class ExtensionMechanism { lazy, sticky, mixed, random };
+
+/** How a displacement is picked from the possible ones.
+ *
+ * See the adhesion_displacement_selection parameter for a description.
+ */
+enum class DisplacementSelection { uniform, gradient };
+
+/** Parse the value of the adhesion_extension_mechanism parameter.
+ *
+ * @param name One of "lazy", "sticky", "mixed" or "random"
+ * @throw std::runtime_error if the name is not recognised
+ */
+ExtensionMechanism parse_extension_mechanism(std::string const &name);
+
+/** Parse the value of the adhesion_displacement_selection parameter.
+ *
+ * @param name Either "uniform" or "gradient"
+ * @throw std::runtime_error if the name is not recognised
+ */
+DisplacementSelection parse_displacement_selection(std::string const &name);
+
+/** A list of possible adhesion displacements.
+ *
+ * Adhesions move at most to a neighbouring pixel, so there are never more than
+ * nine possibilities, including staying put. This stores them inline, so that
+ * they can be listed for every copy attempt without allocating memory.
+ */
+class DisplacementList {
+public:
+  /// Maximum number of displacements, the 8 neighbours and staying put
+  static constexpr std::size_t capacity = 9u;
+
+  /** Create an empty list. */
+  DisplacementList() = default;
+
+  /** Create a list with the given displacements.
+   *
+   * @param displacements At most capacity displacements
+   */
+  DisplacementList(std::initializer_list<PixelDisplacement> displacements);
+
+  /** Add a displacement, there must be space left. */
+  void push_back(PixelDisplacement displacement) {
+    items_[size_++] = displacement;
+  }
+
+  /** Add a displacement, there must be space left. */
+  void emplace_back(int x, int y) { items_[size_++] = PixelDisplacement(x, y); }
+
+  /** Return the number of displacements in the list. */
+  std::size_t size() const { return size_; }
+
+  /** Return whether the list is empty. */
+  bool empty() const { return size_ == 0u; }
+
+  /** Return the i'th displacement. */
+  PixelDisplacement const &operator[](std::size_t i) const { return items_[i]; }
+
+  PixelDisplacement const *begin() const { return items_.data(); }
+  PixelDisplacement const *end() const { return items_.data() + size_; }
+
+private:
+  std::array<PixelDisplacement, capacity> items_;
+  std::size_t size_ = 0u;
+};
+
 /** Calculate annihilation penalty.
  *
  * If an adhesion needs to be moved, but has nowhere to go, then it gets
@@ -42,9 +120,9 @@ int overflow_penalty(int num_present);
  * @param source_pixel The pixel that will be copied from
  * @param target_pixel The pixel it will be copied to
  */
-std::vector<PixelDisplacement> retraction_displacements(CellularPotts const &ca,
-                                                        PixelPos source_pixel,
-                                                        PixelPos target_pixel);
+DisplacementList retraction_displacements(CellularPotts const &ca,
+                                          PixelPos source_pixel,
+                                          PixelPos target_pixel);
 
 /** List all possible displacements.
  *
@@ -55,24 +133,29 @@ std::vector<PixelDisplacement> retraction_displacements(CellularPotts const &ca,
  * @param source_pixel The pixel that will be copied from
  * @param target_pixel The pixel that will be copied to
  */
-std::vector<PixelDisplacement>
-extension_displacements_all(CellularPotts const &ca, PixelPos source_pixel,
-                            PixelPos target_pixel);
+DisplacementList extension_displacements_all(CellularPotts const &ca,
+                                             PixelPos source_pixel,
+                                             PixelPos target_pixel);
 
 /** Find all possible adhesion displacements for a newly added pixel
  *
  * If a copy attempt copies a pixel containing adhesions, then those
  * adhesions may move along, depending on settings. This returns a list of
- * possible displacements for those adhesions, according to an algorithm
- * selected in the parameters.
+ * possible displacements for those adhesions, according to the given
+ * mechanism.
+ *
+ * This is instantiated for each ExtensionMechanism, so that the mechanism
+ * doesn't have to be checked on every copy attempt.
  *
+ * @tparam mechanism The extension mechanism to use
  * @param ca A CPM grid to use to find suitable pixels to move to
  * @param source_pixel The pixel that will be copied from
  * @param target_pixel The pixel that will be copied to
  */
-std::vector<PixelDisplacement> extension_displacements(CellularPotts const &ca,
-                                                       PixelPos source_pixel,
-                                                       PixelPos target_pixel);
+template <ExtensionMechanism mechanism>
+DisplacementList extension_displacements(CellularPotts const &ca,
+                                         PixelPos source_pixel,
+                                         PixelPos target_pixel);
 
 /* Choose where displacements will go during the copy.
  *
@@ -111,18 +194,20 @@ std::tuple<PixelDisplacement, double> select_displacement_gradient(
 
 /* Choose where displacements will go during the copy.
  *
- * This checks the settings, and then calls either of the above selection
- * algorithms. There must be at least one possibility.
+ * This calls either of the above selection algorithms, depending on the given
+ * selection, on the adhesions in the index.
  *
  * Returns the chosen displacement and the corresponding DH.
  *
  * At least one possible displacement must be given!
  *
+ * @tparam selection The selection algorithm to use
  * @param index The adhesion index to get adhesions from
  * @param target_pixel Pixel whose adhesions are to be moved
  * @param possibilities Possible directions to move them in
  * @return The chosen displacement and corresponding DH
  */
+template <DisplacementSelection selection>
 std::tuple<PixelDisplacement, double>
 select_displacement(AdhesionIndex const &index, PixelPos target_pixel,
-                    std::vector<PixelDisplacement> const &possibilities);
+                    DisplacementList const &possibilities);
@@ -1,5 +1,8 @@
 #include "adhesion_mover.hpp"
 #include "adhesion_movement.hpp"
+#include "parameter.hpp"
+
+extern Parameter par;
 
 AdhesionDisplacements::AdhesionDisplacements()
     : source({0, 0}), target({0, 0}) {}
@@ -12,37 +15,75 @@ const PixelDisplacement
     AdhesionDisplacements::annihilated(std::numeric_limits<int>::min(),
                                        std::numeric_limits<int>::min());
 
-AdhesionMover::AdhesionMover(CellularPotts const &ca) : ca_(ca) {}
+namespace {
 
-double AdhesionMover::move_dh(PixelPos source_pixel, PixelPos target_pixel,
-                              AdhesionDisplacements &displacements) const {
+/* Implementation of AdhesionMover::move_dh(), instantiated for each
+ * combination of extension mechanism and displacement selection.
+ */
+template <ExtensionMechanism extension, DisplacementSelection selection>
+double move_dh_impl(CellularPotts const &ca, AdhesionIndex const &index,
+                    PixelPos source_pixel, PixelPos target_pixel,
+                    AdhesionDisplacements &displacements) {
 
   double source_dh(0.0), target_dh(0.0);
 
-  auto num_source_adhesions = index_.get_adhesions(source_pixel).size();
+  auto num_source_adhesions = index.get_adhesions(source_pixel).size();
   if (num_source_adhesions > 0) {
     auto possible_displacements =
-        extension_displacements(ca_, source_pixel, target_pixel);
-    std::tie(displacements.source, source_dh) =
-        select_displacement(index_, source_pixel, possible_displacements);
+        extension_displacements<extension>(ca, source_pixel, target_pixel);
+    std::tie(displacements.source, source_dh) = select_displacement<selection>(
+        index, source_pixel, possible_displacements);
   }
 
-  auto num_target_adhesions = index_.get_adhesions(target_pixel).size();
+  auto num_target_adhesions = index.get_adhesions(target_pixel).size();
   if (num_target_adhesions > 0) {
     auto possible_displacements =
-        retraction_displacements(ca_, source_pixel, target_pixel);
+        retraction_displacements(ca, source_pixel, target_pixel);
     if (possible_displacements.empty()) {
       displacements.target = AdhesionDisplacements::annihilated;
       target_dh = annihilation_penalty(num_target_adhesions);
     } else {
       std::tie(displacements.target, target_dh) =
-          select_displacement(index_, target_pixel, possible_displacements);
+          select_displacement<selection>(index, target_pixel,
+                                         possible_displacements);
     }
   }
 
   return source_dh + target_dh;
 }
 
+// Pick the implementation for the given extension and selection
+template <ExtensionMechanism extension>
+auto move_dh_for(DisplacementSelection selection) {
+  if (selection == DisplacementSelection::uniform)
+    return move_dh_impl<extension, DisplacementSelection::uniform>;
+  return move_dh_impl<extension, DisplacementSelection::gradient>;
+}
+
+} // namespace
+
+AdhesionMover::MoveDH AdhesionMover::select_move_dh_() {
+  auto selection =
+      parse_displacement_selection(par.adhesion_displacement_selection);
+
+  switch (parse_extension_mechanism(par.adhesion_extension_mechanism)) {
+  case ExtensionMechanism::lazy:
+    return move_dh_for<ExtensionMechanism::lazy>(selection);
+  case ExtensionMechanism::sticky:
+    return move_dh_for<ExtensionMechanism::sticky>(selection);
+  case ExtensionMechanism::mixed:
+    return move_dh_for<ExtensionMechanism::mixed>(selection);
+  case ExtensionMechanism::random:
+    return move_dh_for<ExtensionMechanism::random>(selection);
+  }
+
+  // not reached
+  return nullptr;
+}
+
+AdhesionMover::AdhesionMover(CellularPotts const &ca)
+    : ca_(ca), move_dh_(select_move_dh_()) {}
+
 void AdhesionMover::commit_move(PixelPos source_pixel, PixelPos target_pixel,
                                 AdhesionDisplacements const &displacements) {
   // Source pixel
@@ -62,6 +103,11 @@ CellECMInteractions AdhesionMover::get_cell_ecm_interactions() const {
   return index_.get_cell_ecm_interactions();
 }
 
+void AdhesionMover::take_cell_ecm_interactions(
+    CellECMInteractions &interactions) {
+  index_.take_cell_ecm_interactions(interactions);
+}
+
 void AdhesionMover::reset_cell_ecm_interactions() {
   index_.reset_cell_ecm_interactions();
 }
@@ -69,3 +115,8 @@ void AdhesionMover::reset_cell_ecm_interactions() {
 void AdhesionMover::update(ECMBoundaryState const &ecm_boundary) {
   index_.rebuild(ecm_boundary);
 }
+
+void AdhesionMover::update(ECMBoundaryState const &ecm_boundary,
+                           ECMBoundaryChanges const &changes) {
+  index_.update(ecm_boundary, changes);
+}
@@ -33,12 +33,18 @@ public:
  * This class implements the logic required to evaluate a copy attempt that
  * requires moving one or more adhesion particles along with or out of the way
  * of the copied pixel.
+ *
+ * The extension mechanism and displacement selection are read from the
+ * parameters on construction, and select a version of move_dh() compiled for
+ * that combination, so that they don't need to be checked for every copy.
  */
 class AdhesionMover {
 public:
   /** Construct an AdhesionMover object.
    *
    * @param ca The CPM to work with.
+   * @throw std::runtime_error if adhesion_extension_mechanism or
+   *      adhesion_displacement_selection has an invalid value.
    */
   AdhesionMover(CellularPotts const &ca);
 
@@ -64,7 +70,9 @@ public:
    * @return The work required.
    */
   double move_dh(PixelPos from, PixelPos to,
-                 AdhesionDisplacements &displacements) const;
+                 AdhesionDisplacements &displacements) const {
+    return move_dh_(ca_, index_, from, to, displacements);
+  }
 
   /** Update the adhesions following a move.
    *
@@ -91,6 +99,15 @@ public:
    */
   CellECMInteractions get_cell_ecm_interactions() const;
 
+  /** Take accumulated changes to the adhesions, and reset.
+   *
+   * This avoids copying the changes, and reuses the memory of the object
+   * passed in for recording further changes.
+   *
+   * @param interactions Object to move the changes into
+   */
+  void take_cell_ecm_interactions(CellECMInteractions &interactions);
+
   /** Reset the adhesion change administration.
    *
    * This clears the recorded adhesion change history.
@@ -108,10 +125,31 @@ public:
    */
   void update(ECMBoundaryState const &ecm_boundary);
 
+  /** Update the internal administration after a partial change to the ECM.
+   *
+   * As update() above, but only the parts of the cache affected by the
+   * given changes are updated, which is faster if there are few.
+   *
+   * @param ecm_boundary ECM boundary state to update from
+   * @param changes Changes since the previously passed state
+   */
+  void update(ECMBoundaryState const &ecm_boundary,
+              ECMBoundaryChanges const &changes);
+
 private:
   /// The CPM grid to work with
   CellularPotts const &ca_;
 
   /// Adhesion index for efficiently calculating work
   AdhesionIndex index_;
+
+  /// Signature of the move_dh() implementations, see adhesion_mover.cpp
+  using MoveDH = double (*)(CellularPotts const &, AdhesionIndex const &,
+                            PixelPos, PixelPos, AdhesionDisplacements &);
+
+  /// The move_dh() implementation selected by the parameters
+  MoveDH move_dh_;
+
+  /// Select the move_dh() implementation matching the parameters
+  static MoveDH select_move_dh_();
 };
@@ -1,5 +1,9 @@
 #include "ecm_boundary_state.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
 Particle::Particle(ParId par_id, ParPos pos, ParticleType type)
     : par_id(par_id), pos(pos), type(type) {}
 
@@ -11,3 +15,270 @@ AngleCstType::AngleCstType(double t0, double k) : t0(t0), k(k) {}
 
 AngleCst::AngleCst(ParId p1, ParId p2, ParId p3, AngleCstTypeId type)
     : p1(p1), p2(p2), p3(p3), type(type) {}
+
+namespace {
+
+// Ids up to this many times the number of items are indexed by array
+std::size_t const dense_index_factor = 16u;
+std::size_t const dense_index_minimum = 65536u;
+
+std::size_t dense_index_limit(std::size_t num_items) {
+  return dense_index_factor * num_items + dense_index_minimum;
+}
+
+void check_size(std::size_t size, std::size_t expected, char const *what) {
+  if (size != expected)
+    throw std::runtime_error(std::string("ECM boundary state has ") +
+                             std::to_string(size) + " " + what +
+                             ", expected " + std::to_string(expected));
+}
+
+} // namespace
+
+constexpr std::size_t ECMTable::npos;
+
+ECMTable::ECMTable(ECMColumn<std::int32_t> ids) : ids_(std::move(ids)) {
+  std::int32_t max_id = -1;
+  for (std::int32_t id : ids_)
+    max_id = std::max(max_id, id);
+  std::size_t num_ids = max_id < 0 ? 0u : std::size_t(max_id) + 1u;
+  dense_.assign(std::min(num_ids, dense_index_limit(ids_.size())), -1);
+
+  for (std::size_t row = 0u; row < ids_.size(); ++row) {
+    if (find(ids_[row]) != npos)
+      throw std::runtime_error("Id " + std::to_string(ids_[row]) +
+                               " occurs more than once in an ECM boundary"
+                               " state");
+    index_(ids_[row], row);
+  }
+}
+
+std::size_t ECMTable::row_of_(std::int32_t id) const {
+  std::size_t row = find(id);
+  if (row == npos)
+    throw std::out_of_range("Id " + std::to_string(id) +
+                            " not found in ECM boundary state");
+  return row;
+}
+
+std::size_t ECMTable::add_row_(std::int32_t id) {
+  std::size_t row = ids_.size();
+  ids_.push_back(id);
+  index_(id, row);
+  return row;
+}
+
+void ECMTable::remove_row_(std::size_t row) {
+  std::size_t last = ids_.size() - 1u;
+  unindex_(ids_[row]);
+  if (row != last)
+    index_(ids_[last], row);
+  ids_.swap_remove(row, 1u);
+}
+
+void ECMTable::index_(std::int32_t id, std::size_t row) {
+  std::size_t limit = dense_index_limit(ids_.size());
+  if (id >= 0 && std::size_t(id) >= dense_.size() && std::size_t(id) < limit) {
+    dense_.resize(std::min(std::max(std::size_t(id) + 1u, 2u * dense_.size()),
+                           limit),
+                  -1);
+    // move any ids that are now in range over from the hash table
+    for (auto it = sparse_.begin(); it != sparse_.end();) {
+      if (static_cast<std::uint32_t>(it->first) < dense_.size()) {
+        dense_[it->first] = static_cast<std::int32_t>(it->second);
+        it = sparse_.erase(it);
+      } else
+        ++it;
+    }
+  }
+
+  if (static_cast<std::uint32_t>(id) < dense_.size())
+    dense_[id] = static_cast<std::int32_t>(row);
+  else
+    sparse_[id] = row;
+}
+
+void ECMTable::unindex_(std::int32_t id) {
+  if (static_cast<std::uint32_t>(id) < dense_.size())
+    dense_[id] = -1;
+  else
+    sparse_.erase(id);
+}
+
+ECMParticles::ECMParticles(ECMColumn<std::int32_t> ids,
+                           ECMColumn<double> positions,
+                           ECMColumn<std::int32_t> types)
+    : ECMTable(std::move(ids)), positions_(std::move(positions)),
+      types_(std::move(types)) {
+  check_size(positions_.size(), 2u * size(), "particle coordinates");
+  check_size(types_.size(), size(), "particle types");
+}
+
+void ECMParticles::set(Particle const &particle) {
+  std::size_t row = find(particle.par_id);
+  if (row == npos) {
+    add_row_(particle.par_id);
+    positions_.push_back(particle.pos.x);
+    positions_.push_back(particle.pos.y);
+    types_.push_back(static_cast<std::int32_t>(particle.type));
+  } else {
+    positions_.set(2u * row, particle.pos.x);
+    positions_.set(2u * row + 1u, particle.pos.y);
+    types_.set(row, static_cast<std::int32_t>(particle.type));
+  }
+}
+
+void ECMParticles::set_pos(ParId id, ParPos pos) {
+  std::size_t row = row_of_(id);
+  positions_.set(2u * row, pos.x);
+  positions_.set(2u * row + 1u, pos.y);
+}
+
+void ECMParticles::set_type(ParId id, ParticleType type) {
+  types_.set(row_of_(id), static_cast<std::int32_t>(type));
+}
+
+void ECMParticles::erase(ParId id) {
+  std::size_t row = find(id);
+  if (row == npos)
+    return;
+  positions_.swap_remove(row, 2u);
+  types_.swap_remove(row, 1u);
+  remove_row_(row);
+}
+
+ECMBonds::ECMBonds(ECMColumn<std::int32_t> ids,
+                   ECMColumn<std::int32_t> particles,
+                   ECMColumn<std::int32_t> types)
+    : ECMTable(std::move(ids)), particles_(std::move(particles)),
+      types_(std::move(types)) {
+  check_size(particles_.size(), 2u * size(), "bonded particle ids");
+  check_size(types_.size(), size(), "bond types");
+}
+
+void ECMBonds::set(BondId id, Bond const &bond) {
+  std::size_t row = find(id);
+  if (row == npos) {
+    add_row_(id);
+    particles_.push_back(bond.p1);
+    particles_.push_back(bond.p2);
+    types_.push_back(bond.type);
+  } else {
+    particles_.set(2u * row, bond.p1);
+    particles_.set(2u * row + 1u, bond.p2);
+    types_.set(row, bond.type);
+  }
+}
+
+void ECMBonds::erase(BondId id) {
+  std::size_t row = find(id);
+  if (row == npos)
+    return;
+  particles_.swap_remove(row, 2u);
+  types_.swap_remove(row, 1u);
+  remove_row_(row);
+}
+
+ECMAngleCsts::ECMAngleCsts(ECMColumn<std::int32_t> ids,
+                           ECMColumn<std::int32_t> particles,
+                           ECMColumn<std::int32_t> types)
+    : ECMTable(std::move(ids)), particles_(std::move(particles)),
+      types_(std::move(types)) {
+  check_size(particles_.size(), 3u * size(), "constrained particle ids");
+  check_size(types_.size(), size(), "angle constraint types");
+}
+
+void ECMAngleCsts::set(AngleCstId id, AngleCst const &angle_cst) {
+  std::size_t row = find(id);
+  if (row == npos) {
+    add_row_(id);
+    particles_.push_back(angle_cst.p1);
+    particles_.push_back(angle_cst.p2);
+    particles_.push_back(angle_cst.p3);
+    types_.push_back(angle_cst.type);
+  } else {
+    particles_.set(3u * row, angle_cst.p1);
+    particles_.set(3u * row + 1u, angle_cst.p2);
+    particles_.set(3u * row + 2u, angle_cst.p3);
+    types_.set(row, angle_cst.type);
+  }
+}
+
+void ECMAngleCsts::erase(AngleCstId id) {
+  std::size_t row = find(id);
+  if (row == npos)
+    return;
+  particles_.swap_remove(row, 3u);
+  types_.swap_remove(row, 1u);
+  remove_row_(row);
+}
+
+namespace {
+
+bool operator!=(Particle const &a, Particle const &b) {
+  return a.pos != b.pos || a.type != b.type;
+}
+
+bool operator!=(Bond const &a, Bond const &b) {
+  return a.p1 != b.p1 || a.p2 != b.p2 || a.type != b.type;
+}
+
+bool operator!=(AngleCst const &a, AngleCst const &b) {
+  return a.p1 != b.p1 || a.p2 != b.p2 || a.p3 != b.p3 || a.type != b.type;
+}
+
+bool operator!=(BondType const &a, BondType const &b) {
+  return a.r0 != b.r0 || a.k != b.k;
+}
+
+bool operator!=(AngleCstType const &a, AngleCstType const &b) {
+  return a.t0 != b.t0 || a.k != b.k;
+}
+
+/* Add the ids of the items that differ between before and after to ids.
+ */
+template <typename Table, typename Id>
+void find_changes(Table const &before, Table const &after,
+                  std::vector<Id> &ids) {
+  for (std::size_t row = 0u; row < after.size(); ++row) {
+    std::size_t before_row = before.find(after.id(row));
+    if (before_row == Table::npos ||
+        before.get(before_row) != after.get(row))
+      ids.push_back(after.id(row));
+  }
+  for (std::size_t row = 0u; row < before.size(); ++row)
+    if (!after.contains(before.id(row)))
+      ids.push_back(before.id(row));
+}
+
+template <typename Id, typename Item>
+void find_changes(std::unordered_map<Id, Item> const &before,
+                  std::unordered_map<Id, Item> const &after,
+                  std::vector<Id> &ids) {
+  for (auto const &id_item : after) {
+    auto it = before.find(id_item.first);
+    if (it == before.end() || it->second != id_item.second)
+      ids.push_back(id_item.first);
+  }
+  for (auto const &id_item : before)
+    if (!after.count(id_item.first))
+      ids.push_back(id_item.first);
+}
+
+} // namespace
+
+ECMBoundaryChanges ecm_boundary_changes(ECMBoundaryState const &before,
+                                        ECMBoundaryState const &after) {
+  ECMBoundaryChanges changes;
+  find_changes(before.particles, after.particles, changes.particles);
+  find_changes(before.bonds, after.bonds, changes.bonds);
+  find_changes(before.angle_csts, after.angle_csts, changes.angle_csts);
+
+  std::vector<BondTypeId> bond_types;
+  find_changes(before.bond_types, after.bond_types, bond_types);
+  std::vector<AngleCstTypeId> angle_cst_types;
+  find_changes(before.angle_cst_types, after.angle_cst_types,
+               angle_cst_types);
+  changes.types = !bond_types.empty() || !angle_cst_types.empty();
+  return changes;
+}
@@ -3,7 +3,13 @@
 #include "vec2.hpp"
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 /// Typedef for particle ids, for clarity
 typedef int ParId;
@@ -146,6 +152,339 @@ struct AngleCst {
   AngleCstTypeId type;
 };
 
+/** A contiguous array of numbers in an ECM boundary state table.
+ *
+ * The numbers are either owned by the column, or they live in memory owned by
+ * another object, for example a message received via MUSCLE3, which is then
+ * kept alive by the column. In the latter case, the numbers are copied to
+ * memory owned by the column when it is first modified. Copying a column that
+ * does not own its numbers is cheap, since they are shared.
+ *
+ * Multi-dimensional data is stored row by row, with a fixed number of
+ * numbers per row, e.g. two for a position.
+ */
+template <typename T> class ECMColumn {
+public:
+  /// Create an empty column
+  ECMColumn() = default;
+
+  /** Create a column owning the given numbers.
+   *
+   * @param items The numbers to store
+   */
+  explicit ECMColumn(std::vector<T> items) : owned_(std::move(items)) {
+    point_at_owned_();
+  }
+
+  /** Create a column referring to numbers owned by another object.
+   *
+   * @param items Pointer to the first number
+   * @param size Number of numbers
+   * @param owner Object keeping the numbers alive
+   */
+  ECMColumn(T const *items, std::size_t size,
+            std::shared_ptr<void const> owner)
+      : data_(items), size_(size), owner_(std::move(owner)) {}
+
+  ECMColumn(ECMColumn const &other)
+      : owned_(other.owned_), data_(other.data_), size_(other.size_),
+        owner_(other.owner_) {
+    if (!owner_)
+      point_at_owned_();
+  }
+
+  ECMColumn(ECMColumn &&other) noexcept { swap(other); }
+
+  ECMColumn &operator=(ECMColumn other) {
+    swap(other);
+    return *this;
+  }
+
+  void swap(ECMColumn &other) noexcept {
+    owned_.swap(other.owned_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    owner_.swap(other.owner_);
+  }
+
+  /// Return the number of numbers in the column
+  std::size_t size() const { return size_; }
+
+  /// Return a pointer to the numbers
+  T const *data() const { return data_; }
+
+  /// Return the i'th number
+  T const &operator[](std::size_t i) const { return data_[i]; }
+
+  T const *begin() const { return data_; }
+  T const *end() const { return data_ + size_; }
+
+  /// Return whether the numbers are owned by another object
+  bool borrowed() const { return static_cast<bool>(owner_); }
+
+  /// Set the i'th number
+  void set(std::size_t i, T value) {
+    own_();
+    owned_[i] = value;
+  }
+
+  /// Add a number at the end
+  void push_back(T value) {
+    own_();
+    owned_.push_back(value);
+    point_at_owned_();
+  }
+
+  /** Remove a row, replacing it with the last one.
+   *
+   * @param row The row to remove
+   * @param width The number of numbers per row
+   */
+  void swap_remove(std::size_t row, std::size_t width) {
+    own_();
+    std::size_t last = owned_.size() - width;
+    for (std::size_t j = 0u; j < width; ++j)
+      owned_[row * width + j] = owned_[last + j];
+    owned_.resize(last);
+    point_at_owned_();
+  }
+
+private:
+  void own_() {
+    if (owner_) {
+      owned_.assign(data_, data_ + size_);
+      owner_.reset();
+      point_at_owned_();
+    }
+  }
+
+  void point_at_owned_() {
+    data_ = owned_.data();
+    size_ = owned_.size();
+  }
+
+  std::vector<T> owned_;
+  T const *data_ = nullptr;
+  std::size_t size_ = 0u;
+  std::shared_ptr<void const> owner_;
+};
+
+/** Base class for the tables of items in an ECM boundary state.
+ *
+ * The items are stored in rows, with a column of ids and further columns
+ * defined by the derived classes. An index from id to row is built when the
+ * table is created, and updated when items are added or removed. Removing an
+ * item moves the last item into its row, so the order of the rows is not
+ * stable.
+ *
+ * Ids are usually small non-negative numbers, so the index is an array
+ * indexed by id, with a hash table for any ids that are too large for it.
+ */
+class ECMTable {
+public:
+  /// Value returned by find() for ids that aren't in the table
+  static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+  /// Return the number of items
+  std::size_t size() const { return ids_.size(); }
+
+  /// Return whether there are no items
+  bool empty() const { return ids_.size() == 0u; }
+
+  /// Return the id of the item in the given row
+  std::int32_t id(std::size_t row) const { return ids_[row]; }
+
+  /// Return the ids of the items, by row
+  ECMColumn<std::int32_t> const &ids() const { return ids_; }
+
+  /** Find the row of an item.
+   *
+   * @param id The id of the item
+   * @return The row, or npos if there's no item with that id
+   */
+  std::size_t find(std::int32_t id) const {
+    if (static_cast<std::uint32_t>(id) < dense_.size()) {
+      std::int32_t row = dense_[id];
+      return row < 0 ? npos : static_cast<std::size_t>(row);
+    }
+    if (sparse_.empty())
+      return npos;
+    auto it = sparse_.find(id);
+    return it == sparse_.end() ? npos : it->second;
+  }
+
+  /// Return whether there is an item with the given id
+  bool contains(std::int32_t id) const { return find(id) != npos; }
+
+protected:
+  ECMTable() = default;
+
+  /** Create a table with the given ids, and index them.
+   *
+   * @throw std::runtime_error if an id occurs more than once
+   */
+  explicit ECMTable(ECMColumn<std::int32_t> ids);
+
+  /// Return the row of the given id, or throw std::out_of_range
+  std::size_t row_of_(std::int32_t id) const;
+
+  /// Add a row for a new id at the end, and return it
+  std::size_t add_row_(std::int32_t id);
+
+  /// Remove the id in the given row, moving the last one into it
+  void remove_row_(std::size_t row);
+
+private:
+  /// Add an id to the index
+  void index_(std::int32_t id, std::size_t row);
+
+  /// Remove an id from the index
+  void unindex_(std::int32_t id);
+
+  ECMColumn<std::int32_t> ids_;
+
+  /// Row of each id below dense_.size(), or -1
+  std::vector<std::int32_t> dense_;
+
+  /// Rows of the other ids
+  std::unordered_map<std::int32_t, std::size_t> sparse_;
+};
+
+/** The particles in an ECM boundary state.
+ *
+ * Columns are the particle ids, their positions (x and y per row), and their
+ * types, which are ParticleType values.
+ */
+class ECMParticles : public ECMTable {
+public:
+  /// Create an empty table
+  ECMParticles() = default;
+
+  /** Create a table from columns.
+   *
+   * @param ids Particle ids
+   * @param positions Particle positions, x and y per row
+   * @param types Particle types
+   * @throw std::runtime_error if the sizes don't match or ids are repeated
+   */
+  ECMParticles(ECMColumn<std::int32_t> ids, ECMColumn<double> positions,
+               ECMColumn<std::int32_t> types);
+
+  /// Return the position of the particle in the given row
+  ParPos pos(std::size_t row) const {
+    return ParPos(positions_[2u * row], positions_[2u * row + 1u]);
+  }
+
+  /// Return the type of the particle in the given row
+  ParticleType type(std::size_t row) const {
+    return static_cast<ParticleType>(types_[row]);
+  }
+
+  /// Return the particle in the given row
+  Particle get(std::size_t row) const {
+    return Particle(id(row), pos(row), type(row));
+  }
+
+  /// Return the particle with the given id, or throw std::out_of_range
+  Particle at(ParId id) const { return get(row_of_(id)); }
+
+  /// Add a particle, or replace the one with the same id
+  void set(Particle const &particle);
+
+  /// Move a particle, which must exist
+  void set_pos(ParId id, ParPos pos);
+
+  /// Change the type of a particle, which must exist
+  void set_type(ParId id, ParticleType type);
+
+  /// Remove a particle, if it exists
+  void erase(ParId id);
+
+private:
+  ECMColumn<double> positions_;
+  ECMColumn<std::int32_t> types_;
+};
+
+/** The bonds in an ECM boundary state.
+ *
+ * Columns are the bond ids, the ids of the two bonded particles per row, and
+ * the bond types.
+ */
+class ECMBonds : public ECMTable {
+public:
+  /// Create an empty table
+  ECMBonds() = default;
+
+  /** Create a table from columns.
+   *
+   * @param ids Bond ids
+   * @param particles Bonded particle ids, two per row
+   * @param types Bond type ids
+   * @throw std::runtime_error if the sizes don't match or ids are repeated
+   */
+  ECMBonds(ECMColumn<std::int32_t> ids, ECMColumn<std::int32_t> particles,
+           ECMColumn<std::int32_t> types);
+
+  /// Return the bond in the given row
+  Bond get(std::size_t row) const {
+    return Bond(particles_[2u * row], particles_[2u * row + 1u], types_[row]);
+  }
+
+  /// Return the bond with the given id, or throw std::out_of_range
+  Bond at(BondId id) const { return get(row_of_(id)); }
+
+  /// Add a bond, or replace the one with the same id
+  void set(BondId id, Bond const &bond);
+
+  /// Remove a bond, if it exists
+  void erase(BondId id);
+
+private:
+  ECMColumn<std::int32_t> particles_;
+  ECMColumn<std::int32_t> types_;
+};
+
+/** The angle constraints in an ECM boundary state.
+ *
+ * Columns are the constraint ids, the ids of the three particles per row, and
+ * the constraint types.
+ */
+class ECMAngleCsts : public ECMTable {
+public:
+  /// Create an empty table
+  ECMAngleCsts() = default;
+
+  /** Create a table from columns.
+   *
+   * @param ids Angle constraint ids
+   * @param particles Constrained particle ids, three per row
+   * @param types Angle constraint type ids
+   * @throw std::runtime_error if the sizes don't match or ids are repeated
+   */
+  ECMAngleCsts(ECMColumn<std::int32_t> ids, ECMColumn<std::int32_t> particles,
+               ECMColumn<std::int32_t> types);
+
+  /// Return the angle constraint in the given row
+  AngleCst get(std::size_t row) const {
+    return AngleCst(particles_[3u * row], particles_[3u * row + 1u],
+                    particles_[3u * row + 2u], types_[row]);
+  }
+
+  /// Return the angle constraint with the given id, or throw
+  /// std::out_of_range
+  AngleCst at(AngleCstId id) const { return get(row_of_(id)); }
+
+  /// Add an angle constraint, or replace the one with the same id
+  void set(AngleCstId id, AngleCst const &angle_cst);
+
+  /// Remove an angle constraint, if it exists
+  void erase(AngleCstId id);
+
+private:
+  ECMColumn<std::int32_t> particles_;
+  ECMColumn<std::int32_t> types_;
+};
+
 /** Boundary of the MD representation of the extracellular matrix (ECM).
  *
  * The ECM can be viewed from different perspectives. From a biological
@@ -178,17 +517,19 @@ struct AngleCst {
  * directly, and it doesn't contain any bonds or angle constraints that do not
  * include an adhesion particle.
  *
- * The representation used here is chosen mostly for flexibility. If a faster
- * representation is needed, then it can usually be generated once after each
- * MD update, and then used for many copy attempts. See AdhesionIndex for an
- * example.
+ * The particles, bonds and angle constraints are stored in tables with a
+ * column per field, matching the arrays in which they are sent by the ECM
+ * simulation, so that a received state can be used without converting it. See
+ * decode_ecm_boundary_state(). The types are few, and are stored in maps.
+ *
+ * For faster access during copy attempts, a different representation can be
+ * generated once after each MD update, and then used for many copy attempts.
+ * See AdhesionIndex for an example.
  */
 struct ECMBoundaryState {
   /** Particles making up the ECM - CPM boundary.
-   *
-   * particles[ParId].pos.x, .pos.y or .type
    */
-  std::unordered_map<ParId, Particle> particles;
+  ECMParticles particles;
 
   /** The different types of bonds available.
    */
@@ -196,7 +537,7 @@ struct ECMBoundaryState {
 
   /** Bonds between two particles.
    */
-  std::unordered_map<BondId, Bond> bonds;
+  ECMBonds bonds;
 
   /** Types of angle constraints.
    */
@@ -204,5 +545,48 @@ struct ECMBoundaryState {
 
   /** Angle constraints.
    */
-  std::unordered_map<AngleCstId, AngleCst> angle_csts;
+  ECMAngleCsts angle_csts;
+};
+
+/** Identifies the parts of an ECMBoundaryState that changed.
+ *
+ * This lists the ids of the particles, bonds and angle constraints that were
+ * added, modified or removed since a previous state, so that derived data
+ * like the AdhesionIndex can be patched rather than rebuilt. Changes to the
+ * bond or angle constraint types are not listed individually, since they
+ * potentially affect everything.
+ */
+struct ECMBoundaryChanges {
+  /// Ids of particles that were added, moved, changed type or removed
+  std::vector<ParId> particles;
+
+  /// Ids of bonds that were added, changed or removed
+  std::vector<BondId> bonds;
+
+  /// Ids of angle constraints that were added, changed or removed
+  std::vector<AngleCstId> angle_csts;
+
+  /// Whether any of the bond types or angle constraint types changed
+  bool types = false;
+
+  /// Whether the whole state was replaced, so that anything may have changed
+  bool everything = false;
+
+  /// Total number of changed particles, bonds and angle constraints
+  std::size_t size() const {
+    return particles.size() + bonds.size() + angle_csts.size();
+  }
 };
+
+/** Find the changes between two ECM boundary states.
+ *
+ * This compares every item in the two states, so it is mostly useful if
+ * both states are available anyway and the changes will be used more than
+ * once.
+ *
+ * @param before The earlier state
+ * @param after The later state
+ * @return The changes needed to turn before into after
+ */
+ECMBoundaryChanges ecm_boundary_changes(ECMBoundaryState const &before,
+                                        ECMBoundaryState const &after);
@@ -1,5 +1,8 @@
 #include "ecm_interaction_tracker.hpp"
 
+#include <cstddef>
+#include <utility>
+
 void ECMInteractionTracker::record_new_particle(ParPos pos,
                                                 double bond_attempt_radius) {
   update_.add_adhesion_particles.new_pos.push_back(pos);
@@ -8,8 +11,18 @@ void ECMInteractionTracker::record_new_particle(ParPos pos,
 }
 
 void ECMInteractionTracker::record_move_particle(ParId par_id, ParPos new_pos) {
-  update_.move_adhesion_particles.par_id.push_back(par_id);
-  update_.move_adhesion_particles.new_pos.push_back(new_pos);
+  auto &map = update_.move_adhesion_particles;
+  if (static_cast<std::size_t>(par_id) >= move_index_.size())
+    move_index_.resize(par_id + 1, -1);
+
+  std::int32_t &index = move_index_[par_id];
+  if (index >= 0) {
+    map.new_pos[index] = new_pos;
+    return;
+  }
+  index = static_cast<std::int32_t>(map.par_id.size());
+  map.par_id.push_back(par_id);
+  map.new_pos.push_back(new_pos);
 }
 
 void ECMInteractionTracker::record_remove_particle(ParId par_id) {
@@ -20,4 +33,18 @@ CellECMInteractions ECMInteractionTracker::get_changes() const {
   return update_;
 }
 
-void ECMInteractionTracker::reset() { update_.clear(); }
+void ECMInteractionTracker::take_changes(CellECMInteractions &changes) {
+  forget_moves_();
+  changes.clear();
+  std::swap(changes, update_);
+}
+
+void ECMInteractionTracker::reset() {
+  forget_moves_();
+  update_.clear();
+}
+
+void ECMInteractionTracker::forget_moves_() {
+  for (ParId par_id : update_.move_adhesion_particles.par_id)
+    move_index_[par_id] = -1;
+}
@@ -4,7 +4,17 @@
 #include "ecm_boundary_state.hpp"
 #include "vec2.hpp"
 
-/** Tracks changes to the adhesions that affect the ECM */
+#include <cstdint>
+#include <vector>
+
+/** Tracks changes to the adhesions that affect the ECM
+ *
+ * Changes are recorded directly into a CellECMInteractions, whose vectors
+ * have the layout of the message sent to the ECM. If a particle is moved more
+ * than once, only its last position is kept, in the place of its first move.
+ * Use take_changes() to hand over the changes without copying, and to reuse
+ * the memory of an earlier set.
+ */
 class ECMInteractionTracker {
 public:
   /** Record a particle being added
@@ -19,6 +29,9 @@ public:
   void record_new_particle(ParPos pos, double bond_attempt_radius);
 
   /** Record a particle being moved
+   *
+   * If the particle was moved before since the last reset, then its new
+   * position replaces the recorded one.
    *
    * @param id Id of the particle that was displaced
    * @param new_pos Its new position
@@ -37,6 +50,17 @@ public:
    */
   CellECMInteractions get_changes() const;
 
+  /** Take the accumulated changes, and reset
+   *
+   * This swaps the changes recorded so far into changes, and records any
+   * subsequent changes into the memory of the object passed in, after
+   * clearing it. Passing an object that was taken before avoids allocating
+   * memory once its vectors are large enough.
+   *
+   * @param changes Object to move the changes into
+   */
+  void take_changes(CellECMInteractions &changes);
+
   /** Reset records
    *
    * This clears the accumulated updates
@@ -44,5 +68,12 @@ public:
   void reset();
 
 private:
+  /// Clear move_index_ for the recorded moves
+  void forget_moves_();
+
   CellECMInteractions update_;
+
+  // Index of each particle's entry in the recorded moves, by particle id, or
+  // -1 if it hasn't moved
+  std::vector<std::int32_t> move_index_;
 };
@@ -0,0 +1,512 @@
+#include "ecm_simulation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+
+// SplitMix64 finaliser, used to derive the noise from a counter
+std::uint64_t mix(std::uint64_t z) {
+  z += 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// A number in [-1, 1), which depends only on the arguments
+double uniform_noise(std::uint64_t seed, std::uint64_t step, ParId par_id,
+                     int dim) {
+  std::uint64_t counter = 2u * static_cast<std::uint64_t>(par_id) + dim;
+  std::uint64_t bits = mix(mix(mix(seed) ^ step) ^ counter);
+  return static_cast<double>(bits >> 11) * 0x1.0p-52 - 1.0;
+}
+
+// cos of the angle at p2 between p1 and p3, given d12 = p1 - p2 and
+// d32 = p3 - p2
+struct Angle {
+  Angle(ParDisplacement d12, ParDisplacement d32)
+      : d12(d12), d32(d32), rsq12(d12.dot(d12)), rsq32(d32.dot(d32)),
+        r12(std::sqrt(rsq12)), r32(std::sqrt(rsq32)) {
+    cos = std::min(std::max(d12.dot(d32) / (r12 * r32), -1.0), 1.0);
+  }
+
+  ParDisplacement d12, d32;
+  double rsq12, rsq32, r12, r32, cos;
+};
+
+void check_id(int id, std::size_t size, char const *what) {
+  if (id < 0 || static_cast<std::size_t>(id) >= size)
+    throw std::runtime_error(std::string("Invalid ") + what + " id " +
+                             std::to_string(id) + " in the ECM state");
+}
+
+// Remove the items that are not to be kept from a boundary table
+template <typename Table, typename Id>
+void erase_unless(Table &table, std::vector<bool> const &keep,
+                  std::vector<Id> &changed) {
+  std::vector<Id> gone;
+  for (std::int32_t id : table.ids())
+    if (!keep[id])
+      gone.push_back(id);
+  for (Id id : gone) {
+    table.erase(id);
+    changed.push_back(id);
+  }
+}
+
+} // namespace
+
+ECMSimulation::ECMSimulation(MDState state, ECMEvolutionParameters const &par)
+    : state_(std::move(state)), par_(par), rng_(par.seed),
+      pool_(par.threads) {
+  // as in the hoomd Simulation: a margin of four contour lengths, and a
+  // safety margin of one more, centered on the CPM domain
+  double margin = 5.0 * par_.contour_length;
+  box_size_ = ParDisplacement(par_.box_size_x + margin,
+                              par_.box_size_y + margin);
+  box_lo_ = ParPos(-0.5 * margin, -0.5 * margin);
+  if (!(box_size_.x > 0.0 && box_size_.y > 0.0))
+    throw std::runtime_error("The ECM box is empty, check box_size_x,"
+                             " box_size_y and contour_length");
+
+  removed_.assign(state_.positions.size(), false);
+  index_();
+  for (ParPos &pos : state_.positions)
+    pos = wrap_(pos);
+  rebuild_boundary_();
+}
+
+void ECMSimulation::apply_interactions(
+    CellECMInteractions const &interactions) {
+  change_types_(interactions.change_type_in_area);
+  add_adhesions_(interactions.add_adhesion_particles);
+  move_adhesions_(interactions.move_adhesion_particles);
+  remove_adhesions_(interactions.remove_adhesion_particles);
+}
+
+void ECMSimulation::run() { run(par_.its); }
+
+void ECMSimulation::run(int its) {
+  std::size_t num_terms = state_.bonds.size() + state_.angle_csts.size();
+  std::function<void(std::size_t, std::size_t)> compute_forces =
+      [this](std::size_t begin, std::size_t end) {
+        compute_term_forces_(begin, end);
+      };
+  std::function<void(std::size_t, std::size_t)> integrate =
+      [this](std::size_t begin, std::size_t end) { integrate_(begin, end); };
+
+  for (int i = 0; i < its; ++i) {
+    pool_.parallel_for(num_terms, compute_forces);
+    pool_.parallel_for(state_.positions.size(), integrate);
+    ++timestep_;
+  }
+}
+
+void ECMSimulation::boundary_state(ECMBoundaryState &state,
+                                   ECMBoundaryChanges &changes) {
+  if (!boundary_sent_) {
+    state = ECMBoundaryState();
+    changes.everything = true;
+    boundary_sent_ = true;
+  }
+
+  if (boundary_shrunk_) {
+    erase_unless(state.particles, in_boundary_particles_, changes.particles);
+    erase_unless(state.bonds, in_boundary_bonds_, changes.bonds);
+    erase_unless(state.angle_csts, in_boundary_angle_csts_,
+                 changes.angle_csts);
+    boundary_shrunk_ = false;
+  }
+
+  for (ParId par_id : boundary_particles_) {
+    Particle particle(par_id, state_.positions[par_id], state_.types[par_id]);
+    std::size_t row = state.particles.find(par_id);
+    if (row == ECMTable::npos || state.particles.pos(row) != particle.pos ||
+        state.particles.type(row) != particle.type) {
+      state.particles.set(particle);
+      changes.particles.push_back(par_id);
+    }
+  }
+
+  // bonds and angle constraints don't change, but new ones may be added
+  for (BondId bond_id : boundary_bonds_) {
+    if (state.bonds.contains(bond_id))
+      continue;
+    Bond const &bond = state_.bonds[bond_id];
+    state.bonds.set(bond_id, bond);
+    changes.bonds.push_back(bond_id);
+    if (state.bond_types.emplace(bond.type, state_.bond_types[bond.type])
+            .second)
+      changes.types = true;
+  }
+
+  for (AngleCstId angle_cst_id : boundary_angle_csts_) {
+    if (state.angle_csts.contains(angle_cst_id))
+      continue;
+    AngleCst const &angle_cst = state_.angle_csts[angle_cst_id];
+    state.angle_csts.set(angle_cst_id, angle_cst);
+    changes.angle_csts.push_back(angle_cst_id);
+    if (state.angle_cst_types
+            .emplace(angle_cst.type, state_.angle_cst_types[angle_cst.type])
+            .second)
+      changes.types = true;
+  }
+}
+
+double ECMSimulation::energy() const {
+  double result = 0.0;
+  auto const &pos = state_.positions;
+  for (Bond const &bond : state_.bonds) {
+    if (is_removed_(bond))
+      continue;
+    BondType const &type = state_.bond_types[bond.type];
+    double r = min_image_(pos[bond.p2] - pos[bond.p1]).length();
+    result += 0.5 * type.k * (r - type.r0) * (r - type.r0);
+  }
+  for (AngleCst const &angle_cst : state_.angle_csts) {
+    if (is_removed_(angle_cst))
+      continue;
+    AngleCstType const &type = state_.angle_cst_types[angle_cst.type];
+    Angle angle(min_image_(pos[angle_cst.p1] - pos[angle_cst.p2]),
+                min_image_(pos[angle_cst.p3] - pos[angle_cst.p2]));
+    double dt = std::acos(angle.cos) - type.t0;
+    result += 0.5 * type.k * dt * dt;
+  }
+  return result;
+}
+
+std::vector<ParDisplacement> ECMSimulation::forces() {
+  compute_term_forces_(0u, state_.bonds.size() + state_.angle_csts.size());
+  std::vector<ParDisplacement> result(state_.positions.size());
+  for (std::size_t i = 0u; i < result.size(); ++i)
+    result[i] = net_force_(static_cast<ParId>(i));
+  return result;
+}
+
+void ECMSimulation::index_() {
+  std::size_t num_particles = state_.positions.size();
+  if (state_.types.size() != num_particles)
+    throw std::runtime_error("The ECM state has " +
+                             std::to_string(num_particles) +
+                             " particle positions but " +
+                             std::to_string(state_.types.size()) + " types");
+
+  std::vector<std::size_t> num_slots(num_particles + 1u, 0u);
+  for (Bond const &bond : state_.bonds) {
+    check_id(bond.p1, num_particles, "particle");
+    check_id(bond.p2, num_particles, "particle");
+    check_id(bond.type, state_.bond_types.size(), "bond type");
+    if (is_removed_(bond))
+      continue;
+    ++num_slots[bond.p1];
+    ++num_slots[bond.p2];
+  }
+  for (AngleCst const &angle_cst : state_.angle_csts) {
+    check_id(angle_cst.p1, num_particles, "particle");
+    check_id(angle_cst.p2, num_particles, "particle");
+    check_id(angle_cst.p3, num_particles, "particle");
+    check_id(angle_cst.type, state_.angle_cst_types.size(),
+             "angle constraint type");
+    if (is_removed_(angle_cst))
+      continue;
+    ++num_slots[angle_cst.p1];
+    ++num_slots[angle_cst.p2];
+    ++num_slots[angle_cst.p3];
+  }
+
+  slot_begin_.assign(num_particles + 1u, 0u);
+  for (std::size_t i = 0u; i < num_particles; ++i)
+    slot_begin_[i + 1u] = slot_begin_[i] + num_slots[i];
+
+  // adding the slots in order keeps them sorted, and so the sums repeatable
+  std::vector<std::size_t> next(slot_begin_.begin(), slot_begin_.end() - 1);
+  slots_.resize(slot_begin_.back());
+  std::size_t slot = 0u;
+  for (Bond const &bond : state_.bonds) {
+    if (is_removed_(bond)) {
+      slot += 2u;
+      continue;
+    }
+    slots_[next[bond.p1]++] = slot++;
+    slots_[next[bond.p2]++] = slot++;
+  }
+  for (AngleCst const &angle_cst : state_.angle_csts) {
+    if (is_removed_(angle_cst)) {
+      slot += 3u;
+      continue;
+    }
+    slots_[next[angle_cst.p1]++] = slot++;
+    slots_[next[angle_cst.p2]++] = slot++;
+    slots_[next[angle_cst.p3]++] = slot++;
+  }
+  term_forces_.assign(slot, ParDisplacement(0.0, 0.0));
+}
+
+ParPos ECMSimulation::wrap_(ParPos pos) const {
+  pos.x -= box_size_.x * std::floor((pos.x - box_lo_.x) / box_size_.x);
+  pos.y -= box_size_.y * std::floor((pos.y - box_lo_.y) / box_size_.y);
+  return pos;
+}
+
+ParDisplacement ECMSimulation::min_image_(ParDisplacement d) const {
+  d.x -= box_size_.x * std::round(d.x / box_size_.x);
+  d.y -= box_size_.y * std::round(d.y / box_size_.y);
+  return d;
+}
+
+template <typename Term>
+bool ECMSimulation::is_removed_(Term const &term) const {
+  if constexpr (std::is_same<Term, AngleCst>::value)
+    if (removed_[term.p3])
+      return true;
+  return removed_[term.p1] || removed_[term.p2];
+}
+
+void ECMSimulation::add_to_boundary_(std::vector<ParId> const &adhesions) {
+  auto add_particle = [this](ParId par_id) {
+    if (!in_boundary_particles_[par_id]) {
+      in_boundary_particles_[par_id] = true;
+      boundary_particles_.push_back(par_id);
+    }
+  };
+
+  std::size_t bond_slots = 2u * state_.bonds.size();
+  for (ParId par_id : adhesions) {
+    add_particle(par_id);
+    for (std::size_t i = slot_begin_[par_id]; i < slot_begin_[par_id + 1];
+         ++i) {
+      std::size_t slot = slots_[i];
+      if (slot < bond_slots) {
+        BondId bond_id = static_cast<BondId>(slot / 2u);
+        Bond const &bond = state_.bonds[bond_id];
+        add_particle(bond.p1);
+        add_particle(bond.p2);
+        if (!in_boundary_bonds_[bond_id]) {
+          in_boundary_bonds_[bond_id] = true;
+          boundary_bonds_.push_back(bond_id);
+        }
+      } else {
+        AngleCstId angle_cst_id =
+            static_cast<AngleCstId>((slot - bond_slots) / 3u);
+        AngleCst const &angle_cst = state_.angle_csts[angle_cst_id];
+        add_particle(angle_cst.p1);
+        add_particle(angle_cst.p2);
+        add_particle(angle_cst.p3);
+        if (!in_boundary_angle_csts_[angle_cst_id]) {
+          in_boundary_angle_csts_[angle_cst_id] = true;
+          boundary_angle_csts_.push_back(angle_cst_id);
+        }
+      }
+    }
+  }
+}
+
+void ECMSimulation::rebuild_boundary_() {
+  boundary_particles_.clear();
+  boundary_bonds_.clear();
+  boundary_angle_csts_.clear();
+  in_boundary_particles_.assign(state_.positions.size(), false);
+  in_boundary_bonds_.assign(state_.bonds.size(), false);
+  in_boundary_angle_csts_.assign(state_.angle_csts.size(), false);
+
+  std::vector<ParId> adhesions;
+  for (std::size_t i = 0u; i < state_.types.size(); ++i)
+    if (state_.types[i] == ParticleType::adhesion && !removed_[i])
+      adhesions.push_back(static_cast<ParId>(i));
+  add_to_boundary_(adhesions);
+  boundary_shrunk_ = true;
+}
+
+void ECMSimulation::compute_term_forces_(std::size_t begin, std::size_t end) {
+  auto const &pos = state_.positions;
+  std::size_t num_bonds = state_.bonds.size();
+
+  for (std::size_t i = begin; i < std::min(end, num_bonds); ++i) {
+    Bond const &bond = state_.bonds[i];
+    BondType const &type = state_.bond_types[bond.type];
+    ParDisplacement d = min_image_(pos[bond.p2] - pos[bond.p1]);
+    double r = d.length();
+    double f = r > 0.0 ? type.k * (r - type.r0) / r : 0.0;
+    term_forces_[2u * i] = ParDisplacement(f * d.x, f * d.y);
+    term_forces_[2u * i + 1u] = ParDisplacement(-f * d.x, -f * d.y);
+  }
+
+  // see hoomd's HarmonicAngleForceCompute
+  for (std::size_t i = std::max(begin, num_bonds); i < end; ++i) {
+    AngleCst const &angle_cst = state_.angle_csts[i - num_bonds];
+    AngleCstType const &type = state_.angle_cst_types[angle_cst.type];
+    Angle angle(min_image_(pos[angle_cst.p1] - pos[angle_cst.p2]),
+                min_image_(pos[angle_cst.p3] - pos[angle_cst.p2]));
+
+    double s = std::max(std::sqrt(1.0 - angle.cos * angle.cos), 0.001);
+    double a = -type.k * (std::acos(angle.cos) - type.t0) / s;
+    double a11 = a * angle.cos / angle.rsq12;
+    double a12 = -a / (angle.r12 * angle.r32);
+    double a22 = a * angle.cos / angle.rsq32;
+
+    ParDisplacement f1(a11 * angle.d12.x + a12 * angle.d32.x,
+                       a11 * angle.d12.y + a12 * angle.d32.y);
+    ParDisplacement f3(a22 * angle.d32.x + a12 * angle.d12.x,
+                       a22 * angle.d32.y + a12 * angle.d12.y);
+    std::size_t slot = 2u * num_bonds + 3u * (i - num_bonds);
+    term_forces_[slot] = f1;
+    term_forces_[slot + 1u] = ParDisplacement(-f1.x - f3.x, -f1.y - f3.y);
+    term_forces_[slot + 2u] = f3;
+  }
+}
+
+ParDisplacement ECMSimulation::net_force_(ParId par_id) const {
+  ParDisplacement result(0.0, 0.0);
+  for (std::size_t i = slot_begin_[par_id]; i < slot_begin_[par_id + 1]; ++i)
+    result += term_forces_[slots_[i]];
+  return result;
+}
+
+void ECMSimulation::integrate_(std::size_t begin, std::size_t end) {
+  // as hoomd's Brownian method, with uniform noise of the same variance
+  double noise = std::sqrt(6.0 * par_.gamma * par_.kT / par_.dt);
+  double mobility = par_.dt / par_.gamma;
+
+  for (std::size_t i = begin; i < end; ++i) {
+    if (state_.types[i] != ParticleType::free)
+      continue;
+    ParId par_id = static_cast<ParId>(i);
+    ParDisplacement force = net_force_(par_id);
+    double rx = uniform_noise(par_.seed, timestep_, par_id, 0);
+    double ry = uniform_noise(par_.seed, timestep_, par_id, 1);
+    ParDisplacement step((force.x + rx * noise) * mobility,
+                         (force.y + ry * noise) * mobility);
+    state_.positions[i] = wrap_(state_.positions[i] + step);
+  }
+}
+
+void ECMSimulation::change_types_(ChangeTypeInArea const &change_type_in_area) {
+  if (change_type_in_area.change_area.empty())
+    return;
+
+  // Find all particles in the change area
+  std::unordered_set<PixelPos> change_zone(
+      change_type_in_area.change_area.begin(),
+      change_type_in_area.change_area.end());
+
+  std::vector<ParId> potential_changes;
+  for (std::size_t i = 0u; i < state_.positions.size(); ++i) {
+    if (state_.types[i] != change_type_in_area.from_type || removed_[i])
+      continue;
+    ParPos const &pos = state_.positions[i];
+    PixelPos pixel(static_cast<int>(std::floor(pos.x)),
+                   static_cast<int>(std::floor(pos.y)));
+    if (change_zone.count(pixel))
+      potential_changes.push_back(static_cast<ParId>(i));
+  }
+
+  std::size_t needed = std::max(change_type_in_area.num_particles, 0);
+  if (potential_changes.size() < needed)
+    throw std::runtime_error(
+        "There are not enough particles in the adhesion zone to create the"
+        " requested number of adhesions. Please increase"
+        " adhesion_zone_radius, decrease num_initial_adhesions, or provide"
+        " an ECM with higher particle density.");
+
+  // Randomly select the required number of particles
+  std::uniform_real_distribution<double> random(0.0, 1.0);
+  std::vector<ParId> selected_changes;
+  std::size_t available = potential_changes.size();
+  while (needed > 0u) {
+    if (random(rng_) <= static_cast<double>(needed) / available) {
+      selected_changes.push_back(potential_changes[available - 1u]);
+      --needed;
+    }
+    --available;
+  }
+
+  for (ParId par_id : selected_changes)
+    state_.types[par_id] = change_type_in_area.to_type;
+
+  if (change_type_in_area.from_type == ParticleType::adhesion)
+    rebuild_boundary_();
+  else if (change_type_in_area.to_type == ParticleType::adhesion)
+    add_to_boundary_(selected_changes);
+}
+
+void ECMSimulation::add_adhesions_(
+    AddAdhesionParticles const &add_adhesion_particles) {
+  auto const &new_pos = add_adhesion_particles.new_pos;
+  auto const &radius = add_adhesion_particles.bond_attempt_radius;
+  if (new_pos.empty())
+    return;
+
+  std::size_t first = state_.positions.size();
+  std::vector<ParId> added;
+  for (ParPos const &pos : new_pos) {
+    added.push_back(static_cast<ParId>(state_.positions.size()));
+    state_.positions.push_back(wrap_(pos));
+    state_.types.push_back(ParticleType::adhesion);
+    removed_.push_back(false);
+  }
+
+  // bond each to the nearest free particle within its radius, if any
+  auto fiber = static_cast<BondTypeId>(NamedBondTypes::fiber);
+  for (std::size_t j = 0u; j < radius.size() && j < new_pos.size(); ++j) {
+    if (!(radius[j] > 0.0))
+      continue;
+    ParPos const &pos = state_.positions[first + j];
+    ParId nearest = -1;
+    double nearest_sq = radius[j] * radius[j];
+    for (std::size_t i = 0u; i < first; ++i) {
+      if (state_.types[i] != ParticleType::free)
+        continue;
+      ParDisplacement d = min_image_(state_.positions[i] - pos);
+      double r_sq = d.dot(d);
+      if (r_sq <= nearest_sq) {
+        nearest = static_cast<ParId>(i);
+        nearest_sq = r_sq;
+      }
+    }
+    if (nearest >= 0) {
+      if (state_.bond_types.size() <= static_cast<std::size_t>(fiber))
+        throw std::runtime_error(
+            "The ECM has no fiber bond type to bond adhesions with");
+      state_.bonds.emplace_back(added[j], nearest, fiber);
+    }
+  }
+
+  index_();
+  in_boundary_particles_.resize(state_.positions.size(), false);
+  in_boundary_bonds_.resize(state_.bonds.size(), false);
+  add_to_boundary_(added);
+}
+
+void ECMSimulation::move_adhesions_(
+    MoveAdhesionParticles const &move_adhesion_particles) {
+  auto const &par_ids = move_adhesion_particles.par_id;
+  for (std::size_t j = 0u; j < par_ids.size(); ++j) {
+    check_id(par_ids[j], state_.positions.size(), "particle");
+    state_.positions[par_ids[j]] = wrap_(move_adhesion_particles.new_pos[j]);
+  }
+}
+
+void ECMSimulation::remove_adhesions_(
+    RemoveAdhesionParticles const &remove_adhesion_particles) {
+  auto const &par_ids = remove_adhesion_particles.par_id;
+  if (par_ids.empty())
+    return;
+
+  for (ParId par_id : par_ids) {
+    check_id(par_id, state_.positions.size(), "particle");
+    if (state_.types[par_id] != ParticleType::adhesion)
+      throw std::runtime_error("Cannot remove particle " +
+                               std::to_string(par_id) +
+                               ", it is not an adhesion particle");
+    state_.types[par_id] = ParticleType::excluded;
+    removed_[par_id] = true;
+  }
+  index_();
+  rebuild_boundary_();
+}
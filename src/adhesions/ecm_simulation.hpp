@@ -0,0 +1,221 @@
+#pragma once
+
+#include "cell_ecm_interactions.hpp"
+#include "ecm_boundary_state.hpp"
+#include "vec2.hpp"
+#include "worker_pool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/** The complete state of the MD representation of the ECM.
+ *
+ * This matches MDState in the Python ECM code, and what make_ecm and
+ * simulate_ecm send on their ecm_out ports. The id of a particle, bond type,
+ * bond, angle constraint type or angle constraint is its index into the
+ * corresponding vector.
+ */
+struct MDState {
+  /// Location of each particle
+  std::vector<ParPos> positions;
+
+  /// Type of each particle
+  std::vector<ParticleType> types;
+
+  /// The different types of bonds available
+  std::vector<BondType> bond_types;
+
+  /// Bonds between particles
+  std::vector<Bond> bonds;
+
+  /// Types of angle constraints
+  std::vector<AngleCstType> angle_cst_types;
+
+  /// Angle constraints
+  std::vector<AngleCst> angle_csts;
+};
+
+/** Parameters for evolving the ECM, see EvolutionParameters in Python.
+ */
+struct ECMEvolutionParameters {
+  /// Time step
+  double dt = 0.01;
+
+  /// Number of time steps to take per call to ECMSimulation::run()
+  int its = 100;
+
+  /// Temperature of the Brownian dynamics
+  double kT = 0.01;
+
+  /// Friction coefficient (viscosity) of the free particles
+  double gamma = 10.0;
+
+  /// Random seed
+  std::uint64_t seed = 0u;
+
+  /// Width of the CPM domain, which must match sizex
+  double box_size_x = 200.0;
+
+  /// Height of the CPM domain, which must match sizey
+  double box_size_y = 200.0;
+
+  /// Length of the fibers, which sets the margin around the domain
+  double contour_length = 50.0;
+
+  /// Number of threads to use, 0 means one per core
+  int threads = 0;
+};
+
+/** Simulates the ECM in-process.
+ *
+ * This implements the same model as the hoomd-based Simulation in
+ * src/ecm/simulation.py, so that the adhesions model can be run without a
+ * separate simulate_ecm component:
+ *
+ * - Bonds are harmonic springs, with energy k/2 (r - r0)^2.
+ * - Angle constraints are harmonic in the angle, with energy k/2 (t - t0)^2,
+ *   and forces computed as hoomd does.
+ * - Free particles move by overdamped Brownian dynamics, with hoomd's
+ *   integration scheme and uniformly distributed noise. Boundary, adhesion
+ *   and excluded particles don't move by themselves.
+ * - The box is periodic, and has the size and position of hoomd's box: the
+ *   CPM domain with a margin of 2.5 contour lengths on each side. Particles
+ *   are wrapped into it, and bonds and angle constraints act over the
+ *   nearest periodic image.
+ * - Changes of particle types in an area, and adding, moving and removing
+ *   adhesion particles are applied as requested by the CPM. A new adhesion
+ *   particle is bonded to the nearest free particle within its bond attempt
+ *   radius, if any, with a fiber bond. Removed particles keep their id and
+ *   stay in state() as excluded particles, so that no ids change, but their
+ *   bonds and angle constraints no longer apply.
+ *
+ * Bond and angle forces are computed per bond and angle, and then gathered
+ * per particle in a fixed order, and the noise for each particle is derived
+ * from the seed, the step and the particle id. Both are spread over a pool of
+ * threads, and the results do not depend on the number of threads.
+ */
+class ECMSimulation {
+public:
+  /** Create a simulation.
+   *
+   * @param state The ECM to start from
+   * @param par Parameters for the evolution
+   * @throw std::runtime_error if the state refers to non-existent items, or
+   *        the box is empty
+   */
+  ECMSimulation(MDState state, ECMEvolutionParameters const &par);
+
+  ECMSimulation(ECMSimulation const &) = delete;
+  ECMSimulation &operator=(ECMSimulation const &) = delete;
+
+  /** Process interaction requests from the cells.
+   *
+   * @param interactions Description of the desired interactions
+   * @throw std::runtime_error if there are not enough particles to change,
+   *        or if a particle to remove is not an adhesion particle
+   */
+  void apply_interactions(CellECMInteractions const &interactions);
+
+  /// Run the simulation for the configured number of steps.
+  void run();
+
+  /// Run the simulation for the given number of steps.
+  void run(int its);
+
+  /** Get the state of the ECM boundary.
+   *
+   * The first call replaces state with the current boundary. Subsequent
+   * calls expect to be passed the state from the previous call, and update
+   * it to match the current boundary, much like a delta message from the
+   * hoomd simulation does. See decode_ecm_boundary_state().
+   *
+   * @param state The state to update
+   * @param changes Changes to add what changed in state to
+   */
+  void boundary_state(ECMBoundaryState &state, ECMBoundaryChanges &changes);
+
+  /** Return the whole state of the simulation.
+   *
+   * Particles are wrapped into the box, see ECMSimulation.
+   */
+  MDState const &state() const { return state_; }
+
+  /// Return the total potential energy of the bonds and angle constraints.
+  double energy() const;
+
+  /// Return the net force on each particle, by particle id.
+  std::vector<ParDisplacement> forces();
+
+private:
+  /** Check that the state is consistent, and build the force slot index
+   *
+   * Bonds and angle constraints on removed particles get no slots, so that
+   * they don't exert forces and aren't added to the boundary.
+   */
+  void index_();
+
+  /// Wrap a position into the periodic box
+  ParPos wrap_(ParPos pos) const;
+
+  /// Return the shortest displacement that is periodically equal to d
+  ParDisplacement min_image_(ParDisplacement d) const;
+
+  /// Return whether a bond or angle constraint involves a removed particle
+  template <typename Term> bool is_removed_(Term const &term) const;
+
+  /// Add adhesion particles and their neighbours to the boundary
+  void add_to_boundary_(std::vector<ParId> const &adhesions);
+
+  /// Make the boundary anew from the current adhesion particles
+  void rebuild_boundary_();
+
+  /// Compute the force of each bond and angle constraint on its particles
+  void compute_term_forces_(std::size_t begin, std::size_t end);
+
+  /// Return the net force on a particle
+  ParDisplacement net_force_(ParId par_id) const;
+
+  /// Move the free particles in the given range by one time step
+  void integrate_(std::size_t begin, std::size_t end);
+
+  void change_types_(ChangeTypeInArea const &change_type_in_area);
+  void add_adhesions_(AddAdhesionParticles const &add_adhesion_particles);
+  void move_adhesions_(MoveAdhesionParticles const &move_adhesion_particles);
+  void remove_adhesions_(
+      RemoveAdhesionParticles const &remove_adhesion_particles);
+
+  MDState state_;
+  ECMEvolutionParameters par_;
+  std::uint64_t timestep_ = 0u;
+  std::mt19937_64 rng_;
+
+  // lower left corner and size of the periodic box
+  ParPos box_lo_;
+  ParDisplacement box_size_;
+
+  // whether each particle was removed
+  std::vector<bool> removed_;
+
+  // Forces of bond b on its particles are in term_forces_[2 * b + i], those
+  // of angle constraint a in term_forces_[2 * bonds + 3 * a + i]. The slots
+  // acting on particle p are slots_[slot_begin_[p]] up to slot_begin_[p + 1].
+  std::vector<ParDisplacement> term_forces_;
+  std::vector<std::size_t> slot_begin_;
+  std::vector<std::size_t> slots_;
+
+  // Items in the boundary, in the order they were added
+  std::vector<ParId> boundary_particles_;
+  std::vector<BondId> boundary_bonds_;
+  std::vector<AngleCstId> boundary_angle_csts_;
+  std::vector<bool> in_boundary_particles_;
+  std::vector<bool> in_boundary_bonds_;
+  std::vector<bool> in_boundary_angle_csts_;
+  bool boundary_sent_ = false;
+
+  // whether items may have left the boundary since it was last sent
+  bool boundary_shrunk_ = false;
+
+  WorkerPool pool_;
+};
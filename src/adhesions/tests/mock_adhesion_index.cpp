@@ -13,6 +13,11 @@ double MockAdhesionWithEnvironment::move_dh(PixelDisplacement move) const {
 }
 
 
+double MockAdhesionWithEnvironment::cached_move_dh(PixelDisplacement move) const {
+    return move_dh(move);
+}
+
+
 std::vector<MockAdhesionWithEnvironment> const &
 MockAdhesionIndex::get_adhesions(PixelPos pixel) const {
     return get_adhesions_return_values.at(pixel);
@@ -32,11 +37,19 @@ void MockAdhesionIndex::remove_adhesions(PixelPos pixel) {}
 
 void MockAdhesionIndex::rebuild(ECMBoundaryState const & ecm) {}
 
+void MockAdhesionIndex::update(
+        ECMBoundaryState const & ecm, ECMBoundaryChanges const & changes) {}
+
 CellECMInteractions MockAdhesionIndex::get_cell_ecm_interactions_return_value;
 
 CellECMInteractions MockAdhesionIndex::get_cell_ecm_interactions() const {
     return get_cell_ecm_interactions_return_value;
 };
 
+void MockAdhesionIndex::take_cell_ecm_interactions(
+        CellECMInteractions & interactions) {
+    interactions = get_cell_ecm_interactions_return_value;
+}
+
 void MockAdhesionIndex::reset_cell_ecm_interactions() {};
 
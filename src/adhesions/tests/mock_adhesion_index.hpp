@@ -17,6 +17,8 @@ struct MockAdhesionWithEnvironment {
 
     double move_dh(PixelDisplacement move) const;
 
+    double cached_move_dh(PixelDisplacement move) const;
+
     std::unordered_map<PixelDisplacement, double> move_dh_return_values;
 };
 
@@ -37,10 +39,16 @@ class MockAdhesionIndex {
 
         void rebuild(ECMBoundaryState const & ecm_boundary);
 
+        void update(
+                ECMBoundaryState const & ecm_boundary,
+                ECMBoundaryChanges const & changes);
+
         static CellECMInteractions get_cell_ecm_interactions_return_value;
 
         CellECMInteractions get_cell_ecm_interactions() const;
 
+        void take_cell_ecm_interactions(CellECMInteractions & interactions);
+
         void reset_cell_ecm_interactions();
 };
 
@@ -6,8 +6,8 @@ class MockParameter {
         double adhesion_zone_radius;
         int num_adhesions;
 
-        char const * adhesion_extension_mechanism;
-        char const * adhesion_displacement_selection;
+        char const * adhesion_extension_mechanism = "sticky";
+        char const * adhesion_displacement_selection = "uniform";
         int adhesion_annihilation_penalty;
         int adhesions_per_pixel_overflow;
         int adhesions_per_pixel_overflow_penalty;
@@ -6,6 +6,7 @@
 #include "adhesion_creation.cpp"
 #include "random.cpp"
 #include "vec2.cpp"
+#include "worker_pool.cpp"
 
 // And add the mock implementations
 #include "mock_ca.cpp"
@@ -19,6 +20,8 @@
 #include "mock_ca.hpp"
 #include "mock_parameter.hpp"
 
+#include <algorithm>
+#include <random>
 #include <vector>
 
 
@@ -29,6 +32,7 @@ using Catch::Matchers::UnorderedRangeEquals;
 
 TEST_CASE("Test adhesion zone basic", "[adhesion_creation]") {
     MockCellularPotts mock_ca;
+    WorkerPool workers(1);
 
     par.sizex = 5;
     par.sizey = 5;
@@ -47,7 +51,7 @@ TEST_CASE("Test adhesion zone basic", "[adhesion_creation]") {
         std::vector<PixelPos> expected = {
             {1, 3}, {0, 2}, {2, 2}, {1, 1}};
 
-        auto zone = adhesion_zone(mock_ca);
+        auto zone = adhesion_zone(mock_ca, workers);
         CHECK_THAT(zone, UnorderedRangeEquals(expected));
     }
 
@@ -57,13 +61,14 @@ TEST_CASE("Test adhesion zone basic", "[adhesion_creation]") {
         std::vector<PixelPos> expected = {
             {1, 3}, {0, 2}, {1, 2}, {2, 2}, {1, 1}};
 
-        auto zone = adhesion_zone(mock_ca);
+        auto zone = adhesion_zone(mock_ca, workers);
         CHECK_THAT(zone, UnorderedRangeEquals(expected));
     }
 }
 
 TEST_CASE("Test adhesion zone with more cells", "[adhesion_creation]") {
     MockCellularPotts mock_ca;
+    WorkerPool workers(1);
 
     par.sizex = 5;
     par.sizey = 5;
@@ -84,7 +89,7 @@ TEST_CASE("Test adhesion zone with more cells", "[adhesion_creation]") {
             {0, 2}, {2, 2}, {3, 2},
             {1, 1}, {2, 1}, {3, 1}};
 
-        auto zone = adhesion_zone(mock_ca);
+        auto zone = adhesion_zone(mock_ca, workers);
         CHECK_THAT(zone, UnorderedRangeEquals(expected));
     }
 
@@ -96,7 +101,7 @@ TEST_CASE("Test adhesion zone with more cells", "[adhesion_creation]") {
             {0, 2}, {1, 2}, {2, 2}, {3, 2},
             {1, 1}, {2, 1}, {3, 1}};
 
-        auto zone = adhesion_zone(mock_ca);
+        auto zone = adhesion_zone(mock_ca, workers);
         CHECK_THAT(zone, UnorderedRangeEquals(expected));
     }
 
@@ -104,6 +109,7 @@ TEST_CASE("Test adhesion zone with more cells", "[adhesion_creation]") {
 
 TEST_CASE("Test adhesion zone at edge", "[adhesion_creation]") {
     MockCellularPotts mock_ca;
+    WorkerPool workers(1);
 
     par.sizex = 5;
     par.sizey = 5;
@@ -124,7 +130,7 @@ TEST_CASE("Test adhesion zone at edge", "[adhesion_creation]") {
             {0, 2}, {2, 2}, {3, 2}, {4, 2},
             {1, 1}, {2, 1}, {2, 0}};
 
-        auto zone = adhesion_zone(mock_ca);
+        auto zone = adhesion_zone(mock_ca, workers);
         CHECK_THAT(zone, UnorderedRangeEquals(expected));
     }
 
@@ -138,8 +144,66 @@ TEST_CASE("Test adhesion zone at edge", "[adhesion_creation]") {
             {1, 1}, {2, 1}, {3, 1}, {4, 1},
             {2, 0}, {3, 0}};
 
-        auto zone = adhesion_zone(mock_ca);
+        auto zone = adhesion_zone(mock_ca, workers);
         CHECK_THAT(zone, UnorderedRangeEquals(expected));
     }
 }
 
+
+TEST_CASE("Test adhesion zone against brute force", "[adhesion_creation]") {
+    MockCellularPotts mock_ca;
+    WorkerPool workers(1);
+
+    par.sizex = 40;
+    par.sizey = 30;
+
+    // Overlapping rectangles of cells, so that there are concave and
+    // disconnected cells, some of them touching the edge of the lattice
+    std::default_random_engine generator(12);
+    std::uniform_int_distribution<int> xdist(-5, par.sizex + 5);
+    std::uniform_int_distribution<int> ydist(-5, par.sizey + 5);
+    std::uniform_int_distribution<int> cdist(0, 6);
+
+    for (int y = 0; y < par.sizey; ++y)
+        for (int x = 0; x < par.sizex; ++x)
+            mock_ca.sigma_return_values[{x, y}] = 0;
+
+    for (int i = 0; i < 20; ++i) {
+        auto [x0, x1] = std::minmax(xdist(generator), xdist(generator));
+        auto [y0, y1] = std::minmax(ydist(generator), ydist(generator));
+        int cell = cdist(generator);
+        for (int y = std::max(y0, 0); y < std::min(y1, par.sizey); ++y)
+            for (int x = std::max(x0, 0); x < std::min(x1, par.sizex); ++x)
+                mock_ca.sigma_return_values[{x, y}] = cell;
+    }
+
+    for (double radius : {0.5, 1.0, 1.5, 2.0, 2.9, 4.0, 7.5, 50.0}) {
+        par.adhesion_zone_radius = radius;
+
+        std::vector<PixelPos> expected;
+        for (int y = 0; y < par.sizey; ++y) {
+            for (int x = 0; x < par.sizex; ++x) {
+                int cell = mock_ca.Sigma(x, y);
+                if (cell <= 0)
+                    continue;
+
+                bool in_zone = false;
+                for (int ny = 0; ny < par.sizey; ++ny)
+                    for (int nx = 0; nx < par.sizex; ++nx)
+                        if (sqr(nx - x) + sqr(ny - y) <= sqr(radius) &&
+                                mock_ca.Sigma(nx, ny) != cell)
+                            in_zone = true;
+
+                if (in_zone)
+                    expected.emplace_back(x, y);
+            }
+        }
+
+        // The cells are divided over the threads in chunks
+        for (int threads : {1, 3}) {
+            WorkerPool workers(threads);
+            auto zone = adhesion_zone(mock_ca, workers);
+            CHECK(zone == expected);
+        }
+    }
+}
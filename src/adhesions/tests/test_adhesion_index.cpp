@@ -7,8 +7,11 @@
 
 
 // Dependencies for the test itself
+#include <algorithm>
 #include <random>
+#include <string>
 
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <catch2/matchers/catch_matchers_range_equals.hpp>
@@ -22,12 +25,28 @@ using Catch::Matchers::WithinULP;
 constexpr double degrees = 3.14159265358979323846 / 180.0;
 
 
-// Helper function that accesses private member variable
-std::unordered_map<
-    PixelPos, std::vector<AdhesionWithEnvironment>
-    > const &
+// Helper function that collects the adhesions of each occupied pixel from
+// the private lists in the index
+std::unordered_map<PixelPos, std::vector<AdhesionWithEnvironment>>
 adhesions_by_pixel(AdhesionIndex const & index) {
-    return index.adhesions_by_pixel_;
+    std::unordered_map<PixelPos, std::vector<AdhesionWithEnvironment>> result;
+
+    auto collect = [&](PixelPos pixel) {
+        auto adhesions = index.get_adhesions(pixel);
+        if (!adhesions.empty())
+            result[pixel].assign(adhesions.begin(), adhesions.end());
+    };
+
+    for (std::uint32_t dx = 0u; dx < index.grid_width_; ++dx)
+        for (std::uint32_t dy = 0u; dy < index.grid_height_; ++dy)
+            collect(PixelPos(
+                        index.grid_origin_.x + static_cast<int>(dx),
+                        index.grid_origin_.y + static_cast<int>(dy)));
+
+    for (auto const & pixel_list : index.outside_grid_)
+        collect(pixel_list.first);
+
+    return result;
 }
 
 
@@ -198,19 +217,143 @@ TEST_CASE("Calculate Delta-H for an AdhesionWithEnvironment", "[adhesion_index]"
 }
 
 
+TEST_CASE("Cache Delta-H for an AdhesionWithEnvironment", "[adhesion_index]") {
+    AdhesionWithEnvironment a(0, {2.3, 2.6});
+    a.bonds.emplace_back(ParPos(3.0, 2.0), BondType(1.0, 2.0));
+    a.angle_csts.emplace_back(
+            ParPos(3.0, 2.0), ParPos(4.0, 2.5), AngleCstType(170.0 * degrees, 0.5));
+
+    // twice, to get the calculated and the remembered values
+    for (int i = 0; i < 2; ++i)
+        for (int dx = -2; dx <= 2; ++dx)
+            for (int dy = -2; dy <= 2; ++dy)
+                REQUIRE(a.cached_move_dh({dx, dy}) == a.move_dh({dx, dy}));
+
+    double before = a.cached_move_dh({1, 0});
+    a.bonds.emplace_back(ParPos(1.0, 2.0), BondType(1.0, 2.0));
+    a.clear_dh_cache();
+    CHECK(a.cached_move_dh({1, 0}) == a.move_dh({1, 0}));
+    CHECK(a.cached_move_dh({1, 0}) != before);
+}
+
+
+TEST_CASE("Adhesion index clears cached Delta-H", "[adhesion_index]") {
+    ECMBoundaryState ecm_boundary;
+    ecm_boundary.bond_types[0] = BondType(1.0, 2.0);
+    ecm_boundary.particles.set(Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(1, ParPos{4.0, 4.0}, ParticleType::free));
+    ecm_boundary.bonds.set(0, Bond(0, 1, 0));
+
+    AdhesionIndex index;
+    index.update(ecm_boundary, ecm_boundary_changes(ECMBoundaryState(), ecm_boundary));
+    auto const & awe = index.get_adhesions({2, 4})[0];
+    double dh = awe.cached_move_dh({1, 0});
+    CHECK(dh == awe.move_dh({1, 0}));
+
+    // moving changes the position
+    index.move_adhesions({2, 4}, {3, 4});
+    auto const & moved = index.get_adhesions({3, 4})[0];
+    CHECK(moved.cached_move_dh({1, 0}) == moved.move_dh({1, 0}));
+    CHECK(moved.cached_move_dh({1, 0}) != dh);
+    dh = moved.cached_move_dh({1, 0});
+
+    // an update changes the environment
+    ECMBoundaryState changed = ecm_boundary;
+    changed.particles.set_pos(1, ParPos{5.0, 3.0});
+    index.update(changed, ecm_boundary_changes(ecm_boundary, changed));
+    auto const & updated = index.get_adhesions({3, 4})[0];
+    CHECK(updated.cached_move_dh({1, 0}) == updated.move_dh({1, 0}));
+    CHECK(updated.cached_move_dh({1, 0}) != dh);
+}
+
+
+/* Microbenchmark of the Delta-H calculation for the copy attempts, run with
+ *
+ * ./build/test_adhesion_index "[benchmark]"
+ *
+ * A pixel with three adhesions is evaluated for all 9 displacements, as
+ * select_displacement_gradient() does, for adhesions with one bond, with two
+ * bonds and an angle constraint as in a fiber, and with four bonds and two
+ * angle constraints where fibers cross.
+ */
+TEST_CASE("Benchmark Delta-H for adhesions", "[.][benchmark][adhesion_index]") {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> offset(-2.0, 2.0);
+
+    auto make_adhesions = [&](int num_bonds, int num_angle_csts) {
+        std::vector<AdhesionWithEnvironment> adhesions;
+        for (int i = 0; i < 3; ++i) {
+            ParPos pos(10.0 + offset(rng) / 4.0 , 10.0 + offset(rng) / 4.0);
+            adhesions.emplace_back(i, pos);
+            std::vector<ParPos> neighbours;
+            for (int b = 0; b < num_bonds; ++b) {
+                neighbours.push_back(pos + ParDisplacement(offset(rng), offset(rng)));
+                adhesions.back().bonds.emplace_back(
+                        neighbours.back(), BondType(1.5, 2.0));
+            }
+            for (int a = 0; a < num_angle_csts; ++a)
+                adhesions.back().angle_csts.emplace_back(
+                        neighbours[a], neighbours[a] + ParDisplacement(offset(rng), offset(rng)),
+                        AngleCstType(170.0 * degrees, 0.5));
+        }
+        return adhesions;
+    };
+
+    std::vector<PixelDisplacement> displacements;
+    for (int dx = -1; dx <= 1; ++dx)
+        for (int dy = -1; dy <= 1; ++dy)
+            displacements.emplace_back(dx, dy);
+
+    for (auto counts: {std::make_pair(1, 0), std::make_pair(2, 1), std::make_pair(4, 2)}) {
+        auto adhesions = make_adhesions(counts.first, counts.second);
+        std::string name =
+            std::to_string(counts.first) + " bonds, " +
+            std::to_string(counts.second) + " angle constraints";
+
+        BENCHMARK("move_dh, " + name) {
+            double dh = 0.0;
+            for (auto const & d: displacements)
+                for (auto const & awe: adhesions)
+                    dh += awe.move_dh(d);
+            return dh;
+        };
+
+        BENCHMARK("cached_move_dh, " + name) {
+            double dh = 0.0;
+            for (auto const & d: displacements)
+                for (auto const & awe: adhesions)
+                    dh += awe.cached_move_dh(d);
+            return dh;
+        };
+
+        BENCHMARK("cached_move_dh after clearing, " + name) {
+            double dh = 0.0;
+            for (auto & awe: adhesions)
+                awe.clear_dh_cache();
+            for (auto const & d: displacements)
+                for (auto const & awe: adhesions)
+                    dh += awe.cached_move_dh(d);
+            return dh;
+        };
+    }
+}
+
+
 TEST_CASE("Build Adhesionindex", "[adhesion_index]") {
     ECMBoundaryState ecm_boundary;
     AdhesionIndex index;
-    auto const & abp = adhesions_by_pixel(index);
+    auto abp = adhesions_by_pixel(index);
 
     // Check build without adhesions
-    ecm_boundary.particles[0] = Particle(0, ParPos{1.2, 1.3}, ParticleType::free);
+    ecm_boundary.particles.set(Particle(0, ParPos{1.2, 1.3}, ParticleType::free));
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
     CHECK(adhesions_by_pixel(index).empty());
 
     // Check a single adhesion without bonds
-    ecm_boundary.particles[1] = Particle(1, ParPos{2.3, 4.5}, ParticleType::adhesion);
+    ecm_boundary.particles.set(Particle(1, ParPos{2.3, 4.5}, ParticleType::adhesion));
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
 
     REQUIRE(abp.size() == 1u);
     REQUIRE(abp.count({2, 4}) == 1u);
@@ -223,8 +366,9 @@ TEST_CASE("Build Adhesionindex", "[adhesion_index]") {
 
     // Add a bond
     ecm_boundary.bond_types[0] = BondType(1.5, 5.0);
-    ecm_boundary.bonds[0] = Bond(0, 1, 0);
+    ecm_boundary.bonds.set(0, Bond(0, 1, 0));
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
     REQUIRE(abp.size() == 1u);
     REQUIRE(abp.count({2, 4}) == 1u);
     REQUIRE(abp.at({2, 4}).size() == 1u);
@@ -239,8 +383,9 @@ TEST_CASE("Build Adhesionindex", "[adhesion_index]") {
     CHECK(awe.bonds.at(0).bond_type.k == 5.0);
 
     // Check that bonds with other adhesion particles are ignored
-    ecm_boundary.particles[0].type = ParticleType::adhesion;
+    ecm_boundary.particles.set_type(0, ParticleType::adhesion);
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
 
     REQUIRE(abp.size() == 2u);
 
@@ -261,8 +406,9 @@ TEST_CASE("Build Adhesionindex", "[adhesion_index]") {
     CHECK(awe.angle_csts.empty());
 
     // Check that bonds with excluded particles are ignored
-    ecm_boundary.particles[0].type = ParticleType::excluded;
+    ecm_boundary.particles.set_type(0, ParticleType::excluded);
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
     REQUIRE(abp.size() == 1u);
 
     REQUIRE(abp.count({2, 4}) == 1u);
@@ -274,12 +420,13 @@ TEST_CASE("Build Adhesionindex", "[adhesion_index]") {
     CHECK(awe.angle_csts.empty());
 
     // Restore first and add a second bond
-    ecm_boundary.particles[0].type = ParticleType::free;
-    ecm_boundary.particles[2] = Particle(2, ParPos{3.3, 1.5}, ParticleType::free);
+    ecm_boundary.particles.set_type(0, ParticleType::free);
+    ecm_boundary.particles.set(Particle(2, ParPos{3.3, 1.5}, ParticleType::free));
     ecm_boundary.bond_types[1] = BondType(1.7, 3.0);
-    ecm_boundary.bonds[1] = Bond(2, 1, 1);
+    ecm_boundary.bonds.set(1, Bond(2, 1, 1));
 
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
 
     REQUIRE(abp.size() == 1u);
 
@@ -300,11 +447,12 @@ TEST_CASE("Build Adhesionindex", "[adhesion_index]") {
     CHECK(awe.angle_csts.empty());
 
     // Add an angle constraint
-    ecm_boundary.particles[3] = Particle(3, ParPos{4.1, 0.3}, ParticleType::free);
+    ecm_boundary.particles.set(Particle(3, ParPos{4.1, 0.3}, ParticleType::free));
     ecm_boundary.angle_cst_types[0] = AngleCstType(3.141593, 6.7);
-    ecm_boundary.angle_csts[0] = AngleCst(1, 2, 3, 0);
+    ecm_boundary.angle_csts.set(0, AngleCst(1, 2, 3, 0));
 
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
 
     REQUIRE(abp.size() == 1u);
     REQUIRE(abp.count({2, 4}) == 1u);
@@ -319,8 +467,9 @@ TEST_CASE("Build Adhesionindex", "[adhesion_index]") {
     CHECK(cst.angle_cst_type.k == 6.7);
 
     // Check multiple adhesions in the same pixel
-    ecm_boundary.particles[4] = Particle(4, ParPos{2.7, 4.1}, ParticleType::adhesion);
+    ecm_boundary.particles.set(Particle(4, ParPos{2.7, 4.1}, ParticleType::adhesion));
     index.rebuild(ecm_boundary);
+    abp = adhesions_by_pixel(index);
 
     REQUIRE(abp.size() == 1u);
     REQUIRE(abp.count({2, 4}) == 1u);
@@ -356,7 +505,7 @@ TEST_CASE("Get adhesions for a given pixel", "[adhesion_index]") {
     CHECK(index.get_adhesions({123, 76}).empty());
 
     ECMBoundaryState ecm_boundary;
-    ecm_boundary.particles[0] = Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion);
+    ecm_boundary.particles.set(Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion));
     AdhesionIndex index2;
     index2.rebuild(ecm_boundary);
 
@@ -372,10 +521,10 @@ TEST_CASE("Move adhesions from one pixel to another", "[adhesion_index]") {
     AdhesionIndex index;
 
     ECMBoundaryState ecm_boundary;
-    ecm_boundary.particles[0] = Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion);
-    ecm_boundary.particles[1] = Particle(1, ParPos{2.2, 4.3}, ParticleType::adhesion);
-    ecm_boundary.particles[2] = Particle(2, ParPos{3.3, 4.0}, ParticleType::adhesion);
-    ecm_boundary.particles[3] = Particle(3, ParPos{3.8, 4.2}, ParticleType::adhesion);
+    ecm_boundary.particles.set(Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(1, ParPos{2.2, 4.3}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(2, ParPos{3.3, 4.0}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(3, ParPos{3.8, 4.2}, ParticleType::adhesion));
     index.rebuild(ecm_boundary);
 
     index.move_adhesions({2, 4}, {3, 4});
@@ -433,13 +582,182 @@ TEST_CASE("Move adhesions from one pixel to another", "[adhesion_index]") {
 }
 
 
+TEST_CASE("Move adhesions outside of the indexed area", "[adhesion_index]") {
+    AdhesionIndex index;
+
+    ECMBoundaryState ecm_boundary;
+    ecm_boundary.particles.set(Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(1, ParPos{2.2, 4.3}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(2, ParPos{3.3, 4.0}, ParticleType::adhesion));
+    index.rebuild(ecm_boundary);
+
+    // far away from any adhesion, so not in the grid
+    index.move_adhesions({2, 4}, {1000, -1000});
+    CHECK(index.get_adhesions({2, 4}).empty());
+    REQUIRE(index.get_adhesions({1000, -1000}).size() == 2u);
+    for (auto const & adh: index.get_adhesions({1000, -1000})) {
+        CHECK(adh.position.x >= 1000.0);
+        CHECK(adh.position.x < 1001.0);
+        CHECK(adh.position.y >= -1000.0);
+        CHECK(adh.position.y < -999.0);
+    }
+
+    // moved adhesions go after the ones already there
+    index.move_adhesions({1000, -1000}, {3, 4});
+    CHECK(index.get_adhesions({1000, -1000}).empty());
+    auto adhesions = index.get_adhesions({3, 4});
+    REQUIRE(adhesions.size() == 3u);
+    CHECK(adhesions[0].par_id == 2);
+    CHECK(adhesions[1].par_id + adhesions[2].par_id == 1);
+
+    // rebuilding keeps the moved adhesions where they are now, and finds
+    // new ones far away
+    ecm_boundary.particles.set(Particle(3, ParPos{5000.5, 5000.5}, ParticleType::adhesion));
+    index.rebuild(ecm_boundary);
+    CHECK(index.get_adhesions({2, 4}).empty());
+    CHECK(index.get_adhesions({3, 4}).size() == 3u);
+    CHECK(index.get_adhesions({5000, 5000}).size() == 1u);
+    CHECK(adhesions_by_pixel(index).size() == 2u);
+}
+
+
+// Helper that checks that two indexes contain the same adhesions
+void check_same_adhesions(AdhesionIndex const & index, AdhesionIndex const & ref) {
+    auto abp = adhesions_by_pixel(index);
+    auto ref_abp = adhesions_by_pixel(ref);
+    REQUIRE(abp.size() == ref_abp.size());
+
+    for (auto const & pixel_awes : ref_abp) {
+        REQUIRE(abp.count(pixel_awes.first) == 1u);
+        auto awes = abp.at(pixel_awes.first);
+        auto ref_awes = pixel_awes.second;
+        REQUIRE(awes.size() == ref_awes.size());
+
+        // the order may differ, and so may the order of the constraints
+        auto by_id = [](AdhesionWithEnvironment const & a, AdhesionWithEnvironment const & b) {
+            return a.par_id < b.par_id;
+        };
+        std::sort(awes.begin(), awes.end(), by_id);
+        std::sort(ref_awes.begin(), ref_awes.end(), by_id);
+
+        for (std::size_t i = 0u; i < awes.size(); ++i) {
+            CHECK(awes[i].par_id == ref_awes[i].par_id);
+            CHECK(awes[i].position == ref_awes[i].position);
+            CHECK(awes[i].bonds.size() == ref_awes[i].bonds.size());
+            CHECK(awes[i].angle_csts.size() == ref_awes[i].angle_csts.size());
+            for (PixelDisplacement move: {PixelDisplacement{1, 0}, PixelDisplacement{-1, 1}})
+                CHECK_THAT(
+                        awes[i].move_dh(move),
+                        WithinRel(ref_awes[i].move_dh(move), 1e-12));
+        }
+    }
+}
+
+
+TEST_CASE("Update adhesion index incrementally", "[adhesion_index]") {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> coord(0.0, 40.0);
+
+    // adhesions 3i, each bonded to 3i + 1 and via that to 3i + 2
+    int const n = 200;
+    ECMBoundaryState before;
+    before.bond_types[0] = BondType(2.0, 1.0);
+    before.angle_cst_types[0] = AngleCstType(3.0, 0.5);
+    for (int i = 0; i < n; ++i) {
+        before.particles.set(Particle(3 * i, ParPos{coord(rng), coord(rng)}, ParticleType::adhesion));
+        before.particles.set(Particle(3 * i + 1, ParPos{coord(rng), coord(rng)}, ParticleType::free));
+        before.particles.set(Particle(3 * i + 2, ParPos{coord(rng), coord(rng)}, ParticleType::free));
+        before.bonds.set(2 * i, Bond(3 * i, 3 * i + 1, 0));
+        before.bonds.set(2 * i + 1, Bond(3 * i + 1, 3 * i + 2, 0));
+        before.angle_csts.set(i, AngleCst(3 * i, 3 * i + 1, 3 * i + 2, 0));
+    }
+
+    // the first update rebuilds, since everything changed
+    AdhesionIndex index;
+    index.update(before, ecm_boundary_changes(ECMBoundaryState(), before));
+
+    ECMBoundaryState after = before;
+    // moved neighbours
+    after.particles.set_pos(1, ParPos{1.5, 2.5});
+    after.particles.set_pos(5, ParPos{3.5, 4.5});
+    // unfit neighbour
+    after.particles.set_type(7, ParticleType::excluded);
+    // removed adhesion
+    after.particles.set_type(9, ParticleType::free);
+    // new adhesion, bonded to another adhesion now
+    after.particles.set_type(14, ParticleType::adhesion);
+    // adhesion moved by the ECM, which we ignore
+    after.particles.set_pos(15, ParPos{20.5, 20.5});
+    // new adhesion particle with a new bond
+    after.particles.set(Particle(1000, ParPos{10.5, 10.5}, ParticleType::adhesion));
+    after.bonds.set(1000, Bond(1000, 16, 0));
+    // changed and removed constraints
+    after.bonds.set(20, Bond(30, 4, 0));
+    after.bonds.erase(22);
+    after.angle_csts.erase(12);
+    after.angle_csts.set(1000, AngleCst(1000, 16, 17, 0));
+
+    SECTION("matches a rebuild") {
+        index.update(after, ecm_boundary_changes(before, after));
+
+        AdhesionIndex ref;
+        ref.rebuild(before);
+        ref.rebuild(after);
+
+        check_same_adhesions(index, ref);
+
+        // and keeps doing so
+        ECMBoundaryState again = after;
+        again.particles.set_type(9, ParticleType::adhesion);
+        again.particles.set_type(1000, ParticleType::free);
+        again.particles.set_pos(4, ParPos{5.5, 5.5});
+        index.update(again, ecm_boundary_changes(after, again));
+        ref.rebuild(again);
+
+        check_same_adhesions(index, ref);
+    }
+
+    SECTION("falls back to a rebuild for many changes") {
+        for (int i = 0; i < n; ++i)
+            after.particles.set_pos(
+                    3 * i + 1,
+                    after.particles.at(3 * i + 1).pos + ParDisplacement{0.25, 0.25});
+        index.update(after, ecm_boundary_changes(before, after));
+
+        AdhesionIndex ref;
+        ref.rebuild(before);
+        ref.rebuild(after);
+
+        check_same_adhesions(index, ref);
+    }
+
+    SECTION("keeps removed adhesions removed") {
+        ParPos pos = before.particles.at(0).pos;
+        PixelPos pixel(floor(pos.x), floor(pos.y));
+        index.remove_adhesions(pixel);
+        index.update(before, ECMBoundaryChanges());
+        CHECK(index.get_adhesions(pixel).empty());
+    }
+
+    SECTION("rebuilds if the whole state was replaced") {
+        ParPos pos = before.particles.at(0).pos;
+        PixelPos pixel(floor(pos.x), floor(pos.y));
+        index.remove_adhesions(pixel);
+        ECMBoundaryChanges changes;
+        changes.everything = true;
+        index.update(before, changes);
+        CHECK(!index.get_adhesions(pixel).empty());
+    }
+}
+
+
 TEST_CASE("Remove adhesions from a pixel", "[adhesion_index]") {
     AdhesionIndex index;
 
     ECMBoundaryState ecm_boundary;
-    ecm_boundary.particles[0] = Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion);
-    ecm_boundary.particles[1] = Particle(1, ParPos{2.2, 4.3}, ParticleType::adhesion);
-    ecm_boundary.particles[2] = Particle(2, ParPos{3.3, 4.0}, ParticleType::adhesion);
+    ecm_boundary.particles.set(Particle(0, ParPos{2.3, 4.8}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(1, ParPos{2.2, 4.3}, ParticleType::adhesion));
+    ecm_boundary.particles.set(Particle(2, ParPos{3.3, 4.0}, ParticleType::adhesion));
     index.rebuild(ecm_boundary);
 
     index.remove_adhesions({2, 4});
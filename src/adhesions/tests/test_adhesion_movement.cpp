@@ -129,7 +129,6 @@ TEST_CASE("Test extension_displacements_all", "[adhesion_movement]") {
 TEST_CASE("Test extension_displacements", "[adhesion_movement]") {
     MockCellularPotts mock_ca;
 
-    par.adhesion_extension_mechanism = "random";
     mock_ca.sigma_return_values = {
             {{4, 6}, 1}, {{5, 6}, 1}, {{6, 6}, 1},
             {{4, 5}, 1}, {{5, 5}, 1}, {{6, 5}, 0},
@@ -140,26 +139,62 @@ TEST_CASE("Test extension_displacements", "[adhesion_movement]") {
             {-1, 0}, {0, 0}, {1, 0},
             {-1,-1}, {0,-1}, {1,-1}};
 
-    auto displacements = extension_displacements(mock_ca, {5, 5}, {6, 5});
+    auto displacements = extension_displacements<ExtensionMechanism::random>(
+            mock_ca, {5, 5}, {6, 5});
     CHECK_THAT(displacements, UnorderedRangeEquals(expected));
 
-    par.adhesion_extension_mechanism = "lazy";
     expected = {{0, 0}};
-    displacements = extension_displacements(mock_ca, {5, 5}, {6, 5});
+    displacements = extension_displacements<ExtensionMechanism::lazy>(
+            mock_ca, {5, 5}, {6, 5});
     CHECK_THAT(displacements, UnorderedRangeEquals(expected));
 
-    par.adhesion_extension_mechanism = "mixed";
     expected = {{0, 0}, {1, 0}};
-    displacements = extension_displacements(mock_ca, {5, 5}, {6, 5});
+    displacements = extension_displacements<ExtensionMechanism::mixed>(
+            mock_ca, {5, 5}, {6, 5});
     CHECK_THAT(displacements, UnorderedRangeEquals(expected));
 
-    par.adhesion_extension_mechanism = "sticky";
     expected = {{1, 0}};
-    displacements = extension_displacements(mock_ca, {5, 5}, {6, 5});
+    displacements = extension_displacements<ExtensionMechanism::sticky>(
+            mock_ca, {5, 5}, {6, 5});
     CHECK_THAT(displacements, UnorderedRangeEquals(expected));
 }
 
 
+TEST_CASE("Parse adhesion movement parameters", "[adhesion_movement]") {
+    CHECK(parse_extension_mechanism("lazy") == ExtensionMechanism::lazy);
+    CHECK(parse_extension_mechanism("sticky") == ExtensionMechanism::sticky);
+    CHECK(parse_extension_mechanism("mixed") == ExtensionMechanism::mixed);
+    CHECK(parse_extension_mechanism("random") == ExtensionMechanism::random);
+    CHECK_THROWS_AS(parse_extension_mechanism("any"), std::runtime_error);
+
+    CHECK(parse_displacement_selection("uniform") ==
+          DisplacementSelection::uniform);
+    CHECK(parse_displacement_selection("gradient") ==
+          DisplacementSelection::gradient);
+    CHECK_THROWS_AS(parse_displacement_selection("Gradient"),
+                    std::runtime_error);
+}
+
+
+TEST_CASE("DisplacementList", "[adhesion_movement]") {
+    DisplacementList displacements;
+    CHECK(displacements.empty());
+
+    for (int x = -1; x <= 1; ++x)
+        for (int y = -1; y <= 1; ++y)
+            displacements.emplace_back(x, y);
+
+    REQUIRE(displacements.size() == DisplacementList::capacity);
+    CHECK(displacements[0] == PixelDisplacement{-1, -1});
+    CHECK(displacements[4] == PixelDisplacement{0, 0});
+    CHECK(*(displacements.end() - 1) == PixelDisplacement{1, 1});
+
+    DisplacementList two = {{0, 0}, {1, 0}};
+    CHECK(two.size() == 2u);
+    CHECK(two[1] == PixelDisplacement{1, 0});
+}
+
+
 TEST_CASE("Test select_displacement_gradient", "[adhesion_movement]") {
     MockAdhesionWithEnvironment a1(1, {5.2, 5.4});
     a1.move_dh_return_values[{-1, 0}] = 1.0;
@@ -78,7 +78,6 @@ TEST_CASE("Move no adhesions", "[adhesion_mover]") {
  */
 TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
     MockCellularPotts mock_ca;
-    AdhesionMover mover(mock_ca);
 
     // Note: keep this in sync with sigma below
     MockAdhesionWithEnvironment a1(1, {4.2, 5.4});
@@ -119,6 +118,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
     SECTION("lazy extension and gradient selection") {
         par.adhesion_extension_mechanism = "lazy";
         par.adhesion_displacement_selection = "gradient";
+        AdhesionMover mover(mock_ca);
 
         AdhesionDisplacements disps;
         double dh = mover.move_dh({4, 5}, {5, 5}, disps);
@@ -130,6 +130,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
     SECTION("sticky extension and gradient selection") {
         par.adhesion_extension_mechanism = "sticky";
         par.adhesion_displacement_selection = "gradient";
+        AdhesionMover mover(mock_ca);
 
         AdhesionDisplacements disps;
         double dh = mover.move_dh({4, 5}, {5, 5}, disps);
@@ -141,6 +142,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
     SECTION("mixed extension and gradient selection") {
         par.adhesion_extension_mechanism = "mixed";
         par.adhesion_displacement_selection = "gradient";
+        AdhesionMover mover(mock_ca);
 
         AdhesionDisplacements disps;
         double dh = mover.move_dh({4, 5}, {5, 5}, disps);
@@ -166,6 +168,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
          */
         par.adhesion_extension_mechanism = "random";
         par.adhesion_displacement_selection = "gradient";
+        AdhesionMover mover(mock_ca);
 
         AdhesionDisplacements disps;
         double dh = mover.move_dh({4, 5}, {5, 5}, disps);
@@ -177,6 +180,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
     SECTION("lazy extension and uniform selection") {
         par.adhesion_extension_mechanism = "lazy";
         par.adhesion_displacement_selection = "uniform";
+        AdhesionMover mover(mock_ca);
 
         std::vector<std::tuple<double, AdhesionDisplacements>> expected = {
             {5.0, AdhesionDisplacements({0, 0}, {0, -1})},
@@ -192,6 +196,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
     SECTION("sticky extension and uniform selection") {
         par.adhesion_extension_mechanism = "sticky";
         par.adhesion_displacement_selection = "uniform";
+        AdhesionMover mover(mock_ca);
 
         std::vector<std::tuple<double, AdhesionDisplacements>> expected = {
             {9.0, AdhesionDisplacements({1, 0}, {0, -1})},
@@ -207,6 +212,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
     SECTION("mixed extension and uniform selection") {
         par.adhesion_extension_mechanism = "mixed";
         par.adhesion_displacement_selection = "uniform";
+        AdhesionMover mover(mock_ca);
 
         std::vector<std::tuple<double, AdhesionDisplacements>> expected = {
             {5.0, AdhesionDisplacements({0, 0}, {0, -1})},
@@ -225,6 +231,7 @@ TEST_CASE("Move some adhesions in various ways", "[adhesion_mover]") {
         // This test is statistical, it should fail about once every 500 runs
         par.adhesion_extension_mechanism = "random";
         par.adhesion_displacement_selection = "uniform";
+        AdhesionMover mover(mock_ca);
 
         std::vector<std::tuple<double, AdhesionDisplacements>> expected = {
             {1.0, AdhesionDisplacements({-1, 1}, {0, -1})},
@@ -2,6 +2,11 @@
 
 #include "ecm_boundary_state.cpp"
 
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
 /** There's not much to test here, since this file just defines some data
  * structures. But we can play with them a bit and see if things compile at
  * least.
@@ -11,30 +16,164 @@
 TEST_CASE( "ECM boundary can be created and populated", "[ecm]" ) {
     ECMBoundaryState ecm_boundary;
 
-    ecm_boundary.particles = {
-        {0, Particle(0, ParPos(1.0, 1.0), ParticleType::boundary)},
-        {1, Particle(1, ParPos(2.0, 2.0), ParticleType::free)},
-        {2, Particle(2, ParPos(3.0, 3.0), ParticleType::adhesion)}
-    };
+    ecm_boundary.particles.set(Particle(0, ParPos(1.0, 1.0), ParticleType::boundary));
+    ecm_boundary.particles.set(Particle(1, ParPos(2.0, 2.0), ParticleType::free));
+    ecm_boundary.particles.set(Particle(2, ParPos(3.0, 3.0), ParticleType::adhesion));
 
     ecm_boundary.bond_types[0].r0 = 1.0;
     ecm_boundary.bond_types[0].k = 1.0;
 
-    ecm_boundary.bonds = {
-        {0, {0, 1, 0}},
-        {1, {1, 2, 0}},
-        {2, {3, 4, 1}}
-    };
+    ecm_boundary.bonds.set(0, {0, 1, 0});
+    ecm_boundary.bonds.set(1, {1, 2, 0});
+    ecm_boundary.bonds.set(2, {3, 4, 1});
 
     ecm_boundary.angle_cst_types[0].t0 = 0.1;
     ecm_boundary.angle_cst_types[0].k = 2.0;
 
-    ecm_boundary.angle_csts = {
-        {0, {0, 1, 2, 0}}
-    };
+    ecm_boundary.angle_csts.set(0, {0, 1, 2, 0});
+
+    REQUIRE(ecm_boundary.particles.at(1).type == ParticleType::free);
+    REQUIRE(ecm_boundary.particles.at(ecm_boundary.bonds.at(0).p1).pos.x == 1.0);
+    REQUIRE(ecm_boundary.angle_cst_types[ecm_boundary.angle_csts.at(0).type].k == 2.0);
+}
+
+
+TEST_CASE( "ECM boundary tables index their items by id", "[ecm]" ) {
+    ECMParticles particles;
+    CHECK(particles.empty());
+    CHECK(particles.find(0) == ECMTable::npos);
+
+    // large and negative ids go into the hash table
+    for (ParId id : {3, 1, 1000000000, -5, 2})
+        particles.set(Particle(id, ParPos(id, 0.5), ParticleType::free));
+    REQUIRE(particles.size() == 5u);
+    for (ParId id : {3, 1, 1000000000, -5, 2}) {
+        std::size_t row = particles.find(id);
+        REQUIRE(row != ECMTable::npos);
+        CHECK(particles.id(row) == id);
+        CHECK(particles.pos(row) == ParPos(id, 0.5));
+    }
+    CHECK(!particles.contains(0));
+    CHECK_THROWS_AS(particles.at(0), std::out_of_range);
+
+    // replacing keeps the row
+    std::size_t row = particles.find(1);
+    particles.set(Particle(1, ParPos(7.0, 8.0), ParticleType::adhesion));
+    CHECK(particles.size() == 5u);
+    CHECK(particles.find(1) == row);
+    CHECK(particles.type(row) == ParticleType::adhesion);
+
+    particles.set_pos(1, ParPos(9.0, 8.0));
+    particles.set_type(1, ParticleType::boundary);
+    CHECK(particles.at(1).pos == ParPos(9.0, 8.0));
+    CHECK(particles.at(1).type == ParticleType::boundary);
+
+    // erasing moves the last one into the gap
+    particles.erase(3);
+    particles.erase(-5);
+    particles.erase(42);
+    REQUIRE(particles.size() == 3u);
+    CHECK(!particles.contains(3));
+    CHECK(!particles.contains(-5));
+    for (ParId id : {1, 1000000000, 2})
+        CHECK(particles.id(particles.find(id)) == id);
+    CHECK(particles.at(2).pos == ParPos(2.0, 0.5));
+
+    // growing the array part takes over ids from the hash table
+    ECMBonds bonds;
+    bonds.set(100000, Bond(0, 1, 0));
+    for (BondId id = 0; id < 10000; ++id)
+        bonds.set(id, Bond(id, id + 1, 1));
+    REQUIRE(bonds.size() == 10001u);
+    CHECK(bonds.at(100000).type == 0);
+    CHECK(bonds.at(9999).p2 == 10000);
+}
+
 
-    REQUIRE(ecm_boundary.particles[1].type == ParticleType::free);
-    REQUIRE(ecm_boundary.particles[ecm_boundary.bonds[0].p1].pos.x == 1.0);
-    REQUIRE(ecm_boundary.angle_cst_types[ecm_boundary.angle_csts[0].type].k == 2.0);
+TEST_CASE( "ECM boundary tables can use memory they don't own", "[ecm]" ) {
+    auto ids = std::make_shared<std::vector<std::int32_t>>(
+            std::vector<std::int32_t>{4, 5, 6});
+    auto groups = std::make_shared<std::vector<std::int32_t>>(
+            std::vector<std::int32_t>{0, 1, 2, 1, 2, 3, 2, 3, 4});
+    std::vector<std::int32_t> types = {0, 1, 0};
+
+    ECMAngleCsts angle_csts(
+            ECMColumn<std::int32_t>(ids->data(), ids->size(), ids),
+            ECMColumn<std::int32_t>(groups->data(), groups->size(), groups),
+            ECMColumn<std::int32_t>(types));
+
+    CHECK(angle_csts.ids().borrowed());
+    CHECK(angle_csts.ids().data() == ids->data());
+    CHECK(angle_csts.at(5).p1 == 1);
+    CHECK(angle_csts.at(5).p3 == 3);
+    CHECK(angle_csts.at(6).type == 0);
+
+    // copies share the memory, and modifying copies it first
+    ECMAngleCsts copy = angle_csts;
+    CHECK(copy.ids().data() == ids->data());
+    copy.erase(4);
+    CHECK(copy.size() == 2u);
+    CHECK(copy.at(6).p1 == 2);
+    CHECK(!copy.ids().borrowed());
+    CHECK((*ids)[0] == 4);
+    CHECK(angle_csts.at(4).p2 == 1);
+
+    // the columns keep the memory alive
+    ids.reset();
+    groups.reset();
+    CHECK(angle_csts.at(4).p1 == 0);
+    CHECK(angle_csts.at(6).p3 == 4);
+
+    // sizes must match and ids be unique
+    std::vector<std::int32_t> one = {1};
+    std::vector<std::int32_t> two = {1, 1};
+    CHECK_THROWS_AS(
+            ECMBonds(ECMColumn<std::int32_t>(two), ECMColumn<std::int32_t>(two),
+                     ECMColumn<std::int32_t>(one)),
+            std::runtime_error);
+    CHECK_THROWS_AS(
+            ECMParticles(ECMColumn<std::int32_t>(two),
+                         ECMColumn<double>({1.0, 2.0, 3.0, 4.0}),
+                         ECMColumn<std::int32_t>(two)),
+            std::runtime_error);
 }
 
+
+
+TEST_CASE( "Changes between ECM boundary states are found", "[ecm]" ) {
+    ECMBoundaryState before;
+    before.particles.set(Particle(0, ParPos(1.0, 1.0), ParticleType::boundary));
+    before.particles.set(Particle(1, ParPos(2.0, 2.0), ParticleType::free));
+    before.particles.set(Particle(2, ParPos(3.0, 3.0), ParticleType::adhesion));
+    before.particles.set(Particle(3, ParPos(4.0, 4.0), ParticleType::free));
+    before.bond_types[0] = BondType(1.0, 1.0);
+    before.bonds.set(0, {0, 1, 0});
+    before.bonds.set(1, {1, 2, 0});
+    before.angle_cst_types[0] = AngleCstType(0.1, 2.0);
+    before.angle_csts.set(0, {0, 1, 2, 0});
+
+    ECMBoundaryState after = before;
+    ECMBoundaryChanges changes = ecm_boundary_changes(before, after);
+    REQUIRE(changes.size() == 0u);
+    REQUIRE(!changes.types);
+
+    after.particles.set_pos(1, ParPos(2.5, 2.0));
+    after.particles.set_type(2, ParticleType::free);
+    after.particles.erase(3);
+    after.particles.set(Particle(4, ParPos(5.0, 5.0), ParticleType::free));
+    after.bonds.set(1, {1, 4, 0});
+    after.bonds.erase(0);
+    after.angle_csts.set(1, AngleCst(1, 2, 4, 0));
+
+    changes = ecm_boundary_changes(before, after);
+    std::sort(changes.particles.begin(), changes.particles.end());
+    std::sort(changes.bonds.begin(), changes.bonds.end());
+    REQUIRE(changes.particles == std::vector<ParId>{1, 2, 3, 4});
+    REQUIRE(changes.bonds == std::vector<BondId>{0, 1});
+    REQUIRE(changes.angle_csts == std::vector<AngleCstId>{1});
+    REQUIRE(changes.size() == 7u);
+    REQUIRE(!changes.types);
+
+    after.bond_types[0].k = 2.0;
+    REQUIRE(ecm_boundary_changes(before, after).types);
+}
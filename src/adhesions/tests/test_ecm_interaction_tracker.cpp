@@ -0,0 +1,83 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "cell_ecm_interactions.cpp"
+#include "ecm_interaction_tracker.cpp"
+#include "vec2.cpp"
+
+#include <vector>
+
+
+TEST_CASE("Record changes", "[ecm_interaction_tracker]") {
+    ECMInteractionTracker tracker;
+
+    tracker.record_new_particle({1.0, 2.0}, 0.5);
+    tracker.record_move_particle(3, {4.0, 5.0});
+    tracker.record_move_particle(1, {6.0, 7.0});
+    tracker.record_remove_particle(2);
+
+    auto changes = tracker.get_changes();
+    REQUIRE(changes.add_adhesion_particles.new_pos == std::vector<ParPos>{{1.0, 2.0}});
+    REQUIRE(changes.add_adhesion_particles.bond_attempt_radius == std::vector<double>{0.5});
+    REQUIRE(changes.move_adhesion_particles.par_id == std::vector<ParId>{3, 1});
+    REQUIRE(changes.move_adhesion_particles.new_pos == std::vector<ParPos>{{4.0, 5.0}, {6.0, 7.0}});
+    REQUIRE(changes.remove_adhesion_particles.par_id == std::vector<ParId>{2});
+
+    tracker.reset();
+    changes = tracker.get_changes();
+    REQUIRE(changes.add_adhesion_particles.new_pos.empty());
+    REQUIRE(changes.move_adhesion_particles.par_id.empty());
+    REQUIRE(changes.remove_adhesion_particles.par_id.empty());
+}
+
+
+TEST_CASE("Coalesce moves of the same particle", "[ecm_interaction_tracker]") {
+    ECMInteractionTracker tracker;
+
+    tracker.record_move_particle(7, {1.0, 1.0});
+    tracker.record_move_particle(2, {2.0, 2.0});
+    tracker.record_move_particle(7, {1.0, 2.0});
+    tracker.record_move_particle(7, {1.0, 3.0});
+
+    auto changes = tracker.get_changes();
+    REQUIRE(changes.move_adhesion_particles.par_id == std::vector<ParId>{7, 2});
+    REQUIRE(changes.move_adhesion_particles.new_pos == std::vector<ParPos>{{1.0, 3.0}, {2.0, 2.0}});
+
+    SECTION("but not across a reset") {
+        tracker.reset();
+        tracker.record_move_particle(2, {3.0, 3.0});
+        tracker.record_move_particle(7, {4.0, 4.0});
+
+        changes = tracker.get_changes();
+        REQUIRE(changes.move_adhesion_particles.par_id == std::vector<ParId>{2, 7});
+        REQUIRE(changes.move_adhesion_particles.new_pos == std::vector<ParPos>{{3.0, 3.0}, {4.0, 4.0}});
+    }
+}
+
+
+TEST_CASE("Take changes", "[ecm_interaction_tracker]") {
+    ECMInteractionTracker tracker;
+
+    tracker.record_move_particle(1, {1.0, 1.0});
+    tracker.record_remove_particle(4);
+
+    // a previously sent set, whose memory gets reused
+    CellECMInteractions changes;
+    changes.move_adhesion_particles.par_id = {5, 6, 7};
+    changes.move_adhesion_particles.new_pos = {{0.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}};
+    tracker.take_changes(changes);
+
+    REQUIRE(changes.move_adhesion_particles.par_id == std::vector<ParId>{1});
+    REQUIRE(changes.move_adhesion_particles.new_pos == std::vector<ParPos>{{1.0, 1.0}});
+    REQUIRE(changes.remove_adhesion_particles.par_id == std::vector<ParId>{4});
+
+    REQUIRE(tracker.get_changes().move_adhesion_particles.par_id.empty());
+    REQUIRE(tracker.get_changes().remove_adhesion_particles.par_id.empty());
+
+    tracker.record_move_particle(1, {2.0, 2.0});
+    tracker.record_move_particle(6, {3.0, 3.0});
+    tracker.take_changes(changes);
+
+    REQUIRE(changes.move_adhesion_particles.par_id == std::vector<ParId>{1, 6});
+    REQUIRE(changes.move_adhesion_particles.new_pos == std::vector<ParPos>{{2.0, 2.0}, {3.0, 3.0}});
+    REQUIRE(changes.remove_adhesion_particles.par_id.empty());
+}
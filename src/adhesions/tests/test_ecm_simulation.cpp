@@ -0,0 +1,373 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "cell_ecm_interactions.cpp"
+#include "ecm_boundary_state.cpp"
+#include "ecm_simulation.cpp"
+#include "worker_pool.cpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+using Catch::Matchers::WithinAbs;
+using Catch::Matchers::WithinRel;
+
+
+/* A strand of five particles, anchored at one end, with bonds between
+ * neighbours and angle constraints over each three consecutive particles.
+ */
+MDState make_strand() {
+    MDState state;
+    state.positions = {
+        {10.0, 10.0}, {12.5, 10.0}, {14.0, 11.5}, {16.5, 11.0}, {18.0, 13.0}};
+    state.types = {
+        ParticleType::boundary, ParticleType::free, ParticleType::free,
+        ParticleType::free, ParticleType::free};
+    state.bond_types = {BondType(2.0, 5.0)};
+    state.angle_cst_types = {AngleCstType(M_PI, 1.0)};
+    for (int i = 0; i < 4; ++i)
+        state.bonds.emplace_back(i, i + 1, 0);
+    for (int i = 0; i < 3; ++i)
+        state.angle_csts.emplace_back(i, i + 1, i + 2, 0);
+    return state;
+}
+
+
+ECMEvolutionParameters noiseless(int threads = 1) {
+    ECMEvolutionParameters par;
+    par.dt = 0.01;
+    par.its = 100;
+    par.kT = 0.0;
+    par.gamma = 1.0;
+    par.seed = 42u;
+    par.threads = threads;
+    return par;
+}
+
+
+TEST_CASE( "ECM simulation forces are minus the gradient of the energy", "[ecm_simulation]" ) {
+    MDState state = make_strand();
+    ECMSimulation sim(state, noiseless());
+    auto forces = sim.forces();
+
+    double h = 1e-6;
+    for (std::size_t i = 0u; i < state.positions.size(); ++i) {
+        for (int dim = 0; dim < 2; ++dim) {
+            MDState plus = state, minus = state;
+            (dim ? plus.positions[i].y : plus.positions[i].x) += h;
+            (dim ? minus.positions[i].y : minus.positions[i].x) -= h;
+            double gradient = (
+                    ECMSimulation(plus, noiseless()).energy() -
+                    ECMSimulation(minus, noiseless()).energy()) / (2.0 * h);
+            double force = dim ? forces[i].y : forces[i].x;
+            REQUIRE_THAT(force, WithinAbs(-gradient, 1e-6));
+        }
+    }
+}
+
+
+TEST_CASE( "ECM simulation relaxes a bond to its rest length", "[ecm_simulation]" ) {
+    MDState state;
+    state.positions = {{0.0, 0.0}, {3.0, 0.0}};
+    state.types = {ParticleType::boundary, ParticleType::free};
+    state.bond_types = {BondType(2.0, 4.0)};
+    state.bonds = {Bond(0, 1, 0)};
+
+    ECMEvolutionParameters par = noiseless();
+    ECMSimulation sim(state, par);
+    sim.run(50);
+
+    // explicit Euler steps of dx/dt = -k (x - r0) / gamma
+    double expected = 2.0 + std::pow(1.0 - 4.0 * par.dt / par.gamma, 50);
+    REQUIRE_THAT(sim.state().positions[1].x, WithinRel(expected, 1e-12));
+    REQUIRE(sim.state().positions[1].y == 0.0);
+    REQUIRE(sim.state().positions[0] == ParPos(0.0, 0.0));
+}
+
+
+TEST_CASE( "ECM simulation relaxes a strand", "[ecm_simulation]" ) {
+    ECMSimulation sim(make_strand(), noiseless());
+    double energy = sim.energy();
+    for (int i = 0; i < 10; ++i) {
+        sim.run();
+        REQUIRE(sim.energy() < energy);
+        energy = sim.energy();
+    }
+
+    auto const &pos = sim.state().positions;
+    REQUIRE(pos[0] == ParPos(10.0, 10.0));
+    for (int i = 0; i < 4; ++i)
+        REQUIRE_THAT((pos[i + 1] - pos[i]).length(), WithinAbs(2.0, 1e-3));
+}
+
+
+TEST_CASE( "ECM simulation box is periodic", "[ecm_simulation]" ) {
+    // the default box is [-125, 325) in both directions
+    MDState state;
+    state.positions = {{-124.0, 0.0}, {324.0, 0.0}, {330.0, -130.0}};
+    state.types = {ParticleType::boundary, ParticleType::free, ParticleType::boundary};
+    state.bond_types = {BondType(1.0, 4.0)};
+    state.bonds = {Bond(0, 1, 0)};
+
+    ECMEvolutionParameters par = noiseless();
+    ECMSimulation sim(state, par);
+    REQUIRE(sim.state().positions[2] == ParPos(-120.0, 320.0));
+    REQUIRE_THAT(sim.energy(), WithinRel(2.0, 1e-12));
+
+    // the bond pulls particle 1 across the edge of the box
+    sim.run(50);
+    double length = 1.0 + std::pow(1.0 - 4.0 * par.dt / par.gamma, 50);
+    REQUIRE_THAT(sim.state().positions[1].x, WithinRel(326.0 - length, 1e-12));
+    REQUIRE(sim.state().positions[1].x < 325.0);
+}
+
+
+TEST_CASE( "ECM simulation noise has the Brownian variance", "[ecm_simulation]" ) {
+    MDState state;
+    int n = 4000;
+    for (int i = 0; i < n; ++i) {
+        state.positions.emplace_back(0.0, 0.0);
+        state.types.push_back(ParticleType::free);
+    }
+
+    ECMEvolutionParameters par;
+    par.dt = 0.01;
+    par.kT = 0.5;
+    par.gamma = 2.0;
+    par.seed = 1234u;
+    par.threads = 2;
+    ECMSimulation sim(state, par);
+    sim.run(100);
+
+    double sum = 0.0, sum_sq = 0.0;
+    for (auto const &pos : sim.state().positions) {
+        sum += pos.x + pos.y;
+        sum_sq += pos.x * pos.x + pos.y * pos.y;
+    }
+    double mean = sum / (2 * n);
+    double variance = sum_sq / (2 * n) - mean * mean;
+
+    // <x^2> = 2 D t, with D = kT / gamma
+    double expected = 2.0 * par.kT / par.gamma * 100 * par.dt;
+    REQUIRE_THAT(mean, WithinAbs(0.0, 0.02));
+    REQUIRE_THAT(variance, WithinRel(expected, 0.05));
+}
+
+
+TEST_CASE( "ECM simulation results don't depend on the number of threads", "[ecm_simulation]" ) {
+    // a grid of strands with noise
+    MDState state;
+    state.bond_types = {BondType(1.0, 10.0)};
+    state.angle_cst_types = {AngleCstType(M_PI, 2.0)};
+    for (int s = 0; s < 50; ++s) {
+        int first = static_cast<int>(state.positions.size());
+        for (int b = 0; b < 9; ++b) {
+            state.positions.emplace_back(1.1 * b, 1.0 * s);
+            state.types.push_back(b ? ParticleType::free : ParticleType::boundary);
+            if (b > 0)
+                state.bonds.emplace_back(first + b - 1, first + b, 0);
+            if (b > 1)
+                state.angle_csts.emplace_back(first + b - 2, first + b - 1, first + b, 0);
+        }
+    }
+
+    ECMEvolutionParameters par;
+    par.seed = 5u;
+    par.its = 20;
+
+    par.threads = 1;
+    ECMSimulation serial(state, par);
+    serial.run();
+
+    par.threads = 4;
+    ECMSimulation parallel(state, par);
+    parallel.run();
+
+    REQUIRE(serial.state().positions == parallel.state().positions);
+    REQUIRE(serial.state().positions != state.positions);
+}
+
+
+TEST_CASE( "ECM simulation applies interactions", "[ecm_simulation]" ) {
+    MDState state = make_strand();
+    ECMSimulation sim(state, noiseless());
+
+    CellECMInteractions interactions;
+    auto &ctia = interactions.change_type_in_area;
+    ctia.from_type = ParticleType::free;
+    ctia.to_type = ParticleType::adhesion;
+
+    SECTION("changes the types of particles in an area") {
+        ctia.change_area = {PixelPos(12, 10), PixelPos(14, 11)};
+        ctia.num_particles = 2;
+        sim.apply_interactions(interactions);
+
+        auto const &types = sim.state().types;
+        REQUIRE(types[0] == ParticleType::boundary);
+        REQUIRE(types[1] == ParticleType::adhesion);
+        REQUIRE(types[2] == ParticleType::adhesion);
+        REQUIRE(types[3] == ParticleType::free);
+        REQUIRE(types[4] == ParticleType::free);
+    }
+
+    SECTION("refuses to create too many adhesions") {
+        ctia.change_area = {PixelPos(12, 10)};
+        ctia.num_particles = 2;
+        REQUIRE_THROWS_AS(sim.apply_interactions(interactions), std::runtime_error);
+    }
+
+    SECTION("moves adhesion particles, which then stay put") {
+        ctia.change_area = {PixelPos(16, 11)};
+        ctia.num_particles = 1;
+        interactions.move_adhesion_particles.par_id = {3};
+        interactions.move_adhesion_particles.new_pos = {ParPos(16.0, 12.0)};
+        sim.apply_interactions(interactions);
+        sim.run();
+        REQUIRE(sim.state().positions[3] == ParPos(16.0, 12.0));
+        REQUIRE(sim.state().positions[2] != state.positions[2]);
+    }
+}
+
+
+TEST_CASE( "ECM simulation provides the boundary state", "[ecm_simulation]" ) {
+    ECMSimulation sim(make_strand(), noiseless());
+    ECMBoundaryState boundary;
+    ECMBoundaryChanges changes;
+
+    sim.boundary_state(boundary, changes);
+    REQUIRE(changes.everything);
+    REQUIRE(boundary.particles.empty());
+
+    CellECMInteractions interactions;
+    auto &ctia = interactions.change_type_in_area;
+    ctia.change_area = {PixelPos(14, 11)};
+    ctia.num_particles = 1;
+    ctia.from_type = ParticleType::free;
+    ctia.to_type = ParticleType::adhesion;
+    sim.apply_interactions(interactions);
+
+    // particle 2, what it's bonded to, and everything in its angle csts
+    changes = ECMBoundaryChanges();
+    sim.boundary_state(boundary, changes);
+    REQUIRE(!changes.everything);
+    REQUIRE(changes.types);
+    REQUIRE(boundary.particles.size() == 5u);
+    REQUIRE(boundary.particles.at(2).type == ParticleType::adhesion);
+    REQUIRE(boundary.particles.at(4).pos == ParPos(18.0, 13.0));
+    REQUIRE(boundary.bonds.size() == 2u);
+    REQUIRE(boundary.bonds.contains(1));
+    REQUIRE(boundary.bonds.contains(2));
+    REQUIRE(boundary.angle_csts.size() == 3u);
+    REQUIRE(boundary.bond_types.at(0).r0 == 2.0);
+    REQUIRE(boundary.angle_cst_types.at(0).t0 == M_PI);
+    REQUIRE(changes.particles.size() == 5u);
+    REQUIRE(changes.bonds.size() == 2u);
+
+    SECTION("and updates it after a run") {
+        sim.run();
+        changes = ECMBoundaryChanges();
+        sim.boundary_state(boundary, changes);
+
+        // the boundary and adhesion particles stay put
+        REQUIRE(changes.particles.size() == 3u);
+        REQUIRE(changes.bonds.empty());
+        REQUIRE(changes.angle_csts.empty());
+        REQUIRE(!changes.types);
+        for (ParId par_id : changes.particles)
+            REQUIRE(boundary.particles.at(par_id).pos ==
+                    sim.state().positions[par_id]);
+    }
+
+    SECTION("and shrinks it when adhesions are changed back") {
+        ctia.from_type = ParticleType::adhesion;
+        ctia.to_type = ParticleType::free;
+        sim.apply_interactions(interactions);
+
+        changes = ECMBoundaryChanges();
+        sim.boundary_state(boundary, changes);
+        REQUIRE(boundary.particles.empty());
+        REQUIRE(boundary.bonds.empty());
+        REQUIRE(boundary.angle_csts.empty());
+        REQUIRE(changes.particles.size() == 5u);
+        REQUIRE(changes.bonds.size() == 2u);
+        REQUIRE(changes.angle_csts.size() == 3u);
+    }
+
+    SECTION("and reports no changes if there aren't any") {
+        changes = ECMBoundaryChanges();
+        sim.boundary_state(boundary, changes);
+        REQUIRE(changes.size() == 0u);
+        REQUIRE(!changes.types);
+    }
+}
+
+
+TEST_CASE( "ECM simulation adds and removes adhesion particles", "[ecm_simulation]" ) {
+    ECMSimulation sim(make_strand(), noiseless());
+    ECMBoundaryState boundary;
+    ECMBoundaryChanges changes;
+    sim.boundary_state(boundary, changes);
+
+    // the first one is bonded to particle 2, the second has nothing in range
+    CellECMInteractions interactions;
+    auto &aap = interactions.add_adhesion_particles;
+    aap.new_pos = {ParPos(14.5, 12.0), ParPos(30.0, 30.0)};
+    aap.bond_attempt_radius = {1.0, 1.0};
+    sim.apply_interactions(interactions);
+
+    auto const &state = sim.state();
+    REQUIRE(state.types.size() == 7u);
+    REQUIRE(state.types[5] == ParticleType::adhesion);
+    REQUIRE(state.types[6] == ParticleType::adhesion);
+    REQUIRE(state.bonds.size() == 5u);
+    REQUIRE(state.bonds[4].p1 == 5);
+    REQUIRE(state.bonds[4].p2 == 2);
+    REQUIRE(state.bonds[4].type == 0);
+
+    changes = ECMBoundaryChanges();
+    sim.boundary_state(boundary, changes);
+    REQUIRE(boundary.particles.size() == 3u);
+    REQUIRE(boundary.particles.contains(2));
+    REQUIRE(boundary.particles.contains(5));
+    REQUIRE(boundary.particles.contains(6));
+    REQUIRE(boundary.bonds.size() == 1u);
+    REQUIRE(boundary.bonds.contains(4));
+    REQUIRE(boundary.angle_csts.empty());
+
+    sim.run();
+    REQUIRE(state.positions[5] == ParPos(14.5, 12.0));
+
+    SECTION("which no longer act when removed") {
+        double r = (state.positions[2] - state.positions[5]).length();
+        double bond_energy = 0.5 * 5.0 * (r - 2.0) * (r - 2.0);
+        double energy = sim.energy();
+
+        interactions.clear();
+        interactions.remove_adhesion_particles.par_id = {5};
+        sim.apply_interactions(interactions);
+        REQUIRE(state.types[5] == ParticleType::excluded);
+        REQUIRE(state.types.size() == 7u);
+        REQUIRE(sim.forces()[5] == ParDisplacement(0.0, 0.0));
+        REQUIRE_THAT(sim.energy(), WithinAbs(energy - bond_energy, 1e-12));
+
+        changes = ECMBoundaryChanges();
+        sim.boundary_state(boundary, changes);
+        REQUIRE(boundary.particles.size() == 1u);
+        REQUIRE(boundary.particles.contains(6));
+        REQUIRE(boundary.bonds.empty());
+        REQUIRE(changes.bonds == std::vector<BondId>{4});
+        REQUIRE(changes.particles.size() == 2u);
+
+        // and they don't move
+        ParPos pos = state.positions[5];
+        sim.run();
+        REQUIRE(state.positions[5] == pos);
+    }
+
+    SECTION("but only adhesion particles can be removed") {
+        interactions.clear();
+        interactions.remove_adhesion_particles.par_id = {2};
+        REQUIRE_THROWS_AS(sim.apply_interactions(interactions), std::runtime_error);
+    }
+}
@@ -0,0 +1,4 @@
+TARGET = benchmark
+MAINFILE = "models/benchmark.cpp"
+
+include(Tissue_Simulation_Toolkit.pri)
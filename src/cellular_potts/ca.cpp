@@ -26,18 +26,27 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 // This code derives from a Cellular Potts implementation written around 1995
 // by Nick Savill
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <limits>
 #include <math.h>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
 #include <stdio.h>
 
 #include "ca.hpp"
+#include "checkpoint.hpp"
 #include "crash.hpp"
 #include "dish.hpp"
 #include "graph.hpp"
 #include "hull.hpp"
+#include "lattice_memory.hpp"
 #include "parameter.hpp"
+#include "profiler.hpp"
 #include "random.hpp"
 #include "sqr.hpp"
 #include "sticky.hpp"
@@ -83,13 +92,15 @@ void CellularPotts::BaseInitialisation(vector<Cell> *cells) {
 
 CellularPotts::CellularPotts(vector<Cell> *cells, const int sx, const int sy)
     : adhesion_mover(*this) {
-  sigma = 0;
   frozen = false;
   thetime = 0;
+  copy_attempts = 0;
   zygote_area = 0;
 
   edgelist = nullptr;
   orderedgelist = nullptr;
+  edgelist_bytes = 0;
+  matrix = nullptr;
 
   BaseInitialisation(cells);
   sizex = sx;
@@ -114,15 +125,17 @@ CellularPotts::CellularPotts(vector<Cell> *cells, const int sx, const int sy)
 }
 
 CellularPotts::CellularPotts(void) : adhesion_mover(*this) {
-  sigma = 0;
   sizex = 0;
   sizey = 0;
   frozen = false;
   thetime = 0;
+  copy_attempts = 0;
   zygote_area = 0;
 
   edgelist = nullptr;
   orderedgelist = nullptr;
+  edgelist_bytes = 0;
+  matrix = nullptr;
 
   CopyProb(par.T);
 
@@ -143,19 +156,8 @@ CellularPotts::CellularPotts(void) : adhesion_mover(*this) {
 
 // destructor (virtual)
 CellularPotts::~CellularPotts(void) {
-  if (sigma) {
-    free(sigma[0]);
-    free(sigma);
-    sigma = 0;
-  }
-
-  if (edgelist) {
-    delete edgelist;
-  }
-
-  if (orderedgelist) {
-    delete orderedgelist;
-  }
+  free(edgelist);
+  free(orderedgelist);
 }
 
 void CellularPotts::AllocateSigma(int sx, int sy) {
@@ -163,23 +165,11 @@ void CellularPotts::AllocateSigma(int sx, int sy) {
   sizex = sx;
   sizey = sy;
 
-  sigma = (int **)malloc(sizex * sizeof(int *));
-  if (sigma == NULL)
-    MemoryWarning();
-
-  sigma[0] = (int *)malloc(sizex * sizey * sizeof(int));
-  if (sigma[0] == NULL)
+  /* Cleared CA plane */
+  try {
+    sigma.allocate(sizex, sizey, par.sparse_lattice);
+  } catch (std::bad_alloc const &) {
     MemoryWarning();
-
-  {
-    for (int i = 1; i < sizex; i++)
-      sigma[i] = sigma[i - 1] + sizey;
-  }
-
-  /* Clear CA plane */
-  {
-    for (int i = 0; i < sizex * sizey; i++)
-      sigma[0][i] = 0;
   }
 }
 
@@ -190,7 +180,9 @@ void CellularPotts::AllocateMatrix(Dish &beast) {
   if (matrix == NULL)
     MemoryWarning();
 
-  matrix[0] = (int *)malloc(sizex * sizey * sizeof(int));
+  /* Cleared CA plane */
+  matrix[0] = (int *)allocate_lattice((size_t)sizex * sizey * sizeof(int),
+                                      par.sparse_lattice);
   if (matrix[0] == NULL)
     MemoryWarning();
 
@@ -198,47 +190,60 @@ void CellularPotts::AllocateMatrix(Dish &beast) {
     for (int i = 1; i < sizex; i++)
       matrix[i] = matrix[i - 1] + sizey;
   }
+}
 
-  /* Clear CA plane */
-  {
-    for (int i = 0; i < sizex * sizey; i++)
-      matrix[0][i] = 0;
-  }
+void CellularPotts::AllocateEdgeList(void) {
+  size_t n_edges = (size_t)(sizex - 2) * (sizey - 2) * n_nb;
+
+  // Both lists start out empty. Entries of orderedgelist beyond sizeedgelist
+  // are never read.
+  free(edgelist);
+  free(orderedgelist);
+  edgelist_bytes = n_edges * sizeof(int);
+  edgelist = (int *)allocate_lattice(edgelist_bytes, par.sparse_lattice);
+  orderedgelist = (int *)allocate_lattice(edgelist_bytes, par.sparse_lattice);
+  if (edgelist == NULL || orderedgelist == NULL)
+    MemoryWarning();
+  sizeedgelist = 0;
 }
 
 void CellularPotts::InitialiseEdgeList(void) {
-  edgelist =
-      new int[(par.sizex - 2) * (par.sizey - 2) * nbh_level[par.neighbours]];
-  orderedgelist =
-      new int[(par.sizex - 2) * (par.sizey - 2) * nbh_level[par.neighbours]];
-  sizeedgelist = 0;
-  int pixel;
-  int neighbour;
-  int x, y;
-  int xp, yp;
-  int c, cp;
-
-  // Initialise both edgelist and orderedgelist to have -1 everywhere
-  for (int k = 0;
-       k < (par.sizex - 2) * (par.sizey - 2) * nbh_level[par.neighbours]; k++) {
-    edgelist[k] = -1;
-    orderedgelist[k] = -1;
-  }
-
-  for (int k = 0;
-       k < (par.sizex - 2) * (par.sizey - 2) * nbh_level[par.neighbours]; k++) {
-    // Loop over all edges
-    // Outermost loop is over the y-coordinate
-    // Middle loop is over the x-coordinate
-    // Innermost loop is over the neighbours.
-
-    pixel = k / nbh_level[par.neighbours];
-    neighbour = k % nbh_level[par.neighbours] + 1;
-    x = pixel % (sizex - 2) + 1;
-    y = pixel / (sizex - 2) + 1;
-    c = sigma[x][y];
-    xp = nx[neighbour] + x;
-    yp = ny[neighbour] + y;
+  AllocateEdgeList();
+
+  // Loop over all edges
+  // Outermost loop is over the y-coordinate
+  // Middle loop is over the x-coordinate
+  // Innermost loop is over the neighbours.
+  if (par.sparse_lattice) {
+    // Sites far away from any cell have only medium around them, and no
+    // edges. With periodic boundaries, also visit the sites that may have
+    // neighbours on the other side of the lattice.
+    RebuildTileIndex();
+    int rim = par.periodic_boundaries ? 3 : 0;
+    tile_index->for_each_active_row_span(rim, [this](int y, int x0, int x1) {
+      if (y < 1 || y > sizey - 2)
+        return;
+      for (int x = max(x0, 1); x < min(x1, sizex - 1); x++)
+        AddEdgesOfSite(x, y);
+    });
+  } else {
+    for (int y = 1; y < sizey - 1; y++)
+      for (int x = 1; x < sizex - 1; x++)
+        AddEdgesOfSite(x, y);
+  }
+
+  RebuildObservables();
+}
+
+void CellularPotts::AddEdgesOfSite(int x, int y) {
+  int pixel = (x - 1) + (y - 1) * (sizex - 2);
+  int c = sigma[x][y];
+  int cp;
+
+  for (int neighbour = 1; neighbour <= n_nb; neighbour++) {
+    int k = pixel * n_nb + neighbour - 1;
+    int xp = nx[neighbour] + x;
+    int yp = ny[neighbour] + y;
 
     if (par.periodic_boundaries) {
       // since we are asynchronic, we cannot just copy the borders once
@@ -258,16 +263,227 @@ void CellularPotts::InitialiseEdgeList(void) {
       cp = sigma[xp][yp];
     if (cp != c && cp != -1) {
       // if a pixel and its neighbour have a different sigma, add a unique
-      // interger to edgelist
-      edgelist[k] = sizeedgelist;
-      // also add a unique integer to the end of orderedgelist, making a
-      // bijection between the lists
+      // interger to the end of orderedgelist, and store its position in
+      // edgelist, making a bijection between the lists
       orderedgelist[sizeedgelist] = k;
       sizeedgelist++;
+      edgelist[k] = sizeedgelist;
     }
   }
 }
 
+void CellularPotts::RebuildTileIndex(void) {
+  if (!par.sparse_lattice)
+    return;
+
+  if (tile_index)
+    tile_index->clear();
+  else
+    tile_index =
+        std::make_unique<TileIndex>(sizex, sizey, par.lattice_tile_size);
+
+  for (int x = 1; x < sizex - 1; x++)
+    for (int y = 1; y < sizey - 1; y++)
+      if (sigma[x][y] > 0)
+        tile_index->add_site(x, y);
+}
+
+void CellularPotts::ReleaseEmptyTiles(void) {
+  if (!tile_index)
+    return;
+
+  int ts = tile_index->tile_size();
+  size_t spin_bytes = sigma.spin_bytes();
+  size_t sigma_bytes = sigma.size() * spin_bytes;
+  for (int tile : tile_index->take_emptied_tiles()) {
+    int x0 = (tile / tile_index->tiles_y()) * ts;
+    int y0 = (tile % tile_index->tiles_y()) * ts;
+    int x1 = min(x0 + ts, sizex);
+    int y1 = min(y0 + ts, sizey);
+
+    // sigma is stored column by column
+    for (int x = x0; x < x1; x++)
+      release_zero_pages(sigma.data(), sigma_bytes,
+                         ((size_t)x * sizey + y0) * spin_bytes,
+                         ((size_t)x * sizey + y1) * spin_bytes);
+
+    // the edge list is stored row by row, and only covers the interior. Sites
+    // up to two pixels outside the tile may have had edges into it.
+    if (!edgelist)
+      continue;
+    int ex0 = max(x0 - 2, 1), ex1 = min(x1 + 2, sizex - 1);
+    for (int y = max(y0 - 2, 1); y < min(y1 + 2, sizey - 1); y++) {
+      size_t row = (size_t)(y - 1) * (sizex - 2);
+      release_zero_pages(edgelist, edgelist_bytes,
+                         (row + ex0 - 1) * n_nb * sizeof(int),
+                         (row + ex1 - 1) * n_nb * sizeof(int));
+    }
+  }
+}
+
+void CellularPotts::TrackContacts(int x, int y, int new_sigma) {
+  int old_sigma = sigma[x][y];
+  if (old_sigma == new_sigma)
+    return;
+
+  vector<Cell> &cells = *cell;
+  Cell &old_cell = cells[old_sigma], &new_cell = cells[new_sigma];
+  int old_tau = old_cell.getTau(), new_tau = new_cell.getTau();
+  int n_types = observables.n_types();
+  if (old_tau >= n_types || new_tau >= n_types) {
+    // a cell changed type without RebuildObservables() being called
+    observables.invalidate();
+    return;
+  }
+
+  if (old_sigma)
+    observables.add_sites(old_tau, -1);
+  if (new_sigma)
+    observables.add_sites(new_tau, 1);
+
+  // Same neighbourhood and boundaries as in DeltaH(), the first four
+  // neighbours are the orthogonal ones that define the interfaces. Sites that
+  // are far enough from the border need no boundary checks.
+  int n_loop = max(n_nb, 4);
+  bool interior = x > 2 && y > 2 && x < sizex - 3 && y < sizey - 3;
+  bool known_types = sigma.visit([&](auto const &lattice) {
+    for (int i = 1; i <= n_loop; i++) {
+      int xn = x + nx[i], yn = y + ny[i];
+      if (!interior) {
+        if (par.periodic_boundaries) {
+          if (xn <= 0)
+            xn = sizex - 2 + xn;
+          if (yn <= 0)
+            yn = sizey - 2 + yn;
+          if (xn >= sizex - 1)
+            xn = xn - sizex + 2;
+          if (yn >= sizey - 1)
+            yn = yn - sizey + 2;
+        } else if (xn <= 0 || yn <= 0 || xn >= sizex - 1 || yn >= sizey - 1) {
+          if (i > n_nb)
+            continue;
+          if (old_sigma)
+            observables.add_border_contacts(old_tau, -1, par.border_energy);
+          if (new_sigma)
+            observables.add_border_contacts(new_tau, 1, par.border_energy);
+          continue;
+        }
+      }
+
+      int neighsite = lattice[xn][yn];
+      Cell &neighbour = cells[neighsite];
+      int nb_tau = neighbour.getTau();
+      if (nb_tau >= n_types)
+        return false;
+      if (i <= n_nb) {
+        if (neighsite != old_sigma)
+          observables.add_contacts(old_tau, nb_tau, -1,
+                                   old_cell.EnergyDifference(neighbour));
+        if (neighsite != new_sigma)
+          observables.add_contacts(new_tau, nb_tau, 1,
+                                   new_cell.EnergyDifference(neighbour));
+      }
+      if (i <= 4) {
+        if (neighsite != old_sigma)
+          observables.add_interfaces(old_tau, nb_tau, -1);
+        if (neighsite != new_sigma)
+          observables.add_interfaces(new_tau, nb_tau, 1);
+      }
+    }
+    return true;
+  });
+  if (!known_types)
+    observables.invalidate();
+}
+
+double CellularPotts::CellEnergy(Cell &c) const {
+  return par.lambda * DSQR(c.Area() - c.TargetArea()) +
+         par.lambda2 * DSQR(c.Length() - c.TargetLength());
+}
+
+void CellularPotts::UpdateCellObservables(int s) {
+  if (s == MEDIUM)
+    return;
+  Cell &c = (*cell)[s];
+  if (c.AliveP())
+    observables.set_cell(s, true, c.Area(), c.TargetArea(), c.Length(),
+                         CellEnergy(c));
+  else
+    observables.set_cell(s, false, 0, 0, 0.0, 0.0);
+}
+
+void CellularPotts::RefreshCellObservables(void) {
+  if (!observables.valid())
+    return;
+  for (int s = 1; s < (int)cell->size(); s++)
+    UpdateCellObservables(s);
+}
+
+void CellularPotts::RebuildObservables(void) {
+  observables.invalidate();
+
+  int n_cells = cell->size();
+  // the border is -1
+  bool known_cells = sigma.visit([n_cells](auto const &lattice) {
+    for (size_t i = 0; i < lattice.size(); i++)
+      if (lattice.data()[i] < -1 || lattice.data()[i] >= n_cells)
+        return false;
+    return true;
+  });
+  if (!known_cells)
+    return;
+
+  int n_types = 1;
+  for (auto &c : *cell)
+    n_types = max(n_types, c.getTau() + 1);
+  observables.reset(n_types, n_cells);
+
+  for (int x = 1; x < sizex - 1; x++)
+    for (int y = 1; y < sizey - 1; y++) {
+      int s = sigma[x][y];
+      Cell &c = (*cell)[s];
+      if (s)
+        observables.add_sites(c.getTau(), 1);
+
+      // count each pair of neighbouring sites once, from its first site
+      for (int i = 1; i <= max(n_nb, 4); i++) {
+        int xn = x + nx[i], yn = y + ny[i];
+        if (par.periodic_boundaries) {
+          xn = (xn + sizex - 3) % (sizex - 2) + 1;
+          yn = (yn + sizey - 3) % (sizey - 2) + 1;
+        } else if (xn <= 0 || yn <= 0 || xn >= sizex - 1 || yn >= sizey - 1) {
+          if (s && i <= n_nb)
+            observables.add_border_contacts(c.getTau(), 1, par.border_energy);
+          continue;
+        }
+        if (xn < x || (xn == x && yn <= y))
+          continue;
+        Cell &neighbour = (*cell)[sigma[xn][yn]];
+        if (neighbour.Sigma() == s)
+          continue;
+        if (i <= n_nb)
+          observables.add_contacts(c.getTau(), neighbour.getTau(), 1,
+                                   c.EnergyDifference(neighbour));
+        if (i <= 4)
+          observables.add_interfaces(c.getTau(), neighbour.getTau(), 1);
+      }
+    }
+
+  for (int s = 1; s < n_cells; s++)
+    UpdateCellObservables(s);
+}
+
+void CellularPotts::VerifyObservables(void) {
+  if (!observables.valid())
+    return;
+  Observables running = observables;
+  RebuildObservables();
+  std::string diff = running.compare(observables);
+  if (!diff.empty())
+    throw std::runtime_error("Observables out of sync at MCS " +
+                             std::to_string(thetime) + ": " + diff);
+}
+
 double sat(double x) {
   return x / (par.saturation * x + 1.);
   // return x;
@@ -483,8 +699,9 @@ int CellularPotts::KawasakiDeltaH(int x, int y, int xp, int yp, PDE *PDEfield) {
 }
 
 int CellularPotts::DeltaH(int x, int y, int xp, int yp, PDE *PDEfield,
-                          AdhesionDisplacements *adh_disp) {
-  int DH = 0;
+                          AdhesionDisplacements *adh_disp, DeltaHTerms *terms) {
+  int DH_adhesion = 0, DH_area = 0, DH_chemotaxis = 0, DH_ecm = 0;
+  int DH_length = 0;
   int i, sxy, sxyp;
   int neighsite;
 
@@ -517,24 +734,25 @@ int CellularPotts::DeltaH(int x, int y, int xp, int yp, PDE *PDEfield,
     }
     if (neighsite == -1) {
       // border
-      DH += (sxyp == 0 ? 0 : par.border_energy) -
-            (sxy == 0 ? 0 : par.border_energy);
+      DH_adhesion += (sxyp == 0 ? 0 : par.border_energy) -
+                     (sxy == 0 ? 0 : par.border_energy);
     } else {
-      DH += (*cell)[sxyp].EnergyDifference((*cell)[neighsite]) -
-            (*cell)[sxy].EnergyDifference((*cell)[neighsite]);
+      DH_adhesion += (*cell)[sxyp].EnergyDifference((*cell)[neighsite]) -
+                     (*cell)[sxy].EnergyDifference((*cell)[neighsite]);
     }
   }
   // lambda is determined by chemical 0
   // cerr << "[" << lambda << "]";
   if (sxyp == MEDIUM) {
-    DH += (int)(par.lambda * (1. - 2. * (double)((*cell)[sxy].Area() -
-                                                 (*cell)[sxy].TargetArea())));
+    DH_area +=
+        (int)(par.lambda * (1. - 2. * (double)((*cell)[sxy].Area() -
+                                               (*cell)[sxy].TargetArea())));
   } else if (sxy == MEDIUM) {
-    DH +=
+    DH_area +=
         (int)((par.lambda * (1. + 2. * (double)((*cell)[sxyp].Area() -
                                                 (*cell)[sxyp].TargetArea()))));
   } else
-    DH += (int)((
+    DH_area += (int)((
         par.lambda *
         (2. + 2. * (double)((*cell)[sxyp].Area() - (*cell)[sxyp].TargetArea() -
                             (*cell)[sxy].Area() + (*cell)[sxy].TargetArea()))));
@@ -547,7 +765,7 @@ int CellularPotts::DeltaH(int x, int y, int xp, int yp, PDE *PDEfield,
     if (!(par.extensiononly && sxyp == 0)) {
       int DDH = (int)(par.chemotaxis * (sat(PDEfield->get_PDEvars(0, x, y)) -
                                         sat(PDEfield->get_PDEvars(0, xp, yp))));
-      DH -= DDH;
+      DH_chemotaxis -= DDH;
     }
   }
 
@@ -555,7 +773,7 @@ int CellularPotts::DeltaH(int x, int y, int xp, int yp, PDE *PDEfield,
   if (par.adhesions_enabled) {
     if (adh_disp) {
       double adh_dh = adhesion_mover.move_dh({xp, yp}, {x, y}, *adh_disp);
-      DH += static_cast<int>(round(adh_dh));
+      DH_ecm += static_cast<int>(round(adh_dh));
     } else {
       throw std::runtime_error(
           "Adhesions are enabled but not adh_disp argument was passed to"
@@ -567,25 +785,36 @@ int CellularPotts::DeltaH(int x, int y, int xp, int yp, PDE *PDEfield,
   /* Length constraint */
   // sp is expanding cell, s is retracting cell
   if (sxyp == MEDIUM) {
-    DH -= (int)(lambda2 *
-                (DSQR((*cell)[sxy].Length() - (*cell)[sxy].TargetLength()) -
-                 DSQR((*cell)[sxy].GetNewLengthIfXYWereRemoved(x, y) -
-                      (*cell)[sxy].TargetLength())));
+    DH_length -=
+        (int)(lambda2 *
+              (DSQR((*cell)[sxy].Length() - (*cell)[sxy].TargetLength()) -
+               DSQR((*cell)[sxy].GetNewLengthIfXYWereRemoved(x, y) -
+                    (*cell)[sxy].TargetLength())));
   } else if (sxy == MEDIUM) {
-    DH -= (int)(lambda2 *
-                (DSQR((*cell)[sxyp].Length() - (*cell)[sxyp].TargetLength()) -
-                 DSQR((*cell)[sxyp].GetNewLengthIfXYWereAdded(x, y) -
-                      (*cell)[sxyp].TargetLength())));
+    DH_length -=
+        (int)(lambda2 *
+              (DSQR((*cell)[sxyp].Length() - (*cell)[sxyp].TargetLength()) -
+               DSQR((*cell)[sxyp].GetNewLengthIfXYWereAdded(x, y) -
+                    (*cell)[sxyp].TargetLength())));
   } else {
-    DH -= (int)(lambda2 *
-                ((DSQR((*cell)[sxyp].Length() - (*cell)[sxyp].TargetLength()) -
-                  DSQR((*cell)[sxyp].GetNewLengthIfXYWereAdded(x, y) -
-                       (*cell)[sxyp].TargetLength())) +
-                 (DSQR((*cell)[sxy].Length() - (*cell)[sxy].TargetLength()) -
-                  DSQR((*cell)[sxy].GetNewLengthIfXYWereRemoved(x, y) -
-                       (*cell)[sxy].TargetLength()))));
+    DH_length -=
+        (int)(lambda2 *
+              ((DSQR((*cell)[sxyp].Length() - (*cell)[sxyp].TargetLength()) -
+                DSQR((*cell)[sxyp].GetNewLengthIfXYWereAdded(x, y) -
+                     (*cell)[sxyp].TargetLength())) +
+               (DSQR((*cell)[sxy].Length() - (*cell)[sxy].TargetLength()) -
+                DSQR((*cell)[sxy].GetNewLengthIfXYWereRemoved(x, y) -
+                     (*cell)[sxy].TargetLength()))));
   }
-  return DH;
+  if (terms) {
+    terms->value = {};
+    terms->value[DeltaHTerms::adhesion] = DH_adhesion;
+    terms->value[DeltaHTerms::area] = DH_area;
+    terms->value[DeltaHTerms::length] = DH_length;
+    terms->value[DeltaHTerms::chemotaxis] = DH_chemotaxis;
+    terms->value[DeltaHTerms::ecm_adhesion] = DH_ecm;
+  }
+  return DH_adhesion + DH_area + DH_chemotaxis + DH_ecm + DH_length;
 }
 
 int CellularPotts::Act_AmoebaeMove(PDE *PDEfield) {
@@ -594,6 +823,9 @@ int CellularPotts::Act_AmoebaeMove(PDE *PDEfield) {
   int SumDH = 0;
   if (frozen)
     return 0;
+  MoveStatistics *stats = GetMoveStatistics();
+  long attempts = 0, accepted = 0;
+  long disconnecting = 0, disconnecting_rejected = 0;
   loop = (sizex - 2) * (sizey - 2);
   for (int i = 0; i < loop; i++) {
     // take a random site
@@ -630,15 +862,32 @@ int CellularPotts::Act_AmoebaeMove(PDE *PDEfield) {
     if (kp != -1) {
       // Don't even think of copying the special border state into you!
       if (k >= 0 && k != kp) {
+        attempts++;
         if (par.cluster_connectivity == false ||
             ConnectivityPreservedPCluster(x, y)) {
           /* Try to copy if sites do not belong to the same cell */
           // connectivity dissipation:
           int H_diss = 0;
-          if (!ConnectivityPreservedP(x, y))
+          bool disconnects = !ConnectivityPreservedP(x, y);
+          if (disconnects)
             H_diss = par.conn_diss;
-          int D_H = Act_DeltaH(x, y, xp, yp, PDEfield);
-          if ((p = CopyvProb(D_H, H_diss, false)) > 0) {
+          DeltaHTerms terms;
+          bool sampled = stats && stats->sample();
+          int D_H =
+              Act_DeltaH(x, y, xp, yp, PDEfield, sampled ? &terms : nullptr);
+          p = CopyvProb(D_H, H_diss, false);
+          if (disconnects) {
+            disconnecting++;
+            if (!p)
+              disconnecting_rejected++;
+          }
+          if (sampled) {
+            terms.value[DeltaHTerms::connectivity] = H_diss;
+            stats->record(terms, (*cell)[k].getTau(),
+                          kp >= 0 ? (*cell)[kp].getTau() : -1, p > 0);
+          }
+          if (p > 0) {
+            accepted++;
             ConvertSpin(x, y, xp, yp);
             SumDH += D_H;
             if (par.lambda_Act > 0) {
@@ -683,14 +932,23 @@ int CellularPotts::Act_AmoebaeMove(PDE *PDEfield) {
               }
             }
           }
+        } else {
+          // the copy would split up the cluster
+          disconnecting++;
+          disconnecting_rejected++;
         }
       }
     }
   }
+  copy_attempts += attempts;
+  if (stats)
+    EndMoveStatisticsStep(attempts, accepted, disconnecting,
+                          disconnecting_rejected, -1);
   return SumDH;
 }
 
-int CellularPotts::Act_DeltaH(int x, int y, int xp, int yp, PDE *PDEfield) {
+int CellularPotts::Act_DeltaH(int x, int y, int xp, int yp, PDE *PDEfield,
+                              DeltaHTerms *terms) {
   int DH = 0;
   int i, sxy, sxyp;
   int neighsite;
@@ -932,6 +1190,16 @@ int CellularPotts::Act_DeltaH(int x, int y, int xp, int yp, PDE *PDEfield) {
   }
   DH += DH_matrix_interaction;
   // std::cout << "DH_matrix: " << DH_matrix_interaction << std::endl;
+  if (terms) {
+    terms->value = {};
+    terms->value[DeltaHTerms::adhesion] = DH_adhesive_energy;
+    terms->value[DeltaHTerms::area] = DH_area;
+    terms->value[DeltaHTerms::perimeter] = DH_perimeter;
+    terms->value[DeltaHTerms::length] = DH_length;
+    terms->value[DeltaHTerms::chemotaxis] = -DDH;
+    terms->value[DeltaHTerms::ecm_adhesion] = DH_matrix_interaction;
+    terms->value[DeltaHTerms::act] = DH_act;
+  }
   return DH;
 }
 
@@ -952,7 +1220,14 @@ void CellularPotts::ConvertSpin(int x, int y, int xp, int yp) {
     (*cell)[tmpcell].AddSiteToMoments(x, y);
     (*cell)[tmpcell].SetPerimeter(GetNewPerimeterIfXYWereAdded(tmpcell, x, y));
   }
+  int old_sigma = sigma[x][y];
+  TrackSiteChange(x, y, sigma[xp][yp]);
   sigma[x][y] = sigma[xp][yp];
+
+  if (observables.valid()) {
+    UpdateCellObservables(old_sigma);
+    UpdateCellObservables(sigma[x][y]);
+  }
 }
 
 void CellularPotts::ExchangeSpin(int x, int y, int xp, int yp) {
@@ -977,28 +1252,39 @@ void CellularPotts::ExchangeSpin(int x, int y, int xp, int yp) {
     (*cell)[tmpcell].AddSiteToMoments(x, y);
   }
 
-  // Exchange spins
+  // Exchange spins, one site at a time so that the contacts of the second
+  // site are counted against the new state of the first
   tmpcell = sigma[x][y];
+  TrackSiteChange(x, y, sigma[xp][yp]);
   sigma[x][y] = sigma[xp][yp];
+  TrackSiteChange(xp, yp, tmpcell);
   sigma[xp][yp] = tmpcell;
+
+  if (observables.valid()) {
+    UpdateCellObservables(sigma[x][y]);
+    UpdateCellObservables(sigma[xp][yp]);
+  }
+}
+
+/* Returns the probability of accepting a copy attempt with energy change dh,
+   for dh > 0. */
+static double BoltzmannWeight(int dh) {
+  // if DH becomes extremely large, calculate probability on-the-fly
+  if (dh > BOLTZMANN - 1)
+    return exp(-((double)dh / par.T));
+  return copyprob[dh];
 }
 
 /** PUBLIC **/
 int CellularPotts::CopyvProb(int DH, double stiff, bool anneal) {
-  double dd;
   int s;
   s = (int)stiff;
   if (DH <= -s)
     return 2;
   if (anneal)
     return 0;
-  // if DH becomes extremely large, calculate probability on-the-fly
-  if (DH + s > BOLTZMANN - 1)
-    dd = exp(-((double)(DH + s) / par.T));
-  else
-    dd = copyprob[DH + s];
 
-  if (RANDOM() < dd)
+  if (RANDOM() < BoltzmannWeight(DH + s))
     return 1;
   else
     return 0;
@@ -1026,102 +1312,376 @@ int CellularPotts::AmoebaeMove(PDE *PDEfield, bool anneal) {
 
   int positionedge;
   int targetedge;
-  int targetsite;
-  int targetneighbour;
   int x, y;
   int xp, yp;
 
   int H_diss;
   int D_H;
 
-  int edgeadjusting;
-  int xn, yn; // neighbour cells
-
   if (frozen)
     return 0;
 
+  // pick up changes made to the cells since the last step
+  PROFILE(refresh_observables, RefreshCellObservables();)
+  if (par.verify_observables > 0 && thetime % par.verify_observables == 0)
+    VerifyObservables();
+
+  if (par.parallel_move == "speculative")
+    return SpeculativeAmoebaeMove(PDEfield, anneal);
+
+  PROFILE_ZONE(metropolis)
+  MoveStatistics *stats = GetMoveStatistics();
+  int attempts = 0, accepted = 0;
+  int disconnecting = 0, disconnecting_rejected = 0;
   loop = static_cast<float>(sizeedgelist) / static_cast<float>(n_nb);
-  for (int i = 0; i < loop; i++) {
+  for (int i = 0; i < loop; i++, attempts++) {
     // take a random entry of the edgelist
     positionedge = (int)(RANDOM() * sizeedgelist);
     // find the corresponding edge
     targetedge = orderedgelist[positionedge];
-    // find the lattice site corresponding to this edge
-    targetsite = targetedge / n_nb;
-    // find the neighbour corresponding to this edge
-    targetneighbour = (targetedge % n_nb) + 1;
-
-    // find the x and y coordinate corresponding to the target site
-    x = targetsite % (sizex - 2) + 1;
-    y = targetsite / (sizex - 2) + 1;
-
-    // find the neighbouring site corresponding to this edge
-    xp = nx[targetneighbour] + x;
-    yp = ny[targetneighbour] + y;
-    if (par.periodic_boundaries) {
-      // since we are asynchronic, we cannot just copy the borders once
-      // every MCS
-      if (xp <= 0)
-        xp = sizex - 2 + xp;
-      if (yp <= 0)
-        yp = sizey - 2 + yp;
-      if (xp >= sizex - 1)
-        xp = xp - sizex + 2;
-      if (yp >= sizey - 1)
-        yp = yp - sizey + 2;
-    }
+    // find the lattice sites at both ends of this edge
+    EdgeSites(targetedge, x, y, xp, yp);
 
     // connectivity dissipation:
     H_diss = 0;
-    if (!ConnectivityPreservedP(x, y))
+    bool disconnects = !ConnectivityPreservedP(x, y);
+    if (disconnects)
       H_diss = par.conn_diss;
 
     AdhesionDisplacements adh_disp;
-    D_H = DeltaH(x, y, xp, yp, PDEfield, &adh_disp);
+    DeltaHTerms terms;
+    bool sampled = stats && stats->sample();
+    D_H = DeltaH(x, y, xp, yp, PDEfield, &adh_disp, sampled ? &terms : nullptr);
+
+    p = CopyvProb(D_H, H_diss, anneal);
+    if (disconnects) {
+      disconnecting++;
+      if (!p)
+        disconnecting_rejected++;
+    }
+    if (sampled) {
+      terms.value[DeltaHTerms::connectivity] = H_diss;
+      stats->record(terms, (*cell)[sigma[x][y]].getTau(),
+                    (*cell)[sigma[xp][yp]].getTau(), p > 0);
+    }
 
-    if ((p = CopyvProb(D_H, H_diss, anneal)) > 0) {
+    if (p > 0) {
       if (par.adhesions_enabled)
         adhesion_mover.commit_move({xp, yp}, {x, y}, adh_disp);
       ConvertSpin(x, y, xp,
                   yp); // sigma(x,y) will get the same value as sigma(xp,yp)
-      for (int j = 1; j <= n_nb; j++) {
-        xn = nx[j] + x;
-        yn = ny[j] + y;
-        edgeadjusting = targetsite * n_nb + j - 1;
+      UpdateEdgesAroundSite(x, y, loop);
+      SumDH += D_H;
+      accepted++;
+    }
+  }
+  PROFILE_COUNT(copy_attempts, attempts)
+  PROFILE_COUNT(accepted_moves, accepted)
+  copy_attempts += attempts;
+  if (stats)
+    EndMoveStatisticsStep(attempts, accepted, disconnecting,
+                          disconnecting_rejected, sizeedgelist);
 
-        if (par.periodic_boundaries) {
-          // since we are asynchronic, we cannot just copy the borders once
-          // every MCS
-          if (xn <= 0)
-            xn = sizex - 2 + xn;
-          if (yn <= 0)
-            yn = sizey - 2 + yn;
-          if (xn >= sizex - 1)
-            xn = xn - sizex + 2;
-          if (yn >= sizey - 1)
-            yn = yn - sizey + 2;
+  ReleaseEmptyTiles();
+  return SumDH;
+}
+
+void CellularPotts::EdgeSites(int edge, int &x, int &y, int &xp,
+                              int &yp) const {
+  // find the lattice site corresponding to this edge
+  int targetsite = edge / n_nb;
+  // find the neighbour corresponding to this edge
+  int targetneighbour = (edge % n_nb) + 1;
+
+  // find the x and y coordinate corresponding to the target site
+  x = targetsite % (sizex - 2) + 1;
+  y = targetsite / (sizex - 2) + 1;
+
+  // find the neighbouring site corresponding to this edge
+  xp = nx[targetneighbour] + x;
+  yp = ny[targetneighbour] + y;
+  if (par.periodic_boundaries) {
+    // since we are asynchronic, we cannot just copy the borders once
+    // every MCS
+    if (xp <= 0)
+      xp = sizex - 2 + xp;
+    if (yp <= 0)
+      yp = sizey - 2 + yp;
+    if (xp >= sizex - 1)
+      xp = xp - sizex + 2;
+    if (yp >= sizey - 1)
+      yp = yp - sizey + 2;
+  }
+}
+
+void CellularPotts::UpdateEdgesAroundSite(int x, int y, float &loop) {
+  int targetsite = (x - 1) + (y - 1) * (sizex - 2);
+  for (int j = 1; j <= n_nb; j++) {
+    int xn = nx[j] + x;
+    int yn = ny[j] + y;
+    int edgeadjusting = targetsite * n_nb + j - 1;
+
+    if (par.periodic_boundaries) {
+      // since we are asynchronic, we cannot just copy the borders once
+      // every MCS
+      if (xn <= 0)
+        xn = sizex - 2 + xn;
+      if (yn <= 0)
+        yn = sizey - 2 + yn;
+      if (xn >= sizex - 1)
+        xn = xn - sizex + 2;
+      if (yn >= sizey - 1)
+        yn = yn - sizey + 2;
+    }
+    if (xn > 0 && yn > 0 && xn < sizex - 1 &&
+        yn < sizey - 1) { // if the neighbour site is within the lattice
+      if (!edgelist[edgeadjusting] && sigma[xn][yn] != sigma[x][y]) {
+        // if there should be an edge between (x,y) and (xn,yn) and it is
+        // not there yet, add it
+        AddEdgeToEdgelist(edgeadjusting);
+        PROFILE_COUNT(edges_added, 1)
+        // adjust loop because two edges were removeed
+        loop += 2.0 / n_nb;
+      }
+      if (edgelist[edgeadjusting] && sigma[xn][yn] == sigma[x][y]) {
+        // if there should be no edge between (x,y) and (xn,yn), but there
+        // is an edge remove it
+        RemoveEdgeFromEdgelist(edgeadjusting);
+        PROFILE_COUNT(edges_removed, 1)
+        // adjust loop because two edges were removed
+        loop -= 2.0 / n_nb;
+      }
+    }
+  }
+}
+
+WorkerPool &CellularPotts::Workers(void) {
+  if (!move_workers)
+    move_workers = std::make_unique<WorkerPool>(par.move_threads);
+  return *move_workers;
+}
+
+MoveStatistics *CellularPotts::GetMoveStatistics(void) {
+  if (par.move_stats_stride <= 0)
+    return nullptr;
+  if (!move_stats)
+    move_stats =
+        std::make_unique<MoveStatistics>(par.move_stats_sample_interval);
+  return move_stats.get();
+}
+
+void CellularPotts::EndMoveStatisticsStep(long attempts, long accepted,
+                                          long disconnecting,
+                                          long disconnecting_rejected,
+                                          long edges) {
+  move_stats->end_step(attempts, accepted, disconnecting,
+                       disconnecting_rejected, edges);
+  if (thetime % par.move_stats_stride == 0)
+    move_stats->write(par.move_stats_file, thetime);
+}
+
+int CellularPotts::SpeculativeAmoebaeMove(PDE *PDEfield, bool anneal) {
+  // Worker threads draw edges and evaluate copy attempts concurrently. The
+  // lattice is divided into tiles, and each tile and each cell has a lock
+  // and a version number that is incremented whenever a commit changes it.
+  // An attempt is evaluated under shared locks on the tiles around the site
+  // and on the cells involved. If it is accepted, the locks are retaken
+  // exclusively, and the attempt is committed if their versions have not
+  // changed in the meantime. If they have, the attempt is discarded and a new
+  // edge is drawn in its place. Attempts in different parts of the lattice
+  // thus only contend for the edge list, the observables and the totals,
+  // which are guarded by a separate lock that is held briefly to draw an edge
+  // and to commit. Locks are taken in the order tiles, cells, edge list, and
+  // tiles and cells by increasing index, so that workers cannot deadlock.
+  const int tile_size = 16;
+  // distance from (x,y) of the sites that DeltaH() and
+  // ConnectivityPreservedP() look at
+  const int reach = n_nb > 8 ? 2 : 1;
+  constexpr int max_tiles = (2 * 2 + 1) * (2 * 2 + 1);
+  const int tiles_y = (sizey + tile_size - 1) / tile_size;
+  const int tiles_x = (sizex + tile_size - 1) / tile_size;
+  std::vector<std::shared_mutex> tile_locks(tiles_x * tiles_y);
+  std::vector<unsigned> tile_version(tiles_x * tiles_y, 0);
+  std::vector<std::shared_mutex> cell_locks(cell->size());
+  std::vector<unsigned> cell_version(cell->size(), 0);
+  std::shared_mutex edge_mutex;
+
+  // Find the tiles along one axis that a copy attempt into c depends on
+  auto axis_tiles = [&](int c, int size, int *tiles) {
+    int n = 0;
+    for (int d = -reach; d <= reach; d++) {
+      int w = c + d;
+      if (par.periodic_boundaries) {
+        if (w <= 0)
+          w = size - 2 + w;
+        if (w >= size - 1)
+          w = w - size + 2;
+      }
+      int tile = w / tile_size;
+      if (std::find(tiles, tiles + n, tile) == tiles + n)
+        tiles[n++] = tile;
+    }
+    return n;
+  };
+
+  // Find the tiles that a copy attempt into (x,y) depends on, in the order
+  // in which they are locked
+  auto site_tiles = [&](int x, int y, int *tiles) {
+    int xtiles[2 * 2 + 1], ytiles[2 * 2 + 1];
+    int n_xtiles = axis_tiles(x, sizex, xtiles);
+    int n_ytiles = axis_tiles(y, sizey, ytiles);
+    int n = 0;
+    for (int i = 0; i < n_xtiles; i++)
+      for (int j = 0; j < n_ytiles; j++)
+        tiles[n++] = xtiles[i] * tiles_y + ytiles[j];
+    std::sort(tiles, tiles + n);
+    return n;
+  };
+
+  std::atomic<int> attempts(0);
+  std::atomic<long> claimed(0), conflicts(0);
+  std::atomic<long> disconnecting(0), disconnecting_rejected(0);
+
+  // these are only changed under an exclusive lock on the edge list
+  float loop = static_cast<float>(sizeedgelist) / static_cast<float>(n_nb);
+  int SumDH = 0;
+  long commits = 0;
+
+  auto worker = [&](unsigned seed) {
+    PROFILE_ZONE(speculative_worker)
+    using ReadLock = std::shared_lock<std::shared_mutex>;
+    using WriteLock = std::unique_lock<std::shared_mutex>;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    int tiles[max_tiles];
+    // versions of the tiles, followed by those of sxy and sxyp
+    unsigned seen[max_tiles + 2];
+    bool retrying = false;
+    long local_claimed = 0, local_conflicts = 0;
+    long local_disconnecting = 0, local_disconnecting_rejected = 0;
+
+    for (;;) {
+      int x, y, xp, yp;
+      {
+        ReadLock edge_lock(edge_mutex);
+        if (!sizeedgelist)
+          break;
+        // claim a copy attempt, unless we are retrying one
+        if (!retrying) {
+          if (!(attempts.fetch_add(1) < loop))
+            break;
+          local_claimed++;
         }
-        if (xn > 0 && yn > 0 && xn < sizex - 1 &&
-            yn < sizey - 1) { // if the neighbour site is within the lattice
-          if (edgelist[edgeadjusting] == -1 && sigma[xn][yn] != sigma[x][y]) {
-            // if there should be an edge between (x,y) and (xn,yn) and it is
-            // not there yet, add it
-            AddEdgeToEdgelist(edgeadjusting);
-            // adjust loop because two edges were removeed
-            loop += 2.0 / n_nb;
-          }
-          if (edgelist[edgeadjusting] != -1 && sigma[xn][yn] == sigma[x][y]) {
-            // if there should be no edge between (x,y) and (xn,yn), but there
-            // is an edge remove it
-            RemoveEdgeFromEdgelist(edgeadjusting);
-            // adjust loop because two edges were removed
-            loop -= 2.0 / n_nb;
+        int positionedge = (int)(uniform(rng) * sizeedgelist);
+        EdgeSites(orderedgelist[positionedge], x, y, xp, yp);
+      }
+      retrying = true;
+      int n_tiles = site_tiles(x, y, tiles);
+
+      // evaluate the attempt, and record what the outcome depends on
+      int sxy, sxyp, D_H;
+      bool accept, disconnects;
+      {
+        ReadLock tile_read[max_tiles];
+        for (int i = 0; i < n_tiles; i++)
+          tile_read[i] = ReadLock(tile_locks[tiles[i]]);
+        sxy = sigma[x][y];
+        sxyp = sigma[xp][yp];
+        if (sxy == sxyp) {
+          // a commit removed the edge after we drew it
+          local_conflicts++;
+          continue;
+        }
+        ReadLock cell_read[2];
+        if (std::min(sxy, sxyp) > 0)
+          cell_read[0] = ReadLock(cell_locks[std::min(sxy, sxyp)]);
+        cell_read[1] = ReadLock(cell_locks[std::max(sxy, sxyp)]);
+
+        for (int i = 0; i < n_tiles; i++)
+          seen[i] = tile_version[tiles[i]];
+        unsigned sxy_version = cell_version[sxy];
+        unsigned sxyp_version = cell_version[sxyp];
+
+        int H_diss = 0;
+        disconnects = !ConnectivityPreservedP(x, y);
+        if (disconnects)
+          H_diss = par.conn_diss;
+        D_H = DeltaH(x, y, xp, yp, PDEfield, nullptr);
+        accept = D_H <= -H_diss ||
+                 (!anneal && uniform(rng) < BoltzmannWeight(D_H + H_diss));
+        if (!accept) {
+          if (disconnects) {
+            local_disconnecting++;
+            local_disconnecting_rejected++;
           }
+          retrying = false;
+          continue;
         }
+        seen[n_tiles] = sxy_version;
+        seen[n_tiles + 1] = sxyp_version;
       }
-      SumDH += D_H;
-    }
-  }
+
+      WriteLock tile_write[max_tiles];
+      for (int i = 0; i < n_tiles; i++)
+        tile_write[i] = WriteLock(tile_locks[tiles[i]]);
+      WriteLock cell_write[2];
+      if (std::min(sxy, sxyp) > 0)
+        cell_write[0] = WriteLock(cell_locks[std::min(sxy, sxyp)]);
+      cell_write[1] = WriteLock(cell_locks[std::max(sxy, sxyp)]);
+
+      bool valid = cell_version[sxy] == seen[n_tiles] &&
+                   cell_version[sxyp] == seen[n_tiles + 1];
+      for (int i = 0; i < n_tiles; i++)
+        if (tile_version[tiles[i]] != seen[i])
+          valid = false;
+      if (!valid) {
+        local_conflicts++;
+        continue;
+      }
+
+      {
+        WriteLock edge_lock(edge_mutex);
+        ConvertSpin(x, y, xp, yp);
+        UpdateEdgesAroundSite(x, y, loop);
+        SumDH += D_H;
+        commits++;
+      }
+      tile_version[(x / tile_size) * tiles_y + y / tile_size]++;
+      // the medium's properties do not enter into DeltaH()
+      if (sxy)
+        cell_version[sxy]++;
+      if (sxyp)
+        cell_version[sxyp]++;
+      if (disconnects)
+        local_disconnecting++;
+      retrying = false;
+    }
+    claimed += local_claimed;
+    conflicts += local_conflicts;
+    disconnecting += local_disconnecting;
+    disconnecting_rejected += local_disconnecting_rejected;
+  };
+
+  // seed the workers from the main generator, so that runs are repeatable up
+  // to the scheduling of the threads
+  WorkerPool &workers = Workers();
+  std::vector<unsigned> seeds(workers.size());
+  for (unsigned &seed : seeds)
+    seed = (unsigned)RandomNumber(MBIG);
+  workers.parallel_for(seeds.size(), [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++)
+      worker(seeds[i]);
+  });
+
+  PROFILE_COUNT(speculative_attempts, claimed.load())
+  PROFILE_COUNT(speculative_commits, commits)
+  PROFILE_COUNT(speculative_conflicts, conflicts.load())
+  copy_attempts += claimed.load();
+  if (GetMoveStatistics())
+    EndMoveStatisticsStep(claimed.load(), commits, disconnecting.load(),
+                          disconnecting_rejected.load(), sizeedgelist);
+
+  ReleaseEmptyTiles();
   return SumDH;
 }
 
@@ -1129,18 +1689,18 @@ void CellularPotts::AddEdgeToEdgelist(
     int edge) { // add an edge to the end of edgelist
   int counteredge = CounterEdge(edge);
 
-  // assign a unique integer to position 'edge' in the edgelist
-  edgelist[edge] = sizeedgelist;
-  // assign a unique integer at the end of orderedgelist, maintaining the
-  // bijection between the lists
+  // assign a unique integer at the end of orderedgelist
   orderedgelist[sizeedgelist] = edge;
   // Increase the size of the array
   sizeedgelist++;
+  // store the position (plus one) at position 'edge' in the edgelist,
+  // maintaining the bijection between the lists
+  edgelist[edge] = sizeedgelist;
 
   // Repeat for the counteredge
-  edgelist[counteredge] = sizeedgelist;
   orderedgelist[sizeedgelist] = counteredge;
   sizeedgelist++;
+  edgelist[counteredge] = sizeedgelist;
 }
 
 void CellularPotts::RemoveEdgeFromEdgelist(
@@ -1148,25 +1708,25 @@ void CellularPotts::RemoveEdgeFromEdgelist(
   int counteredge = CounterEdge(edge);
 
   if (edgelist[edge] !=
-      sizeedgelist - 1) { // if edge is not the last edge in orderedgelist
+      sizeedgelist) { // if edge is not the last edge in orderedgelist
     // move the edge in the last position to the position of the edge that must
     // be deleted
-    orderedgelist[edgelist[edge]] = orderedgelist[sizeedgelist - 1];
+    orderedgelist[edgelist[edge] - 1] = orderedgelist[sizeedgelist - 1];
     edgelist[orderedgelist[sizeedgelist - 1]] = edgelist[edge];
   }
   // remove the edge from the edgelist
-  edgelist[edge] = -1;
+  edgelist[edge] = 0;
   // free the last position of orderedgelist
   orderedgelist[sizeedgelist - 1] = -1;
   // decrease the size of the edgelist
   sizeedgelist--;
 
   // Repeat for counteredge
-  if (edgelist[counteredge] != sizeedgelist - 1) {
-    orderedgelist[edgelist[counteredge]] = orderedgelist[sizeedgelist - 1];
+  if (edgelist[counteredge] != sizeedgelist) {
+    orderedgelist[edgelist[counteredge] - 1] = orderedgelist[sizeedgelist - 1];
     edgelist[orderedgelist[sizeedgelist - 1]] = edgelist[counteredge];
   }
-  edgelist[counteredge] = -1;
+  edgelist[counteredge] = 0;
   orderedgelist[sizeedgelist - 1] = -1;
   sizeedgelist--;
 }
@@ -1297,6 +1857,7 @@ int CellularPotts::IsingMove(PDE *PDEfield) {
 
     if (D_H != 0 && (p = CopyvProb(D_H, 0, false) > 0)) {
 
+      TrackSiteChange(x, y, sigma[x][y] == 0 ? 1 : 0);
       sigma[x][y] = sigma[x][y] == 0 ? 1 : 0;
       SumDH += D_H;
     }
@@ -1324,6 +1885,7 @@ int CellularPotts::PottsMove(PDE *PDEfield) {
     int D_H = PottsDeltaH(x, y, new_state);
     // cerr << "D_H = " << D_H << endl;
     if (D_H < 0 || (p = CopyvProb(D_H, 0, false) > 0)) {
+      TrackSiteChange(x, y, new_state);
       sigma[x][y] = new_state;
       // cerr << "[ " << x << ", " << y << "]";
       SumDH += D_H;
@@ -1378,6 +1940,7 @@ int CellularPotts::PottsNeighbourMove(PDE *PDEfield) {
     int D_H = PottsDeltaH(x, y, kp);
     // cerr << "D_H = " << D_H << endl;
     if (D_H < 0 || (p = CopyvProb(D_H, 0, false) > 0)) {
+      TrackSiteChange(x, y, kp);
       sigma[x][y] = kp;
       // cerr << "[ " << x << ", " << y << "]";
       SumDH += D_H;
@@ -1391,6 +1954,11 @@ CellECMInteractions CellularPotts::GetCellECMInteractions() const {
   return adhesion_mover.get_cell_ecm_interactions();
 }
 
+void CellularPotts::TakeCellECMInteractions(
+    CellECMInteractions &interactions) {
+  adhesion_mover.take_cell_ecm_interactions(interactions);
+}
+
 void CellularPotts::ResetCellECMInteractions() {
   return adhesion_mover.reset_cell_ecm_interactions();
 }
@@ -1400,6 +1968,12 @@ void CellularPotts::SetECMBoundaryState(
   return adhesion_mover.update(ecm_boundary_state);
 }
 
+void CellularPotts::SetECMBoundaryState(
+    ECMBoundaryState const &ecm_boundary_state,
+    ECMBoundaryChanges const &changes) {
+  return adhesion_mover.update(ecm_boundary_state, changes);
+}
+
 /** A simple method to plot all sigma's in window
     without the black lines */
 void CellularPotts::PlotSigma(Graphics *g, int mag) {
@@ -1422,7 +1996,7 @@ void CellularPotts::PlotIsing(Graphics *g, int mag) {
 }
 
 int **CellularPotts::SearchNandPlot(Graphics *g, bool get_neighbours) {
-  int i, j, q;
+  int i, q;
   int **neighbours = 0;
 
   /* Allocate neighbour matrix */
@@ -1444,8 +2018,8 @@ int **CellularPotts::SearchNandPlot(Graphics *g, bool get_neighbours) {
       neighbours[0][i] = EMPTY;
   }
 
-  for (i = 0; i < sizex - 1; i++)
-    for (j = 0; j < sizey - 1; j++) {
+  auto scan = [&](int i, int j0, int j1) {
+    for (int j = j0; j < j1; j++) {
       int colour;
       if (sigma[i][j] <= 0) {
         colour = 0;
@@ -1519,6 +2093,18 @@ int **CellularPotts::SearchNandPlot(Graphics *g, bool get_neighbours) {
       } else if (g && sigma[i][j] > 0)
         g->Point(colour, i + 1, j + 1);
     }
+  };
+
+  if (tile_index && !g) {
+    // cell borders only occur near cells
+    tile_index->for_each_active_column_span(0, [&](int i, int j0, int j1) {
+      if (i < sizex - 1)
+        scan(i, j0, min(j1, sizey - 1));
+    });
+  } else {
+    for (i = 0; i < sizex - 1; i++)
+      scan(i, 0, sizey - 1);
+  }
 
   if (get_neighbours)
     return neighbours;
@@ -1692,6 +2278,7 @@ int CellularPotts::GetMatrixLevel(int x, int y) {
 }
 
 void CellularPotts::ReadZygotePicture(void) {
+  observables.invalidate();
   int pix, cells, i, j, c, p, checkx, checky;
   char **pixelmap;
   char pixel[3];
@@ -2058,6 +2645,7 @@ void CellularPotts::DivideCells(vector<bool> which_cells) {
             motherp->DecrementArea();
             motherp->DecrementTargetArea();
             motherp->RemoveSiteFromMoments(i, j);
+            TrackSiteChange(i, j, daughterp->Sigma());
             sigma[i][j] = daughterp->Sigma();
             daughterp->AddSiteToMoments(i, j);
             daughterp->IncrementArea();
@@ -2071,11 +2659,14 @@ void CellularPotts::DivideCells(vector<bool> which_cells) {
 
   if (divflags)
     free(divflags);
+
+  RefreshCellObservables();
 }
 
 /**! Fill the plane with initial cells
  \return actual amount of cells (some are not draw due to overlap) */
 int CellularPotts::ThrowInCells(int n, int cellsize) {
+  observables.invalidate();
 
   //  int gapx=(sizex-nx*cellsize)/(nx+1);
   // int gapy=(sizey-ny*cellsize)/(ny+1);
@@ -2155,6 +2746,7 @@ int CellularPotts::GrowInCells(int n_cells, int cell_size, double subfield,
 }
 
 void CellularPotts::RandomSpins(double prob) {
+  observables.invalidate();
   for (int x = 1; x <= sizex - 2; x++) {
     for (int y = 1; y < sizey - 2; y++) {
       sigma[x][y] = (RANDOM() < prob) ? 0 : 1;
@@ -2165,6 +2757,7 @@ void CellularPotts::RandomSpins(double prob) {
 
 int CellularPotts::GrowInCells(int n_cells, int cell_size, int sx, int sy,
                                int offset_x, int offset_y) {
+  observables.invalidate();
 
   // make initial cells using Eden Growth
 
@@ -2172,19 +2765,15 @@ int CellularPotts::GrowInCells(int n_cells, int cell_size, int sx, int sy,
   if (new_sigma == NULL)
     MemoryWarning();
 
-  new_sigma[0] = (int *)malloc(sizex * sizey * sizeof(int));
+  /* Cleared CA plane */
+  new_sigma[0] = (int *)allocate_lattice((size_t)sizex * sizey * sizeof(int),
+                                         par.sparse_lattice);
   if (new_sigma[0] == NULL)
     MemoryWarning();
 
   for (int i = 1; i < sizex; i++)
     new_sigma[i] = new_sigma[i - 1] + sizey;
 
-  /* Clear CA plane */
-  {
-    for (int i = 0; i < sizex * sizey; i++)
-      new_sigma[0][i] = 0;
-  }
-
   // scatter initial points, or place a cell in the middle
   // if only one cell is desired
   int cellnum = cell->size() - 1;
@@ -2208,6 +2797,9 @@ int CellularPotts::GrowInCells(int n_cells, int cell_size, int sx, int sy,
       for (int x = 1; x < sizex - 1; x++)
         for (int y = 1; y < sizey - 1; y++) {
 
+          // only write sites that change, so that empty parts of the lattice
+          // are not touched (see par.sparse_lattice)
+          int new_sxy;
           if (sigma[x][y] == 0) {
             // take a random neighbour
             int xyp = (int)(8 * RANDOM() + 1);
@@ -2218,22 +2810,25 @@ int CellularPotts::GrowInCells(int n_cells, int cell_size, int sx, int sy,
             // You get a ragged border, which you may like!
             if ((kp = sigma[xp][yp]) != -1)
               if (kp > (cellnum - n_cells))
-                new_sigma[x][y] = kp;
+                new_sxy = kp;
               else
-                new_sigma[x][y] = 0;
+                new_sxy = 0;
             else
-              new_sigma[x][y] = 0;
+              new_sxy = 0;
 
           } else {
-            new_sigma[x][y] = sigma[x][y];
+            new_sxy = sigma[x][y];
           }
+          if (new_sigma[x][y] != new_sxy)
+            new_sigma[x][y] = new_sxy;
         }
 
       // copy sigma to new_sigma, but do not touch the border!
       {
         for (int x = 1; x < sizex - 1; x++) {
           for (int y = 1; y < sizey - 1; y++) {
-            sigma[x][y] = new_sigma[x][y];
+            if (sigma[x][y] != new_sigma[x][y])
+              sigma[x][y] = new_sigma[x][y];
           }
         }
       }
@@ -2247,6 +2842,7 @@ int CellularPotts::GrowInCells(int n_cells, int cell_size, int sx, int sy,
 
 /** Draw a square cell in at (cx,cy) */
 int CellularPotts::SquareCell(int sig, int cx, int cy, int size) {
+  observables.invalidate();
   int xmin, xmax;
   xmin = cx - size / 2;
   if (xmin < 1)
@@ -2286,7 +2882,7 @@ bool CellularPotts::ConnectivityPreservedP(int x, int y) {
   int n_borders =
       0; // to count the amount of sites in state sxy bordering a site !=sxy
 
-  static int stack[8]; // stack to count number of different surrounding cells
+  int stack[8]; // stack to count number of different surrounding cells
   int stackp = -1;
   bool one_of_neighbours_medium = false;
   for (int i = 1; i <= 8; i++) {
@@ -2345,7 +2941,7 @@ bool CellularPotts::ConnectivityPreservedPCluster(int x, int y) {
   int n_borders =
       0; // to count the amount of sites in state sxy bordering a site !=sxy
 
-  static int stack[8]; // stack to count number of different surrounding cells
+  int stack[8]; // stack to count number of different surrounding cells
   int stackp = -1;
   bool one_of_neighbours_medium = false;
 
@@ -2415,22 +3011,45 @@ bool CellularPotts::ConnectivityPreservedPCluster(int x, int y) {
 
 double CellularPotts::CellDensity(void) const {
   // return the density of cells
-  int sum = 0;
-  for (int i = 0; i < sizex * sizey; i++) {
-    if (sigma[0][i]) {
-      sum++;
+  if (observables.valid()) {
+    // cells plus the border
+    long border = 2 * sizex + 2 * (sizey - 2);
+    return (double)(observables.occupied_area() + border) /
+           (double)(sizex * sizey);
+  }
+  if (tile_index) {
+    // cells plus the border
+    long border = 2 * sizex + 2 * (sizey - 2);
+    return (double)(tile_index->occupied_sites() + border) /
+           (double)(sizex * sizey);
+  }
+  int sum = sigma.visit([](auto const &lattice) {
+    int sum = 0;
+    for (size_t i = 0; i < lattice.size(); i++) {
+      if (lattice.data()[i]) {
+        sum++;
+      }
     }
-  }
+    return sum;
+  });
   return (double)sum / (double)(sizex * sizey);
 }
 
 double CellularPotts::MeanCellArea(void) const {
+  if (observables.valid()) {
+    double n = observables.alive_cells();
+    cerr << "Mean cell length is " << observables.alive_length() / n << endl;
+    return (double)observables.alive_area() / n;
+  }
+
   int sum_area = 0, n = 0;
   double sum_length = 0.;
   vector<Cell>::iterator c = cell->begin();
   ++c;
 
   for (; c != cell->end(); c++) {
+    if (!c->AliveP())
+      continue;
     sum_area += c->Area();
     sum_length += c->Length();
     n++;
@@ -2456,6 +3075,7 @@ void CellularPotts::SetRandomTypes(void) {
     // cerr << "Setting celltype " << celltype << endl;
     c->setTau(celltype);
   }
+  RebuildObservables();
 }
 
 void CellularPotts::GrowAndDivideCells(int growth_rate) {
@@ -2479,6 +3099,8 @@ void CellularPotts::GrowAndDivideCells(int growth_rate) {
       which_cells[c->Sigma()] = false;
     }
   }
+  // some cells changed type
+  RebuildObservables();
   DivideCells(which_cells);
 }
 
@@ -2690,28 +3312,36 @@ double CellularPotts::Compactness(void) {
 void CellularPotts::FindBoundingBox(void) {
   int min_x = sizex + 2, max_x = 0;
   int min_y = sizey + 2, max_y = 0;
-  for (int x = 1; x <= sizex - 2; x++) {
-    for (int y = 1; y <= sizey - 2; y++) {
-      if (sigma[x][y]) {
-        if (x < min_x) {
-          min_x = x;
-        }
-        if (x > max_x) {
-          max_x = x;
-        }
-        if (y < min_y) {
-          min_y = y;
-        }
-        if (y > max_y) {
-          max_y = y;
+  auto scan = [&](int x0, int y0, int x1, int y1) {
+    for (int x = max(x0, 1); x <= min(x1 - 1, sizex - 2); x++) {
+      for (int y = max(y0, 1); y <= min(y1 - 1, sizey - 2); y++) {
+        if (sigma[x][y]) {
+          if (x < min_x) {
+            min_x = x;
+          }
+          if (x > max_x) {
+            max_x = x;
+          }
+          if (y < min_y) {
+            min_y = y;
+          }
+          if (y > max_y) {
+            max_y = y;
+          }
         }
       }
     }
-  }
+  };
+
+  if (tile_index)
+    tile_index->for_each_occupied_tile(scan);
+  else
+    scan(1, 1, sizex - 1, sizey - 1);
 }
 
 // useful to demonstrate large q-Potts
 void CellularPotts::RandomSigma(int n_cells) {
+  observables.invalidate();
   for (int x = 0; x < sizex; x++) {
     for (int y = 0; y < sizey; y++) {
       sigma[x][y] = (int)(n_cells * RANDOM());
@@ -2754,12 +3384,152 @@ void CellularPotts::anneal(int steps) {
 }
 
 int **CellularPotts::get_annealed_sigma(int steps) {
-  int **tmp_a = sigma;
-  int **tmp_b;
-  AllocateSigma(par.sizex, par.sizey);
-  std::copy(*tmp_a, (*tmp_a) + (par.sizex * par.sizey), *sigma);
+  SpinField saved(sigma);
   anneal(steps);
-  tmp_b = sigma;
-  sigma = tmp_a;
-  return tmp_b;
+
+  int **annealed = (int **)malloc(sizex * sizeof(int *));
+  if (annealed == NULL)
+    MemoryWarning();
+  annealed[0] = (int *)malloc((size_t)sizex * sizey * sizeof(int));
+  if (annealed[0] == NULL)
+    MemoryWarning();
+  for (int i = 1; i < sizex; i++)
+    annealed[i] = annealed[i - 1] + sizey;
+  for (size_t i = 0; i < sigma.size(); i++)
+    annealed[0][i] = sigma.get(i);
+
+  // restore the lattice and everything derived from it, in place so that
+  // views from getSigma() stay valid
+  saved.visit([this](auto const &lattice) { sigma.assign(lattice); });
+  RebuildTileIndex();
+  if (edgelist)
+    InitialiseEdgeList();
+  else
+    RebuildObservables();
+  return annealed;
+}
+
+void CellularPotts::WriteCheckpoint(CheckpointWriter &checkpoint) const {
+  checkpoint.begin_section("CPM ");
+  checkpoint.write<int32_t>(sizex);
+  checkpoint.write<int32_t>(sizey);
+  checkpoint.write<int32_t>(n_nb);
+  checkpoint.write<int32_t>(thetime);
+  checkpoint.write<int32_t>(zygote_area);
+  checkpoint.write<int32_t>(frozen);
+  checkpoint.write<int32_t>(sigma.spin_bytes());
+  checkpoint.write<int32_t>(0); // keeps the lattice 8-byte aligned
+  sigma.visit([&](auto const &lattice) {
+    checkpoint.write_bytes(lattice.data(),
+                           lattice.size() * sizeof(*lattice.data()));
+  });
+  checkpoint.end_section();
+
+  if (edgelist) {
+    // edgelist holds the positions of the edges in orderedgelist, and is
+    // rebuilt from it
+    checkpoint.begin_section("EDGE");
+    checkpoint.write<int64_t>(sizeedgelist);
+    checkpoint.write_bytes(orderedgelist, (size_t)sizeedgelist * sizeof(int));
+    checkpoint.end_section();
+  }
+
+  checkpoint.begin_section("ACT ");
+  vector<array<int, 2>> alive(alivePixels.begin(), alivePixels.end());
+  vector<array<int, 3>> act;
+  act.reserve(actPixels.size());
+  for (auto const &pixel : actPixels)
+    act.push_back({pixel.first[0], pixel.first[1], pixel.second});
+  checkpoint.write_vector(alive);
+  checkpoint.write_vector(act);
+  checkpoint.end_section();
+
+  if (matrix) {
+    checkpoint.begin_section("MTRX");
+    checkpoint.write_bytes(matrix[0], (size_t)sizex * sizey * sizeof(int));
+    checkpoint.end_section();
+  }
+}
+
+void CellularPotts::ReadCheckpoint(CheckpointReader &checkpoint) {
+  checkpoint.begin_section("CPM ");
+  int sx = checkpoint.read<int32_t>();
+  int sy = checkpoint.read<int32_t>();
+  int nnb = checkpoint.read<int32_t>();
+  if (sx != sizex || sy != sizey || nnb != n_nb)
+    throw std::runtime_error(
+        "The checkpoint has a different lattice size or neighbourhood");
+  thetime = checkpoint.read<int32_t>();
+  zygote_area = checkpoint.read<int32_t>();
+  frozen = checkpoint.read<int32_t>();
+  int spin_bytes = checkpoint.read<int32_t>();
+  checkpoint.read<int32_t>();
+
+  // overwrite in place so that views from getSigma() stay valid, converting
+  // if the checkpoint was made with another spin type
+  size_t n_sites = sigma.size();
+  if (spin_bytes == 2)
+    sigma.assign(static_cast<const int16_t *>(
+        checkpoint.read_bytes(n_sites * sizeof(int16_t))));
+  else if (spin_bytes == 4)
+    sigma.assign(static_cast<const int32_t *>(
+        checkpoint.read_bytes(n_sites * sizeof(int32_t))));
+  else
+    throw std::runtime_error("The checkpoint has an invalid spin type");
+  checkpoint.end_section();
+
+  if (checkpoint.has_section("EDGE")) {
+    checkpoint.begin_section("EDGE");
+    AllocateEdgeList();
+    int64_t n_listed = checkpoint.read<int64_t>();
+    int64_t n_edges = edgelist_bytes / sizeof(int);
+    if (n_listed < 0 || n_listed > n_edges)
+      throw std::runtime_error("The checkpoint has an invalid edge list");
+    memcpy(orderedgelist, checkpoint.read_bytes(n_listed * sizeof(int)),
+           n_listed * sizeof(int));
+    for (int i = 0; i < n_listed; i++) {
+      if (orderedgelist[i] < 0 || orderedgelist[i] >= n_edges)
+        throw std::runtime_error("The checkpoint has an invalid edge list");
+      edgelist[orderedgelist[i]] = i + 1;
+    }
+    sizeedgelist = n_listed;
+    checkpoint.end_section();
+  }
+
+  checkpoint.begin_section("ACT ");
+  alivePixels.clear();
+  for (auto const &pixel : checkpoint.read_vector<array<int, 2>>())
+    alivePixels.insert(pixel);
+  actPixels.clear();
+  for (auto const &pixel : checkpoint.read_vector<array<int, 3>>())
+    actPixels[{pixel[0], pixel[1]}] = pixel[2];
+  checkpoint.end_section();
+
+  if (checkpoint.has_section("MTRX")) {
+    checkpoint.begin_section("MTRX");
+    size_t bytes = (size_t)sizex * sizey * sizeof(int);
+    if (!matrix) {
+      matrix = (int **)malloc(sizex * sizeof(int *));
+      if (matrix == NULL)
+        MemoryWarning();
+      matrix[0] = (int *)allocate_lattice(bytes, par.sparse_lattice);
+      if (matrix[0] == NULL)
+        MemoryWarning();
+      for (int i = 1; i < sizex; i++)
+        matrix[i] = matrix[i - 1] + sizey;
+    } else {
+      memset(matrix[0], 0, bytes);
+    }
+    copy_into_lattice(matrix[0], checkpoint.read_bytes(bytes), bytes);
+    checkpoint.end_section();
+  }
+
+  RebuildTileIndex();
+  RebuildObservables();
+}
+
+void CellularPotts::SetSigmaField(const int32_t *spins) {
+  observables.invalidate();
+  sigma.assign(spins);
+  RebuildTileIndex();
 }
@@ -35,17 +35,25 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <random>
 #include <stdio.h>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "adhesion_mover.hpp"
 #include "cell.hpp"
 #include "cell_ecm_interactions.hpp"
+#include "move_statistics.hpp"
+#include "observables.hpp"
 #include "pde.hpp"
+#include "spin_lattice.hpp"
+#include "tile_index.hpp"
+#include "worker_pool.hpp"
 
 using namespace std;
 
@@ -76,6 +84,8 @@ template <typename T, size_t N> struct hash<array<T, N>> {
 };
 } // namespace std
 
+class CheckpointReader;
+class CheckpointWriter;
 class Dish;
 
 class Dir {
@@ -134,6 +144,58 @@ public:
   */
   void InitialiseEdgeList(void);
 
+  /*! \brief Recounts the occupied sites per tile of the sparse lattice
+
+  Only used if par.sparse_lattice is set. The tile index is kept up to date by
+  the Monte Carlo moves, and rebuilt by InitialiseEdgeList(). Call this after
+  changing sigma directly, e.g. after placing new cells, if you do not call
+  InitialiseEdgeList() afterwards.
+  */
+  void RebuildTileIndex(void);
+
+  /*! \brief Returns memory backing emptied tiles to the operating system
+
+  Only used if par.sparse_lattice is set. Pages of sigma and of the edge list
+  that have become entirely empty since the last call are released; they are
+  transparently mapped again, filled with zeros, when next written to.
+  Called automatically at the end of each AmoebaeMove().
+  */
+  void ReleaseEmptyTiles(void);
+
+  //! \brief Returns the tile index of the sparse lattice, or nullptr
+  inline const TileIndex *GetTileIndex(void) const { return tile_index.get(); }
+
+  /*! \brief Recompute the running totals of global observables from scratch
+
+  Done automatically by InitialiseEdgeList(). Call this after changing sigma
+  directly or changing the types of cells, if you do not call
+  InitialiseEdgeList() afterwards. If sigma contains cells that do not exist
+  (yet), the observables are left invalid.
+  */
+  void RebuildObservables(void);
+
+  /*! \brief Update the observables after changing properties of the cells
+
+  The observables follow the cells as they move, but do not notice changes to
+  e.g. target areas made through Cell's methods. This picks those up. It is
+  called automatically at the start of each AmoebaeMove().
+  */
+  void RefreshCellObservables(void);
+
+  /*! \brief Check the running totals against a full recomputation
+
+  Throws std::runtime_error if they differ. Called after every
+  par.verify_observables MCS, for debugging.
+  */
+  void VerifyObservables(void);
+
+  /*! \brief Returns running totals of global observables, see Observables
+
+  These are valid after InitialiseEdgeList() or RebuildObservables(), until
+  sigma is changed directly.
+  */
+  inline const Observables &GetObservables(void) const { return observables; }
+
   /*! \brief Allocates data for the sigma array
 
    Keyword virtual means, that derived classed (cppvmCellularPotts) can override
@@ -203,12 +265,18 @@ public:
 
   //! Return the total area occupied by the cells
   inline int Mass(void) {
-    int mass = 0;
-    for (int i = 0; i < sizex * sizey; i++) {
-      if (sigma[0][i] > 0)
-        mass++;
-    }
-    return mass;
+    if (observables.valid())
+      return observables.occupied_area();
+    if (tile_index)
+      return tile_index->occupied_sites();
+    return sigma.visit([](auto const &lattice) {
+      int mass = 0;
+      for (size_t i = 0; i < lattice.size(); i++) {
+        if (lattice.data()[i] > 0)
+          mass++;
+      }
+      return mass;
+    });
   }
 
   /*! \brief Find a bounding box that contains all cells
@@ -238,12 +306,21 @@ public:
   void DivideCells(std::vector<bool> which_cells);
 
   /*! Implements the core CPM algorithm. Carries out one MCS.
+
+    If par.parallel_move is "speculative", the copy attempts are carried out
+    by several threads, see SpeculativeAmoebaeMove().
+
+    If par.move_stats_stride is positive, statistics of the copy attempts are
+    collected and appended to par.move_stats_file every move_stats_stride
+    MCS, see MoveStatistics. Speculative moves are counted, but not
+    sampled.
     \return Total energy change during MCS.
   */
   int AmoebaeMove(PDE *PDEfield = 0, bool anneal = false);
 
   /*! Implements the core CPM algorithm including Act dynamics. Carries out one
-    MCS with the edge lsit algorithmAMo. \return Total energy change during MCS.
+    MCS with the edge lsit algorithmAMo. Collects statistics like
+    AmoebaeMove(). \return Total energy change during MCS.
   */
   int Act_AmoebaeMove(PDE *PDEfield);
 
@@ -272,6 +349,12 @@ public:
    */
   CellECMInteractions GetCellECMInteractions() const;
 
+  /*! Moves changes made to the adhesions since the last reset into
+   * interactions, and clears them. The memory of interactions is reused to
+   * record further changes.
+   */
+  void TakeCellECMInteractions(CellECMInteractions &interactions);
+
   /*! Clears recorded changes to the adhesions.
    */
   void ResetCellECMInteractions();
@@ -280,6 +363,12 @@ public:
    */
   void SetECMBoundaryState(ECMBoundaryState const &ecm_boundary_state);
 
+  /*! Set ECM boundary state, given what changed since the previous one.
+    This is faster than the above if few things changed.
+   */
+  void SetECMBoundaryState(ECMBoundaryState const &ecm_boundary_state,
+                           ECMBoundaryChanges const &changes);
+
   /*! \brief Read initial cell shape from XPM file.
     Reads the initial cell shape from an
     include xpm picture called "ZYGXPM(ZYGOTE)",
@@ -302,6 +391,9 @@ public:
   //! Returns the number of completed Monte Carlo steps.
   inline int Time() const { return thetime; }
 
+  //! Returns the number of copy attempts evaluated since the CPM was created.
+  inline long long CopyAttempts() const { return copy_attempts; }
+
   // not currently used? In Critter implementation (see Hogeweg
   // 2000) this was used to have cells divide at double their original area.
   inline int ZygoteArea() const { return zygote_area; }
@@ -317,6 +409,47 @@ public:
   i.e. This will return the index of the cell which occupies site (x,y). */
   inline int Sigma(const int x, const int y) const { return sigma[x][y]; }
 
+  /*! \brief Set the value of lattice site (x,y).
+
+  With 16-bit spins (see Spin), this throws std::overflow_error if s does not
+  fit. */
+  inline void SetSigma(const int x, const int y, const int s) {
+    if constexpr (sizeof(Spin) < sizeof(int))
+      SpinField::check(s);
+    observables.invalidate();
+    TrackSiteChange(x, y, s);
+    sigma[x][y] = s;
+  }
+
+  /*! \brief Replace the whole lattice.
+
+  \param spins SizeX() * SizeY() spins, with site (x,y) at x * SizeY() + y.
+
+  Like SetSigma(), this checks that the spins fit. */
+  void SetSigmaField(const int32_t *spins);
+
+  /*! \brief Call f with the lattice, read-only and in its storage type.
+
+  See SpinField::visit(). Unlike getSigma(), this works with 16-bit spins. */
+  template <typename F> decltype(auto) VisitSigma(F &&f) const {
+    return sigma.visit(std::forward<F>(f));
+  }
+
+  /*! \brief Return the lattice as ints, column by column.
+
+  \param buffer Used to convert the spins if they are not stored as ints.
+  \return A pointer into the lattice itself if the spins are ints, or into
+  buffer otherwise.
+  */
+  const int *SigmaInts(std::vector<int> &buffer) const {
+    return sigma.visit([&buffer](auto const &lattice) -> const int * {
+      if constexpr (std::is_same<decltype(*lattice.data()), const int &>::value)
+        return lattice.data();
+      buffer.assign(lattice.data(), lattice.data() + lattice.size());
+      return buffer.data();
+    });
+  }
+
   // Was used to make it possible to enlarge the Graphics window in
   // X11 and replace the contents interactively. Not currently supported.
   void Replace(Graphics *g);
@@ -375,7 +508,8 @@ public:
   */
   void ShowDirections(Graphics &g, const Dir *celldir) const;
 
-  //! \brief Returns the mean area of the cells.
+  //! \brief Returns the mean area of the living cells, and prints their mean
+  //! length.
   double MeanCellArea(void) const;
 
   /*! \brief Returns the cell density.
@@ -442,8 +576,37 @@ public:
   */
   int **get_annealed_sigma(int steps);
 
-  // Return Sigma Array for use on GPU
-  inline int **getSigma() { return sigma; }
+  /*! \brief Write the state of the CPM to a checkpoint
+
+  Stores the lattice, the edge list, the time and the act and matrix fields.
+  The cells are stored by Dish::WriteCheckpoint(). The adhesions are not
+  stored, they are restored from the ECM by SetECMBoundaryState().
+  */
+  void WriteCheckpoint(CheckpointWriter &checkpoint) const;
+
+  /*! \brief Restore the state of the CPM from a checkpoint
+
+  The cells must have been restored already, so that the tile index and the
+  observables can be rebuilt. Throws std::runtime_error if the checkpoint
+  does not match the lattice size or neighbourhood of this CPM.
+  */
+  void ReadCheckpoint(CheckpointReader &checkpoint);
+
+  /*! \brief Return the sigma field as an int**, e.g. for use on the GPU
+
+  This points into the lattice itself, and stays valid as long as this
+  CellularPotts. It is not available if the toolkit was built with 16-bit
+  spins, in which case this throws std::logic_error; use VisitSigma() instead.
+  */
+  inline int **getSigma() { return sigma.int_view(); }
+
+  /*! \brief Return the threads that the CPM runs loops on
+
+  There are par.move_threads of them, started by the first call and kept
+  until the CPM is destroyed. They may be used for other work on the lattice
+  in between steps, e.g. by adhesion_zone().
+  */
+  WorkerPool &Workers(void);
 
   /*! \brief plot the sigma at (x,y)
   \return True if cell belongs to medium
@@ -467,13 +630,18 @@ public:
 private:
   /*! \brief Standard deltaH with are constraint, length constraint and
    * chemotaxis
+
+   If terms is not null, the contribution of each term is stored in it.
    */
   int DeltaH(int x, int y, int xp, int yp, PDE *PDEfield,
-             AdhesionDisplacements *adh_disp);
+             AdhesionDisplacements *adh_disp, DeltaHTerms *terms = nullptr);
 
   /*! \brief DeltaH, including act dynamics
+
+   If terms is not null, the contribution of each term is stored in it.
    */
-  int Act_DeltaH(int x, int y, int xp, int yp, PDE *PDEfield = 0);
+  int Act_DeltaH(int x, int y, int xp, int yp, PDE *PDEfield = 0,
+                 DeltaHTerms *terms = nullptr);
 
   /*! \brief Compute deltaH for Kawasaki dynamics
    */
@@ -517,6 +685,83 @@ private:
    */
   int CounterEdge(int edge);
 
+  /*! \brief Add the edges from (x,y) to neighbours with a different sigma
+   */
+  void AddEdgesOfSite(int x, int y);
+
+  /*! \brief Find the lattice sites at both ends of an edge of the edge list
+
+   (x,y) is the site that is copied into, (xp,yp) the site copied from.
+   */
+  void EdgeSites(int edge, int &x, int &y, int &xp, int &yp) const;
+
+  /*! \brief Add and remove edges around (x,y) after its sigma changed
+
+   \param loop: Number of copy attempts in the current MCS, adjusted for the
+   change in the number of edges.
+   */
+  void UpdateEdgesAroundSite(int x, int y, float &loop);
+
+  /*! \brief Return the move statistics, or null if they are disabled
+
+   Creates them if par.move_stats_stride is set.
+   */
+  MoveStatistics *GetMoveStatistics(void);
+
+  /*! \brief Record the end of an MCS in the move statistics, and write them
+   out if par.move_stats_stride has passed
+
+   See MoveStatistics::end_step(). edges is -1 if the MCS does not use the
+   edge list.
+   */
+  void EndMoveStatisticsStep(long attempts, long accepted, long disconnecting,
+                             long disconnecting_rejected, long edges);
+
+  /*! \brief Carry out one MCS with speculative parallel copy attempts
+
+   Keeps the random sequential semantics of AmoebaeMove(): par.move_threads
+   worker threads draw random edges and compute DeltaH concurrently, and
+   commit accepted copies after checking that the neighbourhood of the copy
+   and the cells involved have not changed since. If they have, the attempt
+   is discarded and a new edge is drawn. Each part of the lattice and each
+   cell has its own lock, so that only attempts close to each other or on
+   the same cells wait for each other. The numbers of attempts, commits and
+   conflicts are recorded by the profiler.
+   \return Total energy change during MCS.
+   */
+  int SpeculativeAmoebaeMove(PDE *PDEfield, bool anneal);
+
+  /*! \brief Allocate empty edge lists for the current lattice size
+   */
+  void AllocateEdgeList(void);
+
+  /*! \brief Update the observables' areas and contacts before sigma[x][y] is
+   set to new_sigma
+   */
+  void TrackContacts(int x, int y, int new_sigma);
+
+  /*! \brief Update the contribution of cell sigma to the observables
+   */
+  void UpdateCellObservables(int sigma);
+
+  /*! \brief Returns the area and length constraint energy of a cell
+   */
+  double CellEnergy(Cell &c) const;
+
+  /*! \brief Update the sparse lattice's tile index and the observables before
+   sigma[x][y] is set to new_sigma
+   */
+  inline void TrackSiteChange(int x, int y, int new_sigma) {
+    if (observables.valid())
+      TrackContacts(x, y, new_sigma);
+    if (!tile_index)
+      return;
+    if (sigma[x][y] <= 0 && new_sigma > 0)
+      tile_index->add_site(x, y);
+    else if (sigma[x][y] > 0 && new_sigma <= 0)
+      tile_index->remove_site(x, y);
+  }
+
   /*! \brief Find the cell size of cell c
    */
   void MeasureCellSize(Cell &c);
@@ -561,7 +806,7 @@ protected:
   void BaseInitialisation(std::vector<Cell> *cell);
 
 protected:
-  int **sigma;
+  SpinField sigma;
   int sizex;
   int sizey;
 
@@ -569,13 +814,22 @@ private:
   bool frozen;
   static const int nx[21], ny[21];
   static const int nbh_level[4];
+  // edgelist holds for each edge its position in orderedgelist plus one, or 0
+  // if the edge is not in the list, so that a freshly allocated list is empty.
   int *edgelist;
   int *orderedgelist;
   int sizeedgelist;
+  size_t edgelist_bytes;
+  std::unique_ptr<TileIndex> tile_index;
+  Observables observables;
+  std::unique_ptr<MoveStatistics> move_stats;
+  // see Workers()
+  std::unique_ptr<WorkerPool> move_workers;
   static int shuffleindex[9];
   std::vector<Cell> *cell;
   int zygote_area;
   int thetime;
+  long long copy_attempts;
   int n_nb;
   AdhesionMover adhesion_mover;
 };
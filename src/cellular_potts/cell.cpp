@@ -28,6 +28,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include <malloc.h>
 #endif
 #include "cell.hpp"
+#include "checkpoint.hpp"
 #include "dish.hpp"
 #include "parameter.hpp"
 #include "sticky.hpp"
@@ -111,7 +112,10 @@ void Cell::ConstructorBody(int settau) {
   // amount gives the total number of Cell instantiations (including copies)
   amount++;
 
-  // maxsigma keeps track of the last cell identity number given out to a cell
+  // maxsigma keeps track of the last cell identity number given out to a cell.
+  // With 16-bit spins, refuse to hand out one that does not fit in the lattice.
+  if constexpr (sizeof(Spin) < sizeof(int))
+    SpinField::check(maxsigma);
   sigma = maxsigma++;
 
   if (!J) {
@@ -192,3 +196,35 @@ void Cell::ClearJ(void) {
     J[0][i] = EMPTY;
   }
 }
+
+void Cell::WriteCheckpoint(CheckpointWriter &checkpoint) const {
+  for (int value : {colour, sigma, tau, mother, daughter, times_divided,
+                    date_of_birth, colour_of_birth, area, target_area,
+                    adhesive_area, ref_adhesive_area, growth_threshold,
+                    perimeter, target_perimeter, n_copies})
+    checkpoint.write<int32_t>(value);
+  checkpoint.write<int32_t>(alive);
+  for (double value :
+       {length, target_length, v[0], v[1], grad[0], grad[1], border})
+    checkpoint.write(value);
+  for (long value : {sum_x, sum_y, sum_xx, sum_yy, sum_xy})
+    checkpoint.write<int64_t>(value);
+  checkpoint.write_bytes(chem, par.n_chem * sizeof(double));
+}
+
+void Cell::ReadCheckpoint(CheckpointReader &checkpoint) {
+  for (int *value : {&colour, &sigma, &tau, &mother, &daughter,
+                     &times_divided, &date_of_birth, &colour_of_birth, &area,
+                     &target_area, &adhesive_area, &ref_adhesive_area,
+                     &growth_threshold, &perimeter, &target_perimeter,
+                     &n_copies})
+    *value = checkpoint.read<int32_t>();
+  alive = checkpoint.read<int32_t>();
+  for (double *value :
+       {&length, &target_length, &v[0], &v[1], &grad[0], &grad[1], &border})
+    *value = checkpoint.read<double>();
+  for (long *value : {&sum_x, &sum_y, &sum_xx, &sum_yy, &sum_xy})
+    *value = checkpoint.read<int64_t>();
+  memcpy(chem, checkpoint.read_bytes(par.n_chem * sizeof(double)),
+         par.n_chem * sizeof(double));
+}
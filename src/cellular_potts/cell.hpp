@@ -29,6 +29,8 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include <math.h>
 
 extern Parameter par;
+class CheckpointReader;
+class CheckpointWriter;
 class Dish;
 
 class Cell {
@@ -338,6 +340,12 @@ public:
     return adhesive_area = adhesive_area - decrement;
   }
 
+  //! Write all state of the cell, except its owner, to a checkpoint.
+  void WriteCheckpoint(CheckpointWriter &checkpoint) const;
+
+  //! Restore the state written by WriteCheckpoint().
+  void ReadCheckpoint(CheckpointReader &checkpoint);
+
 private:
   /*! \brief Read a table of static Js.
     First line: number of types (including medium)
@@ -21,6 +21,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 
 */
 #include "dish.hpp"
+#include "checkpoint.hpp"
 #include "crash.hpp"
 #include "info.hpp"
 #include "inputoutput.hpp"
@@ -33,6 +34,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include <iostream>
 #include <list>
 #include <math.h>
+#include <stdexcept>
 #include <string.h>
 #include <vector>
 
@@ -45,9 +47,24 @@ extern Parameter par;
 
 using namespace std;
 
-Dish::Dish() {
+Dish::Dish(bool resumable) {
   ConstructorBody();
 
+  if (par.restart_file != "None") {
+    if (!resumable)
+      throw std::runtime_error(
+          "This model cannot continue from a checkpoint, set restart_file to "
+          "None");
+    // Continue a previous run; the parameters that set up the initial state
+    // do not apply
+    CPM = new CellularPotts(&cell, par.sizex, par.sizey);
+    io = new IO(*this);
+    if (par.n_chem)
+      PDEfield = new PDE(par.n_chem, par.sizex, par.sizey);
+    ReadCheckpoint(par.restart_file);
+    return;
+  }
+
   if (par.load_mcds) {
     ImportMultiCellDS(par.mcds_input);
   } else {
@@ -143,6 +160,8 @@ void Dish::CellGrowthAndDivision(void) {
   // Divide scheduled cells
   if (cell_division) {
     CPM->DivideCells(which_cells);
+  } else {
+    CPM->RefreshCellObservables();
   }
 }
 
@@ -160,6 +179,9 @@ int Dish::CountCells(void) const {
 }
 
 int Dish::Area(void) const {
+  if (CPM && CPM->GetObservables().valid())
+    return CPM->GetObservables().occupied_area();
+
   int total_area = 0;
   vector<Cell>::const_iterator i;
   for ((i = cell.begin(), i++); i != cell.end(); ++i) {
@@ -169,6 +191,9 @@ int Dish::Area(void) const {
 }
 
 int Dish::TargetArea(void) const {
+  if (CPM && CPM->GetObservables().valid())
+    return CPM->GetObservables().target_area();
+
   int total_area = 0;
   vector<Cell>::const_iterator i;
   for ((i = cell.begin(), i++); i != cell.end(); ++i) {
@@ -238,9 +263,11 @@ void Dish::ImportMultiCellDS(std::string const &fname) {
   CPM = new CellularPotts(&cell, par.sizex, par.sizey);
   if (par.n_chem)
     PDEfield = new PDE(par.n_chem, par.sizex, par.sizey);
-  int **sigma = CPM->getSigma();
   int **lattice = mcds.get_lattice();
-  std::copy(*lattice, (*lattice) + (par.sizex * par.sizey), *sigma);
+  for (int x = 0; x < par.sizex; x++)
+    for (int y = 0; y < par.sizey; y++)
+      if (CPM->Sigma(x, y) != lattice[x][y])
+        CPM->SetSigma(x, y, lattice[x][y]);
   for (auto iocell : *mcds.get_cells()) {
     MCDS_import_cell(&mcds, iocell.second.mcds_obj->ID());
   }
@@ -248,6 +275,65 @@ void Dish::ImportMultiCellDS(std::string const &fname) {
   sizechange = true;
 }
 
+void Dish::WriteCheckpoint(std::string const &fname) const {
+  CheckpointWriter checkpoint(fname);
+
+  RandomState rng = GetRandomState();
+  checkpoint.begin_section("RNG ");
+  checkpoint.write(rng);
+  checkpoint.end_section();
+
+  checkpoint.begin_section("CELL");
+  checkpoint.write<int32_t>(Cell::maxsigma);
+  checkpoint.write<int32_t>(par.n_chem);
+  checkpoint.write<uint64_t>(cell.size());
+  for (Cell const &c : cell)
+    c.WriteCheckpoint(checkpoint);
+  checkpoint.end_section();
+
+  CPM->WriteCheckpoint(checkpoint);
+  if (PDEfield)
+    PDEfield->WriteCheckpoint(checkpoint);
+
+  checkpoint.commit();
+}
+
+void Dish::ReadCheckpoint(std::string const &fname) {
+  CheckpointReader checkpoint(fname);
+
+  checkpoint.begin_section("CELL");
+  int maxsigma = checkpoint.read<int32_t>();
+  if (checkpoint.read<int32_t>() != par.n_chem)
+    throw std::runtime_error("Checkpoint " + fname +
+                             " has a different number of chemicals");
+  uint64_t n_cells = checkpoint.read<uint64_t>();
+  if (n_cells == 0 || n_cells > (uint64_t)INT32_MAX)
+    throw std::runtime_error("Checkpoint " + fname +
+                             " has an invalid number of cells");
+
+  // Add all cells before reading any of them, as the copy constructor used
+  // when the vector grows does not copy every field
+  cell.reserve(n_cells);
+  while (cell.size() < n_cells)
+    cell.push_back(Cell(*this));
+  for (Cell &c : cell)
+    c.ReadCheckpoint(checkpoint);
+  Cell::maxsigma = maxsigma;
+  checkpoint.end_section();
+
+  // The CPM rebuilds its derived state from the cells read above
+  CPM->ReadCheckpoint(checkpoint);
+  if (PDEfield)
+    PDEfield->ReadCheckpoint(checkpoint);
+  else if (checkpoint.has_section("PDE "))
+    throw std::runtime_error("Checkpoint " + fname +
+                             " has PDE planes, but n_chem is 0");
+
+  checkpoint.begin_section("RNG ");
+  SetRandomState(checkpoint.read<RandomState>());
+  checkpoint.end_section();
+}
+
 void Dish::MCDS_export_cell(MCDS_io *mcds, Cell *cell) {
   int cell_id = cell->Sigma();
   io_cell *iocell = mcds->get_new_cell(cell_id);
@@ -45,7 +45,14 @@ class Dish {
   friend class Info;
 
 public:
-  Dish();
+  /*! \brief Set up the dish, or restore it from par.restart_file
+
+  \param resumable Whether the model can continue a run from a checkpoint,
+  i.e. takes its step counter from CPM->Time() and writes checkpoints. If
+  not, setting par.restart_file throws std::runtime_error, rather than
+  silently starting the model from the wrong step.
+  */
+  Dish(bool resumable = false);
   /*! \brief Init defines the initial state of the virtual
     cell culture.
 
@@ -86,7 +93,11 @@ public:
   //! \brief. Returns the summed area of all cells in the dish
   int Area(void) const;
 
-  //! \brief Returns the summed of all cells target area in the dish
+  /*! \brief Returns the summed of all cells target area in the dish
+
+  Changes made to the target areas through Cell since the last call to
+  CPM->AmoebaeMove() are included only after CPM->RefreshCellObservables().
+  */
   int TargetArea(void) const;
 
   //! \brief Returns the horizontal size of the dish.
@@ -111,6 +122,23 @@ public:
   void ExportMultiCellDS(std::string const &fname);
   void ImportMultiCellDS(std::string const &fname);
 
+  /*! \brief Write the complete simulation state to a binary checkpoint
+
+  Stores the random number generator, the cells, the CPM and the PDE planes,
+  so that a run restarted from the checkpoint with ReadCheckpoint()
+  continues exactly as the original run would have. The file is replaced
+  atomically, so a crash while writing leaves the previous checkpoint intact.
+  */
+  void WriteCheckpoint(std::string const &fname) const;
+
+  /*! \brief Restore the simulation state from a binary checkpoint
+
+  CPM and PDEfield must have been allocated with the same size and number of
+  chemicals as the run that wrote the checkpoint. Throws std::runtime_error
+  if the checkpoint cannot be read or does not match.
+  */
+  void ReadCheckpoint(std::string const &fname);
+
 protected:
   //! Assign a the cell to the current Dish
   void SetCellOwner(Cell &which_cell);
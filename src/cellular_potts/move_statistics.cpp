@@ -0,0 +1,156 @@
+#include "move_statistics.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <ostream>
+#include <stdexcept>
+
+char const *DeltaHTerms::name(int term) {
+  static char const *const names[n_terms] = {
+      "adhesion",   "area",         "perimeter", "length",
+      "chemotaxis", "ecm_adhesion", "act",       "connectivity"};
+  return names[term];
+}
+
+MoveStatistics::MoveStatistics(int sample_interval)
+    : sample_interval_(std::max(1, sample_interval)),
+      countdown_(sample_interval_) {}
+
+int MoveStatistics::bin(int value) {
+  std::uint64_t magnitude = std::llabs(static_cast<long long>(value));
+  int width = 0;
+  while (magnitude) {
+    magnitude >>= 1;
+    width++;
+  }
+  return n_side_bins + (value < 0 ? -width : width);
+}
+
+std::int64_t MoveStatistics::bin_lower(int bin) {
+  int k = bin - n_side_bins;
+  if (k == 0)
+    return 0;
+  std::int64_t magnitude = std::int64_t(1) << (std::abs(k) - 1);
+  return k < 0 ? -magnitude : magnitude;
+}
+
+void MoveStatistics::record(DeltaHTerms const &terms, int type, int type_p,
+                            bool accepted) {
+  samples_++;
+  for (int t = 0; t < DeltaHTerms::n_terms; t++) {
+    histograms_[t][bin(terms.value[t])]++;
+    sums_[t] += terms.value[t];
+  }
+
+  if (type < 0 || type_p < 0)
+    return;
+  int needed = std::max(type, type_p) + 1;
+  if (needed > n_types_) {
+    std::vector<std::uint64_t> attempts(needed * needed, 0);
+    std::vector<std::uint64_t> accepts(needed * needed, 0);
+    for (int i = 0; i < n_types_; i++)
+      for (int j = 0; j < n_types_; j++) {
+        attempts[i * needed + j] = type_attempts_[i * n_types_ + j];
+        accepts[i * needed + j] = type_accepted_[i * n_types_ + j];
+      }
+    type_attempts_.swap(attempts);
+    type_accepted_.swap(accepts);
+    n_types_ = needed;
+  }
+  type_attempts_[type * n_types_ + type_p]++;
+  if (accepted)
+    type_accepted_[type * n_types_ + type_p]++;
+}
+
+void MoveStatistics::end_step(std::int64_t attempts, std::int64_t accepted,
+                              std::int64_t disconnecting,
+                              std::int64_t disconnecting_rejected,
+                              std::int64_t edges) {
+  steps_.push_back(
+      {attempts, accepted, disconnecting, disconnecting_rejected, edges});
+}
+
+std::uint64_t MoveStatistics::sampled(int type, int type_p) const {
+  if (type >= n_types_ || type_p >= n_types_)
+    return 0;
+  return type_attempts_[type * n_types_ + type_p];
+}
+
+std::uint64_t MoveStatistics::sampled_accepted(int type, int type_p) const {
+  if (type >= n_types_ || type_p >= n_types_)
+    return 0;
+  return type_accepted_[type * n_types_ + type_p];
+}
+
+void MoveStatistics::write(std::ostream &out, int time) {
+  auto write_steps = [&](char const *name, std::int64_t Step::*field) {
+    out << ",\"" << name << "\":[";
+    for (std::size_t i = 0; i < steps_.size(); i++)
+      out << (i ? "," : "") << steps_[i].*field;
+    out << "]";
+  };
+
+  out << "{\"time\":" << time;
+  write_steps("attempts", &Step::attempts);
+  write_steps("accepted", &Step::accepted);
+  write_steps("disconnecting", &Step::disconnecting);
+  write_steps("disconnecting_rejected", &Step::disconnecting_rejected);
+  write_steps("edges", &Step::edges);
+
+  out << ",\"sample_interval\":" << sample_interval_;
+  out << ",\"samples\":" << samples_;
+  out << ",\"terms\":{";
+  for (int t = 0; t < DeltaHTerms::n_terms; t++) {
+    out << (t ? "," : "") << "\"" << DeltaHTerms::name(t) << "\":{";
+    out << "\"mean\":"
+        << (samples_ ? static_cast<double>(sums_[t]) / samples_ : 0.0);
+    out << ",\"histogram\":{";
+    bool first = true;
+    for (int b = 0; b < n_bins; b++) {
+      if (!histograms_[t][b])
+        continue;
+      out << (first ? "" : ",") << "\"" << bin_lower(b)
+          << "\":" << histograms_[t][b];
+      first = false;
+    }
+    out << "}}";
+  }
+  out << "}";
+
+  out << ",\"types\":[";
+  bool first = true;
+  for (int i = 0; i < n_types_; i++)
+    for (int j = 0; j < n_types_; j++) {
+      std::uint64_t attempts = type_attempts_[i * n_types_ + j];
+      if (!attempts)
+        continue;
+      out << (first ? "" : ",") << "[" << i << "," << j << "," << attempts
+          << "," << type_accepted_[i * n_types_ + j] << "]";
+      first = false;
+    }
+  out << "]}\n";
+
+  clear_();
+}
+
+void MoveStatistics::write(std::string const &path, int time) {
+  if (!file_.is_open() || path != path_) {
+    file_.close();
+    file_.open(path, std::ios::trunc);
+    path_ = path;
+  }
+  write(file_, time);
+  file_.flush();
+  if (!file_)
+    throw std::runtime_error("Error writing move statistics to " + path);
+}
+
+void MoveStatistics::clear_() {
+  steps_.clear();
+  samples_ = 0;
+  for (auto &histogram : histograms_)
+    histogram.fill(0);
+  sums_.fill(0);
+  std::fill(type_attempts_.begin(), type_attempts_.end(), 0);
+  std::fill(type_accepted_.begin(), type_accepted_.end(), 0);
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/** Contributions of the terms of the Hamiltonian to the DeltaH of a copy
+ * attempt
+ *
+ * The terms add up to the DeltaH used to decide on the copy, except for
+ * connectivity, which is the dissipation added when the copy would break up
+ * the cell.
+ */
+struct DeltaHTerms {
+  enum Term {
+    adhesion,     // contact energy between cells, and with the border
+    area,         // area constraint
+    perimeter,    // perimeter constraint
+    length,       // length constraint
+    chemotaxis,   // chemotaxis up the gradient of PDE layer 0
+    ecm_adhesion, // moving the adhesions with the ECM
+    act,          // Act model protrusions
+    connectivity, // dissipation for breaking the cell's connectivity
+    n_terms
+  };
+
+  std::array<int, n_terms> value{};
+
+  /// Return the name of term, as used in the output.
+  static char const *name(int term);
+};
+
+/** Statistics of the copy attempts of the Monte Carlo steps
+ *
+ * Counts the attempts, the accepted copies, the attempts that would break the
+ * connectivity of a cell and how many of those were rejected, and the size of
+ * the edge list per MCS. In addition, one in every sample_interval attempts
+ * is sampled: the contribution of each term of DeltaH is added to a
+ * histogram, and the attempt and its outcome are counted by the types of the
+ * cells involved. Sampling is deterministic, so that the random numbers of
+ * the simulation are not affected.
+ *
+ * Histograms have logarithmic bins: 0 has its own bin, and positive and
+ * negative values v with 2^(k-1) <= |v| < 2^k are in bin k on either side.
+ *
+ * The statistics are written as JSON lines, one object per interval, see
+ * write(). After writing, they start again from zero.
+ */
+class MoveStatistics {
+public:
+  /// Number of histogram bins on each side of the bin of 0
+  static constexpr int n_side_bins = 32;
+  static constexpr int n_bins = 2 * n_side_bins + 1;
+
+  /** Create statistics
+   *
+   * @param sample_interval Sample one in this many attempts, at least 1.
+   */
+  explicit MoveStatistics(int sample_interval);
+
+  /** Decide whether to sample the next copy attempt
+   *
+   * Returns true once every sample_interval calls.
+   */
+  bool sample() {
+    if (--countdown_ > 0)
+      return false;
+    countdown_ = sample_interval_;
+    return true;
+  }
+
+  /** Record a sampled copy attempt
+   *
+   * @param terms Contributions to DeltaH.
+   * @param type Type (tau) of the cell copied into.
+   * @param type_p Type of the cell copied from.
+   * @param accepted Whether the copy was accepted.
+   */
+  void record(DeltaHTerms const &terms, int type, int type_p, bool accepted);
+
+  /** Record the end of a Monte Carlo step
+   *
+   * @param attempts Number of copy attempts during the step.
+   * @param accepted Number of accepted copies.
+   * @param disconnecting Number of attempts that would have broken the
+   *        connectivity of a cell.
+   * @param disconnecting_rejected Number of those that were rejected.
+   * @param edges Size of the edge list at the end of the step.
+   */
+  void end_step(std::int64_t attempts, std::int64_t accepted,
+                std::int64_t disconnecting,
+                std::int64_t disconnecting_rejected, std::int64_t edges);
+
+  /// Return the bin that value falls in.
+  static int bin(int value);
+
+  /// Return the value in bin that is closest to zero.
+  static std::int64_t bin_lower(int bin);
+
+  /// Return the histogram of term, see DeltaHTerms::Term.
+  std::array<std::uint64_t, n_bins> const &histogram(int term) const {
+    return histograms_[term];
+  }
+
+  /// Return the number of sampled attempts from type_p into type.
+  std::uint64_t sampled(int type, int type_p) const;
+
+  /// Return the number of those that were accepted.
+  std::uint64_t sampled_accepted(int type, int type_p) const;
+
+  /// Return the number of steps recorded since the last write.
+  std::size_t steps() const { return steps_.size(); }
+
+  /** Write the statistics as a single line of JSON and clear them
+   *
+   * The object has the time, per step arrays of attempts, accepted copies,
+   * disconnecting attempts, rejected disconnecting attempts and edge list
+   * sizes, the number of sampled attempts, the mean and the non-empty bins
+   * of the histogram of each term, keyed by bin_lower(), and the sampled
+   * attempts and acceptances by pair of types as a list of
+   * [type, type_p, attempts, accepted].
+   *
+   * @param out Stream to write to.
+   * @param time Time (MCS) of the last step.
+   */
+  void write(std::ostream &out, int time);
+
+  /** Append the statistics to a file and clear them
+   *
+   * The file is truncated the first time it is written to.
+   *
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  void write(std::string const &path, int time);
+
+private:
+  struct Step {
+    std::int64_t attempts;
+    std::int64_t accepted;
+    std::int64_t disconnecting;
+    std::int64_t disconnecting_rejected;
+    std::int64_t edges;
+  };
+
+  void clear_();
+
+  int sample_interval_;
+  int countdown_;
+
+  std::vector<Step> steps_;
+  std::uint64_t samples_ = 0;
+  std::array<std::array<std::uint64_t, n_bins>, DeltaHTerms::n_terms>
+      histograms_{};
+  std::array<std::int64_t, DeltaHTerms::n_terms> sums_{};
+
+  // sampled attempts and acceptances by pair of types, type * n_types_ +
+  // type_p, grown as types are seen
+  int n_types_ = 0;
+  std::vector<std::uint64_t> type_attempts_;
+  std::vector<std::uint64_t> type_accepted_;
+
+  std::string path_;
+  std::ofstream file_;
+};
@@ -0,0 +1,101 @@
+#include "observables.hpp"
+
+#include <cmath>
+#include <sstream>
+
+void Observables::reset(int n_types, std::size_t n_cells) {
+  n_types_ = n_types;
+
+  occupied_area_ = 0;
+  type_area_.assign(n_types, 0);
+
+  contacts_.assign(n_types * n_types, 0);
+  contact_energy_.assign(n_types * n_types, 0);
+  border_contacts_.assign(n_types, 0);
+  border_energy_.assign(n_types, 0);
+  interfaces_.assign(n_types * n_types, 0);
+  total_contact_energy_ = 0;
+
+  cells_.assign(n_cells, CellRecord());
+  alive_cells_ = 0;
+  alive_area_ = 0;
+  target_area_ = 0;
+  alive_length_ = 0.0;
+  cell_energy_ = 0.0;
+
+  valid_ = true;
+}
+
+void Observables::set_cell(std::size_t sigma, bool alive, int area,
+                           int target_area, double length, double energy) {
+  if (sigma >= cells_.size())
+    cells_.resize(sigma + 1);
+
+  CellRecord &record = cells_[sigma];
+  if (record.alive) {
+    alive_cells_--;
+    alive_area_ -= record.area;
+    target_area_ -= record.target_area;
+    alive_length_ -= record.length;
+  }
+  cell_energy_ -= record.energy;
+
+  record.alive = alive;
+  record.area = area;
+  record.target_area = target_area;
+  record.length = length;
+  record.energy = energy;
+
+  if (alive) {
+    alive_cells_++;
+    alive_area_ += area;
+    target_area_ += target_area;
+    alive_length_ += length;
+  }
+  cell_energy_ += energy;
+}
+
+std::string Observables::compare(Observables const &reference) const {
+  std::ostringstream diff;
+  auto check = [&](std::string const &what, double value, double expected) {
+    if (diff.tellp() == 0 && value != expected)
+      diff << what << " is " << value << ", expected " << expected;
+  };
+
+  if (n_types_ != reference.n_types_)
+    return "Number of types differs";
+
+  check("occupied area", occupied_area_, reference.occupied_area_);
+  check("number of living cells", alive_cells_, reference.alive_cells_);
+  check("area of living cells", alive_area_, reference.alive_area_);
+  check("target area", target_area_, reference.target_area_);
+  check("contact energy", total_contact_energy_,
+        reference.total_contact_energy_);
+  for (int t1 = 0; t1 < n_types_; t1++) {
+    std::string type = " of type " + std::to_string(t1);
+    check("area" + type, type_area_[t1], reference.type_area_[t1]);
+    check("border contacts" + type, border_contacts_[t1],
+          reference.border_contacts_[t1]);
+    for (int t2 = t1; t2 < n_types_; t2++) {
+      std::string with = " with " + std::to_string(t2);
+      check("contacts" + type + with, contacts(t1, t2),
+            reference.contacts(t1, t2));
+      check("interfaces" + type + with, interfaces(t1, t2),
+            reference.interfaces(t1, t2));
+    }
+  }
+
+  // the cell energy and length are floating point sums, which are updated in
+  // a different order than they are recomputed
+  auto check_sum = [&](std::string const &what, double value,
+                       double expected) {
+    double tolerance = 1e-6 * (1.0 + std::fabs(expected));
+    if (diff.tellp() == 0 && std::fabs(value - expected) > tolerance)
+      diff << what << " is " << value << ", expected " << expected;
+  };
+  check_sum("cell energy", cell_energy_, reference.cell_energy_);
+  check_sum("length of living cells", alive_length_,
+            reference.alive_length_);
+
+  return diff.str();
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/** Running totals of global properties of a CPM configuration
+ *
+ * CellularPotts keeps these up to date as the lattice changes, so that they
+ * can be obtained in constant time, rather than by scanning the lattice or
+ * the cells. Cell types are indexed by tau, cells by sigma. Type 0 and cell 0
+ * are the medium.
+ *
+ * Contacts are counted per pair of neighbouring sites, using the same
+ * neighbourhood as the adhesion energy, and only between different cells.
+ * Contacts with the border of the lattice are counted separately.
+ *
+ * Interfaces are counted in the same way, but always between orthogonal
+ * neighbours, so that they measure the length of the boundaries between
+ * cells of each pair of types regardless of the neighbourhood used for the
+ * energy. The border is not included.
+ *
+ * The total Hamiltonian is the contact (adhesion) energy plus the area and
+ * length constraint energies of the cells. Chemotaxis, connectivity and
+ * adhesion to the ECM enter into DeltaH, but are not part of it.
+ */
+class Observables {
+public:
+  /** Clear all totals and mark them as valid
+   *
+   * @param n_types Number of cell types, including the medium.
+   * @param n_cells Number of cells, including the medium.
+   */
+  void reset(int n_types, std::size_t n_cells);
+
+  /// Return whether the totals describe the current configuration.
+  bool valid() const { return valid_; }
+
+  /// Mark the totals as out of date, e.g. after the lattice was overwritten.
+  void invalidate() { valid_ = false; }
+
+  /** Record that sites of a type were added or removed
+   *
+   * @param type Type of the sites.
+   * @param count Number of sites added, negative if removed.
+   */
+  void add_sites(int type, int count) {
+    type_area_[type] += count;
+    if (type != 0)
+      occupied_area_ += count;
+  }
+
+  /** Record that contacts between sites of two types were added or removed
+   *
+   * @param type1 Type of the site on one side.
+   * @param type2 Type of the site on the other side.
+   * @param count Number of contacts added, negative if removed.
+   * @param energy Adhesion energy of a single contact.
+   */
+  void add_contacts(int type1, int type2, int count, int energy) {
+    std::size_t i = pair_index_(type1, type2);
+    contacts_[i] += count;
+    contact_energy_[i] += (long)count * energy;
+    total_contact_energy_ += (long)count * energy;
+  }
+
+  /** Record that interfaces between sites of two types were added or removed
+   *
+   * @param type1 Type of the site on one side.
+   * @param type2 Type of the site on the other side.
+   * @param count Number of interface edges added, negative if removed.
+   */
+  void add_interfaces(int type1, int type2, int count) {
+    interfaces_[pair_index_(type1, type2)] += count;
+  }
+
+  /** Record that contacts between sites of a type and the border were added or
+   * removed
+   *
+   * @param type Type of the site next to the border.
+   * @param count Number of contacts added, negative if removed.
+   * @param energy Energy of a single contact.
+   */
+  void add_border_contacts(int type, int count, int energy) {
+    border_contacts_[type] += count;
+    border_energy_[type] += (long)count * energy;
+    total_contact_energy_ += (long)count * energy;
+  }
+
+  /** Update the contribution of a cell to the totals
+   *
+   * @param sigma The cell.
+   * @param alive Whether the cell is alive.
+   * @param area Its area.
+   * @param target_area Its target area.
+   * @param length Its length.
+   * @param energy Its area and length constraint energy.
+   */
+  void set_cell(std::size_t sigma, bool alive, int area, int target_area,
+                double length, double energy);
+
+  /// Return the number of types, including the medium.
+  int n_types() const { return n_types_; }
+
+  /// Return the number of sites that are occupied by a cell.
+  long occupied_area() const { return occupied_area_; }
+
+  /// Return the number of sites occupied by cells of a type.
+  long type_area(int type) const { return type_area_[type]; }
+
+  /// Return the number of living cells, excluding the medium.
+  int alive_cells() const { return alive_cells_; }
+
+  /// Return the summed area of the living cells.
+  long alive_area() const { return alive_area_; }
+
+  /// Return the summed target area of the living cells.
+  long target_area() const { return target_area_; }
+
+  /// Return the summed length of the living cells.
+  double alive_length() const { return alive_length_; }
+
+  /// Return the number of contacts between sites of two types.
+  long contacts(int type1, int type2) const {
+    return contacts_[pair_index_(type1, type2)];
+  }
+
+  /// Return the adhesion energy of the contacts between two types.
+  long contact_energy(int type1, int type2) const {
+    return contact_energy_[pair_index_(type1, type2)];
+  }
+
+  /// Return the interface length between cells of two types.
+  long interfaces(int type1, int type2) const {
+    return interfaces_[pair_index_(type1, type2)];
+  }
+
+  /// Return the number of contacts between sites of a type and the border.
+  long border_contacts(int type) const { return border_contacts_[type]; }
+
+  /// Return the energy of the contacts between a type and the border.
+  long border_energy(int type) const { return border_energy_[type]; }
+
+  /// Return the total adhesion energy, including the border.
+  long contact_energy() const { return total_contact_energy_; }
+
+  /// Return the summed area and length constraint energy of the cells.
+  double cell_energy() const { return cell_energy_; }
+
+  /// Return the total Hamiltonian.
+  double hamiltonian() const { return total_contact_energy_ + cell_energy_; }
+
+  /** Compare against totals computed from scratch
+   *
+   * @param reference The recomputed totals.
+   * @return A description of the first difference, or an empty string if
+   *         there is none.
+   */
+  std::string compare(Observables const &reference) const;
+
+private:
+  struct CellRecord {
+    bool alive = false;
+    int area = 0;
+    int target_area = 0;
+    double length = 0.0;
+    double energy = 0.0;
+  };
+
+  std::size_t pair_index_(int type1, int type2) const {
+    return type1 < type2 ? type1 * n_types_ + type2 : type2 * n_types_ + type1;
+  }
+
+  bool valid_ = false;
+  int n_types_ = 0;
+
+  long occupied_area_ = 0;
+  std::vector<long> type_area_;
+
+  // upper triangle of a n_types_ x n_types_ matrix
+  std::vector<long> contacts_;
+  std::vector<long> contact_energy_;
+  std::vector<long> border_contacts_;
+  std::vector<long> border_energy_;
+  std::vector<long> interfaces_;
+  long total_contact_energy_ = 0;
+
+  std::vector<CellRecord> cells_;
+  int alive_cells_ = 0;
+  long alive_area_ = 0;
+  long target_area_ = 0;
+  double alive_length_ = 0.0;
+  double cell_energy_ = 0.0;
+};
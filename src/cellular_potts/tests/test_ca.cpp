@@ -0,0 +1,107 @@
+// Load the code to be tested, and what it needs
+#include "ca.cpp"
+#include "adhesion_index.cpp"
+#include "adhesion_mover.cpp"
+#include "adhesion_movement.cpp"
+#include "cell.cpp"
+#include "cell_ecm_interactions.cpp"
+#include "checkpoint.cpp"
+#include "crash.cpp"
+#include "ecm_boundary_state.cpp"
+#include "ecm_interaction_tracker.cpp"
+#include "hull.cpp"
+#include "lattice_memory.cpp"
+#include "move_statistics.cpp"
+#include "neighbours.cpp"
+#include "observables.cpp"
+#include "parameter_file.cpp"
+#include "parameter.cpp"
+#include "random.cpp"
+#include "spin_lattice.cpp"
+#include "tile_index.cpp"
+#include "vec2.cpp"
+#include "worker_pool.cpp"
+
+// A bare dish for the cells to belong to, which asks them for the time when
+// they're born
+Dish::Dish(bool) {}
+Dish::~Dish() {}
+int Dish::Time(void) const { return 0; }
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <vector>
+
+
+TEST_CASE("SetSigma keeps the sparse lattice's tile index up to date", "[ca]")
+{
+    par = Parameter();
+    par.sparse_lattice = true;
+    par.lattice_tile_size = 4;
+
+    std::vector<Cell> cells;
+    CellularPotts ca(&cells, 20, 20);
+    ca.RebuildTileIndex();
+    REQUIRE(ca.GetTileIndex() != nullptr);
+    REQUIRE(ca.Mass() == 0);
+
+    ca.SetSigma(5, 5, 1);
+    ca.SetSigma(6, 5, 1);
+    ca.SetSigma(15, 12, 2);
+    REQUIRE(ca.Mass() == 3);
+    REQUIRE(ca.GetTileIndex()->occupied_sites() == 3);
+
+    // overwriting a cell with another one doesn't change the mass
+    ca.SetSigma(6, 5, 2);
+    REQUIRE(ca.Mass() == 3);
+
+    ca.SetSigma(5, 5, 0);
+    ca.SetSigma(15, 12, 0);
+    REQUIRE(ca.Mass() == 1);
+
+    SECTION("and so does SetSigmaField") {
+        std::vector<int32_t> spins(20 * 20, 0);
+        spins[3 * 20 + 4] = 1;
+        spins[10 * 20 + 10] = 1;
+        ca.SetSigmaField(spins.data());
+        REQUIRE(ca.Mass() == 2);
+    }
+}
+
+
+TEST_CASE("MeanCellArea only counts living cells", "[ca]")
+{
+    par = Parameter();
+    par.Jtable = "../../../data/J.dat";
+
+    Dish dish;
+    std::vector<Cell> cells;
+    cells.push_back(Cell(dish, 0));
+    CellularPotts ca(&cells, 20, 20);
+
+    // cell 1 is 4x3, cell 2 is 2x2 and dead, cell 3 is 1x1
+    for (int x = 2; x < 6; x++)
+        for (int y = 2; y < 5; y++)
+            ca.SetSigma(x, y, 1);
+    for (int x = 10; x < 12; x++)
+        for (int y = 10; y < 12; y++)
+            ca.SetSigma(x, y, 2);
+    ca.SetSigma(15, 15, 3);
+
+    for (int i = 0; i < 3; i++)
+        cells.push_back(Cell(dish));
+    ca.MeasureCellSizes();
+    cells[2].Apoptose();
+
+    // the slow path uses the cells, the fast path the observables
+    REQUIRE(!ca.GetObservables().valid());
+    double slow = ca.MeanCellArea();
+    REQUIRE(slow == 6.5);
+
+    ca.RebuildObservables();
+    REQUIRE(ca.GetObservables().valid());
+    REQUIRE(ca.MeanCellArea() == slow);
+    REQUIRE(ca.GetObservables().alive_length() ==
+            cells[1].Length() + cells[3].Length());
+}
@@ -0,0 +1,149 @@
+// Load the code to be tested
+#include "move_statistics.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+DeltaHTerms make_terms(int adhesion, int area, int connectivity)
+{
+    DeltaHTerms terms;
+    terms.value[DeltaHTerms::adhesion] = adhesion;
+    terms.value[DeltaHTerms::area] = area;
+    terms.value[DeltaHTerms::connectivity] = connectivity;
+    return terms;
+}
+
+}
+
+TEST_CASE("Histogram bins are logarithmic", "[move_statistics]")
+{
+    int const zero = MoveStatistics::n_side_bins;
+    REQUIRE(MoveStatistics::bin(0) == zero);
+    REQUIRE(MoveStatistics::bin(1) == zero + 1);
+    REQUIRE(MoveStatistics::bin(2) == zero + 2);
+    REQUIRE(MoveStatistics::bin(3) == zero + 2);
+    REQUIRE(MoveStatistics::bin(4) == zero + 3);
+    REQUIRE(MoveStatistics::bin(-1) == zero - 1);
+    REQUIRE(MoveStatistics::bin(-7) == zero - 3);
+    REQUIRE(MoveStatistics::bin(2147483647) == MoveStatistics::n_bins - 2);
+    REQUIRE(MoveStatistics::bin(-2147483647 - 1) == 0);
+
+    REQUIRE(MoveStatistics::bin_lower(zero) == 0);
+    REQUIRE(MoveStatistics::bin_lower(zero + 3) == 4);
+    REQUIRE(MoveStatistics::bin_lower(zero - 3) == -4);
+    for (int v : {-100, -5, -1, 1, 6, 1000}) {
+        std::int64_t lower = MoveStatistics::bin_lower(MoveStatistics::bin(v));
+        REQUIRE((v < 0 ? -lower : lower) <= (v < 0 ? -v : v));
+        REQUIRE((v < 0 ? -lower : lower) * 2 > (v < 0 ? -v : v));
+    }
+}
+
+TEST_CASE("One in every interval attempts is sampled", "[move_statistics]")
+{
+    MoveStatistics stats(4);
+    int sampled = 0;
+    for (int i = 0; i < 20; ++i)
+        if (stats.sample())
+            ++sampled;
+    REQUIRE(sampled == 5);
+
+    MoveStatistics every(0);
+    REQUIRE(every.sample());
+    REQUIRE(every.sample());
+}
+
+TEST_CASE("Samples are counted by term and type pair", "[move_statistics]")
+{
+    MoveStatistics stats(1);
+    stats.record(make_terms(-6, 2, 0), 1, 2, true);
+    stats.record(make_terms(5, 2, 2000), 1, 2, false);
+    stats.record(make_terms(0, -1, 0), 2, 0, true);
+    stats.record(make_terms(0, 0, 0), -1, 1, true);
+
+    auto const &adhesion = stats.histogram(DeltaHTerms::adhesion);
+    REQUIRE(adhesion[MoveStatistics::bin(-6)] == 1);
+    REQUIRE(adhesion[MoveStatistics::bin(5)] == 1);
+    REQUIRE(adhesion[MoveStatistics::bin(0)] == 2);
+    REQUIRE(stats.histogram(DeltaHTerms::connectivity)
+                [MoveStatistics::bin(2000)] == 1);
+
+    REQUIRE(stats.sampled(1, 2) == 2);
+    REQUIRE(stats.sampled_accepted(1, 2) == 1);
+    REQUIRE(stats.sampled(2, 0) == 1);
+    REQUIRE(stats.sampled_accepted(2, 0) == 1);
+    REQUIRE(stats.sampled(2, 1) == 0);
+    REQUIRE(stats.sampled(7, 7) == 0);
+}
+
+TEST_CASE("Statistics are written as JSON lines", "[move_statistics]")
+{
+    MoveStatistics stats(1);
+    stats.record(make_terms(-6, 2, 0), 1, 2, true);
+    stats.record(make_terms(4, 2, 0), 1, 2, false);
+    stats.end_step(10, 4, 2, 1, 120);
+    stats.end_step(12, 5, 0, 0, 118);
+    REQUIRE(stats.steps() == 2);
+
+    std::ostringstream out;
+    stats.write(out, 2);
+    std::string line = out.str();
+
+    REQUIRE(line.back() == '\n');
+    REQUIRE(line.find('\n') == line.size() - 1);
+    REQUIRE(line.rfind("{\"time\":2,\"attempts\":[10,12],", 0) == 0);
+    REQUIRE(line.find("\"accepted\":[4,5]") != std::string::npos);
+    REQUIRE(line.find("\"disconnecting\":[2,0]") != std::string::npos);
+    REQUIRE(line.find("\"disconnecting_rejected\":[1,0]") !=
+            std::string::npos);
+    REQUIRE(line.find("\"edges\":[120,118]") != std::string::npos);
+    REQUIRE(line.find("\"samples\":2") != std::string::npos);
+    REQUIRE(line.find("\"adhesion\":{\"mean\":-1,\"histogram\":"
+                      "{\"-4\":1,\"4\":1}}") != std::string::npos);
+    REQUIRE(line.find("\"area\":{\"mean\":2,\"histogram\":{\"2\":2}}") !=
+            std::string::npos);
+    REQUIRE(line.find("\"types\":[[1,2,2,1]]}") != std::string::npos);
+
+    // and start again
+    REQUIRE(stats.steps() == 0);
+    REQUIRE(stats.sampled(1, 2) == 0);
+    std::ostringstream again;
+    stats.write(again, 3);
+    REQUIRE(again.str().find("\"samples\":0") != std::string::npos);
+    REQUIRE(again.str().find("\"types\":[]") != std::string::npos);
+}
+
+TEST_CASE("Statistics are appended to a file", "[move_statistics]")
+{
+    std::string path = "test_move_statistics.jsonl";
+    {
+        std::ofstream old(path);
+        old << "left over\n";
+    }
+
+    MoveStatistics stats(1);
+    stats.end_step(1, 1, 0, 0, 8);
+    stats.write(path, 1);
+    stats.end_step(2, 0, 0, 0, 8);
+    stats.write(path, 2);
+
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    std::remove(path.c_str());
+
+    REQUIRE(lines.size() == 2);
+    REQUIRE(lines[0].rfind("{\"time\":1,", 0) == 0);
+    REQUIRE(lines[1].rfind("{\"time\":2,", 0) == 0);
+
+    REQUIRE_THROWS_AS(stats.write("/nonexistent/x.jsonl", 3),
+                      std::runtime_error);
+}
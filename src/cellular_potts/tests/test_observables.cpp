@@ -0,0 +1,143 @@
+// Load the code to be tested
+#include "observables.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Observables start out invalid", "[observables]")
+{
+    Observables obs;
+    REQUIRE(!obs.valid());
+
+    obs.reset(3, 4);
+    REQUIRE(obs.valid());
+    REQUIRE(obs.occupied_area() == 0);
+    REQUIRE(obs.alive_cells() == 0);
+    REQUIRE(obs.hamiltonian() == 0.0);
+
+    obs.invalidate();
+    REQUIRE(!obs.valid());
+}
+
+TEST_CASE("Observables track areas", "[observables]")
+{
+    Observables obs;
+    obs.reset(3, 4);
+
+    obs.add_sites(1, 5);
+    obs.add_sites(2, 3);
+    obs.add_sites(0, 7);
+    obs.add_sites(2, -1);
+
+    REQUIRE(obs.occupied_area() == 7);
+    REQUIRE(obs.type_area(0) == 7);
+    REQUIRE(obs.type_area(1) == 5);
+    REQUIRE(obs.type_area(2) == 2);
+}
+
+TEST_CASE("Observables track contacts per pair of types", "[observables]")
+{
+    Observables obs;
+    obs.reset(3, 4);
+
+    obs.add_contacts(1, 2, 3, 10);
+    obs.add_contacts(2, 1, 1, 10);
+    obs.add_contacts(0, 1, 2, 4);
+    obs.add_contacts(1, 0, -1, 4);
+    obs.add_border_contacts(2, 2, 100);
+
+    REQUIRE(obs.contacts(1, 2) == 4);
+    REQUIRE(obs.contacts(2, 1) == 4);
+    REQUIRE(obs.contact_energy(1, 2) == 40);
+    REQUIRE(obs.contacts(0, 1) == 1);
+    REQUIRE(obs.contact_energy(1, 0) == 4);
+    REQUIRE(obs.contacts(0, 2) == 0);
+    REQUIRE(obs.border_contacts(2) == 2);
+    REQUIRE(obs.border_energy(2) == 200);
+    REQUIRE(obs.contact_energy() == 244);
+}
+
+TEST_CASE("Observables track interfaces per pair of types", "[observables]")
+{
+    Observables obs;
+    obs.reset(4, 4);
+
+    obs.add_interfaces(3, 1, 5);
+    obs.add_interfaces(1, 3, -2);
+    obs.add_interfaces(0, 2, 4);
+
+    REQUIRE(obs.interfaces(1, 3) == 3);
+    REQUIRE(obs.interfaces(3, 1) == 3);
+    REQUIRE(obs.interfaces(2, 0) == 4);
+    REQUIRE(obs.interfaces(1, 1) == 0);
+
+    // interfaces do not contribute to the energy
+    REQUIRE(obs.contact_energy() == 0);
+}
+
+TEST_CASE("Observables track cells", "[observables]")
+{
+    Observables obs;
+    obs.reset(2, 3);
+
+    obs.set_cell(1, true, 45, 50, 3.0, 2.5);
+    obs.set_cell(2, true, 30, 40, 2.0, 1.0);
+    REQUIRE(obs.alive_cells() == 2);
+    REQUIRE(obs.alive_area() == 75);
+    REQUIRE(obs.target_area() == 90);
+    REQUIRE(obs.alive_length() == 5.0);
+    REQUIRE(obs.cell_energy() == 3.5);
+
+    // updating a cell replaces its contribution
+    obs.set_cell(1, true, 46, 60, 3.5, 0.5);
+    REQUIRE(obs.alive_cells() == 2);
+    REQUIRE(obs.alive_area() == 76);
+    REQUIRE(obs.target_area() == 100);
+    REQUIRE(obs.cell_energy() == 1.5);
+
+    // dead cells no longer count, even if they still have an area
+    obs.set_cell(2, false, 20, 0, 1.5, 0.0);
+    REQUIRE(obs.alive_cells() == 1);
+    REQUIRE(obs.alive_area() == 46);
+    REQUIRE(obs.target_area() == 60);
+    REQUIRE(obs.alive_length() == 3.5);
+
+    // cells created after the reset
+    obs.set_cell(5, true, 10, 10, 1.0, 0.0);
+    REQUIRE(obs.alive_cells() == 2);
+
+    obs.add_contacts(0, 1, 1, 8);
+    REQUIRE(obs.hamiltonian() == 8.5);
+}
+
+TEST_CASE("Observables compare against a recomputation", "[observables]")
+{
+    Observables running, reference;
+    running.reset(3, 3);
+    reference.reset(3, 3);
+
+    for (auto *obs : {&running, &reference})
+    {
+        obs->add_sites(1, 4);
+        obs->add_contacts(0, 1, 8, 16);
+        obs->set_cell(1, true, 4, 5, 2.0, 1.0);
+    }
+    REQUIRE(running.compare(reference).empty());
+
+    running.add_contacts(1, 2, 1, 10);
+    running.add_contacts(1, 2, -1, 10);
+    REQUIRE(running.compare(reference).empty());
+
+    running.add_interfaces(0, 1, 1);
+    REQUIRE(running.compare(reference) ==
+            "interfaces of type 0 with 1 is 1, expected 0");
+    running.add_interfaces(0, 1, -1);
+
+    running.add_contacts(2, 1, 1, 0);
+    REQUIRE(running.compare(reference) ==
+            "contacts of type 1 with 2 is 1, expected 0");
+
+    Observables other_types;
+    other_types.reset(2, 3);
+    REQUIRE(!reference.compare(other_types).empty());
+}
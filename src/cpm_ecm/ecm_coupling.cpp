@@ -0,0 +1,222 @@
+#include "cpm_ecm/ecm_coupling.hpp"
+
+#include "cpm_ecm/io.hpp"
+#include "ecm_simulation.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+using libmuscle::DataConstRef;
+using libmuscle::Instance;
+using libmuscle::Message;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point t) {
+  return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+void send_encoded(Instance &instance, int step,
+                  CellECMInteractions const &interactions) {
+  auto data = encode_cell_ecm_interactions(interactions);
+  instance.send("cell_ecm_interactions_out", Message(step, data));
+}
+
+DataConstRef receive_state(Instance &instance) {
+  return instance.receive("ecm_boundary_state_in").data();
+}
+
+} // namespace
+
+ECMCoupling::ECMCoupling(Instance &instance, int lag)
+    : instance_(instance), lag_(std::max(lag, 0)) {
+  if (lag_ > 0)
+    thread_ = std::thread(&ECMCoupling::run_, this);
+}
+
+ECMCoupling::ECMCoupling(Instance &instance, ECMSimulation &ecm)
+    : instance_(instance), lag_(0), ecm_(&ecm) {
+  thread_ = std::thread(&ECMCoupling::run_, this);
+}
+
+ECMCoupling::~ECMCoupling() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_available_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void ECMCoupling::send_interactions(int step,
+                                    CellECMInteractions interactions) {
+  if (ecm_) {
+    ecm_interactions_ = std::move(interactions);
+    return;
+  }
+
+  if (lag_ == 0) {
+    send_encoded(instance_, step, interactions);
+    recycle_(std::move(interactions));
+    return;
+  }
+
+  // the ECM sends a state for every step, in the same order
+  submit_([this, step, interactions = std::move(interactions)]() mutable {
+    send_encoded(instance_, step, interactions);
+    recycle_(std::move(interactions));
+    DataConstRef state = receive_state(instance_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    received_.push_back(std::move(state));
+  });
+}
+
+ECMBoundaryState const &ECMCoupling::boundary_state(
+    int step, ECMBoundaryChanges &changes) {
+  changes = ECMBoundaryChanges();
+  if (ecm_)
+    return local_boundary_state_(changes);
+
+  std::vector<DataConstRef> messages;
+  {
+    PROFILE_ZONE(ecm_wait)
+    auto start = Clock::now();
+    if (lag_ == 0) {
+      messages.push_back(receive_state(instance_));
+      ++state_step_;
+      wait_time_ += seconds_since(start);
+    } else {
+      int target = std::max(step - lag_, 0);
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_done_.wait(lock, [this, target] {
+        int available = state_step_ + static_cast<int>(received_.size());
+        return error_ || available >= target;
+      });
+      rethrow_();
+      for (; state_step_ < target; ++state_step_) {
+        messages.push_back(std::move(received_.front()));
+        received_.pop_front();
+      }
+      wait_time_ += seconds_since(start);
+    }
+  }
+
+  // deltas are small, so applying them here is cheaper than copying the
+  // state in the background
+  for (auto const &message : messages)
+    decode_ecm_boundary_state(message, state_, changes);
+  return state_;
+}
+
+ECMBoundaryState const &
+ECMCoupling::local_boundary_state_(ECMBoundaryChanges &changes) {
+  {
+    PROFILE_ZONE(ecm_wait)
+    auto start = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_done_.wait(lock, [this] { return pending_ == 0; });
+    rethrow_();
+    wait_time_ += seconds_since(start);
+  }
+
+  // as simulate_ecm does, take the state before applying the interactions
+  ecm_->boundary_state(state_, changes);
+  submit_([this, interactions = std::move(ecm_interactions_)]() mutable {
+    ecm_->apply_interactions(interactions);
+    recycle_(std::move(interactions));
+    ecm_->run();
+  });
+  ecm_interactions_ = CellECMInteractions();
+  return state_;
+}
+
+CellECMInteractions ECMCoupling::spare_interactions() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (spare_interactions_.empty())
+    return CellECMInteractions();
+  CellECMInteractions interactions = std::move(spare_interactions_.back());
+  spare_interactions_.pop_back();
+  return interactions;
+}
+
+void ECMCoupling::send(std::string const &port, Message const &message) {
+  if (lag_ == 0) {
+    instance_.send(port, message);
+    return;
+  }
+  submit_([this, port, message] { instance_.send(port, message); });
+}
+
+void ECMCoupling::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_done_.wait(lock, [this] { return pending_ == 0; });
+  rethrow_();
+}
+
+double ECMCoupling::wait_time() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return wait_time_;
+}
+
+void ECMCoupling::recycle_(CellECMInteractions &&interactions) {
+  interactions.clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  // no more than can be in use at the same time, in case they're not reused
+  if (spare_interactions_.size() < static_cast<std::size_t>(lag_) + 2u)
+    spare_interactions_.push_back(std::move(interactions));
+}
+
+void ECMCoupling::submit_(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rethrow_();
+    jobs_.push_back(std::move(job));
+    ++pending_;
+  }
+  job_available_.notify_one();
+}
+
+void ECMCoupling::run_() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_available_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty())
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    std::exception_ptr error;
+    try {
+      PROFILE_ZONE(ecm_exchange)
+      job();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --pending_;
+      if (error) {
+        // the remaining messages can no longer be exchanged in order
+        error_ = error;
+        pending_ -= jobs_.size();
+        jobs_.clear();
+      }
+    }
+    job_done_.notify_all();
+  }
+}
+
+void ECMCoupling::rethrow_() {
+  if (error_)
+    std::rethrow_exception(error_);
+}
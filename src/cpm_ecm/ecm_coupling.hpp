@@ -0,0 +1,148 @@
+#pragma once
+
+#include <libmuscle/libmuscle.hpp>
+
+#include "cell_ecm_interactions.hpp"
+#include "ecm_boundary_state.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ECMSimulation;
+
+/** Exchanges messages between the CPM and the ECM simulation
+ *
+ * In each MCS, the CPM sends the interactions of the previous MCS to the ECM
+ * and receives a boundary state from it. The ECM sends its state before it
+ * receives the interactions, so the two simulations already run at the same
+ * time, and the state of step i does not include the interactions of step
+ * i - 1 yet.
+ *
+ * With a lag of 0, the messages are sent and received by the calling thread,
+ * and step i waits for the state the ECM sends in step i, as before. With a
+ * lag of n > 0, a background thread encodes, sends and receives the
+ * messages, and step i uses the state the ECM sent in step i - n (or its
+ * first one, at the start). This lets the CPM run up to n steps ahead when
+ * the ECM takes longer for a while, at the cost of the CPM seeing older
+ * fibril positions. Which state is used does not depend on timing, so runs
+ * remain reproducible.
+ *
+ * The ECM can also be simulated in this process, by an ECMSimulation. The
+ * coupling then behaves as with a lag of 0, but the ECM runs on a background
+ * thread while the CPM does its step, taking the place of the separate ECM
+ * program.
+ *
+ * libmuscle's Instance must be used by one thread at a time, so the instance
+ * must not be used directly while the coupling exists. Messages on other
+ * ports are sent through send(), which keeps them in order.
+ *
+ * Interactions are sent without copying them, and kept until they have been
+ * sent or applied. They are then cleared and kept for spare_interactions()
+ * to hand out again, so that once their vectors have grown large enough, no
+ * memory is allocated for them.
+ */
+class ECMCoupling {
+public:
+  /** Create a coupling
+   *
+   * @param instance The instance to communicate through, which has ports
+   *        cell_ecm_interactions_out and ecm_boundary_state_in.
+   * @param lag Number of steps the boundary state lags behind, at least 0.
+   */
+  ECMCoupling(libmuscle::Instance &instance, int lag);
+
+  /** Create a coupling to an ECM simulated in this process
+   *
+   * @param instance The instance to send messages on other ports through.
+   * @param ecm The ECM simulation, which must outlive the coupling.
+   */
+  ECMCoupling(libmuscle::Instance &instance, ECMSimulation &ecm);
+
+  /// Waits for all messages to be sent and received.
+  ~ECMCoupling();
+
+  ECMCoupling(ECMCoupling const &) = delete;
+  ECMCoupling &operator=(ECMCoupling const &) = delete;
+
+  /** Send the interactions of a step to the ECM
+   *
+   * @param step The current step, starting at 0 and going up by one.
+   * @param interactions The interactions to send.
+   */
+  void send_interactions(int step, CellECMInteractions interactions);
+
+  /** Get an empty CellECMInteractions to record interactions into
+   *
+   * This returns an object passed to send_interactions() earlier if one is
+   * done with, or a new one otherwise.
+   *
+   * @return An object without interactions.
+   */
+  CellECMInteractions spare_interactions();
+
+  /** Get the boundary state to use in a step
+   *
+   * This waits for the state to be received if needed, and must be called
+   * after send_interactions() for the same step. The received messages are
+   * applied to the state of the previous call in order, see
+   * decode_ecm_boundary_state().
+   *
+   * @param step The current step.
+   * @param changes Set to the changes since the previous call.
+   * @return The state, which remains valid until the next call.
+   */
+  ECMBoundaryState const &boundary_state(int step,
+                                         ECMBoundaryChanges &changes);
+
+  /** Send a message on another port
+   *
+   * @param port The port to send on.
+   * @param message The message, which must only refer to data it owns.
+   */
+  void send(std::string const &port, libmuscle::Message const &message);
+
+  /// Wait until all messages have been sent and received.
+  void flush();
+
+  /// Return the total time spent waiting for boundary states, in s.
+  double wait_time() const;
+
+private:
+  ECMBoundaryState const &local_boundary_state_(ECMBoundaryChanges &changes);
+  void recycle_(CellECMInteractions &&interactions);
+  void submit_(std::function<void()> job);
+  void run_();
+  void rethrow_();
+
+  libmuscle::Instance &instance_;
+  int lag_;
+
+  // the local ECM, if any, and the interactions to apply to it next
+  ECMSimulation *ecm_ = nullptr;
+  CellECMInteractions ecm_interactions_;
+
+  // the state in use, and the step in which the ECM sent it
+  ECMBoundaryState state_;
+  int state_step_ = -1;
+
+  std::thread thread_;
+  mutable std::mutex mutex_;
+  std::condition_variable job_available_;
+  std::condition_variable job_done_;
+  std::deque<std::function<void()>> jobs_;
+  std::size_t pending_ = 0;
+  // states received by the thread but not yet applied
+  std::deque<libmuscle::DataConstRef> received_;
+  // interactions that have been sent, for reuse
+  std::vector<CellECMInteractions> spare_interactions_;
+  bool stopping_ = false;
+  std::exception_ptr error_;
+  double wait_time_ = 0.0;
+};
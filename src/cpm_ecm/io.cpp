@@ -3,26 +3,42 @@
 #include "cell_ecm_interactions.hpp"
 #include "cpm_ecm/io.hpp"
 #include "ecm_boundary_state.hpp"
+#include "ecm_simulation.hpp"
 #include "util/muscle3/muscle3_grid.hpp"
 
 #include <cinttypes>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 using libmuscle::Data;
 using libmuscle::DataConstRef;
 
 namespace {
 
-Data encode_change_type_in_area(ChangeTypeInArea const &ctia, AutoMemory &mem) {
-  mem.m0.resize(ctia.change_area.size() * 2u);
-  for (std::size_t i = 0u; i < ctia.change_area.size(); ++i) {
-    mem.m0[i * 2u] = ctia.change_area[i].x;
-    mem.m0[i * 2u + 1u] = ctia.change_area[i].y;
-  }
+/* Wrap a list of positions as an (n, 2) grid, without copying.
+ *
+ * A Vec2 is just its two coordinates, so a vector of them is laid out like
+ * a grid with the coordinates of each position in a row.
+ */
+template <typename Coordinate>
+Data position_grid(std::vector<Vec2<Coordinate>> const &positions,
+                   std::string const &index) {
+  static_assert(std::is_standard_layout<Vec2<Coordinate>>::value &&
+                    sizeof(Vec2<Coordinate>) == 2u * sizeof(Coordinate),
+                "Vec2 must be laid out as an array of two coordinates");
+  return Data::grid<Coordinate>(
+      reinterpret_cast<Coordinate const *>(positions.data()),
+      {positions.size(), 2u}, {index, "xy"});
+}
 
-  auto change_area = Data::grid<int32_t>(
-      mem.m0.data(), {ctia.change_area.size(), 2u}, {"par_id", "xy"});
+Data encode_change_type_in_area(ChangeTypeInArea const &ctia) {
+  auto change_area = position_grid(ctia.change_area, "par_id");
 
   return Data::dict("change_area", change_area, "num_particles",
                     ctia.num_particles, "from_type",
@@ -30,16 +46,8 @@ Data encode_change_type_in_area(ChangeTypeInArea const &ctia, AutoMemory &mem) {
                     static_cast<int>(ctia.to_type));
 }
 
-Data encode_add_adhesion_particles(AddAdhesionParticles const &aap,
-                                   AutoMemory &mem) {
-  mem.m1.resize(aap.new_pos.size() * 2u);
-  for (std::size_t i = 0u; i < aap.new_pos.size(); ++i) {
-    mem.m1[i * 2u] = aap.new_pos[i].x;
-    mem.m1[i * 2u + 1u] = aap.new_pos[i].y;
-  }
-
-  auto new_pos =
-      Data::grid<double>(mem.m1.data(), {aap.new_pos.size(), 2u}, {"i", "xy"});
+Data encode_add_adhesion_particles(AddAdhesionParticles const &aap) {
+  auto new_pos = position_grid(aap.new_pos, "i");
 
   auto bond_attempt_radius = Data::grid<double>(
       aap.bond_attempt_radius.data(), {aap.bond_attempt_radius.size()}, {"i"});
@@ -48,37 +56,60 @@ Data encode_add_adhesion_particles(AddAdhesionParticles const &aap,
                     bond_attempt_radius);
 }
 
-Data encode_move_adhesion_particles(MoveAdhesionParticles const &map,
-                                    AutoMemory &mem) {
+Data encode_move_adhesion_particles(MoveAdhesionParticles const &map) {
   auto par_id =
       Data::grid<int32_t>(map.par_id.data(), {map.par_id.size()}, {"i"});
-
-  mem.m2.resize(map.new_pos.size() * 2u);
-  for (std::size_t i = 0u; i < map.new_pos.size(); ++i) {
-    mem.m2[i * 2u] = map.new_pos[i].x;
-    mem.m2[i * 2u + 1u] = map.new_pos[i].y;
-  }
-
-  auto new_pos =
-      Data::grid<double>(mem.m2.data(), {map.new_pos.size(), 2u}, {"i", "xy"});
+  auto new_pos = position_grid(map.new_pos, "i");
 
   return Data::dict("par_id", par_id, "new_pos", new_pos);
 }
 
-std::unordered_map<ParId, Particle> decode_particles(DataConstRef const &data) {
-  std::unordered_map<ParId, Particle> result;
-
-  Muscle3Grid<int32_t> par_ids(data["par_ids"]);
-  Muscle3Grid<double> positions(data["positions"]);
-  Muscle3Grid<int32_t> types(data["types"]);
-
-  for (std::size_t i = 0u; i < par_ids.shape(0u); ++i) {
-    result[par_ids(i)] =
-        Particle(par_ids(i), {positions(i, 0), positions(i, 1)},
-                 static_cast<ParticleType>(types(i)));
-  }
+/* Get a column of an ECM boundary state table from a received grid.
+ *
+ * If the grid is stored row by row, as numpy does, then the column refers to
+ * the received data directly, and keeps it alive. Otherwise, it is copied.
+ *
+ * width is the number of values per row, the grid must have shape (n,) if it
+ * is 1, and (n, width) otherwise.
+ */
+template <typename T>
+ECMColumn<T> decode_column(DataConstRef const &data, std::size_t width) {
+  if (!data.is_a_grid_of<T>())
+    throw std::runtime_error(
+        std::string("Expected to receive a grid of type ") +
+        typeid(T).name() + ", but received something else");
+
+  auto shape = data.shape();
+  std::size_t size = 1u;
+  for (std::size_t extent : shape)
+    size *= extent;
+  if (size == 0u)
+    return ECMColumn<T>();
+
+  bool rows_ok = (shape.size() == 1u && width == 1u) ||
+                 (shape.size() == 2u && shape[1] == width);
+  if (!rows_ok)
+    throw std::runtime_error("Received a grid of the wrong shape, expected " +
+                             std::to_string(width) + " values per row");
+
+  T const *elements = data.elements<T>();
+  if (shape.size() == 1u ||
+      data.storage_order() == libmuscle::StorageOrder::last_adjacent)
+    return ECMColumn<T>(elements, size,
+                        std::make_shared<DataConstRef const>(data));
+
+  std::vector<T> values(size);
+  std::size_t rows = shape[0];
+  for (std::size_t i = 0u; i < rows; ++i)
+    for (std::size_t j = 0u; j < width; ++j)
+      values[i * width + j] = elements[j * rows + i];
+  return ECMColumn<T>(std::move(values));
+}
 
-  return result;
+ECMParticles decode_particles(DataConstRef const &data) {
+  return ECMParticles(decode_column<int32_t>(data["par_ids"], 1u),
+                      decode_column<double>(data["positions"], 2u),
+                      decode_column<int32_t>(data["types"], 1u));
 }
 
 std::unordered_map<BondTypeId, BondType>
@@ -95,18 +126,10 @@ decode_bond_types(DataConstRef const &data) {
   return result;
 }
 
-std::unordered_map<BondId, Bond> decode_bonds(DataConstRef const &data) {
-  std::unordered_map<BondId, Bond> result;
-
-  Muscle3Grid<int32_t> bond_ids(data["bond_ids"]);
-  Muscle3Grid<int32_t> particle_groups(data["particle_groups"]);
-  Muscle3Grid<int32_t> types(data["types"]);
-
-  for (std::size_t i = 0u; i < bond_ids.shape(0u); ++i)
-    result[bond_ids(i)] = Bond(particle_groups(i, 0), particle_groups(i, 1),
-                               static_cast<BondTypeId>(types(i)));
-
-  return result;
+ECMBonds decode_bonds(DataConstRef const &data) {
+  return ECMBonds(decode_column<int32_t>(data["bond_ids"], 1u),
+                  decode_column<int32_t>(data["particle_groups"], 2u),
+                  decode_column<int32_t>(data["types"], 1u));
 }
 
 std::unordered_map<AngleCstTypeId, AngleCstType>
@@ -123,57 +146,160 @@ decode_angle_cst_types(DataConstRef const &data) {
   return result;
 }
 
-std::unordered_map<AngleCstId, AngleCst>
-decode_angle_csts(DataConstRef const &data) {
-  std::unordered_map<AngleCstId, AngleCst> result;
+ECMAngleCsts decode_angle_csts(DataConstRef const &data) {
+  return ECMAngleCsts(decode_column<int32_t>(data["angle_cst_ids"], 1u),
+                      decode_column<int32_t>(data["particle_groups"], 3u),
+                      decode_column<int32_t>(data["types"], 1u));
+}
 
-  Muscle3Grid<int32_t> angle_cst_ids(data["angle_cst_ids"]);
-  Muscle3Grid<int32_t> particle_groups(data["particle_groups"]);
-  Muscle3Grid<int32_t> types(data["types"]);
+/* Remove the items with the ids in a received grid from a table.
+ *
+ * The ids are added to changed.
+ */
+template <typename Table, typename Id>
+void remove_items(DataConstRef const &ids, Table &table,
+                  std::vector<Id> &changed) {
+  for (std::int32_t id : decode_column<std::int32_t>(ids, 1u)) {
+    table.erase(id);
+    changed.push_back(id);
+  }
+}
 
-  for (std::size_t i = 0u; i < angle_cst_ids.shape(0u); ++i)
-    result[angle_cst_ids(i)] =
-        AngleCst(particle_groups(i, 0), particle_groups(i, 1),
-                 particle_groups(i, 2), static_cast<AngleCstTypeId>(types(i)));
+/* Add or replace the items in rows in a table, adding their ids to changed.
+ */
+void add_items(ECMParticles const &rows, ECMParticles &table,
+               std::vector<ParId> &changed) {
+  for (std::size_t row = 0u; row < rows.size(); ++row) {
+    table.set(rows.get(row));
+    changed.push_back(rows.id(row));
+  }
+}
 
-  return result;
+void add_items(ECMBonds const &rows, ECMBonds &table,
+               std::vector<BondId> &changed) {
+  for (std::size_t row = 0u; row < rows.size(); ++row) {
+    table.set(rows.id(row), rows.get(row));
+    changed.push_back(rows.id(row));
+  }
 }
 
-} // namespace
+void add_items(ECMAngleCsts const &rows, ECMAngleCsts &table,
+               std::vector<AngleCstId> &changed) {
+  for (std::size_t row = 0u; row < rows.size(); ++row) {
+    table.set(rows.id(row), rows.get(row));
+    changed.push_back(rows.id(row));
+  }
+}
 
-std::pair<Data, AutoMemory>
-encode_cell_ecm_interactions(CellECMInteractions const &interactions) {
-  AutoMemory mem;
+template <typename Id, typename Type, typename Equal>
+bool same_types(std::unordered_map<Id, Type> const &a,
+                std::unordered_map<Id, Type> const &b, Equal equal) {
+  if (a.size() != b.size())
+    return false;
+  for (auto const &id_type : a) {
+    auto it = b.find(id_type.first);
+    if (it == b.end() || !equal(id_type.second, it->second))
+      return false;
+  }
+  return true;
+}
 
+} // namespace
+
+Data encode_cell_ecm_interactions(CellECMInteractions const &interactions) {
   auto change_type_in_area =
-      encode_change_type_in_area(interactions.change_type_in_area, mem);
+      encode_change_type_in_area(interactions.change_type_in_area);
 
   auto add_adhesion_particles =
-      encode_add_adhesion_particles(interactions.add_adhesion_particles, mem);
+      encode_add_adhesion_particles(interactions.add_adhesion_particles);
 
   auto move_adhesion_particles =
-      encode_move_adhesion_particles(interactions.move_adhesion_particles, mem);
+      encode_move_adhesion_particles(interactions.move_adhesion_particles);
 
   auto const &rap = interactions.remove_adhesion_particles;
   auto remove_adhesion_particles =
       Data::dict("par_id", Data::grid<int32_t>(rap.par_id.data(),
                                                {rap.par_id.size()}, {"i"}));
 
-  auto result =
-      Data::dict("change_type_in_area", change_type_in_area,
-                 "add_adhesion_particles", add_adhesion_particles,
-                 "move_adhesion_particles", move_adhesion_particles,
-                 "remove_adhesion_particles", remove_adhesion_particles);
+  return Data::dict("change_type_in_area", change_type_in_area,
+                    "add_adhesion_particles", add_adhesion_particles,
+                    "move_adhesion_particles", move_adhesion_particles,
+                    "remove_adhesion_particles", remove_adhesion_particles);
+}
+
+void decode_ecm_boundary_state(DataConstRef const &data,
+                               ECMBoundaryState &state,
+                               ECMBoundaryChanges &changes) {
+  if (!data["delta"].as<bool>()) {
+    state.particles = decode_particles(data["particles"]);
+    state.bond_types = decode_bond_types(data["bond_types"]);
+    state.bonds = decode_bonds(data["bonds"]);
+    state.angle_cst_types = decode_angle_cst_types(data["angle_cst_types"]);
+    state.angle_csts = decode_angle_csts(data["angle_csts"]);
+    changes.everything = true;
+    return;
+  }
 
-  return std::make_pair(result, mem);
+  remove_items(data["removed_particles"], state.particles, changes.particles);
+  add_items(decode_particles(data["particles"]), state.particles,
+            changes.particles);
+  remove_items(data["removed_bonds"], state.bonds, changes.bonds);
+  add_items(decode_bonds(data["bonds"]), state.bonds, changes.bonds);
+  remove_items(data["removed_angle_csts"], state.angle_csts,
+               changes.angle_csts);
+  add_items(decode_angle_csts(data["angle_csts"]), state.angle_csts,
+            changes.angle_csts);
+
+  auto bond_types = decode_bond_types(data["bond_types"]);
+  auto angle_cst_types = decode_angle_cst_types(data["angle_cst_types"]);
+  bool same_bond_types = same_types(
+      state.bond_types, bond_types, [](BondType const &a, BondType const &b) {
+        return a.r0 == b.r0 && a.k == b.k;
+      });
+  bool same_angle_cst_types =
+      same_types(state.angle_cst_types, angle_cst_types,
+                 [](AngleCstType const &a, AngleCstType const &b) {
+                   return a.t0 == b.t0 && a.k == b.k;
+                 });
+  if (!same_bond_types || !same_angle_cst_types) {
+    state.bond_types = std::move(bond_types);
+    state.angle_cst_types = std::move(angle_cst_types);
+    changes.types = true;
+  }
 }
 
-ECMBoundaryState decode_ecm_boundary_state(DataConstRef const &data) {
-  ECMBoundaryState result;
-  result.particles = decode_particles(data["particles"]);
-  result.bond_types = decode_bond_types(data["bond_types"]);
-  result.bonds = decode_bonds(data["bonds"]);
-  result.angle_cst_types = decode_angle_cst_types(data["angle_cst_types"]);
-  result.angle_csts = decode_angle_csts(data["angle_csts"]);
+MDState decode_mdstate(DataConstRef const &data) {
+  MDState result;
+
+  auto const &particles = data["particles"];
+  Muscle3Grid<double> positions(particles["positions"]);
+  Muscle3Grid<int32_t> types(particles["types"]);
+  for (std::size_t i = 0u; i < types.shape(0u); ++i) {
+    result.positions.emplace_back(positions(i, 0u), positions(i, 1u));
+    result.types.push_back(static_cast<ParticleType>(types(i)));
+  }
+
+  Muscle3Grid<double> r0(data["bond_types"]["r0"]);
+  Muscle3Grid<double> bond_k(data["bond_types"]["k"]);
+  for (std::size_t i = 0u; i < r0.shape(0u); ++i)
+    result.bond_types.emplace_back(r0(i), bond_k(i));
+
+  Muscle3Grid<int32_t> bond_groups(data["bonds"]["groups"]);
+  Muscle3Grid<int32_t> bond_types(data["bonds"]["types"]);
+  for (std::size_t i = 0u; i < bond_types.shape(0u); ++i)
+    result.bonds.emplace_back(bond_groups(i, 0u), bond_groups(i, 1u),
+                              bond_types(i));
+
+  Muscle3Grid<double> t0(data["angle_cst_types"]["t0"]);
+  Muscle3Grid<double> angle_k(data["angle_cst_types"]["k"]);
+  for (std::size_t i = 0u; i < t0.shape(0u); ++i)
+    result.angle_cst_types.emplace_back(t0(i), angle_k(i));
+
+  Muscle3Grid<int32_t> angle_groups(data["angle_csts"]["groups"]);
+  Muscle3Grid<int32_t> angle_types(data["angle_csts"]["types"]);
+  for (std::size_t i = 0u; i < angle_types.shape(0u); ++i)
+    result.angle_csts.emplace_back(angle_groups(i, 0u), angle_groups(i, 1u),
+                                   angle_groups(i, 2u), angle_types(i));
+
   return result;
 }
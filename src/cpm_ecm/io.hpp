@@ -4,40 +4,41 @@
 
 #include "cell_ecm_interactions.hpp"
 #include "ecm_boundary_state.hpp"
-
-#include <utility>
-
-/* Helper class that owns memory for encoded CellECMInteractions
- *
- * To convert a CellECMInteractions to a MUSCLE3 data object, we need to make
- * some auxiliary arrays that need to be kept in memory until the data has been
- * sent. This class holds those arrays, and is returned along with the object.
- *
- * I'm going to extend the MUSCLE3 API to make this unneccessary, but in the
- * mean time this will ensure we don't have memory leaks. The naming is
- * intentionally obscure, the caller is not supposed to do anything with this.
- */
-struct AutoMemory {
-  std::vector<int32_t> m0;
-  std::vector<double> m1;
-  std::vector<double> m2;
-};
+#include "ecm_simulation.hpp"
 
 /** Encode a CellECMInteractions object
  *
- * The result will reference memory in the CellECMInteractions object passed to
- * this function, so that needs to be kept around for as long as the result is
- * used. Also, new memory will be allocated, which is owned by the second item
- * in the result. Likewise, that needs to be kept alive.
+ * The vectors in a CellECMInteractions already have the layout of the arrays
+ * in the message, so the result refers to them rather than copying them.
+ * The CellECMInteractions object passed to this function therefore needs to
+ * be kept around, unchanged, for as long as the result is used.
  *
  * @param interactions The object to encode
  */
-std::pair<libmuscle::Data, AutoMemory>
+libmuscle::Data
 encode_cell_ecm_interactions(CellECMInteractions const &interactions);
 
-/** Decode an ECM boundary state into an ECMBoundaryState object
+/** Decode an ECM boundary state message into an ECMBoundaryState object
+ *
+ * The ECM sends either a keyframe with the full state, or a delta with the
+ * items that were added, changed or removed since its previous message. A
+ * keyframe replaces state, with tables that refer to the arrays in the
+ * received data where possible rather than copying them. A delta is applied
+ * to state in place, which must then hold the state of the previous message.
  *
  * @param data A data object received using MUSCLE3 that contains an ECM
  * boundary state.
+ * @param state The state to update.
+ * @param changes Changes to add what changed in state to.
+ */
+void decode_ecm_boundary_state(libmuscle::DataConstRef const &data,
+                               ECMBoundaryState &state,
+                               ECMBoundaryChanges &changes);
+
+/** Decode a whole ECM state, as sent by make_ecm and simulate_ecm
+ *
+ * @param data A data object received using MUSCLE3 that contains an ECM
+ * state, see encode_mdstate() in ecm/muscle3.py.
+ * @return The decoded state.
  */
-ECMBoundaryState decode_ecm_boundary_state(libmuscle::DataConstRef const &data);
+MDState decode_mdstate(libmuscle::DataConstRef const &data);
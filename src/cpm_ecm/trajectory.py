@@ -0,0 +1,260 @@
+"""Reader for trajectories written by the simulation
+
+The format is written by TrajectoryWriter in src/util/trajectory.hpp, see
+there for a description. Frames are grouped into zlib-compressed chunks, in
+which the first frame has the whole lattice and the others only the sites that
+changed. Reading a frame therefore decompresses its chunk and replays the
+frames before it in that chunk. The last chunk read is kept, so that reading
+the frames in order is fast.
+"""
+from bisect import bisect_right
+from dataclasses import dataclass
+from pathlib import Path
+import struct
+from typing import BinaryIO, Iterator, List, NoReturn, Optional, Tuple, Union
+import zlib
+
+import numpy as np
+import numpy.typing as npt
+
+
+CELL_DTYPE = np.dtype([
+        ('sigma', '<i4'), ('tau', '<i4'), ('alive', '<i4'), ('area', '<i4'),
+        ('target_area', '<i4'), ('perimeter', '<i4'), ('x', '<f8'),
+        ('y', '<f8')])
+"""Cell records, see TrajectoryCell in trajectory.hpp"""
+
+
+_MAGIC = b'TSTTRAJ\0'
+_INDEX_MAGIC = b'TSTTIDX\0'
+_VERSION = 1
+_BYTE_ORDER_MARK = 0x01020304
+
+_HEADER = struct.Struct('<8sIIiiiIII')
+_CHUNK_HEADER = struct.Struct('<4sIIIQQ')
+_INDEX_ENTRY = struct.Struct('<QQII')
+_TRAILER = struct.Struct('<Q8s')
+
+_FULL_SIGMA = 1
+_HAS_PDE = 2
+_HAS_CELLS = 4
+
+_PDE_DTYPES = {0: '<f4', 1: '<f8', 8: '<u1', 16: '<u2'}
+
+
+@dataclass
+class TrajectoryFrame:
+    """A frame of a trajectory
+
+    Attributes:
+        time: Time (MCS) at which the frame was written
+        sigma: Cellular Potts state, SizeX x SizeY array
+        pde: Concentrations, L x SizeX x SizeY array, if stored
+        cells: Cell records with fields as in CELL_DTYPE, if stored
+    """
+    time: int
+    sigma: npt.NDArray[np.int32]
+    pde: Optional[npt.NDArray[np.float64]]
+    cells: Optional[npt.NDArray[np.void]]
+
+
+class Trajectory:
+    """A trajectory file, opened for reading"""
+    def __init__(self, path: Union[str, Path]) -> None:
+        """Open a trajectory
+
+        Args:
+            path: File to read
+
+        Raises:
+            RuntimeError: If the file is not a trajectory, or is damaged
+        """
+        self._path = Path(path)
+        self._file: BinaryIO = self._path.open('rb')
+        self._size = self._file.seek(0, 2)
+
+        header = self._read_at(0, _HEADER.size)
+        (magic, version, mark, self.sizex, self.sizey, self.layers,
+                self._pde_type, _, _) = _HEADER.unpack(header)
+        if magic != _MAGIC:
+            self._fail('not a trajectory file')
+        if mark != _BYTE_ORDER_MARK:
+            self._fail('written on a machine with a different byte order')
+        if version == 0 or version > _VERSION:
+            self._fail(f'unsupported version {version}')
+        if self._pde_type not in _PDE_DTYPES:
+            self._fail(f'unknown PDE type {self._pde_type}')
+
+        # decoding state of the loaded chunk
+        self._loaded_chunk = -1
+        self._data = b''
+        self._pos = 0
+        self._next_frame = 0
+        self._sigma = np.zeros((self.sizex, self.sizey), np.int32)
+
+        # (offset, first frame, number of frames) of each chunk
+        self._chunks: List[Tuple[int, int, int]] = []
+        self.times: List[int] = []
+        if not self._read_index():
+            self._scan_chunks()
+
+    def close(self) -> None:
+        """Close the file"""
+        self._file.close()
+
+    def __enter__(self) -> 'Trajectory':
+        return self
+
+    def __exit__(self, *args: object) -> None:
+        self.close()
+
+    def __len__(self) -> int:
+        return len(self.times)
+
+    def __iter__(self) -> Iterator[TrajectoryFrame]:
+        for i in range(len(self)):
+            yield self.frame(i)
+
+    def frame(self, i: int) -> TrajectoryFrame:
+        """Read a frame
+
+        Args:
+            i: Index of the frame, from 0 to len(self)
+
+        Raises:
+            IndexError: If there is no frame i
+        """
+        if i < 0 or i >= len(self.times):
+            raise IndexError(f'Trajectory {self._path}: no frame {i}')
+
+        chunk = bisect_right([first for _, first, _ in self._chunks], i) - 1
+        # deltas can only be applied going forward from the start of a chunk
+        if chunk != self._loaded_chunk or self._next_frame > i:
+            self._load_chunk(chunk)
+        frame = self._decode_frame()
+        while self._next_frame <= i:
+            frame = self._decode_frame()
+        return frame
+
+    def _read_index(self) -> bool:
+        """Read the index at the end of the file, if it was written"""
+        if self._size < _HEADER.size + _TRAILER.size:
+            return False
+        offset, magic = _TRAILER.unpack(
+                self._read_at(self._size - _TRAILER.size, _TRAILER.size))
+        if magic != _INDEX_MAGIC:
+            return False
+
+        tag, _, n_chunks = struct.unpack('<4sIQ', self._read_at(offset, 16))
+        if tag != b'TIDX':
+            self._fail('invalid index')
+        pos = offset + 16
+        for _ in range(n_chunks):
+            chunk_offset, _, first, frames = _INDEX_ENTRY.unpack(
+                    self._read_at(pos, _INDEX_ENTRY.size))
+            self._chunks.append((chunk_offset, first, frames))
+            pos += _INDEX_ENTRY.size
+
+        n_frames, = struct.unpack('<Q', self._read_at(pos, 8))
+        times = np.frombuffer(self._read_at(pos + 8, 4 * n_frames), '<i4')
+        self.times = times.tolist()
+        return True
+
+    def _scan_chunks(self) -> None:
+        """Find the complete chunks of a trajectory that was not closed"""
+        pos = _HEADER.size
+        while self._size - pos >= _CHUNK_HEADER.size:
+            tag, frames, first, _, _, size = _CHUNK_HEADER.unpack(
+                    self._read_at(pos, _CHUNK_HEADER.size))
+            if tag != b'CHNK' or size > self._size - pos - _CHUNK_HEADER.size:
+                break
+            self._chunks.append((pos, first, frames))
+            pos += _CHUNK_HEADER.size + size
+
+        for c, (_, _, frames) in enumerate(self._chunks):
+            self._load_chunk(c)
+            for _ in range(frames):
+                self.times.append(self._decode_frame().time)
+
+    def _load_chunk(self, chunk: int) -> None:
+        """Decompress a chunk and prepare to decode its first frame"""
+        offset, first, _ = self._chunks[chunk]
+        tag, _, _, _, raw_size, size = _CHUNK_HEADER.unpack(
+                self._read_at(offset, _CHUNK_HEADER.size))
+        if tag != b'CHNK':
+            self._fail(f'invalid chunk at offset {offset}')
+        try:
+            self._data = zlib.decompress(
+                    self._read_at(offset + _CHUNK_HEADER.size, size))
+        except zlib.error:
+            self._fail(f'corrupt chunk at offset {offset}')
+        if len(self._data) != raw_size:
+            self._fail(f'corrupt chunk at offset {offset}')
+
+        self._loaded_chunk = chunk
+        self._pos = 0
+        self._next_frame = first
+
+    def _take(self, dtype: str, count: int) -> npt.NDArray[np.generic]:
+        """Get the next count values from the decompressed chunk"""
+        size = np.dtype(dtype).itemsize * count
+        if self._pos + size > len(self._data):
+            self._fail(f'frame {self._next_frame} is truncated')
+        values = np.frombuffer(self._data, dtype, count, self._pos)
+        self._pos += size
+        return values
+
+    def _decode_frame(self) -> TrajectoryFrame:
+        """Decode the next frame of the loaded chunk"""
+        n = self.sizex * self.sizey
+        time = int(self._take('<i4', 1)[0])
+        flags = int(self._take('<u4', 1)[0])
+
+        # the lattice is updated in place, and copied for the caller
+        sigma = self._sigma.reshape(n)
+        if flags & _FULL_SIGMA:
+            sigma[:] = self._take('<i4', n)
+        else:
+            changes = int(self._take('<u4', 1)[0])
+            gaps = self._take('<u4', changes)
+            values = self._take('<i4', changes)
+            sites = np.cumsum(gaps, dtype=np.int64)
+            if changes and sites[-1] >= n:
+                self._fail(f'frame {self._next_frame} is corrupt')
+            sigma[sites] = values
+
+        pde: Optional[npt.NDArray[np.float64]] = None
+        if flags & _HAS_PDE:
+            pde = np.empty((self.layers, self.sizex, self.sizey))
+            dtype = _PDE_DTYPES[self._pde_type]
+            for layer in range(self.layers):
+                if self._pde_type in (8, 16):
+                    lo, hi = self._take('<f8', 2)
+                    step = (hi - lo) / np.iinfo(dtype).max
+                    values = self._take(dtype, n) * step + lo
+                else:
+                    values = self._take(dtype, n)
+                pde[layer] = values.reshape(self.sizex, self.sizey)
+
+        cells: Optional[npt.NDArray[np.void]] = None
+        if flags & _HAS_CELLS:
+            count = int(self._take('<u4', 1)[0])
+            size = CELL_DTYPE.itemsize * count
+            if self._pos + size > len(self._data):
+                self._fail(f'frame {self._next_frame} is truncated')
+            cells = np.frombuffer(self._data, CELL_DTYPE, count, self._pos)
+            self._pos += size
+
+        self._next_frame += 1
+        return TrajectoryFrame(time, self._sigma.copy(), pde, cells)
+
+    def _read_at(self, offset: int, size: int) -> bytes:
+        """Read size bytes at offset"""
+        self._file.seek(offset)
+        data = self._file.read(size)
+        if len(data) != size:
+            self._fail('unexpected end of file')
+        return data
+
+    def _fail(self, what: str) -> NoReturn:
+        raise RuntimeError(f'Trajectory {self._path}: {what}')
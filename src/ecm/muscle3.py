@@ -4,9 +4,9 @@ This module contains some functions for getting information from
 MUSCLE3 into our custom data types, and vice versa for taking our
 data and sending it to other components via MUSCLE3.
 """
-from dataclasses import asdict, fields
+from dataclasses import fields
 import logging
-from typing import Any, Optional, Type, TypeVar
+from typing import Any, Dict, Optional, Tuple, Type, TypeVar
 
 import numpy as np
 
@@ -172,12 +172,127 @@ def decode_cell_ecm_interactions(data: Any) -> CellECMInteractions:
             remove_adhesion_particles = remove_adhesion_particles)
 
 
+def _fields_dict(obj: Any) -> Dict[str, Any]:
+    """Make a dict of the fields of a dataclass, without copying them."""
+    return {field.name: getattr(obj, field.name) for field in fields(obj)}
+
+
 def encode_ecm_boundary_state(boundary: Optional[ECMBoundaryState]) -> Any:
-    """Encode the state of the ECM boundary.
+    """Encode the full state of the ECM boundary.
+
+    This makes a keyframe, see BoundaryStateEncoder. It does not copy the
+    data, so the state object passed in must not be changed or the result
+    will change too.
 
     Args:
         boundary: The current state of the boundary to encode
     """
     if boundary is None:
         return None
-    return asdict(boundary)
+    result: Dict[str, Any] = {
+            field.name: _fields_dict(getattr(boundary, field.name))
+            for field in fields(boundary)}
+    result['delta'] = False
+    return result
+
+
+def _table_delta(old: Any, new: Any) -> Tuple[Dict[str, Any], Any]:
+    """Find what changed between two versions of a boundary table.
+
+    The tables are SparseParticles, SparseBonds or SparseAngleCsts
+    objects, the first field of which holds the ids of the items.
+
+    Args:
+        old: The previous version of the table
+        new: The current version of the table
+
+    Returns:
+        The added and changed items, as a dict of arrays in the same
+        format as in a keyframe, and an array with the ids of the
+        removed items.
+    """
+    names = [field.name for field in fields(new)]
+    old_ids = getattr(old, names[0])
+    new_ids = getattr(new, names[0])
+
+    changed = np.ones(len(new_ids), dtype=bool)
+    if len(old_ids) > 0 and len(new_ids) > 0:
+        order = np.argsort(old_ids)
+        idx = np.searchsorted(old_ids, new_ids, sorter=order)
+        rows = order[np.minimum(idx, len(order) - 1)]
+        changed = old_ids[rows] != new_ids
+        for name in names[1:]:
+            differs = getattr(old, name)[rows] != getattr(new, name)
+            changed |= differs.reshape(len(new_ids), -1).any(axis=1)
+
+    removed = np.setdiff1d(old_ids, new_ids).astype(np.int32)
+    return {name: getattr(new, name)[changed] for name in names}, removed
+
+
+class BoundaryStateEncoder:
+    """Encodes successive states of the ECM boundary.
+
+    Most of the boundary stays the same from one step to the next, so
+    rather than sending all of it every time, this sends a keyframe with
+    the full state every keyframe_interval messages, and in between a
+    delta with only the particles, bonds and angle constraints that were
+    added, changed or removed since the previous message. The receiver
+    applies each delta to its copy of the state.
+
+    Keyframes are made by encode_ecm_boundary_state(), and have 'delta'
+    set to False. Deltas have 'delta' set to True, 'particles', 'bonds'
+    and 'angle_csts' with the added or changed items in the same format
+    as a keyframe, and 'removed_particles', 'removed_bonds' and
+    'removed_angle_csts' with the ids of the removed items. There are
+    only a few bond and angle constraint types, so those are always sent
+    in full.
+    """
+    def __init__(self, keyframe_interval: int) -> None:
+        """Create a BoundaryStateEncoder
+
+        Args:
+            keyframe_interval: Number of messages from one keyframe to
+                    the next, 1 to send only keyframes.
+        """
+        self._keyframe_interval = max(keyframe_interval, 1)
+        self._previous: Optional[ECMBoundaryState] = None
+        self._count = 0
+
+    def encode(self, boundary: Optional[ECMBoundaryState]) -> Any:
+        """Encode the next state of the ECM boundary.
+
+        This does not copy the data, and the state must not be changed
+        afterwards, because the next delta is made relative to it.
+
+        Args:
+            boundary: The current state of the boundary to encode
+        """
+        if boundary is None:
+            return None
+
+        previous = self._previous
+        keyframe = (
+                previous is None or
+                self._count % self._keyframe_interval == 0)
+        self._previous = boundary
+        self._count += 1
+        if keyframe:
+            return encode_ecm_boundary_state(boundary)
+        assert previous is not None
+
+        particles, removed_particles = _table_delta(
+                previous.particles, boundary.particles)
+        bonds, removed_bonds = _table_delta(previous.bonds, boundary.bonds)
+        angle_csts, removed_angle_csts = _table_delta(
+                previous.angle_csts, boundary.angle_csts)
+
+        return {
+                'delta': True,
+                'particles': particles,
+                'removed_particles': removed_particles,
+                'bond_types': _fields_dict(boundary.bond_types),
+                'bonds': bonds,
+                'removed_bonds': removed_bonds,
+                'angle_cst_types': _fields_dict(boundary.angle_cst_types),
+                'angle_csts': angle_csts,
+                'removed_angle_csts': removed_angle_csts}
@@ -1,6 +1,6 @@
 from tissue_simulation_toolkit.ecm.muscle3 import (
-        decode_cell_ecm_interactions, decode_mdstate, encode_mdstate,
-        encode_ecm_boundary_state, from_settings)
+        BoundaryStateEncoder, decode_cell_ecm_interactions, decode_mdstate,
+        encode_mdstate, from_settings)
 from tissue_simulation_toolkit.ecm.muscle3_mpi_wrapper import Instance
 from tissue_simulation_toolkit.ecm.parameters import EvolutionParameters
 from tissue_simulation_toolkit.ecm.simulation import Simulation
@@ -35,6 +35,12 @@ def main() -> None:
             state_output_interval = instance.get_setting('state_output_interval', 'int')
         except KeyError:
             state_output_interval = mcs + 1
+        try:
+            keyframe_interval = instance.get_setting(
+                    'boundary_keyframe_interval', 'int')
+        except KeyError:
+            keyframe_interval = 100
+        boundary_encoder = BoundaryStateEncoder(keyframe_interval)
 
         msg = instance.receive('ecm_in')
         ecm = decode_mdstate(msg.data)
@@ -47,7 +53,7 @@ def main() -> None:
                     state = sim.get_state()
                     instance.send('state_out', Message(i, data=encode_mdstate(state)))
 
-            boundary = encode_ecm_boundary_state(sim.get_boundary_state())
+            boundary = boundary_encoder.encode(sim.get_boundary_state())
             msg = Message(msg.timestamp, data=boundary)
             instance.send('ecm_boundary_state_out', msg)
 
@@ -376,10 +376,10 @@ class Simulation:
             angle_cst_types_ids = np.unique(angle_csts_typeids)
             angle_cst_types_t0 = np.array([
                 self._angle_cst_force_cache[i][1]
-                for i in angle_csts_typeids], dtype=np.float64)
+                for i in angle_cst_types_ids], dtype=np.float64)
             angle_cst_types_k = np.array([
                 self._angle_cst_force_cache[i][0]
-                for i in angle_csts_typeids], dtype=np.float64)
+                for i in angle_cst_types_ids], dtype=np.float64)
 
             result = ECMBoundaryState(
                     SparseParticles(par_ids, par_pos, par_type),
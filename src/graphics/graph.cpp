@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "graph.hpp"
+#include "output_writer.hpp"
 #include "parameter.hpp"
 #include "random.hpp"
 
@@ -31,6 +32,18 @@ void start_graphics(int argc, char **argv) {
   app.exec();
 #endif
 
+#ifdef HEADLESSGRAPHICS
+  // No event loop, just run the time steps. Nobody could unpause us.
+  if (par.pause_on_start) {
+    std::cerr << "Ignoring pause_on_start with headless graphics\n";
+    par.pause_on_start = false;
+  }
+  HeadlessGraphics g(window_size_x, window_size_y);
+  for (int t = 0; t < par.mcs; t++) {
+    g.TimeStep();
+  }
+#endif
+
 #ifdef X11GRAPHICS
   X11Graphics g(window_size_x, window_size_y);
   int t;
@@ -38,4 +51,11 @@ void start_graphics(int argc, char **argv) {
     g.TimeStep();
   }
 #endif
+
+  // Finish writing output while the graphics still exist
+  OutputWriter &writer = SharedOutputWriter();
+  writer.flush();
+  if (par.output_threads > 0)
+    std::cerr << "Waited " << writer.stall_time()
+              << " s for images and configurations to be written\n";
 }
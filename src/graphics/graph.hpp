@@ -28,7 +28,8 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 
 \brief API for Graphics windows.
 
-No implementation here. Implemented by X11Graphics and QtGraphics.
+No implementation here. Implemented by X11Graphics, QtGraphics,
+GLGraphics, QtGLGraphics and HeadlessGraphics.
 
 */
 #include <iostream>
@@ -138,6 +139,10 @@ public:
 #include "x11graph.hpp"
 #endif
 
+#ifdef HEADLESSGRAPHICS
+#include "headlessgraph.hpp"
+#endif
+
 void start_graphics(int argc, char **argv);
 
 #endif
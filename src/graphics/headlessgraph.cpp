@@ -0,0 +1,244 @@
+#include "headlessgraph.hpp"
+#include "output_writer.hpp"
+#include "parameter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <zlib.h>
+
+using namespace std;
+
+namespace {
+
+void put_u32(vector<unsigned char> &out, uint32_t value) {
+  out.push_back(value >> 24);
+  out.push_back(value >> 16);
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+bool write_chunk(FILE *fp, const char *type,
+                 const vector<unsigned char> &data) {
+  vector<unsigned char> chunk;
+  put_u32(chunk, data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  put_u32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+  return fwrite(chunk.data(), 1, chunk.size(), fp) == chunk.size();
+}
+
+// level is a zlib compression level
+bool write_png(const char *fname, const uint32_t *image, int xfield,
+               int yfield, int level) {
+  FILE *fp = fopen(fname, "wb");
+  if (fp == NULL)
+    return false;
+
+  const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+                                      '\n'};
+  bool ok = fwrite(signature, 1, 8, fp) == 8;
+
+  // 8-bit RGB, no interlacing
+  vector<unsigned char> header;
+  put_u32(header, xfield);
+  put_u32(header, yfield);
+  header.insert(header.end(), {8, 2, 0, 0, 0});
+  ok = ok && write_chunk(fp, "IHDR", header);
+
+  // Rows of pixels, each preceded by filter type 0
+  vector<unsigned char> raw;
+  raw.reserve((size_t)yfield * (3 * xfield + 1));
+  for (int y = 0; y < yfield; y++) {
+    raw.push_back(0);
+    for (int x = 0; x < xfield; x++) {
+      uint32_t rgb = image[(size_t)y * xfield + x];
+      raw.push_back(rgb >> 16);
+      raw.push_back(rgb >> 8);
+      raw.push_back(rgb);
+    }
+  }
+
+  uLongf size = compressBound(raw.size());
+  vector<unsigned char> data(size);
+  ok = ok && compress2(data.data(), &size, raw.data(), raw.size(), level) ==
+                 Z_OK;
+  data.resize(size);
+  ok = ok && write_chunk(fp, "IDAT", data);
+  ok = ok && write_chunk(fp, "IEND", {});
+
+  return fclose(fp) == 0 && ok;
+}
+
+bool write_ppm(const char *fname, const uint32_t *image, int xfield,
+               int yfield) {
+  FILE *fp = fopen(fname, "wb");
+  if (fp == NULL)
+    return false;
+
+  bool ok = fprintf(fp, "P6\n%d %d\n255\n", xfield, yfield) > 0;
+  vector<unsigned char> row(3 * xfield);
+  for (int y = 0; y < yfield; y++) {
+    for (int x = 0; x < xfield; x++) {
+      uint32_t rgb = image[(size_t)y * xfield + x];
+      row[3 * x] = rgb >> 16;
+      row[3 * x + 1] = rgb >> 8;
+      row[3 * x + 2] = rgb;
+    }
+    ok = ok && fwrite(row.data(), 1, row.size(), fp) == row.size();
+  }
+  return fclose(fp) == 0 && ok;
+}
+
+} // namespace
+
+HeadlessGraphics::HeadlessGraphics(int xfield, int yfield)
+    : xfield(xfield), yfield(yfield) {}
+
+void HeadlessGraphics::BeginScene(void) {
+  if (colours.empty())
+    ReadColorTable();
+  if (image.empty())
+    image.assign((size_t)xfield * yfield, colours[0]);
+}
+
+void HeadlessGraphics::ClearImage(void) {
+  BeginScene();
+  fill(image.begin(), image.end(), colours[0]);
+}
+
+void HeadlessGraphics::Point(int colour, int x, int y) {
+  if (colour >= 0 && colour < (int)colours.size())
+    SetPixel(x, y, colours[colour]);
+}
+
+void HeadlessGraphics::PointAlpha(int alpha, int x, int y) {
+  // blend black over the image, like QtGraphics does
+  if (x < 0 || y < 0 || x >= xfield || y >= yfield || image.empty())
+    return;
+  uint32_t &pixel = image[(size_t)y * xfield + x];
+  uint32_t blended = 0;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint32_t channel = (pixel >> shift) & 0xff;
+    blended |= (channel * (255 - alpha) / 255) << shift;
+  }
+  pixel = blended;
+}
+
+void HeadlessGraphics::Rectangle(int colour, int x, int y) {
+  if (colour < 0 || colour >= (int)colours.size())
+    return;
+  uint32_t rgb = colours[colour];
+  SetPixel(2 * x, 2 * y, rgb);
+  SetPixel(2 * x + 1, 2 * y, rgb);
+  SetPixel(2 * x, 2 * y + 1, rgb);
+  SetPixel(2 * x + 1, 2 * y + 1, rgb);
+}
+
+void HeadlessGraphics::Line(float x1, float y1, float x2, float y2,
+                            int colour) {
+  if (colour < 0 || colour >= (int)colours.size())
+    return;
+
+  // Bresenham, in the doubled coordinates used by the other backends
+  int xa = (int)(x1 * 2), ya = (int)(y1 * 2);
+  int xb = (int)(x2 * 2), yb = (int)(y2 * 2);
+  int dx = abs(xb - xa), sx = xa < xb ? 1 : -1;
+  int dy = -abs(yb - ya), sy = ya < yb ? 1 : -1;
+  int err = dx + dy;
+  while (true) {
+    SetPixel(xa, ya, colours[colour]);
+    if (xa == xb && ya == yb)
+      break;
+    int e2 = 2 * err;
+    if (e2 >= dy) {
+      err += dy;
+      xa += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      ya += sy;
+    }
+  }
+}
+
+int HeadlessGraphics::GetXYCoo(int *X, int *Y) {
+  *X = 0;
+  *Y = 0;
+  return 0;
+}
+
+void HeadlessGraphics::Resize(int xf, int yf) {
+  xfield = xf;
+  yfield = yf;
+  image.clear();
+}
+
+void HeadlessGraphics::Write(char *fname, int quality) {
+  if (fname == 0) {
+    throw("HeadlessGraphics::Write: empty filename!\n");
+  }
+  BeginScene();
+
+  string name(fname);
+  string extension = name.substr(name.find_last_of('.') + 1);
+  transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+  // Copy the image, and encode and write it in the background
+  OutputWriter &writer = SharedOutputWriter();
+  size_t bytes = image.size() * sizeof(uint32_t);
+  OutputWriter::Buffer snapshot = writer.buffer(bytes);
+  memcpy(snapshot->data(), image.data(), bytes);
+
+  // quality runs from 0 for the smallest file to 100 for the fastest, as
+  // with Qt
+  int level = Z_DEFAULT_COMPRESSION;
+  if (quality >= 0)
+    level = 9 - min(quality, 100) * 9 / 100;
+
+  int xf = xfield, yf = yfield;
+  writer.submit([snapshot, name, extension, xf, yf, level]() {
+    const uint32_t *pixels =
+        reinterpret_cast<const uint32_t *>(snapshot->data());
+    bool written = false;
+    if (extension == "png")
+      written = write_png(name.c_str(), pixels, xf, yf, level);
+    else if (extension == "ppm")
+      written = write_ppm(name.c_str(), pixels, xf, yf);
+
+    if (written) {
+      cerr << "Image " << name << " was succesfully written.\n";
+    } else {
+      cerr << "Image " << name << " could not be written.\n";
+      cerr << "Please choose one of the following formats: png ppm\n";
+    }
+  });
+}
+
+void HeadlessGraphics::ReadColorTable(void) {
+  extern Parameter par;
+  FILE *fpc = fopen(par.colortable.c_str(), "r");
+  if (fpc == NULL) {
+    cerr << "Colormap '" << par.colortable << "' not found.\n";
+    throw "HeadlessGraphics::ReadColorTable: Colormap not found.";
+  }
+
+  // unlisted colours are black
+  colours.assign(256, 0);
+  int i, r, g, b, a;
+  while (fscanf(fpc, "%d %d %d %d %d", &i, &r, &g, &b, &a) == 5) {
+    if (i >= 0 && i < 256)
+      colours[i] = (r & 0xff) << 16 | (g & 0xff) << 8 | (b & 0xff);
+  }
+  fclose(fpc);
+}
+
+void HeadlessGraphics::SetPixel(int x, int y, uint32_t rgb) {
+  if (x >= 0 && y >= 0 && x < xfield && y < yfield && !image.empty())
+    image[(size_t)y * xfield + x] = rgb;
+}
@@ -0,0 +1,67 @@
+#ifndef _HEADLESSGRAPH_H_
+#define _HEADLESSGRAPH_H_
+
+#include "graph.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/*! \class HeadlessGraphics
+
+\brief Graphics implementation without a window, for batch runs.
+
+start_graphics() calls TimeStep() par.mcs times in a plain loop, so there is
+no event loop, and no display or GUI library is needed. Anything the model
+plots is drawn into an image in memory, which Write() saves as PNG or PPM.
+The image is allocated on the first call to BeginScene(), so runs that do
+not plot do not pay for it.
+
+There is no user interaction: GetXYCoo() always returns 0 and pausing is
+ignored, as nobody could unpause the simulation. start_graphics() therefore
+turns off pause_on_start.
+*/
+class HeadlessGraphics : public Graphics {
+public:
+  HeadlessGraphics(int xfield, int yfield);
+
+  virtual void BeginScene(void);
+  virtual void ClearImage(void);
+
+  virtual void Point(int colour, int x, int y);
+  virtual void PointAlpha(int alpha, int x, int y);
+  virtual void Rectangle(int colour, int x, int y);
+  virtual void Line(float x1, float y1, float x2, float y2, int colour);
+
+  virtual int GetXYCoo(int *X, int *Y);
+
+  virtual int XField(void) const { return xfield; }
+  virtual int YField(void) const { return yfield; }
+
+  /*! \brief Writes the image to a file.
+
+  The format is chosen by extension, .png or .ppm. For PNG, quality sets the
+  compression, from 0 for the smallest file to 100 for the fastest to write,
+  as with Qt. The image is copied, and written in the background by the
+  SharedOutputWriter().
+  */
+  virtual void Write(char *fname, int quality = -1);
+
+  virtual void Resize(int xfield, int yfield);
+
+  virtual void TimeStep(void);
+
+  //! \brief Returns the image as 0xRRGGBB values, row by row.
+  const std::vector<uint32_t> &Image(void) const { return image; }
+
+private:
+  void ReadColorTable(void);
+  void SetPixel(int x, int y, uint32_t rgb);
+
+  int xfield;
+  int yfield;
+  std::vector<uint32_t> colours;
+  std::vector<uint32_t> image;
+};
+
+#define TIMESTEP void HeadlessGraphics::TimeStep(void)
+#endif
@@ -32,6 +32,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #ifndef Q_OS_DARWIN
 #include <malloc.h>
 #endif
+#include "output_writer.hpp"
 #include "parameter.hpp"
 #include "qtgraph.hpp"
 #include <QResizeEvent>
@@ -232,28 +233,30 @@ void QtGraphics::Write(char *fname, int quality) {
   if (fname == 0) {
     throw("QtGraphics::Write: empty filename!\n");
   }
-  // replay the picture on image
-  // and write it to fname
+  // Take a copy of the picture, which can be saved on a background thread
+  // while we continue drawing on the pixmap
+  QImage image = pixmap->toImage();
   QString imname(fname);
 
   // Get file extension to infer desired image format
-  QString extension_str = imname.section('.', -1).toUpper();
-  const char *extension = extension_str.toLocal8Bit().constData();
-  // cerr << "Extension is: " << extension << "\n";
-  if (pixmap->save(imname, extension, quality)) {
-    cerr << "Image " << imname.toLocal8Bit().constData()
-         << " was succesfully written.\n";
-  } else {
-    cerr << "Image " << imname.toLocal8Bit().constData()
-         << " could not be written.\n";
-    QList<QByteArray> fmt = QImageWriter::supportedImageFormats();
-    cerr << "Please choose one of the following formats: ";
-    for (QList<QByteArray>::ConstIterator f = fmt.begin(); f != fmt.end();
-         f++) {
-      cerr << f->constData() << " ";
+  QByteArray extension = imname.section('.', -1).toUpper().toLocal8Bit();
+
+  SharedOutputWriter().submit([image, imname, extension, quality]() {
+    if (image.save(imname, extension.constData(), quality)) {
+      cerr << "Image " << imname.toLocal8Bit().constData()
+           << " was succesfully written.\n";
+    } else {
+      cerr << "Image " << imname.toLocal8Bit().constData()
+           << " could not be written.\n";
+      QList<QByteArray> fmt = QImageWriter::supportedImageFormats();
+      cerr << "Please choose one of the following formats: ";
+      for (QList<QByteArray>::ConstIterator f = fmt.begin(); f != fmt.end();
+           f++) {
+        cerr << f->constData() << " ";
+      }
+      cerr << "\n";
     }
-    cerr << "\n";
-  }
+  });
 }
 
 void QtGraphics::resizeEvent(QResizeEvent *event) {
@@ -34,6 +34,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "sqr.hpp"
 #include <algorithm>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <math.h>
@@ -53,6 +54,10 @@ INIT {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -63,6 +68,7 @@ TIMESTEP {
     static Info *info = new Info(*dish, *this);
     static Plotter *plotter = new Plotter(dish, this);
     dish->CPM->Act_AmoebaeMove(dish->PDEfield);
+    dish->io->WriteTrajectory(i);
     if (par.max_Act && par.lambda_Act) {
       dish->PDEfield->MILayerCA(3, 1., dish->CPM, dish);
       dish->PDEfield->AgeLayer(2, 1., dish->CPM, dish);
@@ -91,6 +97,10 @@ TIMESTEP {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -245,6 +255,9 @@ int main(int argc, char *argv[]) {
   } catch (const char *error) {
     std::cerr << error << std::endl;
     return 1;
+  } catch (std::exception const &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
   }
   return 0;
 }
@@ -28,8 +28,10 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #endif
 #include "adhesion_creation.hpp"
 #include "cell.hpp"
+#include "cpm_ecm/ecm_coupling.hpp"
 #include "cpm_ecm/io.hpp"
 #include "dish.hpp"
+#include "ecm_simulation.hpp"
 #include "graph.hpp"
 #include "info.hpp"
 #include "parameter.hpp"
@@ -40,6 +42,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include <algorithm>
 #include <cstdint>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <math.h>
@@ -69,6 +72,15 @@ extern Parameter par;
 
 std::unique_ptr<Instance> instance;
 
+// the ECM, if it is simulated here rather than by simulate_ecm
+std::unique_ptr<ECMSimulation> ecm;
+
+// used for all communication during the run, see ecm_coupling.hpp
+std::unique_ptr<ECMCoupling> coupling;
+
+// 0 if the state is not sent
+int64_t state_output_interval = 0;
+
 INIT {
   try {
     // Define initial distribution of cells
@@ -88,6 +100,10 @@ INIT {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -98,23 +114,20 @@ TIMESTEP {
     static Info *info = new Info(*dish, *this);
     static Plotter plotter = Plotter(dish, this);
 
+    CellECMInteractions interactions = coupling->spare_interactions();
     if (i == 0) {
       // request creation of initial adhesions
-      CellECMInteractions interactions;
-      auto adh_zone = adhesion_zone(*(dish->CPM));
+      auto adh_zone = adhesion_zone(*(dish->CPM), dish->CPM->Workers());
       interactions.change_type_in_area.change_area = adh_zone;
       interactions.change_type_in_area.num_particles =
           par.num_initial_adhesions;
       interactions.change_type_in_area.from_type = ParticleType::free;
       interactions.change_type_in_area.to_type = ParticleType::adhesion;
-      auto data_mem = encode_cell_ecm_interactions(interactions);
-      instance->send("cell_ecm_interactions_out", Message(i, data_mem.first));
     } else {
       // get any adhesion particle movements from CPM and send them out
-      auto interactions = dish->CPM->GetCellECMInteractions();
-      auto data_mem = encode_cell_ecm_interactions(interactions);
-      instance->send("cell_ecm_interactions_out", Message(i, data_mem.first));
+      dish->CPM->TakeCellECMInteractions(interactions);
     }
+    coupling->send_interactions(i, std::move(interactions));
 
     dish->CPM->ResetCellECMInteractions();
 
@@ -130,19 +143,19 @@ TIMESTEP {
       }
     }
 
-    auto ecm_boundary_state_msg = instance->receive("ecm_boundary_state_in");
-    auto ecm_boundary_state =
-        decode_ecm_boundary_state(ecm_boundary_state_msg.data());
-    dish->CPM->SetECMBoundaryState(ecm_boundary_state);
+    ECMBoundaryChanges ecm_changes;
+    auto const &ecm_boundary_state = coupling->boundary_state(i, ecm_changes);
+    dish->CPM->SetECMBoundaryState(ecm_boundary_state, ecm_changes);
 
     PROFILE(amoebamove, dish->CPM->AmoebaeMove(dish->PDEfield);)
+    dish->io->WriteTrajectory(i);
 
-    if (instance->is_connected("state_out")) {
-      if (i % instance->get_setting_as<int64_t>("state_output_interval") == 0) {
+    if (state_output_interval > 0) {
+      if (i % state_output_interval == 0) {
         std::cerr << "i = " << i << ", sending on state_out" << std::endl;
-        auto *cpm_sigma = dish->CPM->getSigma()[0];
+        std::vector<int> spins;
         Data cpm_state =
-            Data::grid(cpm_sigma,
+            Data::grid(dish->CPM->SigmaInts(spins),
                        {static_cast<std::size_t>(dish->CPM->SizeX()),
                         static_cast<std::size_t>(dish->CPM->SizeY())},
                        {"x", "y"}, StorageOrder::last_adjacent);
@@ -155,7 +168,7 @@ TIMESTEP {
                         static_cast<std::size_t>(pde->SizeY())},
                        {"layer", "x", "y"}, StorageOrder::first_adjacent);
         Data state = Data::dict("cpm", cpm_state, "pde", pde_state);
-        instance->send("state_out", Message(i, state));
+        coupling->send("state_out", Message(i, state));
       }
     }
 
@@ -174,6 +187,7 @@ TIMESTEP {
     exit(1);
   } catch (std::exception const &e) {
     // ensure we crash if there's a problem, Qt swallows exceptions
+    std::cerr << e.what() << std::endl;
     std::terminate();
   }
   PROFILE_PRINT
@@ -192,7 +206,6 @@ void PDE::Secrete(CellularPotts *cpm) {
       }
     }
   }
-  PROFILE_PRINT
 }
 
 void PDE::DerivativesPDE(CellularPotts *cpm, PDEFIELD_TYPE *derivs, int x,
@@ -216,7 +229,8 @@ void Plotter::Plot() {
 
 int main(int argc, char *argv[]) {
   PortsDescription ports(
-      {{Operator::O_I, {"cell_ecm_interactions_out", "state_out"}},
+      {{Operator::F_INIT, {"ecm_in"}},
+       {Operator::O_I, {"cell_ecm_interactions_out", "state_out"}},
        {Operator::S, {"ecm_boundary_state_in"}}});
   instance = std::make_unique<Instance>(0, nullptr, ports);
 
@@ -224,16 +238,53 @@ int main(int argc, char *argv[]) {
   set_parameters_from_settings(*instance);
   Seed(par.rseed);
 
+  if (instance->is_connected("state_out"))
+    state_output_interval =
+        instance->get_setting_as<int64_t>("state_output_interval");
+  if (par.ecm_engine == "native") {
+    if (!instance->is_connected("ecm_in")) {
+      std::cerr << "ecm_engine is native, but ecm_in is not connected"
+                << std::endl;
+      return 1;
+    }
+    ECMEvolutionParameters ecm_par;
+    ecm_par.dt = par.md_dt;
+    ecm_par.its = par.md_its;
+    ecm_par.kT = par.md_kT;
+    ecm_par.gamma = par.viscosity;
+    ecm_par.seed = static_cast<std::uint64_t>(par.md_seed);
+    ecm_par.box_size_x = par.sizex;
+    ecm_par.box_size_y = par.sizey;
+    ecm_par.contour_length = par.contour_length;
+    ecm_par.threads = par.ecm_threads;
+    MDState initial_ecm = decode_mdstate(instance->receive("ecm_in").data());
+    ecm = std::make_unique<ECMSimulation>(std::move(initial_ecm), ecm_par);
+    coupling = std::make_unique<ECMCoupling>(*instance, *ecm);
+  } else {
+    coupling = std::make_unique<ECMCoupling>(*instance, par.ecm_coupling_lag);
+  }
+
   try {
     start_graphics(argc, argv);
   } catch (const char *error) {
     std::cerr << error << std::endl;
     return 1;
+  } catch (std::exception const &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
   } catch (...) {
     std::cerr << "An unknown exception was caught" << std::endl;
     return 1;
   }
 
+  // Receive the states that were sent in the last steps, and let go of the
+  // instance
+  coupling->flush();
+  std::cerr << "Waited " << coupling->wait_time()
+            << " s for the ECM boundary state" << std::endl;
+  coupling.reset();
+  ecm.reset();
+
   // This is a hack, the whole model is really supposed to be inside a while
   // loop guarded by this statement. The architecture here won't allow that
   // and fortunately we don't need to actually run more than once, but
@@ -0,0 +1,322 @@
+/*
+
+Copyright 1996-2006 Roeland Merks
+
+This file is part of Tissue Simulation Toolkit.
+
+Tissue Simulation Toolkit is free software; you can redistribute
+it and/or modify it under the terms of the GNU General Public
+License as published by the Free Software Foundation; either
+version 2 of the License, or (at your option) any later version.
+
+Tissue Simulation Toolkit is distributed in the hope that it will
+be useful, but WITHOUT ANY WARRANTY; without even the implied
+warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Tissue Simulation Toolkit; if not, write to the Free
+Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301 USA
+
+*/
+
+/* Benchmark model
+ *
+ * Runs one of a few canonical scenarios, selected by benchmark_scenario, and
+ * writes how long it took to benchmark_output as JSON. The scenarios follow
+ * the sorting, vessel, Act_model and adhesions models, with these changes:
+ *
+ * - act starts from cells grown by GrowInCells rather than a zygote picture,
+ *   and does not grow or decay the matrix adhesions (MILayerCA).
+ * - adhesions creates a synthetic ECM boundary state instead of coupling to
+ *   the ECM simulation through MUSCLE3: each adhesion is bonded to a fixed
+ *   free particle, and held at an angle by a second one. The state is passed
+ *   to the CPM every MCS, as the coupled model does.
+ *
+ * Use src/scripts/benchmark.py to run the scenarios at several lattice sizes
+ * and compare the results to a baseline.
+ */
+#include <stdio.h>
+#ifndef __APPLE__
+#include <malloc.h>
+#endif
+#include "adhesion_creation.hpp"
+#include "cell.hpp"
+#include "dish.hpp"
+#include "graph.hpp"
+#include "info.hpp"
+#include "parameter.hpp"
+#include "plotter.hpp"
+#include "profiler.hpp"
+#include "random.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+Clock::time_point start_time;
+
+double seconds_since(Clock::time_point t) {
+  return std::chrono::duration<double>(Clock::now() - t).count();
+}
+
+// Peak resident set size of the process, in bytes
+long long peak_rss() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return -1;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return usage.ru_maxrss * 1024LL;
+#endif
+}
+
+// FNV-1a hash of the CPM lattice, to check that a run is reproducible
+std::uint64_t lattice_hash(CellularPotts const &cpm) {
+  std::uint64_t hash = 14695981039346656037ULL;
+  for (int x = 0; x < cpm.SizeX(); x++)
+    for (int y = 0; y < cpm.SizeY(); y++) {
+      std::uint32_t spin = cpm.Sigma(x, y);
+      for (int b = 0; b < 4; b++) {
+        hash ^= (spin >> (8 * b)) & 0xff;
+        hash *= 1099511628211ULL;
+      }
+    }
+  return hash;
+}
+
+/* Create an ECM boundary state with adhesions in the adhesion zone
+ *
+ * Each adhesion is bonded to a free particle, which is bonded to a second
+ * one further out, with an angle constraint over the three.
+ */
+ECMBoundaryState synthetic_ecm(CellularPotts &cpm, int adhesions,
+                               unsigned seed) {
+  ECMBoundaryState ecm;
+  ecm.bond_types[static_cast<BondTypeId>(NamedBondTypes::fiber)] =
+      BondType(2.0, 50.0);
+  ecm.angle_cst_types[0] = AngleCstType(M_PI, 5.0);
+
+  std::vector<PixelPos> zone = adhesion_zone(cpm, cpm.Workers());
+  if (zone.empty())
+    return ecm;
+
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<std::size_t> pick(0, zone.size() - 1);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (int i = 0; i < adhesions; i++) {
+    PixelPos pixel = zone[pick(rng)];
+    ParPos pos(pixel.x + uniform(rng), pixel.y + uniform(rng));
+    double angle = 2.0 * M_PI * uniform(rng);
+    ParDisplacement step(2.0 * cos(angle), 2.0 * sin(angle));
+
+    ParId adhesion = 3 * i, near = 3 * i + 1, far = 3 * i + 2;
+    ecm.particles.set(Particle(adhesion, pos, ParticleType::adhesion));
+    ecm.particles.set(Particle(near, pos + step, ParticleType::free));
+    ecm.particles.set(Particle(far, pos + step + step, ParticleType::free));
+    ecm.bonds.set(2 * i, Bond(adhesion, near, 0));
+    ecm.bonds.set(2 * i + 1, Bond(near, far, 0));
+    ecm.angle_csts.set(i, AngleCst(adhesion, near, far, 0));
+  }
+  return ecm;
+}
+
+} // namespace
+
+INIT {
+  try {
+    CPM->GrowInCells(par.n_init_cells, par.size_init_cells, par.subfield);
+    CPM->ConstructInitCells(*this);
+    for (int i = 0; i < par.divisions; i++) {
+      CPM->DivideCells();
+    }
+
+    if (par.benchmark_scenario == "sorting")
+      CPM->SetRandomTypes();
+
+    if (par.benchmark_scenario == "act") {
+      CPM->MeasureCellPerimeters();
+      CPM->AllocateMatrix(*this);
+    } else {
+      CPM->InitialiseEdgeList();
+    }
+  } catch (const char *error) {
+    cerr << "Caught exception\n";
+    std::cerr << error << "\n";
+    exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
+  }
+}
+
+TIMESTEP {
+  try {
+    static int i = 0;
+    static Dish *dish;
+    static double startup = 0.0, t_cpm = 0.0, t_pde = 0.0;
+    static long long pde_site_updates = 0;
+    static ECMBoundaryState ecm;
+
+    if (i == 0) {
+      dish = new Dish();
+      if (par.benchmark_scenario == "adhesions")
+        ecm = synthetic_ecm(*dish->CPM, par.num_initial_adhesions,
+                            static_cast<unsigned>(par.rseed));
+      startup = seconds_since(start_time);
+    }
+
+    auto t = Clock::now();
+    if (par.benchmark_scenario == "vessel" && i >= par.relaxation) {
+      PROFILE_ZONE(pde)
+      if (i == par.relaxation) {
+        dish->PDEfield->InitialisePDE(dish->CPM);
+        dish->PDEfield->InitialiseDiffusionCoefficients(dish->CPM);
+      } else {
+        for (int r = 0; r < par.pde_its; r++)
+          dish->PDEfield->ReactionDiffusion(dish->CPM);
+        pde_site_updates += static_cast<long long>(par.pde_its) *
+                            dish->PDEfield->Layers() *
+                            dish->PDEfield->SizeX() * dish->PDEfield->SizeY();
+      }
+    }
+    t_pde += seconds_since(t);
+
+    t = Clock::now();
+    if (par.benchmark_scenario == "act") {
+      PROFILE(amoebamove, dish->CPM->Act_AmoebaeMove(dish->PDEfield);)
+      if (par.max_Act && par.lambda_Act)
+        dish->PDEfield->AgeLayer(2, 1., dish->CPM, dish);
+    } else if (par.benchmark_scenario == "adhesions") {
+      dish->CPM->SetECMBoundaryState(ecm);
+      PROFILE(amoebamove, dish->CPM->AmoebaeMove(dish->PDEfield);)
+      dish->CPM->ResetCellECMInteractions();
+    } else {
+      PROFILE(amoebamove, dish->CPM->AmoebaeMove(dish->PDEfield);)
+    }
+    t_cpm += seconds_since(t);
+
+    i++;
+    if (i == par.mcs) {
+      double t_total = t_cpm + t_pde;
+      long long attempts = dish->CPM->CopyAttempts();
+      auto const &cells = *dish->CPM->getCellArray();
+      long cell_count = std::count_if(cells.begin() + 1, cells.end(),
+                                      [](Cell const &c) { return c.AliveP(); });
+
+      std::ofstream out(par.benchmark_output);
+      out << std::setprecision(9);
+      out << "{\"scenario\":\"" << par.benchmark_scenario << "\""
+          << ",\"sizex\":" << par.sizex << ",\"sizey\":" << par.sizey
+          << ",\"mcs\":" << par.mcs << ",\"rseed\":" << par.rseed
+          << ",\"cells\":" << cell_count
+          << ",\"startup_s\":" << startup << ",\"cpm_s\":" << t_cpm
+          << ",\"pde_s\":" << t_pde
+          << ",\"mcs_per_s\":" << (t_total > 0 ? par.mcs / t_total : 0)
+          << ",\"copy_attempts\":" << attempts << ",\"copy_attempts_per_s\":"
+          << (t_cpm > 0 ? attempts / t_cpm : 0)
+          << ",\"pde_site_updates\":" << pde_site_updates
+          << ",\"pde_site_updates_per_s\":"
+          << (t_pde > 0 ? pde_site_updates / t_pde : 0)
+          << ",\"peak_rss_bytes\":" << peak_rss() << ",\"lattice_hash\":\""
+          << std::hex << std::setw(16) << std::setfill('0')
+          << lattice_hash(*dish->CPM) << "\"}\n";
+      if (!out)
+        throw "Could not write the benchmark output";
+    }
+  } catch (const char *error) {
+    cerr << "Caught exception\n";
+    std::cerr << error << "\n";
+    exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
+  }
+  PROFILE_PRINT
+}
+
+void PDE::InitialisePDE(CellularPotts *cpm) {
+  for (int x = 0; x < sizex; x++) {
+    for (int y = 0; y < sizey; y++) {
+      PDEvars[0][x][y] = 0;
+    }
+  }
+}
+
+void PDE::InitialiseDiffusionCoefficients(CellularPotts *cpm) {
+  for (int x = 0; x < sizex; x++) {
+    for (int y = 0; y < sizey; y++) {
+      for (int l = 0; l < par.n_chem; l++) {
+        DiffCoeffs[l][x][y] = par.diff_coeff[l];
+      }
+    }
+  }
+}
+
+void PDE::DerivativesPDE(CellularPotts *cpm, PDEFIELD_TYPE *derivs, int x,
+                         int y) {
+  // inside cells
+  if (cpm->Sigma(x, y)) {
+    derivs[0] = par.secr_rate[0];
+  } else {
+    // outside cells
+    derivs[0] = -par.decay_rate[0] * PDEvars[0][x][y];
+  }
+}
+
+void PDE::AgeLayer(int l, double value, CellularPotts *cpm, Dish *dish) {
+  for (const auto elem : cpm->actPixels) {
+    if (elem.second > 0.) {
+      cpm->actPixels[elem.first] -= value;
+    }
+  }
+}
+
+int PDE::MapColour(double val) {
+  return (((int)((val / ((val) + 1.)) * 100)) % 100) + 155;
+}
+
+void Plotter::Plot() {
+  graphics->BeginScene();
+  graphics->ClearImage();
+
+  plotCPMCellTypes();
+  plotCPMLines();
+
+  graphics->EndScene();
+}
+
+int main(int argc, char *argv[]) {
+  extern Parameter par;
+  start_time = Clock::now();
+  try {
+    par.Read(argv[1]);
+    Seed(par.rseed);
+    start_graphics(argc, argv);
+  } catch (const char *error) {
+    std::cerr << error << std::endl;
+    return 1;
+  } catch (std::exception const &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -30,6 +30,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "sqr.hpp"
 #include <algorithm>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <malloc.h>
@@ -48,6 +49,10 @@ INIT {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -93,6 +98,10 @@ TIMESTEP {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -108,6 +117,9 @@ int main(int argc, char *argv[]) {
   } catch (const char *error) {
     std::cerr << error << std::endl;
     return 1;
+  } catch (std::exception const &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
   }
   return 0;
 }
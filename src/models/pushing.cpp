@@ -29,6 +29,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "sqr.hpp"
 #include <algorithm>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <malloc.h>
@@ -61,6 +62,10 @@ INIT {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -74,6 +79,7 @@ TIMESTEP {
     static Info *info = new Info(*dish, *this);
 
     dish->CPM->AmoebaeMove(dish->PDEfield);
+    dish->io->WriteTrajectory(i);
 
     // cerr << "Done\n";
     if (par.graphics && !(i % par.storage_stride)) {
@@ -108,6 +114,10 @@ TIMESTEP {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -128,6 +138,9 @@ int main(int argc, char *argv[]) {
   } catch (const char *error) {
     std::cerr << error << std::endl;
     return 1;
+  } catch (std::exception const &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
   }
   return 0;
 }
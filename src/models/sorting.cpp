@@ -36,6 +36,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "sqr.hpp"
 #include <algorithm>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <math.h>
@@ -71,6 +72,10 @@ INIT {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
@@ -80,7 +85,9 @@ TIMESTEP {
     static int i = 0;
     static Dish *dish;
     if (i == 0) {
-      dish = new Dish();
+      dish = new Dish(true);
+      // continue counting where a restarted run left off
+      i = dish->CPM->Time();
     }
 
     static Info *info = new Info(*dish, *this);
@@ -99,6 +106,8 @@ TIMESTEP {
 
     if (!info->IsPaused()) {
       PROFILE(amoebamove, dish->CPM->AmoebaeMove(dish->PDEfield);)
+      dish->io->WriteContactInterfaces(i);
+      dish->io->WriteTrajectory(i);
     }
     // cout << "Compactness = " << dish-> CPM -> Compactness() << endl;
 
@@ -114,11 +123,17 @@ TIMESTEP {
 
     if (!info->IsPaused()) {
       i++;
+      if (par.checkpoint_stride > 0 && i % par.checkpoint_stride == 0)
+        dish->WriteCheckpoint(par.checkpoint_file);
     }
   } catch (const char *error) {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
   PROFILE_PRINT
 }
@@ -149,6 +164,9 @@ int main(int argc, char *argv[]) {
   } catch (const char *error) {
     std::cerr << error << std::endl;
     return 1;
+  } catch (std::exception const &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
   }
   return 0;
 }
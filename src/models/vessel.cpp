@@ -34,6 +34,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "random.hpp"
 #include <algorithm>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <math.h>
@@ -61,13 +62,23 @@ INIT {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
 }
 
 TIMESTEP {
   try {
     static int i = 0;
-    static Dish *dish = new Dish();
+    static Dish *dish;
+    if (i == 0) {
+      dish = new Dish(true);
+      // continue counting where a restarted run left off
+      i = dish->CPM->Time();
+    }
+
     static Info *info = new Info(*dish, *this);
     static Plotter plotter = Plotter(dish, this);
     if (i >= par.relaxation) {
@@ -96,6 +107,7 @@ TIMESTEP {
       }
     }
     PROFILE(amoebamove, dish->CPM->AmoebaeMove(dish->PDEfield);)
+    dish->io->WriteTrajectory(i);
 
     if (par.graphics && !(i % par.storage_stride)) {
       PROFILE(all_plots, plotter.Plot();)
@@ -110,10 +122,16 @@ TIMESTEP {
       Write(fname);
     }
     i++;
+    if (par.checkpoint_stride > 0 && i % par.checkpoint_stride == 0)
+      dish->WriteCheckpoint(par.checkpoint_file);
   } catch (const char *error) {
     cerr << "Caught exception\n";
     std::cerr << error << "\n";
     exit(1);
+  } catch (std::exception const &error) {
+    cerr << "Caught exception\n";
+    std::cerr << error.what() << "\n";
+    exit(1);
   }
   PROFILE_PRINT
 }
@@ -124,7 +142,6 @@ void PDE::InitialisePDE(CellularPotts *cpm) {
       PDEvars[0][x][y] = 0;
     }
   }
-  PROFILE_PRINT
 }
 
 void PDE::InitialiseDiffusionCoefficients(CellularPotts *cpm) {
@@ -135,7 +152,6 @@ void PDE::InitialiseDiffusionCoefficients(CellularPotts *cpm) {
       }
     }
   }
-  PROFILE_PRINT
 }
 void PDE::DerivativesPDE(CellularPotts *cpm, PDEFIELD_TYPE *derivs, int x,
                          int y) {
@@ -146,7 +162,6 @@ void PDE::DerivativesPDE(CellularPotts *cpm, PDEFIELD_TYPE *derivs, int x,
     // outside cells
     derivs[0] = -par.decay_rate[0] * PDEvars[0][x][y];
   }
-  PROFILE_PRINT
 }
 
 void PDE::Secrete(CellularPotts *cpm) {
@@ -163,7 +178,6 @@ void PDE::Secrete(CellularPotts *cpm) {
       }
     }
   }
-  PROFILE_PRINT
 }
 
 int PDE::MapColour(double val) {
@@ -191,6 +205,9 @@ int main(int argc, char *argv[]) {
   } catch (const char *error) {
     std::cerr << error << std::endl;
     return 1;
+  } catch (std::exception const &error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
   }
   return 0;
 }
@@ -33,6 +33,38 @@ PARAMETER(bool, graphics, true, "Whether to enable graphics")
 PARAMETER(bool, store, true, "Whether to store output to disk")
 PARAMETER(int, storage_stride, 10, "Interval at which to store/show plots")
 PARAMETER(std::string, datadir, "data_film", "Directory to store plots in")
+PARAMETER(int, output_threads, 0,
+          "Number of threads writing images and configurations in the"
+          " background, 0 to write them immediately. The time the simulation"
+          " spends waiting for these threads is printed at the end of the run")
+PARAMETER(int, output_queue_length, 2,
+          "Number of images and configurations that may be waiting to be"
+          " written before the simulation waits for the writer threads")
+CONSTRAINT(output_threads >= 0, "output_threads must not be negative")
+CONSTRAINT(output_queue_length >= 1, "output_queue_length must be at least 1")
+PARAMETER(int, contact_interfaces_stride, 0,
+          "Interval at which to write the interface lengths between cell"
+          " types, 0 to disable. See IO::WriteContactInterfaces()")
+PARAMETER(std::string, contact_interfaces_file, "contact_interfaces.txt",
+          "File to write the interface lengths between cell types to")
+PARAMETER(int, trajectory_stride, 0,
+          "Interval at which to add the lattice, PDE and cells to the"
+          " trajectory, 0 to disable. See IO::WriteTrajectory()")
+PARAMETER(std::string, trajectory_file, "trajectory.trj",
+          "File to write the trajectory to")
+PARAMETER(std::string, trajectory_pde, "float32",
+          "How to store the PDE in the trajectory: none, float32, float64, or"
+          " quantised per layer to uint16 or uint8")
+PARAMETER(int, trajectory_chunk_frames, 64,
+          "Number of trajectory frames compressed together. Reading a frame"
+          " decompresses the frames before it in its chunk")
+CONSTRAINT(trajectory_stride >= 0, "trajectory_stride must not be negative")
+CONSTRAINT(trajectory_pde == "none" || trajectory_pde == "float32" ||
+               trajectory_pde == "float64" || trajectory_pde == "uint16" ||
+               trajectory_pde == "uint8",
+           "trajectory_pde must be none, float32, float64, uint16 or uint8")
+CONSTRAINT(trajectory_chunk_frames >= 1,
+           "trajectory_chunk_frames must be at least 1")
 PARAMETER(std::string, colortable, "../data/default.ctb",
           "Colortable to use for plotting")
 
@@ -43,6 +75,37 @@ PARAMETER(
 
 PARAMETER(int, rseed, -1, "Random seed for the simulation")
 
+PARAMETER(std::string, restart_file, "None",
+          "Checkpoint to continue a previous run from, or None to start a new"
+          " run. Supported by the sorting and vessel models and the Python"
+          " module, other models refuse to start. See Dish::ReadCheckpoint()")
+PARAMETER(std::string, checkpoint_file, "checkpoint.tst",
+          "File to write checkpoints to, it is replaced by each new checkpoint")
+PARAMETER(int, checkpoint_stride, 0,
+          "Interval at which to write a checkpoint, 0 to disable")
+CONSTRAINT(checkpoint_stride >= 0, "checkpoint_stride must not be negative")
+PARAMETER(std::string, profile_output, "None",
+          "Base name of the profile written at the end of the run if the"
+          " model was built with PROFILING = enabled: a Chrome trace in"
+          " <name>.json and a summary in <name>.csv. None to not write it")
+PARAMETER(int, profile_print_interval, 0,
+          "Interval at which to print the profile summary, 0 to only print it"
+          " at the end of the run")
+CONSTRAINT(profile_print_interval >= 0,
+           "profile_print_interval must not be negative")
+PARAMETER(int, move_stats_stride, 0,
+          "Interval at which to write statistics of the copy attempts, 0 to"
+          " disable. See CellularPotts::AmoebaeMove()")
+PARAMETER(std::string, move_stats_file, "move_stats.jsonl",
+          "File to write the statistics of the copy attempts to, as one line"
+          " of JSON per interval")
+PARAMETER(int, move_stats_sample_interval, 64,
+          "Break down DeltaH into its terms, and count acceptance by cell"
+          " type, for one in this many copy attempts")
+CONSTRAINT(move_stats_stride >= 0, "move_stats_stride must not be negative")
+CONSTRAINT(move_stats_sample_interval >= 1,
+           "move_stats_sample_interval must be at least 1")
+
 PARAMETER(bool, usecuda, false, "Whether to use CUDA for PDE calculations")
 PARAMETER(int, number_of_cores, 1,
           "Number of cores used in CUDA kernels, check for your device!")
@@ -73,6 +136,19 @@ PARAMETER(int, sizey, 200, "Vertical size of the grid")
 PARAMETER(bool, periodic_boundaries, false,
           "Whether to use periodic boundaries for the CPM grid")
 
+PARAMETER(
+    bool, sparse_lattice, false,
+    "Only materialise the parts of the CPM grid that are near cells\n"
+    "\n"
+    "Useful for large domains of which the cells occupy only a small part.\n"
+    "The grid is divided into tiles, and lattice-wide scans only visit tiles\n"
+    "that contain cells, plus a halo of one tile around them. Memory backing\n"
+    "empty tiles is allocated on first use and released when they empty.\n")
+PARAMETER(int, lattice_tile_size, 32,
+          "Width and height of a tile of the sparse lattice, in pixels")
+
+CONSTRAINT(lattice_tile_size >= 4, "lattice_tile_size must be at least 4")
+
 PARAMETER(int, mcs, 10000, "Number of Monte Carlo Steps to run")
 
 SECTION("Cellular Potts Model - Initialisation")
@@ -89,6 +165,9 @@ PARAMETER(int, divisions, 0,
 
 PARAMETER(std::string, initial_configuration_file, "None",
           "json file may be provided to import a cpm configuration")
+PARAMETER(bool, configuration_sidecar, false,
+          "Whether to keep a binary copy of json configurations, which loads"
+          " much faster. See IO::ReadConfiguration()")
 
 SECTION("Cellular Potts Model - Dynamics")
 
@@ -113,6 +192,30 @@ PARAMETER(int, neighbours, 2,
           " energy. 0: no neighbours, 1: 4 orthogonal neighbours (von Neumann),"
           "  2: 8 direct neighbours (Moore), 3: 5x5 block minus the corners.")
 
+PARAMETER(
+    std::string, parallel_move, "none",
+    "How to parallelise the copy attempts of a Monte Carlo step\n"
+    "\n"
+    "none: One at a time, in a single thread\n"
+    "speculative: Several threads draw edges and compute DH at the same time,\n"
+    "        and commit accepted copies one by one if the neighbourhood of\n"
+    "        the copy has not changed in the meantime, or retry otherwise.\n"
+    "        Not available together with adhesions.\n")
+PARAMETER(int, move_threads, 0,
+          "Number of threads for parallel_move and for finding the adhesion"
+          " zone, 0 means one per core")
+
+CONSTRAINT(parallel_move == "none" || parallel_move == "speculative",
+           "parallel_move must be none or speculative")
+CONSTRAINT(move_threads >= 0, "move_threads must not be negative")
+
+PARAMETER(int, verify_observables, 0,
+          "Check the running totals of area, cell count and energy against a"
+          " full recomputation every this many MCS, for debugging. 0 to"
+          " disable")
+CONSTRAINT(verify_observables >= 0,
+           "verify_observables must not be negative")
+
 SECTION("Actin model")
 
 PARAMETER(int, ref_adhesive_area, 100,
@@ -227,6 +330,71 @@ PARAMETER(
     "Number of adhesions per pixel above which a crowding penalty is applied")
 PARAMETER(int, adhesions_per_pixel_overflow_penalty, 600,
           "Per-adhesion penalty (in DH units) in case of crowding")
+PARAMETER(
+    int, ecm_coupling_lag, 0,
+    "Number of steps the ECM boundary state used by the CPM lags behind\n"
+    "\n"
+    "0: Use the state the ECM sent in the same step, waiting for it if\n"
+    "   needed\n"
+    "n > 0: Use the state the ECM sent n steps earlier, and exchange\n"
+    "   messages on a background thread, so that the CPM can run up to n\n"
+    "   steps ahead of the ECM\n")
+PARAMETER(std::string, ecm_engine, "muscle3",
+          "Where the ECM is simulated\n"
+          "\n"
+          "muscle3: By simulate_ecm, coupled via MUSCLE3\n"
+          "native: In this program, starting from the ECM received on\n"
+          "   ecm_in, using the md_ parameters below\n")
+PARAMETER(int, ecm_threads, 0,
+          "Number of threads for the native ECM, 0 means one per core")
+PARAMETER(int, md_its, 100, "Number of native ECM time steps per MCS")
+PARAMETER(double, md_dt, 0.01, "Time step of the native ECM")
+PARAMETER(double, md_kT, 0.01, "Temperature of the native ECM")
+PARAMETER(double, viscosity, 10.0,
+          "Friction coefficient of free particles in the native ECM")
+PARAMETER(int, md_seed, 12345678, "Random seed of the native ECM")
+PARAMETER(double, contour_length, 50.0,
+          "Length of the ECM fibers\n"
+          "\n"
+          "The native ECM has a periodic box that extends 2.5 contour lengths\n"
+          "beyond the lattice on each side, as in simulate_ecm\n")
+
+CONSTRAINT(adhesion_extension_mechanism == "lazy" ||
+               adhesion_extension_mechanism == "sticky" ||
+               adhesion_extension_mechanism == "mixed" ||
+               adhesion_extension_mechanism == "random",
+           "adhesion_extension_mechanism must be lazy, sticky, mixed or"
+           " random")
+CONSTRAINT(adhesion_displacement_selection == "uniform" ||
+               adhesion_displacement_selection == "gradient",
+           "adhesion_displacement_selection must be uniform or gradient")
+CONSTRAINT(ecm_coupling_lag >= 0, "ecm_coupling_lag must not be negative")
+CONSTRAINT(ecm_engine == "muscle3" || ecm_engine == "native",
+           "ecm_engine must be muscle3 or native")
+CONSTRAINT(ecm_threads >= 0, "ecm_threads must not be negative")
+CONSTRAINT(md_its >= 0, "md_its must not be negative")
+CONSTRAINT(md_dt > 0.0, "md_dt must be positive")
+CONSTRAINT(md_kT >= 0.0, "md_kT must not be negative")
+CONSTRAINT(contour_length >= 0.0, "contour_length must not be negative")
+CONSTRAINT(viscosity > 0.0, "viscosity must be positive")
+CONSTRAINT(!adhesions_enabled || parallel_move == "none",
+           "parallel_move is not supported with adhesions_enabled")
+
+SECTION("Benchmark")
+
+PARAMETER(std::string, benchmark_scenario, "sorting",
+          "Scenario run by the benchmark model\n"
+          "\n"
+          "sorting: Cell sorting by differential adhesion\n"
+          "vessel: Vasculogenesis, with chemotaxis and a PDE\n"
+          "act: The Act model of cell migration\n"
+          "adhesions: Adhesions with a synthetic ECM, without MUSCLE3\n")
+PARAMETER(std::string, benchmark_output, "benchmark.json",
+          "File to write the measurements of the benchmark model to")
+CONSTRAINT(benchmark_scenario == "sorting" || benchmark_scenario == "vessel" ||
+               benchmark_scenario == "act" ||
+               benchmark_scenario == "adhesions",
+           "benchmark_scenario must be sorting, vessel, act or adhesions")
 
 SECTION("Obsolete and unused")
 
@@ -1,3 +1,5 @@
+#pragma once
+
 // Class point needed by 2D convex hull code
 class Point {
 
@@ -28,8 +28,9 @@ void Plotter::plotPDEDensity() {
 }
 
 void Plotter::plotCPMLines() {
-  glgraphics->cpmLinePlot(dish->CPM->getSigma()[0], par.sizex, par.sizey, 0, 0,
-                          0);
+  std::vector<int> spins;
+  glgraphics->cpmLinePlot(const_cast<int *>(dish->CPM->SigmaInts(spins)),
+                          par.sizex, par.sizey, 0, 0, 0);
 }
 
 void Plotter::plotPDEContourLines() {
@@ -0,0 +1,558 @@
+/* Python module for driving a model from Python
+ *
+ * Built instead of an executable with qmake PYTHON_MODULE=enabled, see
+ * doc/source/python_module.rst. The module is named after the model, and
+ * exposes its Dish, CellularPotts and PDE, so that a Python script can step
+ * the simulation and analyse the state in between.
+ *
+ * The lattice and the PDE layers are returned as NumPy arrays that point
+ * directly into the simulation's memory, so nothing is copied, and they
+ * reflect the current state at any time. The cells are returned as a
+ * read-only snapshot of their most important fields.
+ *
+ * The model's INIT block and PDE functions are used as they are, but its
+ * TIMESTEP and main() are not, the Python script takes their place.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include "ca.hpp"
+#include "cell.hpp"
+#include "dish.hpp"
+#include "parameter.hpp"
+#include "pde.hpp"
+#include "random.hpp"
+
+#include <cstddef>
+#include <exception>
+#include <type_traits>
+#include <vector>
+
+#ifndef TST_MODULE
+#error "Define TST_MODULE as the name of the model"
+#endif
+
+#define TST_STRINGIFY_(x) #x
+#define TST_STRINGIFY(x) TST_STRINGIFY_(x)
+#define TST_CONCAT_(a, b) a##b
+#define TST_CONCAT(a, b) TST_CONCAT_(a, b)
+
+extern Parameter par;
+
+namespace {
+
+// The simulation uses global state (par, the random number generator, and
+// static members of Cell), so there can only be one Dish per process.
+bool dish_created = false;
+
+struct DishObject {
+  PyObject_HEAD Dish *dish;
+};
+
+struct CellularPottsObject {
+  PyObject_HEAD DishObject *owner;
+};
+
+struct PDEObject {
+  PyObject_HEAD DishObject *owner;
+};
+
+// Fields of the cells as returned by Dish.cells()
+struct CellRecord {
+  int sigma;
+  int tau;
+  bool alive;
+  int area;
+  int target_area;
+  int perimeter;
+  int target_perimeter;
+  double length;
+  double target_length;
+  double center_x;
+  double center_y;
+  int mother;
+  int daughter;
+  int times_divided;
+  int date_of_birth;
+};
+
+PyArray_Descr *cell_record_descr = nullptr;
+
+extern PyTypeObject DishType;
+extern PyTypeObject CellularPottsType;
+extern PyTypeObject PDEType;
+
+/* Call f, translating exceptions thrown by the simulation into a Python
+ * RuntimeError
+ */
+template <typename F> PyObject *translate_errors(F &&f) {
+  try {
+    return f();
+  } catch (char const *error) {
+    PyErr_SetString(PyExc_RuntimeError, error);
+  } catch (std::exception const &error) {
+    PyErr_SetString(PyExc_RuntimeError, error.what());
+  }
+  return nullptr;
+}
+
+/* Make a NumPy array pointing to data, which keeps owner alive
+ *
+ * Returns a new reference, or nullptr with an exception set.
+ */
+PyObject *make_view(PyObject *owner, int type, std::vector<npy_intp> dims,
+                    void *data, bool writeable) {
+  int flags = NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED;
+  if (writeable)
+    flags |= NPY_ARRAY_WRITEABLE;
+  PyObject *array =
+      PyArray_New(&PyArray_Type, static_cast<int>(dims.size()), dims.data(),
+                  type, nullptr, data, 0, flags, nullptr);
+  if (!array)
+    return nullptr;
+  Py_INCREF(owner);
+  if (PyArray_SetBaseObject(reinterpret_cast<PyArrayObject *>(array),
+                            owner) < 0) {
+    Py_DECREF(array);
+    return nullptr;
+  }
+  return array;
+}
+
+/* Create the dtype of CellRecord
+ *
+ * Returns a new reference, or nullptr with an exception set.
+ */
+PyArray_Descr *make_cell_record_descr() {
+  struct Field {
+    char const *name;
+    int type;
+    std::size_t offset;
+  };
+  static_assert(sizeof(int) == 4, "int must be 32 bits");
+  Field const fields[] = {
+      {"sigma", NPY_INT32, offsetof(CellRecord, sigma)},
+      {"tau", NPY_INT32, offsetof(CellRecord, tau)},
+      {"alive", NPY_BOOL, offsetof(CellRecord, alive)},
+      {"area", NPY_INT32, offsetof(CellRecord, area)},
+      {"target_area", NPY_INT32, offsetof(CellRecord, target_area)},
+      {"perimeter", NPY_INT32, offsetof(CellRecord, perimeter)},
+      {"target_perimeter", NPY_INT32, offsetof(CellRecord, target_perimeter)},
+      {"length", NPY_FLOAT64, offsetof(CellRecord, length)},
+      {"target_length", NPY_FLOAT64, offsetof(CellRecord, target_length)},
+      {"center_x", NPY_FLOAT64, offsetof(CellRecord, center_x)},
+      {"center_y", NPY_FLOAT64, offsetof(CellRecord, center_y)},
+      {"mother", NPY_INT32, offsetof(CellRecord, mother)},
+      {"daughter", NPY_INT32, offsetof(CellRecord, daughter)},
+      {"times_divided", NPY_INT32, offsetof(CellRecord, times_divided)},
+      {"date_of_birth", NPY_INT32, offsetof(CellRecord, date_of_birth)}};
+
+  // Build the dtype from a dict, as in numpy.dtype({'names': ..., ...})
+  PyObject *names = PyList_New(0);
+  PyObject *formats = PyList_New(0);
+  PyObject *offsets = PyList_New(0);
+  bool ok = names && formats && offsets;
+  for (Field const &field : fields) {
+    if (!ok)
+      break;
+    PyObject *name = PyUnicode_FromString(field.name);
+    PyObject *format =
+        reinterpret_cast<PyObject *>(PyArray_DescrFromType(field.type));
+    PyObject *offset = PyLong_FromSize_t(field.offset);
+    ok = name && format && offset && PyList_Append(names, name) == 0 &&
+         PyList_Append(formats, format) == 0 &&
+         PyList_Append(offsets, offset) == 0;
+    Py_XDECREF(name);
+    Py_XDECREF(format);
+    Py_XDECREF(offset);
+  }
+
+  PyArray_Descr *descr = nullptr;
+  if (ok) {
+    PyObject *spec =
+        Py_BuildValue("{sOsOsOsn}", "names", names, "formats", formats,
+                      "offsets", offsets, "itemsize",
+                      static_cast<Py_ssize_t>(sizeof(CellRecord)));
+    if (spec)
+      PyArray_DescrConverter(spec, &descr);
+    Py_XDECREF(spec);
+  }
+  Py_XDECREF(names);
+  Py_XDECREF(formats);
+  Py_XDECREF(offsets);
+  return descr;
+}
+
+// Dish
+
+/* Check that the Dish was set up successfully
+ *
+ * Returns false with an exception set if it was not.
+ */
+bool check_dish(DishObject *self) {
+  if (self->dish)
+    return true;
+  PyErr_SetString(PyExc_RuntimeError, "The Dish was not set up");
+  return false;
+}
+
+int Dish_init(DishObject *self, PyObject *args, PyObject *kwds) {
+  char const *keywords[] = {"parfile", nullptr};
+  char const *parfile;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s",
+                                   const_cast<char **>(keywords), &parfile))
+    return -1;
+
+  if (dish_created) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Only one Dish can be created per process");
+    return -1;
+  }
+
+  PyObject *result = translate_errors([&]() -> PyObject * {
+    // start from the defaults, in case an earlier attempt read a file
+    par = Parameter();
+    par.Read(parfile);
+    Seed(par.rseed);
+    self->dish = new Dish(true);
+    // only now, so that a Dish can be created after a failed attempt
+    dish_created = true;
+    Py_RETURN_NONE;
+  });
+  if (!result)
+    return -1;
+  Py_DECREF(result);
+  return 0;
+}
+
+void Dish_dealloc(DishObject *self) {
+  delete self->dish;
+  Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+PyObject *Dish_get_time(DishObject *self, void *) {
+  if (!check_dish(self))
+    return nullptr;
+  return PyLong_FromLong(self->dish->Time());
+}
+
+PyObject *Dish_get_cpm(DishObject *self, void *) {
+  if (!check_dish(self))
+    return nullptr;
+  auto *cpm = PyObject_New(CellularPottsObject, &CellularPottsType);
+  if (!cpm)
+    return nullptr;
+  Py_INCREF(self);
+  cpm->owner = self;
+  return reinterpret_cast<PyObject *>(cpm);
+}
+
+PyObject *Dish_get_pde(DishObject *self, void *) {
+  if (!check_dish(self))
+    return nullptr;
+  if (!self->dish->PDEfield)
+    Py_RETURN_NONE;
+  auto *pde = PyObject_New(PDEObject, &PDEType);
+  if (!pde)
+    return nullptr;
+  Py_INCREF(self);
+  pde->owner = self;
+  return reinterpret_cast<PyObject *>(pde);
+}
+
+PyObject *Dish_count_cells(DishObject *self, PyObject *) {
+  if (!check_dish(self))
+    return nullptr;
+  return PyLong_FromLong(self->dish->CountCells());
+}
+
+PyObject *Dish_cells(DishObject *self, PyObject *) {
+  if (!check_dish(self))
+    return nullptr;
+  std::vector<Cell> &cells = *self->dish->CPM->getCellArray();
+  npy_intp n = static_cast<npy_intp>(cells.size());
+
+  Py_INCREF(cell_record_descr);
+  PyObject *array = PyArray_NewFromDescr(&PyArray_Type, cell_record_descr, 1,
+                                         &n, nullptr, nullptr, 0, nullptr);
+  if (!array)
+    return nullptr;
+
+  auto *records = static_cast<CellRecord *>(
+      PyArray_DATA(reinterpret_cast<PyArrayObject *>(array)));
+  for (std::size_t i = 0; i < cells.size(); i++) {
+    Cell &cell = cells[i];
+    CellRecord &record = records[i];
+    record.sigma = cell.Sigma();
+    record.tau = cell.getTau();
+    record.alive = cell.AliveP();
+    record.area = cell.Area();
+    record.target_area = cell.TargetArea();
+    record.perimeter = cell.Perimeter();
+    record.target_perimeter = cell.TargetPerimeter();
+    record.length = cell.Length();
+    record.target_length = cell.TargetLength();
+    record.center_x = cell.getCenterX();
+    record.center_y = cell.getCenterY();
+    record.mother = cell.Mother();
+    record.daughter = cell.Daughter();
+    record.times_divided = cell.TimesDivided();
+    record.date_of_birth = cell.DateOfBirth();
+  }
+  PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject *>(array),
+                     NPY_ARRAY_WRITEABLE);
+  return array;
+}
+
+PyObject *Dish_cell_growth_and_division(DishObject *self, PyObject *) {
+  if (!check_dish(self))
+    return nullptr;
+  return translate_errors([&]() -> PyObject * {
+    self->dish->CellGrowthAndDivision();
+    Py_RETURN_NONE;
+  });
+}
+
+PyGetSetDef Dish_getset[] = {
+    {"time", reinterpret_cast<getter>(Dish_get_time), nullptr,
+     "Number of completed Monte Carlo steps", nullptr},
+    {"cpm", reinterpret_cast<getter>(Dish_get_cpm), nullptr,
+     "The CellularPotts of the dish", nullptr},
+    {"pde", reinterpret_cast<getter>(Dish_get_pde), nullptr,
+     "The PDE of the dish, or None if there are no chemicals", nullptr},
+    {nullptr}};
+
+PyMethodDef Dish_methods[] = {
+    {"count_cells", reinterpret_cast<PyCFunction>(Dish_count_cells),
+     METH_NOARGS, "Return the number of living cells."},
+    {"cells", reinterpret_cast<PyCFunction>(Dish_cells), METH_NOARGS,
+     "Return a read-only structured array with a snapshot of the cells.\n\n"
+     "Element i describes the cell with sigma i, with element 0 being the\n"
+     "medium, so cells()[cpm.sigma] gives the cell at each site, except at\n"
+     "the border of the lattice, where sigma is -1 unless the boundaries\n"
+     "are periodic. Dead cells are included, see the alive field."},
+    {"cell_growth_and_division",
+     reinterpret_cast<PyCFunction>(Dish_cell_growth_and_division),
+     METH_NOARGS, "Grow stretched cells, and divide large ones."},
+    {nullptr}};
+
+PyTypeObject DishType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// CellularPotts
+
+void CellularPotts_dealloc(CellularPottsObject *self) {
+  Py_DECREF(self->owner);
+  PyObject_Free(self);
+}
+
+CellularPotts *cpm_of(CellularPottsObject *self) {
+  return self->owner->dish->CPM;
+}
+
+PyObject *CellularPotts_get_sizex(CellularPottsObject *self, void *) {
+  return PyLong_FromLong(cpm_of(self)->SizeX());
+}
+
+PyObject *CellularPotts_get_sizey(CellularPottsObject *self, void *) {
+  return PyLong_FromLong(cpm_of(self)->SizeY());
+}
+
+PyObject *CellularPotts_get_copy_attempts(CellularPottsObject *self, void *) {
+  return PyLong_FromLongLong(cpm_of(self)->CopyAttempts());
+}
+
+PyObject *CellularPotts_get_sigma(CellularPottsObject *self, void *) {
+  CellularPotts *cpm = cpm_of(self);
+  int type = sizeof(Spin) == 2 ? NPY_INT16 : NPY_INT32;
+  void *data = cpm->VisitSigma([](auto const &lattice) {
+    return const_cast<void *>(static_cast<void const *>(lattice.data()));
+  });
+  return make_view(reinterpret_cast<PyObject *>(self->owner), type,
+                   {cpm->SizeX(), cpm->SizeY()}, data, false);
+}
+
+PyObject *CellularPotts_amoebae_move(CellularPottsObject *self, PyObject *) {
+  return translate_errors([&]() -> PyObject * {
+    Dish *dish = self->owner->dish;
+    return PyLong_FromLong(dish->CPM->AmoebaeMove(dish->PDEfield));
+  });
+}
+
+PyObject *CellularPotts_act_amoebae_move(CellularPottsObject *self,
+                                         PyObject *) {
+  return translate_errors([&]() -> PyObject * {
+    Dish *dish = self->owner->dish;
+    return PyLong_FromLong(dish->CPM->Act_AmoebaeMove(dish->PDEfield));
+  });
+}
+
+PyGetSetDef CellularPotts_getset[] = {
+    {"sizex", reinterpret_cast<getter>(CellularPotts_get_sizex), nullptr,
+     "Horizontal size of the lattice", nullptr},
+    {"sizey", reinterpret_cast<getter>(CellularPotts_get_sizey), nullptr,
+     "Vertical size of the lattice", nullptr},
+    {"copy_attempts",
+     reinterpret_cast<getter>(CellularPotts_get_copy_attempts), nullptr,
+     "Number of copy attempts evaluated so far", nullptr},
+    {"sigma", reinterpret_cast<getter>(CellularPotts_get_sigma), nullptr,
+     "Read-only (sizex, sizey) view of the lattice, without copying.\n\n"
+     "The view follows the simulation as it runs. It is invalidated if the\n"
+     "lattice is replaced, which only happens when a checkpoint is read or\n"
+     "the model anneals a copy of the lattice, so get a new one after that.",
+     nullptr},
+    {nullptr}};
+
+PyMethodDef CellularPotts_methods[] = {
+    {"amoebae_move", reinterpret_cast<PyCFunction>(CellularPotts_amoebae_move),
+     METH_NOARGS,
+     "Do one Monte Carlo step, and return the total energy change."},
+    {"act_amoebae_move",
+     reinterpret_cast<PyCFunction>(CellularPotts_act_amoebae_move),
+     METH_NOARGS,
+     "Do one Monte Carlo step of the Act model, and return the total energy\n"
+     "change."},
+    {nullptr}};
+
+PyTypeObject CellularPottsType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// PDE
+
+void PDE_dealloc(PDEObject *self) {
+  Py_DECREF(self->owner);
+  PyObject_Free(self);
+}
+
+PDE *pde_of(PDEObject *self) { return self->owner->dish->PDEfield; }
+
+PyObject *PDE_get_layers(PDEObject *self, void *) {
+  return PyLong_FromLong(pde_of(self)->Layers());
+}
+
+PyObject *PDE_get_time(PDEObject *self, void *) {
+  return PyFloat_FromDouble(pde_of(self)->TheTime());
+}
+
+PyObject *PDE_get_fields(PDEObject *self, void *) {
+  PDE *pde = pde_of(self);
+  int type = std::is_same<PDEFIELD_TYPE, float>::value ? NPY_FLOAT32
+                                                       : NPY_FLOAT64;
+  return make_view(reinterpret_cast<PyObject *>(self->owner), type,
+                   {pde->Layers(), pde->SizeX(), pde->SizeY()},
+                   pde->getPDEvars()[0][0], true);
+}
+
+PyObject *PDE_reaction_diffusion(PDEObject *self, PyObject *args) {
+  int steps = 1;
+  if (!PyArg_ParseTuple(args, "|i", &steps))
+    return nullptr;
+  return translate_errors([&]() -> PyObject * {
+    Dish *dish = self->owner->dish;
+    for (int i = 0; i < steps; i++)
+      dish->PDEfield->ReactionDiffusion(dish->CPM);
+    Py_RETURN_NONE;
+  });
+}
+
+PyObject *PDE_diffuse(PDEObject *self, PyObject *args) {
+  int steps = 1;
+  if (!PyArg_ParseTuple(args, "|i", &steps))
+    return nullptr;
+  return translate_errors([&]() -> PyObject * {
+    pde_of(self)->Diffuse(steps);
+    Py_RETURN_NONE;
+  });
+}
+
+PyGetSetDef PDE_getset[] = {
+    {"layers", reinterpret_cast<getter>(PDE_get_layers), nullptr,
+     "Number of layers (chemicals)", nullptr},
+    {"time", reinterpret_cast<getter>(PDE_get_time), nullptr,
+     "Simulated time, the number of steps times dt", nullptr},
+    {"fields", reinterpret_cast<getter>(PDE_get_fields), nullptr,
+     "Writable (layers, sizex, sizey) view of the layers, without copying.\n\n"
+     "The view stays valid for as long as it exists.",
+     nullptr},
+    {nullptr}};
+
+PyMethodDef PDE_methods[] = {
+    {"reaction_diffusion", reinterpret_cast<PyCFunction>(PDE_reaction_diffusion),
+     METH_VARARGS,
+     "reaction_diffusion(steps=1)\n\n"
+     "Do reaction diffusion steps, using the model's DerivativesPDE."},
+    {"diffuse", reinterpret_cast<PyCFunction>(PDE_diffuse), METH_VARARGS,
+     "diffuse(steps=1)\n\nDo diffusion steps."},
+    {nullptr}};
+
+PyTypeObject PDEType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, TST_STRINGIFY(TST_MODULE),
+    "Tissue Simulation Toolkit model " TST_STRINGIFY(TST_MODULE), -1,
+    nullptr};
+
+bool ready_types() {
+  DishType.tp_name = TST_STRINGIFY(TST_MODULE) ".Dish";
+  DishType.tp_doc = "Dish(parfile)\n\n"
+                    "The simulation, set up from a parameter file by the "
+                    "model's INIT.";
+  DishType.tp_basicsize = sizeof(DishObject);
+  DishType.tp_flags = Py_TPFLAGS_DEFAULT;
+  DishType.tp_new = PyType_GenericNew;
+  DishType.tp_init = reinterpret_cast<initproc>(Dish_init);
+  DishType.tp_dealloc = reinterpret_cast<destructor>(Dish_dealloc);
+  DishType.tp_getset = Dish_getset;
+  DishType.tp_methods = Dish_methods;
+
+  CellularPottsType.tp_name = TST_STRINGIFY(TST_MODULE) ".CellularPotts";
+  CellularPottsType.tp_doc = "The CPM of a Dish, see Dish.cpm.";
+  CellularPottsType.tp_basicsize = sizeof(CellularPottsObject);
+  CellularPottsType.tp_flags = Py_TPFLAGS_DEFAULT;
+  CellularPottsType.tp_dealloc =
+      reinterpret_cast<destructor>(CellularPotts_dealloc);
+  CellularPottsType.tp_getset = CellularPotts_getset;
+  CellularPottsType.tp_methods = CellularPotts_methods;
+
+  PDEType.tp_name = TST_STRINGIFY(TST_MODULE) ".PDE";
+  PDEType.tp_doc = "The PDE of a Dish, see Dish.pde.";
+  PDEType.tp_basicsize = sizeof(PDEObject);
+  PDEType.tp_flags = Py_TPFLAGS_DEFAULT;
+  PDEType.tp_dealloc = reinterpret_cast<destructor>(PDE_dealloc);
+  PDEType.tp_getset = PDE_getset;
+  PDEType.tp_methods = PDE_methods;
+
+  return PyType_Ready(&DishType) == 0 &&
+         PyType_Ready(&CellularPottsType) == 0 && PyType_Ready(&PDEType) == 0;
+}
+
+} // namespace
+
+PyMODINIT_FUNC TST_CONCAT(PyInit_, TST_MODULE)(void) {
+  import_array();
+
+  if (!ready_types())
+    return nullptr;
+
+  cell_record_descr = make_cell_record_descr();
+  if (!cell_record_descr)
+    return nullptr;
+
+  PyObject *module = PyModule_Create(&module_def);
+  if (!module)
+    return nullptr;
+
+  PyTypeObject *types[] = {&DishType, &CellularPottsType, &PDEType};
+  char const *names[] = {"Dish", "CellularPotts", "PDE"};
+  for (int i = 0; i < 3; i++) {
+    Py_INCREF(types[i]);
+    if (PyModule_AddObject(module, names[i],
+                           reinterpret_cast<PyObject *>(types[i])) < 0) {
+      Py_DECREF(types[i]);
+      Py_DECREF(module);
+      return nullptr;
+    }
+  }
+  return module;
+}
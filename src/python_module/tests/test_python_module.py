@@ -0,0 +1,77 @@
+"""Smoke test for the Python module of a model
+
+Builds a small dish of the sorting model, steps it, and checks that the
+lattice and the cells seen from Python agree. Run it from bin/ after
+building bin/sorting.so, or use make test_python_module.
+"""
+import os
+import sys
+import tempfile
+
+import numpy as np
+
+sys.path.insert(0, os.getcwd())
+import sorting  # type: ignore  # noqa: E402
+
+
+def write_parameters(directory: str, **changes: object) -> str:
+    """Write a copy of sorting.par with some parameters changed"""
+    lines = []
+    with open(os.path.join('..', 'data', 'sorting.par')) as f:
+        for line in f:
+            name = line.split('=')[0].strip()
+            if name not in changes:
+                lines.append(line)
+    for name, value in changes.items():
+        lines.append(f'{name} = {value}\n')
+
+    path = os.path.join(directory, f'smoke_{len(os.listdir(directory))}.par')
+    with open(path, 'w') as f:
+        f.writelines(lines)
+    return path
+
+
+def main() -> None:
+    with tempfile.TemporaryDirectory() as directory:
+        small = dict(
+                sizex=60, sizey=60, size_init_cells=10, divisions=3,
+                graphics='false', store='false', rseed=3)
+
+        # a failed attempt does not use up the one Dish per process
+        broken = write_parameters(
+                directory, restart_file='does_not_exist.chk', **small)
+        try:
+            sorting.Dish(broken)
+            raise AssertionError('Restarting from a missing file worked')
+        except RuntimeError:
+            pass
+
+        dish = sorting.Dish(write_parameters(directory, **small))
+
+    cpm = dish.cpm
+    sigma = cpm.sigma
+    assert sigma.shape == (60, 60)
+    assert not sigma.flags.writeable
+
+    for _ in range(10):
+        cpm.amoebae_move()
+
+    # the view follows the lattice, and agrees with the cells
+    cells = dish.cells()
+    alive = cells[1:][cells[1:]['alive']]
+    assert len(alive) == dish.count_cells() > 1
+    assert alive['area'].sum() == np.count_nonzero(sigma > 0)
+    for cell in alive:
+        assert np.count_nonzero(sigma == cell['sigma']) == cell['area']
+
+    try:
+        sorting.Dish(os.path.join('..', 'data', 'sorting.par'))
+        raise AssertionError('A second Dish was created')
+    except RuntimeError:
+        pass
+
+    print('Python module smoke test passed')
+
+
+if __name__ == '__main__':
+    main()
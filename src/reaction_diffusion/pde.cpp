@@ -24,9 +24,11 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include <fstream>
 #include <math.h>
 #include <sstream>
+#include <stdexcept>
 #include <stdio.h>
 
 #include "ca.hpp"
+#include "checkpoint.hpp"
 #include "conrec.hpp"
 #include "crash.hpp"
 #include "graph.hpp"
@@ -106,18 +108,16 @@ PDEFIELD_TYPE ***PDE::AllocatePDEvars(const int layers, const int sx,
   for (int i = 1; i < layers; i++) {
     mem[i] = mem[i - 1] + sizex;
   }
-  mem[0][0] =
-      (PDEFIELD_TYPE *)malloc(layers * sizex * sizey * sizeof(PDEFIELD_TYPE));
+  /* Cleared PDE plane. Pages are only mapped in once written to, so planes
+     that are never used take up no memory. */
+  mem[0][0] = (PDEFIELD_TYPE *)calloc((size_t)layers * sizex * sizey,
+                                      sizeof(PDEFIELD_TYPE));
   if (mem[0][0] == NULL) {
     MemoryWarning();
   }
   for (int i = 1; i < layers * sizex; i++) {
     mem[0][i] = mem[0][i - 1] + sizey;
   }
-  /* Clear PDE plane */
-  for (int i = 0; i < layers * sizex * sizey; i++) {
-    mem[0][0][i] = 0.;
-  }
   return mem;
 }
 
@@ -286,8 +286,9 @@ void PDE::SecreteAndDiffuseCL(CellularPotts *cpm, int repeat) {
   int errorcode = 0;
 
   // Write the cellSigma array to GPU for secretion
+  std::vector<int> spins;
   clm.queue.enqueueWriteBuffer(clm.cpm, CL_TRUE, 0, sizeof(int) * sizex * sizey,
-                               cpm->getSigma()[0]);
+                               cpm->SigmaInts(spins));
 
   // Writing pdefield sigma is only necessary if modified outside of kernel
   if (first_round) {
@@ -556,3 +557,43 @@ void PDE::InitLinearYGradient(int spec, double conc_top, double conc_bottom) {
     cerr << y << " " << val << endl;
   }
 }
+
+void PDE::WriteCheckpoint(CheckpointWriter &checkpoint) const {
+  size_t n = (size_t)layers * sizex * sizey;
+
+  checkpoint.begin_section("PDE ");
+  checkpoint.write<int32_t>(layers);
+  checkpoint.write<int32_t>(sizex);
+  checkpoint.write<int32_t>(sizey);
+  checkpoint.write<int32_t>(sizeof(PDEFIELD_TYPE));
+  checkpoint.write(thetime);
+  checkpoint.write_bytes(PDEvars[0][0], n * sizeof(PDEFIELD_TYPE));
+  checkpoint.write_bytes(DiffCoeffs[0][0], n * sizeof(PDEFIELD_TYPE));
+  checkpoint.end_section();
+}
+
+void PDE::ReadCheckpoint(CheckpointReader &checkpoint) {
+  size_t n = (size_t)layers * sizex * sizey;
+
+  checkpoint.begin_section("PDE ");
+  int32_t l = checkpoint.read<int32_t>();
+  int32_t sx = checkpoint.read<int32_t>();
+  int32_t sy = checkpoint.read<int32_t>();
+  int32_t field_size = checkpoint.read<int32_t>();
+  if (l != layers || sx != sizex || sy != sizey)
+    throw std::runtime_error("Checkpoint PDE planes do not match the "
+                             "number of chemicals or the field size");
+  if (field_size != sizeof(PDEFIELD_TYPE))
+    throw std::runtime_error("Checkpoint PDE precision does not match "
+                             "PDEFIELD_TYPE");
+
+  thetime = checkpoint.read<double>();
+  memcpy(PDEvars[0][0], checkpoint.read_bytes(n * sizeof(PDEFIELD_TYPE)),
+         n * sizeof(PDEFIELD_TYPE));
+  memcpy(DiffCoeffs[0][0], checkpoint.read_bytes(n * sizeof(PDEFIELD_TYPE)),
+         n * sizeof(PDEFIELD_TYPE));
+  checkpoint.end_section();
+
+  // the GPU copy is stale now
+  first_round = true;
+}
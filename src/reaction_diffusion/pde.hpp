@@ -38,6 +38,8 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "pdetype.h"
 
 class CellularPotts;
+class CheckpointReader;
+class CheckpointWriter;
 class Dish;
 class PDE {
 
@@ -289,6 +291,19 @@ public:
 
   inline PDEFIELD_TYPE ***getPDEvars() { return PDEvars; }
 
+  /*! \brief Save the PDE planes, diffusion coefficients and time to a
+    checkpoint.
+  */
+  void WriteCheckpoint(CheckpointWriter &checkpoint) const;
+
+  /*! \brief Restore the PDE planes, diffusion coefficients and time from a
+    checkpoint.
+
+    Throws std::runtime_error if the number or size of the planes does not
+    match this PDE object.
+  */
+  void ReadCheckpoint(CheckpointReader &checkpoint);
+
   // CUDA functions
 
   /*! \brief allocate memory required for the CUDA reaction-diffusion solver
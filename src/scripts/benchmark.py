@@ -0,0 +1,230 @@
+"""Script that runs the benchmark scenarios and compares them to a baseline
+
+The scenarios are parameter files in data/benchmarks, which are run by the
+benchmark model (make bin/benchmark) at several lattice sizes. The results
+are written as JSON, and compared to a stored baseline. The script exits
+with status 1 if any metric is worse than the baseline by more than its
+threshold.
+"""
+from argparse import ArgumentParser, Namespace
+import json
+import math
+from pathlib import Path
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from typing import Any, Dict, List, Tuple
+
+
+Result = Dict[str, Any]
+
+
+SCENARIOS = ['sorting', 'vessel', 'act', 'adhesions']
+
+# Metrics compared to the baseline, whether higher is better, and the default
+# allowed relative change in the bad direction
+METRICS: Dict[str, Tuple[bool, float]] = {
+        'mcs_per_s': (True, 0.1),
+        'copy_attempts_per_s': (True, 0.1),
+        'pde_site_updates_per_s': (True, 0.1),
+        'peak_rss_bytes': (False, 0.1),
+        'startup_s': (False, 0.5)}
+
+
+def read_par(path: Path) -> Dict[str, str]:
+    """Reads the values in a parameter file."""
+    values = dict()
+    for line in path.read_text().splitlines():
+        line = line.split('#', 1)[0]
+        if '=' in line:
+            key, value = line.split('=', 1)
+            values[key.strip()] = value.strip()
+    return values
+
+
+def scaled_values(par: Dict[str, str], size: int) -> Dict[str, str]:
+    """Returns parameter values for running a scenario at the given size.
+
+    The lattice is made size by size, and the number of cells and
+    adhesions is scaled with its area, so that the density stays the same.
+    If the cells are made by dividing, then each doubling of the lattice
+    adds two rounds of division, and the initial cell grows with it.
+    """
+    scale = size / int(par['sizex'])
+    values = {'sizex': str(size), 'sizey': str(size)}
+
+    divisions = int(par.get('divisions', '0'))
+    if divisions > 0:
+        extra = 2.0 * math.log2(scale)
+        if extra != round(extra):
+            raise RuntimeError(
+                    f'Size {size} is not the base size {par["sizex"]} times'
+                    ' a power of two')
+        values['divisions'] = str(divisions + round(extra))
+        values['size_init_cells'] = str(
+                round(int(par['size_init_cells']) * scale))
+    else:
+        values['n_init_cells'] = str(
+                round(int(par['n_init_cells']) * scale**2))
+
+    if 'num_initial_adhesions' in par:
+        values['num_initial_adhesions'] = str(
+                round(int(par['num_initial_adhesions']) * scale**2))
+    return values
+
+
+def run(binary: Path, par_file: Path, size: int) -> Result:
+    """Runs a scenario once and returns its results."""
+    values = scaled_values(read_par(par_file), size)
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        output = Path(tmp_dir) / 'benchmark.json'
+        values['benchmark_output'] = str(output)
+
+        # Later values override earlier ones, so we can simply append
+        scaled_par = Path(tmp_dir) / par_file.name
+        scaled_par.write_text(
+                par_file.read_text() + '\n# benchmark.py\n' +
+                ''.join(f'{k} = {v}\n' for k, v in values.items()))
+
+        start = time.perf_counter()
+        subprocess.run(
+                [str(binary.resolve()), str(scaled_par)], cwd=binary.parent,
+                check=True, stdout=subprocess.DEVNULL)
+        wall_time = time.perf_counter() - start
+
+        result: Result = json.loads(output.read_text())
+    result['wall_s'] = wall_time
+    return result
+
+
+def summarise(runs: List[Result]) -> Result:
+    """Combines repeated runs into one result, using the median time."""
+    result = dict(runs[0])
+    for key in ['startup_s', 'cpm_s', 'pde_s', 'wall_s'] + list(METRICS):
+        result[key] = statistics.median(run[key] for run in runs)
+    result['repeats'] = len(runs)
+    hashes = {run['lattice_hash'] for run in runs}
+    if len(hashes) > 1:
+        print(f'Warning: {result["scenario"]} at {result["sizex"]} is not'
+              ' reproducible, the lattice differs between runs')
+    return result
+
+
+def key(result: Result) -> str:
+    return f'{result["scenario"]}/{result["sizex"]}'
+
+
+def compare(
+        results: List[Result], baseline: List[Result],
+        thresholds: Dict[str, float]) -> bool:
+    """Compares results to the baseline and prints a table.
+
+    Returns True if no metric got worse by more than its threshold.
+    """
+    base_by_key = {key(result): result for result in baseline}
+    ok = True
+    print(f'{"scenario":<20} {"metric":<24} {"baseline":>12} {"now":>12}'
+          f' {"change":>8}')
+    for result in results:
+        base = base_by_key.get(key(result))
+        if base is None:
+            print(f'{key(result):<20} not in baseline')
+            continue
+
+        if base['lattice_hash'] != result['lattice_hash']:
+            print(f'{key(result):<20} lattice differs from the baseline, the'
+                  ' simulation itself has changed')
+
+        for metric, (higher_is_better, _) in METRICS.items():
+            if not base[metric] or not result[metric]:
+                continue
+            change = result[metric] / base[metric] - 1.0
+            worse = -change if higher_is_better else change
+            regressed = worse > thresholds[metric]
+            ok = ok and not regressed
+            print(f'{key(result):<20} {metric:<24} {base[metric]:>12.4g}'
+                  f' {result[metric]:>12.4g} {change:>+8.1%}'
+                  f'{"  REGRESSION" if regressed else ""}')
+    return ok
+
+
+def parse_threshold(arg: str) -> Tuple[str, float]:
+    metric, _, value = arg.partition('=')
+    if metric not in METRICS:
+        raise ValueError(f'Unknown metric {metric}')
+    return metric, float(value)
+
+
+def parse_args() -> Namespace:
+    """Gets the scenarios, sizes and files from the command line arguments"""
+    parser = ArgumentParser(
+            description='Run the benchmarks and compare to a baseline')
+    parser.add_argument(
+            '--binary', type=Path, default=Path('bin/benchmark'),
+            help='Benchmark model to run')
+    parser.add_argument(
+            '--scenario-dir', type=Path, default=Path('data/benchmarks'),
+            help='Directory with the parameter files of the scenarios')
+    parser.add_argument(
+            '--scenarios', type=str, default=','.join(SCENARIOS),
+            help='Comma-separated scenarios to run')
+    parser.add_argument(
+            '--sizes', type=str, default='200,400,800',
+            help='Comma-separated lattice sizes to run each scenario at')
+    parser.add_argument(
+            '--repeat', type=int, default=3,
+            help='Number of times to run each, the median is reported')
+    parser.add_argument(
+            '--output', type=Path, default=Path('benchmark_results.json'),
+            help='File to write the results to')
+    parser.add_argument(
+            '--baseline', type=Path,
+            default=Path('data/benchmarks/baseline.json'),
+            help='Baseline results to compare to')
+    parser.add_argument(
+            '--save-baseline', action='store_true',
+            help='Write the results to the baseline instead of comparing')
+    parser.add_argument(
+            '--threshold', type=parse_threshold, action='append',
+            default=[], metavar='METRIC=FRACTION',
+            help='Allowed relative regression of a metric, e.g.'
+            ' mcs_per_s=0.05. Metrics: ' + ', '.join(METRICS))
+    return parser.parse_args()
+
+
+def main() -> None:
+    args = parse_args()
+    thresholds = {metric: default for metric, (_, default) in METRICS.items()}
+    thresholds.update(args.threshold)
+
+    results = list()
+    for scenario in args.scenarios.split(','):
+        par_file = args.scenario_dir / f'{scenario}.par'
+        for size in args.sizes.split(','):
+            print(f'Running {scenario} at {size}x{size}', flush=True)
+            runs = [
+                    run(args.binary, par_file, int(size))
+                    for _ in range(args.repeat)]
+            results.append(summarise(runs))
+
+    args.output.write_text(json.dumps(results, indent=2) + '\n')
+    print(f'Results written to {args.output}')
+
+    if args.save_baseline:
+        args.baseline.write_text(json.dumps(results, indent=2) + '\n')
+        print(f'Baseline written to {args.baseline}')
+        return
+
+    if not args.baseline.exists():
+        print(f'No baseline at {args.baseline}, use --save-baseline to make'
+              ' one')
+        return
+
+    if not compare(results, json.loads(args.baseline.read_text()), thresholds):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
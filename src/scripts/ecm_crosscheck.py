@@ -0,0 +1,284 @@
+"""Script that cross-checks the native ECM simulation against hoomd
+
+This generates a small network, and simulates it with both the hoomd-based
+Simulation in src/ecm/simulation.py and the native ECMSimulation in
+src/adhesions/ecm_simulation.cpp, which is run by bin/ecm_native. Both start
+from the same state and get the same interactions, in a few phases:
+
+- equilibrate: run without interactions
+- adhere: change all free particles in a disk to adhesions
+- pull: move the new adhesions
+- relax: run without interactions
+
+The temperature is zero, so that both simulations are deterministic, and
+the positions of the particles are compared after each phase, taking the
+periodic box into account. The script exits with status 1 if any particle
+differs by more than the tolerance, or has a different type.
+
+Use make ecm_crosscheck to build what is needed and run it.
+"""
+from argparse import ArgumentParser, Namespace
+import json
+import math
+from pathlib import Path
+import subprocess
+import sys
+import tempfile
+from typing import Any, Dict, List, Tuple
+
+import numpy as np
+import numpy.typing as npt
+
+from tissue_simulation_toolkit.ecm.cell_ecm_interactions import (
+        AddAdhesionParticles, CellECMInteractions, ChangeTypeInArea,
+        MoveAdhesionParticles, RemoveAdhesionParticles)
+from tissue_simulation_toolkit.ecm.ecm import (
+        AngleCstTypes, AngleCsts, BondTypes, Bonds, MDState, ParticleType,
+        Particles)
+from tissue_simulation_toolkit.ecm.muscle3 import encode_net
+from tissue_simulation_toolkit.ecm.network.network import generate_network
+from tissue_simulation_toolkit.ecm.parameters import (
+        EvolutionParameters, GenerationParameters)
+from tissue_simulation_toolkit.ecm.simulation import Simulation
+
+
+def generation_parameters(size: int) -> GenerationParameters:
+    """Returns parameters for a network on a size x size domain.
+
+    These are those of src/models/adhesions.ymmsl.in, with the number of
+    strands and crosslinks scaled to the area.
+    """
+    count = 2000 * size * size // (200 * 200)
+    return GenerationParameters(
+            box_size_x=size, box_size_y=size, Lx=size / 2, Ly=size / 2,
+            fixed_boundary=False, bottom_fixed=True, top_fixed=False,
+            contour_length=50.0, strands=count, beads=9,
+            spring_r0=6.25, spring_k=200.0, crosslink_k=200.0,
+            helix_angle=0.0, bend_t0=math.pi, bend_k=200.0,
+            num_init_crosslinks=count, crosslink_max_r=3.0,
+            crosslink_quant_step=0.3, crosslink_bin_size=1.0 / 3.0)
+
+
+def evolution_parameters(
+        gen_par: GenerationParameters, its: int, seed: int
+        ) -> EvolutionParameters:
+    """Returns parameters for a noiseless evolution of the network."""
+    return EvolutionParameters(
+            box_size_x=gen_par.box_size_x, box_size_y=gen_par.box_size_y,
+            contour_length=gen_par.contour_length,
+            md_use_gpu=False, md_seed=seed, md_dt=0.01, md_its=its,
+            overdamped=True, md_kT=0.0, viscosity=10.0)
+
+
+def make_state(gen_par: GenerationParameters) -> Dict[str, Any]:
+    """Generates a network, as make_ecm does.
+
+    Returns the state as nested dicts of numpy arrays, see encode_net().
+    """
+    return encode_net(generate_network(gen_par))
+
+
+def md_state(state: Dict[str, Any]) -> MDState:
+    """Makes an MDState from the result of make_state()."""
+    return MDState(
+            Particles(state['particles']['positions'],
+                      state['particles']['types']),
+            BondTypes(state['bond_types']['r0'], state['bond_types']['k']),
+            Bonds(state['bonds']['groups'], state['bonds']['types']),
+            AngleCstTypes(
+                state['angle_cst_types']['t0'], state['angle_cst_types']['k']),
+            AngleCsts(state['angle_csts']['groups'],
+                      state['angle_csts']['types']))
+
+
+def to_json(obj: Any) -> Any:
+    """Converts nested dicts of numpy arrays to something json can write."""
+    if isinstance(obj, dict):
+        return {key: to_json(value) for key, value in obj.items()}
+    if isinstance(obj, np.ndarray):
+        return obj.tolist()
+    return obj
+
+
+def interactions(phase: Dict[str, Any]) -> CellECMInteractions:
+    """Makes the interactions of a phase for the hoomd simulation."""
+    ctia = ChangeTypeInArea()
+    if 'change_type_in_area' in phase:
+        data = phase['change_type_in_area']
+        ctia = ChangeTypeInArea(
+                np.array(data['change_area'], dtype=np.int32).reshape(-1, 2),
+                data['num_particles'], ParticleType(data['from_type']),
+                ParticleType(data['to_type']))
+
+    moves = MoveAdhesionParticles()
+    if 'move_adhesion_particles' in phase:
+        data = phase['move_adhesion_particles']
+        moves = MoveAdhesionParticles(
+                np.array(data['par_id'], dtype=np.int32),
+                np.array(data['new_pos'], dtype=np.float64).reshape(-1, 2))
+
+    return CellECMInteractions(
+            ctia, AddAdhesionParticles(), moves, RemoveAdhesionParticles())
+
+
+def adhere(state: MDState, size: int, radius: int) -> Dict[str, Any]:
+    """Requests all free particles in a disk in the middle to adhere.
+
+    The number of particles is that in the given state, so that neither
+    simulation has to pick them at random.
+    """
+    centre = size // 2
+    area = [(x, y)
+            for x in range(centre - radius, centre + radius + 1)
+            for y in range(centre - radius, centre + radius + 1)
+            if (x - centre)**2 + (y - centre)**2 <= radius**2]
+    pixels = set(area)
+    free = state.particles.type_ids == ParticleType.free.value
+    count = sum(
+            1 for pos in state.particles.positions[free]
+            if tuple(map(int, np.floor(pos))) in pixels)
+    return {'change_type_in_area': {
+        'change_area': area, 'num_particles': count,
+        'from_type': ParticleType.free.value,
+        'to_type': ParticleType.adhesion.value}}
+
+
+def pull(state: MDState, shift: Tuple[float, float]) -> Dict[str, Any]:
+    """Requests all adhesions to be moved over the given distance."""
+    adhesions = np.flatnonzero(
+            state.particles.type_ids == ParticleType.adhesion.value)
+    new_pos = state.particles.positions[adhesions] + np.array(shift)
+    return {'move_adhesion_particles': {
+        'par_id': adhesions.tolist(), 'new_pos': new_pos.tolist()}}
+
+
+def run_hoomd(
+        par: EvolutionParameters, state: MDState, args: Namespace
+        ) -> Tuple[List[Dict[str, Any]], List[MDState]]:
+    """Runs the phases with hoomd.
+
+    Returns the interactions of each phase, and the state after it.
+    """
+    sim = Simulation(par, state)
+    phases: List[Dict[str, Any]] = list()
+    results: List[MDState] = list()
+
+    def phase(requests: Dict[str, Any]) -> None:
+        sim.apply_interactions(interactions(requests))
+        sim.run()
+        phases.append(requests)
+        result = sim.get_state()
+        assert result is not None
+        results.append(result)
+
+    phase(dict())
+    phase(adhere(results[-1], args.size, args.radius))
+    phase(pull(results[-1], (args.pull, 0.0)))
+    phase(dict())
+    return phases, results
+
+
+def run_native(
+        par: EvolutionParameters, state: Dict[str, Any],
+        phases: List[Dict[str, Any]], args: Namespace
+        ) -> List[Dict[str, Any]]:
+    """Runs the phases with bin/ecm_native.
+
+    Returns the positions and types after each phase.
+    """
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        in_file = Path(tmp_dir) / 'input.json'
+        out_file = Path(tmp_dir) / 'output.json'
+        native_par = {
+                'md_dt': par.md_dt, 'md_kT': par.md_kT,
+                'viscosity': par.viscosity, 'md_seed': par.md_seed,
+                'box_size_x': par.box_size_x, 'box_size_y': par.box_size_y,
+                'contour_length': par.contour_length,
+                'threads': args.threads}
+        native_state = dict(state, **state['particles'])
+        del native_state['particles']
+        native_input = {
+                'par': native_par, 'state': to_json(native_state),
+                'phases': [
+                    {'interactions': to_json(phase), 'its': par.md_its}
+                    for phase in phases]}
+        in_file.write_text(json.dumps(native_input))
+        subprocess.run(
+                [str(args.native), str(in_file), str(out_file)], check=True)
+        result: List[Dict[str, Any]] = json.loads(out_file.read_text())
+    return result
+
+
+def max_distance(
+        par: EvolutionParameters, a: npt.NDArray[np.float64],
+        b: npt.NDArray[np.float64]) -> float:
+    """Returns the largest distance between corresponding particles.
+
+    This takes the periodic box into account, see ECMSimulation.
+    """
+    margin = 5.0 * par.contour_length
+    box = np.array([par.box_size_x + margin, par.box_size_y + margin])
+    d = a - b
+    d -= box * np.round(d / box)
+    return float(np.max(np.linalg.norm(d, axis=1), initial=0.0))
+
+
+def parse_args() -> Namespace:
+    parser = ArgumentParser(
+            description='Cross-checks the native ECM simulation against hoomd')
+    parser.add_argument(
+            '--native', type=Path, default=Path('bin/ecm_native'),
+            help='The native ECM program, built by make bin/ecm_native')
+    parser.add_argument(
+            '--size', type=int, default=100,
+            help='Size of the domain, the network is scaled to it')
+    parser.add_argument(
+            '--its', type=int, default=200, help='Time steps per phase')
+    parser.add_argument(
+            '--radius', type=int, default=8,
+            help='Radius in pixels of the disk of new adhesions')
+    parser.add_argument(
+            '--pull', type=float, default=3.0,
+            help='Distance to move the adhesions over')
+    parser.add_argument(
+            '--threads', type=int, default=0,
+            help='Threads for the native ECM, 0 means one per core')
+    parser.add_argument(
+            '--tolerance', type=float, default=1e-6,
+            help='Largest allowed difference in position')
+    parser.add_argument(
+            '--seed', type=int, default=1, help='Seed for the network')
+    return parser.parse_args()
+
+
+def main() -> None:
+    args = parse_args()
+    np.random.seed(args.seed)
+
+    gen_par = generation_parameters(args.size)
+    par = evolution_parameters(gen_par, args.its, args.seed)
+    state = make_state(gen_par)
+    print(f'Network of {len(state["particles"]["types"])} particles,'
+          f' {len(state["bonds"]["types"])} bonds and'
+          f' {len(state["angle_csts"]["types"])} angle constraints')
+
+    phases, hoomd_results = run_hoomd(par, md_state(state), args)
+    native_results = run_native(par, state, phases, args)
+
+    names = ['equilibrate', 'adhere', 'pull', 'relax']
+    ok = True
+    for name, expected, native in zip(names, hoomd_results, native_results):
+        positions = np.array(native['positions'], dtype=np.float64)
+        types = np.array(native['types'], dtype=np.int32)
+        distance = max_distance(par, positions, expected.particles.positions)
+        same_types = np.array_equal(types, expected.particles.type_ids)
+        ok = ok and distance <= args.tolerance and same_types
+        print(f'{name:12} largest difference {distance:.3g}'
+              f'{"" if same_types else ", types differ"}')
+
+    print('The simulations agree' if ok else 'The simulations differ')
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,131 @@
+/* Runs the native ECM simulation for ecm_crosscheck.py
+ *
+ * Usage: ecm_native <input.json> <output.json>
+ *
+ * The input holds the evolution parameters, the initial MDState and a list
+ * of phases, each with interactions to apply and a number of steps to run
+ * after applying them. The output holds the positions and types of the
+ * particles after each phase. See ecm_crosscheck.py for the format.
+ */
+#include "ecm_simulation.hpp"
+
+#include "../lib/json/json.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+
+std::vector<ParPos> read_positions(json const &rows) {
+  std::vector<ParPos> result;
+  for (auto const &row : rows)
+    result.emplace_back(row.at(0).get<double>(), row.at(1).get<double>());
+  return result;
+}
+
+MDState read_state(json const &state) {
+  MDState result;
+  result.positions = read_positions(state.at("positions"));
+  for (int type : state.at("types"))
+    result.types.push_back(static_cast<ParticleType>(type));
+
+  auto const &bond_types = state.at("bond_types");
+  for (std::size_t i = 0u; i < bond_types.at("r0").size(); ++i)
+    result.bond_types.emplace_back(bond_types["r0"][i].get<double>(),
+                                   bond_types.at("k")[i].get<double>());
+  auto const &bonds = state.at("bonds");
+  for (std::size_t i = 0u; i < bonds.at("groups").size(); ++i) {
+    auto const &group = bonds["groups"][i];
+    result.bonds.emplace_back(group.at(0).get<int>(), group.at(1).get<int>(),
+                              bonds.at("types")[i].get<int>());
+  }
+
+  auto const &angle_cst_types = state.at("angle_cst_types");
+  for (std::size_t i = 0u; i < angle_cst_types.at("t0").size(); ++i)
+    result.angle_cst_types.emplace_back(
+        angle_cst_types["t0"][i].get<double>(),
+        angle_cst_types.at("k")[i].get<double>());
+  auto const &angle_csts = state.at("angle_csts");
+  for (std::size_t i = 0u; i < angle_csts.at("groups").size(); ++i) {
+    auto const &group = angle_csts["groups"][i];
+    result.angle_csts.emplace_back(
+        group.at(0).get<int>(), group.at(1).get<int>(),
+        group.at(2).get<int>(), angle_csts.at("types")[i].get<int>());
+  }
+  return result;
+}
+
+ECMEvolutionParameters read_parameters(json const &par) {
+  ECMEvolutionParameters result;
+  result.dt = par.at("md_dt");
+  result.kT = par.at("md_kT");
+  result.gamma = par.at("viscosity");
+  result.seed = par.at("md_seed");
+  result.box_size_x = par.at("box_size_x");
+  result.box_size_y = par.at("box_size_y");
+  result.contour_length = par.at("contour_length");
+  result.threads = par.value("threads", 0);
+  return result;
+}
+
+CellECMInteractions read_interactions(json const &interactions) {
+  CellECMInteractions result;
+  if (interactions.contains("change_type_in_area")) {
+    auto const &ctia = interactions["change_type_in_area"];
+    for (auto const &pixel : ctia.at("change_area"))
+      result.change_type_in_area.change_area.emplace_back(
+          pixel.at(0).get<int>(), pixel.at(1).get<int>());
+    result.change_type_in_area.num_particles = ctia.at("num_particles");
+    result.change_type_in_area.from_type =
+        static_cast<ParticleType>(ctia.at("from_type").get<int>());
+    result.change_type_in_area.to_type =
+        static_cast<ParticleType>(ctia.at("to_type").get<int>());
+  }
+  if (interactions.contains("move_adhesion_particles")) {
+    auto const &map = interactions["move_adhesion_particles"];
+    for (int par_id : map.at("par_id"))
+      result.move_adhesion_particles.par_id.push_back(par_id);
+    result.move_adhesion_particles.new_pos = read_positions(map.at("new_pos"));
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <input.json> <output.json>"
+              << std::endl;
+    return 1;
+  }
+
+  try {
+    json input = json::parse(std::ifstream(argv[1]));
+    ECMSimulation sim(read_state(input.at("state")),
+                      read_parameters(input.at("par")));
+
+    json output = json::array();
+    for (auto const &phase : input.at("phases")) {
+      sim.apply_interactions(read_interactions(phase.at("interactions")));
+      sim.run(phase.at("its").get<int>());
+
+      json positions = json::array();
+      for (ParPos const &pos : sim.state().positions)
+        positions.push_back({pos.x, pos.y});
+      json types = json::array();
+      for (ParticleType type : sim.state().types)
+        types.push_back(static_cast<int>(type));
+      output.push_back({{"positions", positions}, {"types", types}});
+    }
+
+    std::ofstream(argv[2]) << output.dump();
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,53 @@
+"""Script that plots the frames of a trajectory
+
+"""
+from argparse import ArgumentParser, Namespace
+from pathlib import Path
+
+import numpy as np
+
+from tissue_simulation_toolkit.cpm_ecm.state_plotter import StatePlotter
+from tissue_simulation_toolkit.cpm_ecm.trajectory import Trajectory
+
+
+def parse_args() -> Namespace:
+    """Gets a trajectory file from the command line arguments"""
+    parser = ArgumentParser(description='Plot the frames of a trajectory')
+    parser.add_argument('trajectory', type=str, help='Trajectory file')
+    parser.add_argument(
+            '--out-dir', type=str, default='.',
+            help='Directory to write the images to')
+    parser.add_argument(
+            '--image-height', type=int, default=600,
+            help='Height of the image in pixels')
+    parser.add_argument(
+            '--stride', type=int, default=1, help='Plot every n-th frame')
+    args = parser.parse_args()
+    return args
+
+
+def main() -> None:
+    args = parse_args()
+    out_dir = Path(args.out_dir)
+
+    with Trajectory(args.trajectory) as trajectory:
+        plotter = StatePlotter(
+                trajectory.sizex / 2, trajectory.sizey / 2, args.image_height)
+
+        # trajectories have no ECM, and may not have a PDE
+        no_positions = np.zeros((0, 2))
+        no_types = np.zeros(0, np.int32)
+        no_bonds = np.zeros((0, 2), np.int32)
+        no_pde = np.zeros((1, trajectory.sizex, trajectory.sizey))
+
+        for i in range(0, len(trajectory), args.stride):
+            frame = trajectory.frame(i)
+            print(f'mcs: {frame.time}')
+            plotter.draw(
+                    frame.time, no_positions, no_types, no_bonds,
+                    no_pde if frame.pde is None else frame.pde, frame.sigma,
+                    draw=False, save=True, out_dir=out_dir)
+
+
+if __name__ == '__main__':
+    main()
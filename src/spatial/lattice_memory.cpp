@@ -0,0 +1,56 @@
+#include "lattice_memory.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+void *allocate_lattice(std::size_t bytes, bool sparse) {
+  void *block = std::calloc(bytes, 1);
+#if defined(MADV_NOHUGEPAGE)
+  if (block && sparse) {
+    std::uintptr_t page = sysconf(_SC_PAGESIZE);
+    std::uintptr_t begin = ((std::uintptr_t)block + page - 1) & ~(page - 1);
+    std::uintptr_t end = ((std::uintptr_t)block + bytes) & ~(page - 1);
+    if (begin < end)
+      madvise((void *)begin, end - begin, MADV_NOHUGEPAGE);
+  }
+#endif
+  return block;
+}
+
+void release_zero_pages(void *block, std::size_t block_bytes, std::size_t begin,
+                        std::size_t end) {
+#if defined(MADV_DONTNEED)
+  static const std::uintptr_t page = sysconf(_SC_PAGESIZE);
+  std::uintptr_t block_begin = (std::uintptr_t)block;
+  std::uintptr_t block_end = block_begin + block_bytes;
+  std::uintptr_t p = (block_begin + begin) & ~(page - 1);
+  for (; p < block_begin + end; p += page) {
+    if (p < block_begin || p + page > block_end)
+      continue;
+    const std::uint64_t *word = (const std::uint64_t *)p;
+    const std::uint64_t *word_end = (const std::uint64_t *)(p + page);
+    while (word != word_end && !*word)
+      ++word;
+    if (word == word_end)
+      madvise((void *)p, page, MADV_DONTNEED);
+  }
+#endif
+}
+
+void copy_into_lattice(void *block, void const *source, std::size_t bytes) {
+  static const unsigned char zeros[4096] = {};
+  unsigned char *dst = (unsigned char *)block;
+  const unsigned char *src = (const unsigned char *)source;
+  for (std::size_t offset = 0; offset < bytes; offset += sizeof(zeros)) {
+    std::size_t n = std::min(sizeof(zeros), bytes - offset);
+    if (std::memcmp(src + offset, zeros, n) != 0)
+      std::memcpy(dst + offset, src + offset, n);
+  }
+}
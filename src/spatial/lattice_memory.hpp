@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+
+/** Allocate zero-filled memory for a lattice-sized array
+ *
+ * Large blocks come straight from the operating system, which only maps pages
+ * in once they are written to, so parts of the lattice that are never used take
+ * up no memory. The sparse lattice relies on this, and opts out of transparent
+ * huge pages, which would map 2MB at a time.
+ *
+ * Free the result with free().
+ *
+ * @param bytes Size of the block, in bytes.
+ * @param sparse Whether to optimise for sparse use.
+ * @return The new block, or nullptr if out of memory.
+ */
+void *allocate_lattice(std::size_t bytes, bool sparse);
+
+/** Return all-zero pages of a lattice-sized array to the operating system
+ *
+ * Checks the pages overlapping [begin, end) of the block, and releases those
+ * that contain only zeros. Pages that stick out of the block are left alone.
+ * Reading a released page gives zeros again, so this does not change the
+ * contents of the block. Does nothing on platforms without madvise().
+ *
+ * @param block The block, as returned by allocate_lattice().
+ * @param block_bytes Size of the block, in bytes.
+ * @param begin Offset of the first byte to consider.
+ * @param end Offset one past the last byte to consider.
+ */
+void release_zero_pages(void *block, std::size_t block_bytes, std::size_t begin,
+                        std::size_t end);
+
+/** Copy data into a zero-filled lattice-sized array
+ *
+ * Copies block by block, skipping blocks of the source that contain only
+ * zeros. Those are left untouched in the destination, so that pages that are
+ * empty in the source stay unmapped, and restoring a mostly empty lattice is
+ * cheap in both time and memory.
+ *
+ * @param block The destination, as returned by allocate_lattice() and not
+ *              written to since, or otherwise containing only zeros.
+ * @param source The data to copy.
+ * @param bytes Number of bytes to copy.
+ */
+void copy_into_lattice(void *block, void const *source, std::size_t bytes);
@@ -0,0 +1,53 @@
+#include "spin_lattice.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include "lattice_memory.hpp"
+
+template <typename SpinT>
+SpinLattice<SpinT>::SpinLattice(int sizex, int sizey, bool sparse)
+    : sizex_(sizex), sizey_(sizey), sparse_(sparse) {
+  data_ =
+      static_cast<SpinT *>(allocate_lattice(size() * sizeof(SpinT), sparse));
+  if (!data_ && size())
+    throw std::bad_alloc();
+}
+
+template <typename SpinT>
+SpinLattice<SpinT>::SpinLattice(SpinLattice const &other)
+    : SpinLattice(other.sizex_, other.sizey_, other.sparse_) {
+  // Copy only the non-zero parts, so as not to touch pages of a sparse lattice
+  // that are not in use.
+  for (std::size_t i = 0; i < size(); ++i)
+    if (other.data_[i])
+      data_[i] = other.data_[i];
+}
+
+template <typename SpinT>
+SpinLattice<SpinT>::SpinLattice(SpinLattice &&other) noexcept
+    : data_(other.data_), sizex_(other.sizex_), sizey_(other.sizey_),
+      sparse_(other.sparse_) {
+  other.data_ = nullptr;
+  other.sizex_ = 0;
+  other.sizey_ = 0;
+}
+
+template <typename SpinT>
+SpinLattice<SpinT> &SpinLattice<SpinT>::operator=(SpinLattice other) noexcept {
+  std::swap(data_, other.data_);
+  std::swap(sizex_, other.sizex_);
+  std::swap(sizey_, other.sizey_);
+  std::swap(sparse_, other.sparse_);
+  return *this;
+}
+
+template <typename SpinT> SpinLattice<SpinT>::~SpinLattice() {
+  std::free(data_);
+}
+
+template class SpinLattice<std::int16_t>;
+template class SpinLattice<std::int32_t>;
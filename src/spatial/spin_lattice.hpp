@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/** Integer type used to store the spins (sigma) of the CPM
+ *
+ * This is chosen when building, with SPINS in Tissue_Simulation_Toolkit.pri.
+ * 16-bit spins halve the memory traffic of the Monte Carlo steps on large
+ * lattices, but limit the number of cells to 32767.
+ */
+#ifdef TST_SPIN16
+using Spin = std::int16_t;
+#else
+using Spin = std::int32_t;
+#endif
+
+/** A 2D lattice of spins of a given integer type
+ *
+ * The spins are stored column by column in a single block, so that
+ * lattice[x][y] works as for an int**, and lattice[0][i] walks through the
+ * whole lattice. Memory is allocated with allocate_lattice(), and is initially
+ * zero.
+ */
+template <typename SpinT> class SpinLattice {
+public:
+  /// Create an empty lattice of size 0x0.
+  SpinLattice() = default;
+
+  /** Create a lattice filled with zeros
+   *
+   * @param sizex Horizontal size of the lattice.
+   * @param sizey Vertical size of the lattice.
+   * @param sparse Whether to optimise for sparse use, see allocate_lattice().
+   */
+  SpinLattice(int sizex, int sizey, bool sparse);
+
+  SpinLattice(SpinLattice const &other);
+  SpinLattice(SpinLattice &&other) noexcept;
+  SpinLattice &operator=(SpinLattice other) noexcept;
+  ~SpinLattice();
+
+  /// Return a pointer to column x.
+  SpinT *operator[](int x) { return data_ + std::size_t(x) * sizey_; }
+  SpinT const *operator[](int x) const {
+    return data_ + std::size_t(x) * sizey_;
+  }
+
+  SpinT *data() { return data_; }
+  SpinT const *data() const { return data_; }
+
+  /// Return the number of sites.
+  std::size_t size() const { return std::size_t(sizex_) * sizey_; }
+
+  int sizex() const { return sizex_; }
+  int sizey() const { return sizey_; }
+  bool sparse() const { return sparse_; }
+
+private:
+  SpinT *data_ = nullptr;
+  int sizex_ = 0;
+  int sizey_ = 0;
+  bool sparse_ = false;
+};
+
+/** The CPM spin field
+ *
+ * This is a SpinLattice with a table of column pointers, so that code written
+ * for an int** lattice can use it unchanged: field[x][y] is a plain reference
+ * to the spin. The spin type is fixed, so there is no check on access.
+ * Storing a spin that does not fit must be prevented by the caller, with
+ * check().
+ *
+ * @tparam SpinT Type to store the spins as, use SpinField for the CPM.
+ */
+template <typename SpinT> class BasicSpinField {
+public:
+  /// Create an empty field of size 0x0.
+  BasicSpinField() = default;
+
+  BasicSpinField(BasicSpinField const &other) : lattice_(other.lattice_) {
+    update_columns_();
+  }
+
+  BasicSpinField &operator=(BasicSpinField const &other) {
+    if (this != &other) {
+      lattice_ = other.lattice_;
+      update_columns_();
+    }
+    return *this;
+  }
+
+  // Moving keeps the block, so the column pointers stay valid
+  BasicSpinField(BasicSpinField &&other) noexcept = default;
+  BasicSpinField &operator=(BasicSpinField &&other) noexcept = default;
+
+  /** Copy the spins of another field of the same size
+   *
+   * Unlike assignment, this keeps the existing storage, so that the result of
+   * earlier calls to int_view() stays valid. Sites that are equal in both
+   * fields are not written to, to keep unused pages of a sparse lattice
+   * unmapped.
+   *
+   * @param other Field to copy from, with the same size as this one.
+   */
+  template <typename OtherSpinT>
+  void assign(SpinLattice<OtherSpinT> const &other) {
+    if (other.sizex() != lattice_.sizex() ||
+        other.sizey() != lattice_.sizey())
+      throw std::invalid_argument("Cannot assign a lattice of another size");
+    assign(other.data());
+  }
+
+  /** Copy spins from an array of size() spins
+   *
+   * This keeps the existing storage like assign(SpinLattice const &). The
+   * spins are checked before anything is written, so the field is unchanged
+   * if one does not fit.
+   *
+   * @param spins The spins, column by column.
+   */
+  template <typename OtherSpinT> void assign(OtherSpinT const *spins) {
+    if constexpr (sizeof(OtherSpinT) > sizeof(SpinT))
+      for (std::size_t i = 0; i < size(); ++i)
+        check(spins[i]);
+
+    SpinT *data = lattice_.data();
+    for (std::size_t i = 0; i < size(); ++i)
+      if (data[i] != spins[i])
+        data[i] = static_cast<SpinT>(spins[i]);
+  }
+
+  /** (Re)allocate the field and fill it with zeros
+   *
+   * This invalidates the result of earlier calls to int_view(), as do
+   * assigning and moving another field into this one.
+   *
+   * @param sizex Horizontal size of the lattice.
+   * @param sizey Vertical size of the lattice.
+   * @param sparse Whether to optimise for sparse use, see allocate_lattice().
+   */
+  void allocate(int sizex, int sizey, bool sparse) {
+    lattice_ = SpinLattice<SpinT>(sizex, sizey, sparse);
+    update_columns_();
+  }
+
+  SpinT *operator[](int x) { return columns_[x]; }
+  SpinT const *operator[](int x) const { return columns_[x]; }
+
+  /// Return the spin at linear index i, i.e. at [i / sizey][i % sizey].
+  int get(std::size_t i) const { return lattice_.data()[i]; }
+
+  /// Return the largest spin that can be stored.
+  static constexpr int max_spin() { return std::numeric_limits<SpinT>::max(); }
+
+  /** Check that a spin can be stored
+   *
+   * @param spin The spin to check.
+   * @throws std::overflow_error if it does not fit.
+   */
+  static void check(int spin) {
+    if (spin < std::numeric_limits<SpinT>::min() || spin > max_spin())
+      throw std::overflow_error(
+          "Spin " + std::to_string(spin) + " does not fit in " +
+          std::to_string(8 * sizeof(SpinT)) +
+          " bits, build with SPINS=int32 to simulate more cells");
+  }
+
+  /// Return the number of bytes used per spin.
+  static constexpr std::size_t spin_bytes() { return sizeof(SpinT); }
+
+  /// Return the start of the storage block, for memory management.
+  void *data() { return lattice_.data(); }
+
+  /// Return the number of sites.
+  std::size_t size() const { return lattice_.size(); }
+
+  /** Return the field as an int**
+   *
+   * This points into the field itself, so changes made through it are
+   * visible in the field and vice versa. It stays valid until the field is
+   * reallocated, assigned to or destroyed.
+   *
+   * @throws std::logic_error if the spins are not stored as ints, use
+   *         visit() to access them instead.
+   */
+  int **int_view() {
+    if constexpr (std::is_same<SpinT, int>::value)
+      return columns_.data();
+    else
+      throw std::logic_error("The lattice is not stored as ints, use "
+                             "CellularPotts::VisitSigma() instead");
+  }
+
+  /** Call a function with the typed lattice
+   *
+   * The function is called with a (const) SpinLattice<SpinT> &. Code written
+   * as a generic lambda this way works for any spin type.
+   */
+  template <typename F> decltype(auto) visit(F &&f) { return f(lattice_); }
+
+  template <typename F> decltype(auto) visit(F &&f) const {
+    return f(lattice_);
+  }
+
+private:
+  void update_columns_() {
+    columns_.resize(lattice_.sizex());
+    for (int x = 0; x < lattice_.sizex(); ++x)
+      columns_[x] = lattice_[x];
+  }
+
+  SpinLattice<SpinT> lattice_;
+  std::vector<SpinT *> columns_;
+};
+
+/// The spin field of the CPM, see Spin.
+using SpinField = BasicSpinField<Spin>;
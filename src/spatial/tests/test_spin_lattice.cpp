@@ -0,0 +1,152 @@
+// Load the code to be tested
+#include "lattice_memory.cpp"
+#include "spin_lattice.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE("Spin lattice layout", "[spin_lattice]")
+{
+    SpinLattice<std::int16_t> lattice(4, 3, false);
+
+    REQUIRE(lattice.size() == 12);
+    for (std::size_t i = 0; i < lattice.size(); ++i)
+        REQUIRE(lattice.data()[i] == 0);
+
+    lattice[2][1] = 7;
+    REQUIRE(lattice.data()[2 * 3 + 1] == 7);
+
+    SpinLattice<std::int16_t> copy(lattice);
+    lattice[2][1] = 0;
+    REQUIRE(copy[2][1] == 7);
+}
+
+template <typename SpinT> void test_field_access()
+{
+    BasicSpinField<SpinT> field;
+    field.allocate(5, 6, false);
+    REQUIRE(field.spin_bytes() == sizeof(SpinT));
+
+    field[0][0] = -1;
+    field[3][4] = 12;
+    field[3][5] = field[3][4];
+    field[3][5] += 1;
+
+    BasicSpinField<SpinT> const &cfield = field;
+    REQUIRE(cfield[0][0] == -1);
+    REQUIRE(cfield[3][4] == 12);
+    REQUIRE(cfield[3][5] == 13);
+    REQUIRE(field.get(3 * 6 + 4) == 12);
+}
+
+TEST_CASE("Spin field access", "[spin_lattice]")
+{
+    test_field_access<std::int16_t>();
+    test_field_access<std::int32_t>();
+}
+
+TEST_CASE("Spin field range", "[spin_lattice]")
+{
+    REQUIRE(BasicSpinField<std::int16_t>::max_spin() == 32767);
+    REQUIRE_NOTHROW(BasicSpinField<std::int16_t>::check(32767));
+    REQUIRE_THROWS_AS(BasicSpinField<std::int16_t>::check(32768),
+                      std::overflow_error);
+    REQUIRE_NOTHROW(BasicSpinField<std::int32_t>::check(100000));
+
+    BasicSpinField<std::int16_t> field;
+    field.allocate(2, 2, false);
+    std::vector<std::int32_t> spins{1, 2, 40000, 4};
+    REQUIRE_THROWS_AS(field.assign(spins.data()), std::overflow_error);
+    REQUIRE(field[0][0] == 0);
+
+    spins[2] = 3;
+    field.assign(spins.data());
+    REQUIRE(field[1][0] == 3);
+}
+
+TEST_CASE("Int views of a 16-bit field are refused", "[spin_lattice]")
+{
+    BasicSpinField<std::int16_t> field;
+    field.allocate(3, 3, false);
+    REQUIRE_THROWS_AS(field.int_view(), std::logic_error);
+}
+
+TEST_CASE("Int views stay valid", "[spin_lattice]")
+{
+    BasicSpinField<int> field;
+    field.allocate(4, 5, true);
+    int **view = field.int_view();
+
+    SECTION("when writing through either side") {
+        field[1][2] = 7;
+        REQUIRE(view[1][2] == 7);
+        view[3][4] = 9;
+        REQUIRE(field[3][4] == 9);
+    }
+
+    SECTION("when asking for another view") {
+        int **again = field.int_view();
+        REQUIRE(again == view);
+        REQUIRE(again[2] == view[2]);
+    }
+
+    SECTION("when copying and restoring the field") {
+        field[1][2] = 7;
+        BasicSpinField<int> saved(field);
+        field[1][2] = 8;
+        field[0][0] = 3;
+
+        saved.visit([&](auto const &lattice) { field.assign(lattice); });
+        REQUIRE(field.int_view() == view);
+        REQUIRE(view[1][2] == 7);
+        REQUIRE(view[0][0] == 0);
+    }
+
+    SECTION("when assigning converted spins") {
+        std::vector<std::int16_t> spins(20, 0);
+        spins[1 * 5 + 2] = 11;
+        field.assign(spins.data());
+        REQUIRE(view[1][2] == 11);
+    }
+}
+
+TEST_CASE("Spin field copies", "[spin_lattice]")
+{
+    BasicSpinField<std::int16_t> field;
+    field.allocate(3, 3, false);
+    field[1][2] = 5;
+
+    BasicSpinField<std::int16_t> copy(field);
+    field[1][2] = 6;
+    REQUIRE(copy[1][2] == 5);
+
+    copy = field;
+    REQUIRE(copy[1][2] == 6);
+    copy[0][1] = 1;
+    REQUIRE(field[0][1] == 0);
+
+    int total = 0;
+    copy.visit([&](auto &lattice) {
+        for (std::size_t i = 0; i < lattice.size(); ++i)
+            total += lattice.data()[i];
+    });
+    REQUIRE(total == 7);
+}
+
+TEST_CASE("Copy into lattice", "[lattice_memory]")
+{
+    std::vector<int> source(5000, 0);
+    source[10] = 3;
+    source[4999] = -1;
+
+    std::size_t bytes = source.size() * sizeof(int);
+    int *block = (int *)allocate_lattice(bytes, true);
+    copy_into_lattice(block, source.data(), bytes);
+    REQUIRE(std::equal(source.begin(), source.end(), block));
+    free(block);
+}
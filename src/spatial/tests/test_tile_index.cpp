@@ -0,0 +1,124 @@
+// Load the code to be tested
+#include "tile_index.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <tuple>
+#include <vector>
+
+TEST_CASE("Empty tile index", "[tile_index]")
+{
+    TileIndex index(100, 50, 16);
+
+    REQUIRE(index.tiles_x() == 7);
+    REQUIRE(index.tiles_y() == 4);
+    REQUIRE(index.occupied_sites() == 0);
+    REQUIRE(index.occupied_tiles() == 0);
+    REQUIRE(index.active_tiles() == 0);
+
+    int visited = 0;
+    index.for_each_active_column_span(0, [&](int, int, int) { ++visited; });
+    index.for_each_active_row_span(0, [&](int, int, int) { ++visited; });
+    REQUIRE(visited == 0);
+}
+
+TEST_CASE("Occupancy counts", "[tile_index]")
+{
+    TileIndex index(100, 50, 16);
+
+    index.add_site(17, 20);
+    index.add_site(18, 21);
+    index.add_site(99, 49);
+
+    REQUIRE(index.count(1, 1) == 2);
+    REQUIRE(index.count(6, 3) == 1);
+    REQUIRE(index.occupied_sites() == 3);
+    REQUIRE(index.occupied_tiles() == 2);
+
+    index.remove_site(17, 20);
+    REQUIRE(index.count(1, 1) == 1);
+    REQUIRE(index.occupied_tiles() == 2);
+
+    index.clear();
+    REQUIRE(index.occupied_sites() == 0);
+    REQUIRE(index.count(6, 3) == 0);
+}
+
+TEST_CASE("Active tiles include a halo", "[tile_index]")
+{
+    TileIndex index(100, 100, 10);
+    index.add_site(55, 55);
+
+    REQUIRE(index.active_tiles() == 9);
+    for (int tx = 4; tx <= 6; ++tx)
+        for (int ty = 4; ty <= 6; ++ty)
+            REQUIRE(index.is_active(tx, ty));
+    REQUIRE(!index.is_active(3, 5));
+    REQUIRE(!index.is_active(5, 7));
+
+    std::vector<std::tuple<int, int, int, int>> ranges;
+    index.for_each_occupied_tile([&](int x0, int y0, int x1, int y1) {
+        ranges.emplace_back(x0, y0, x1, y1);
+    });
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges[0] == std::make_tuple(50, 50, 60, 60));
+}
+
+TEST_CASE("Spans follow the lattice scan order", "[tile_index]")
+{
+    TileIndex index(25, 25, 10);
+    index.add_site(24, 24);
+
+    std::vector<std::tuple<int, int, int>> spans;
+    index.for_each_active_column_span(0, [&](int x, int y0, int y1) {
+        spans.emplace_back(x, y0, y1);
+    });
+    REQUIRE(spans.size() == 15 * 2);
+    REQUIRE(spans.front() == std::make_tuple(10, 10, 20));
+    REQUIRE(spans[1] == std::make_tuple(10, 20, 25));
+    REQUIRE(spans.back() == std::make_tuple(24, 20, 25));
+
+    spans.clear();
+    index.for_each_active_row_span(0, [&](int y, int x0, int x1) {
+        spans.emplace_back(y, x0, x1);
+    });
+    REQUIRE(spans.size() == 15 * 2);
+    REQUIRE(spans.front() == std::make_tuple(10, 10, 20));
+    REQUIRE(spans.back() == std::make_tuple(24, 20, 25));
+}
+
+TEST_CASE("Rim tiles", "[tile_index]")
+{
+    TileIndex index(40, 40, 10);
+
+    int tiles = 0;
+    for (int tx = 0; tx < index.tiles_x(); ++tx)
+        for (int ty = 0; ty < index.tiles_y(); ++ty)
+            if (index.is_rim(tx, ty, 2))
+                ++tiles;
+    REQUIRE(tiles == 12);
+    REQUIRE(!index.is_rim(0, 0, 0));
+
+    int spans = 0;
+    index.for_each_active_column_span(2, [&](int, int, int) { ++spans; });
+    REQUIRE(spans == 20 * 4 + 20 * 2);
+}
+
+TEST_CASE("Emptied tiles", "[tile_index]")
+{
+    TileIndex index(100, 100, 10);
+    index.add_site(5, 5);
+    index.add_site(15, 5);
+    index.add_site(25, 5);
+
+    index.remove_site(5, 5);
+    index.remove_site(15, 5);
+    index.add_site(15, 6);
+    index.remove_site(15, 6);
+    index.add_site(5, 5);
+
+    auto emptied = index.take_emptied_tiles();
+    REQUIRE(emptied == std::vector<int>{1 * 10 + 0});
+    REQUIRE(index.take_emptied_tiles().empty());
+}
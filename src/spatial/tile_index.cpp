@@ -0,0 +1,83 @@
+#include "tile_index.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+TileIndex::TileIndex(int sizex, int sizey, int tile_size)
+    : sizex_(sizex), sizey_(sizey), tile_size_(tile_size) {
+  if (tile_size < 1)
+    throw std::invalid_argument("TileIndex: tile size must be positive");
+
+  tiles_x_ = (sizex + tile_size - 1) / tile_size;
+  tiles_y_ = (sizey + tile_size - 1) / tile_size;
+  counts_.assign(tiles_x_ * tiles_y_, 0);
+  emptied_.assign(tiles_x_ * tiles_y_, false);
+  occupied_sites_ = 0;
+  occupied_tiles_ = 0;
+}
+
+void TileIndex::add_site(int x, int y) {
+  int tile = (x / tile_size_) * tiles_y_ + y / tile_size_;
+  if (counts_[tile]++ == 0)
+    ++occupied_tiles_;
+  ++occupied_sites_;
+}
+
+void TileIndex::remove_site(int x, int y) {
+  int tile = (x / tile_size_) * tiles_y_ + y / tile_size_;
+  --occupied_sites_;
+  if (--counts_[tile] == 0) {
+    --occupied_tiles_;
+    if (!emptied_[tile]) {
+      emptied_[tile] = true;
+      emptied_list_.push_back(tile);
+    }
+  }
+}
+
+void TileIndex::clear() {
+  std::fill(counts_.begin(), counts_.end(), 0);
+  std::fill(emptied_.begin(), emptied_.end(), false);
+  emptied_list_.clear();
+  occupied_sites_ = 0;
+  occupied_tiles_ = 0;
+}
+
+bool TileIndex::is_active(int tx, int ty) const {
+  int tx0 = std::max(tx - 1, 0), tx1 = std::min(tx + 1, tiles_x_ - 1);
+  int ty0 = std::max(ty - 1, 0), ty1 = std::min(ty + 1, tiles_y_ - 1);
+  for (int i = tx0; i <= tx1; ++i)
+    for (int j = ty0; j <= ty1; ++j)
+      if (counts_[i * tiles_y_ + j] > 0)
+        return true;
+  return false;
+}
+
+int TileIndex::active_tiles() const {
+  int active = 0;
+  for (int tx = 0; tx < tiles_x_; ++tx)
+    for (int ty = 0; ty < tiles_y_; ++ty)
+      if (is_active(tx, ty))
+        ++active;
+  return active;
+}
+
+std::vector<int> TileIndex::take_emptied_tiles() {
+  std::vector<int> result;
+  for (int tile : emptied_list_) {
+    emptied_[tile] = false;
+    if (counts_[tile] == 0)
+      result.push_back(tile);
+  }
+  emptied_list_.clear();
+  return result;
+}
+
+bool TileIndex::is_rim(int tx, int ty, int margin) const {
+  if (margin <= 0)
+    return false;
+  int x0 = tx * tile_size_, x1 = x0 + tile_size_ - 1;
+  int y0 = ty * tile_size_, y1 = y0 + tile_size_ - 1;
+  return x0 < margin || y0 < margin || x1 >= sizex_ - margin ||
+         y1 >= sizey_ - margin;
+}
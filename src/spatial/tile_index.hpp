@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+/** Occupancy bookkeeping for a lattice divided into square tiles
+ *
+ * The lattice is split into tiles of tile_size x tile_size sites, and for each
+ * tile the number of occupied (non-medium) sites is tracked. This lets
+ * lattice-wide scans skip the parts of the domain that contain only medium,
+ * which for large, mostly empty domains is most of it.
+ *
+ * A tile is occupied if it contains at least one occupied site. It is active if
+ * it or one of its eight neighbouring tiles is occupied, so the active tiles
+ * cover all occupied sites plus a halo of at least one tile around them. Every
+ * pair of sites that are closer than a tile width and of which at least one is
+ * occupied therefore lies within the active tiles.
+ *
+ * Tiles whose last occupied site is removed are remembered, so that the owner
+ * of the lattice can release the memory backing them.
+ */
+class TileIndex {
+public:
+  /** Create an index for an empty lattice
+   *
+   * @param sizex Horizontal size of the lattice, in sites.
+   * @param sizey Vertical size of the lattice, in sites.
+   * @param tile_size Width and height of a tile, in sites.
+   */
+  TileIndex(int sizex, int sizey, int tile_size);
+
+  /// Marks site (x, y) as occupied.
+  void add_site(int x, int y);
+
+  /// Marks site (x, y) as no longer occupied.
+  void remove_site(int x, int y);
+
+  /// Mark all sites as empty, and forget about emptied tiles.
+  void clear();
+
+  /// Return the number of occupied sites in tile (tx, ty).
+  int count(int tx, int ty) const { return counts_[tx * tiles_y_ + ty]; }
+
+  /// Return whether tile (tx, ty) or any of its neighbours is occupied.
+  bool is_active(int tx, int ty) const;
+
+  /// Return the total number of occupied sites.
+  long occupied_sites() const { return occupied_sites_; }
+
+  /// Return the number of occupied tiles.
+  int occupied_tiles() const { return occupied_tiles_; }
+
+  /// Return the number of active tiles.
+  int active_tiles() const;
+
+  int tile_size() const { return tile_size_; }
+  int tiles_x() const { return tiles_x_; }
+  int tiles_y() const { return tiles_y_; }
+
+  /** Return the tiles that were emptied since the last call
+   *
+   * Tiles are returned as tile indices tx * tiles_y() + ty. A tile is in the
+   * result at most once, and only if it is still empty.
+   */
+  std::vector<int> take_emptied_tiles();
+
+  /** Call a function for the active part of every lattice column
+   *
+   * For each column x, in increasing order, the function is called as
+   * f(x, y0, y1) for each active tile crossing the column, in increasing order
+   * of y. This visits the sites of the active tiles in the same order as a
+   * loop over x with an inner loop over y would.
+   *
+   * @param rim Also visit tiles within this many sites of the edge of the
+   *     lattice, whether active or not. Used to find interactions across
+   *     periodic boundaries, which the halo does not cover.
+   * @param f The function to call.
+   */
+  template <typename F> void for_each_active_column_span(int rim, F f) const {
+    std::vector<char> visit(tiles_y_);
+    for (int tx = 0; tx < tiles_x_; ++tx) {
+      for (int ty = 0; ty < tiles_y_; ++ty)
+        visit[ty] = is_active(tx, ty) || is_rim(tx, ty, rim);
+      int x1 = std::min((tx + 1) * tile_size_, sizex_);
+      for (int x = tx * tile_size_; x < x1; ++x)
+        for (int ty = 0; ty < tiles_y_; ++ty)
+          if (visit[ty])
+            f(x, ty * tile_size_, std::min((ty + 1) * tile_size_, sizey_));
+    }
+  }
+
+  /** Call a function for the active part of every lattice row
+   *
+   * As for_each_active_column_span(), but with the roles of x and y swapped:
+   * f(y, x0, x1) is called for each row y in increasing order.
+   *
+   * @param rim See for_each_active_column_span().
+   * @param f The function to call.
+   */
+  template <typename F> void for_each_active_row_span(int rim, F f) const {
+    std::vector<char> visit(tiles_x_);
+    for (int ty = 0; ty < tiles_y_; ++ty) {
+      for (int tx = 0; tx < tiles_x_; ++tx)
+        visit[tx] = is_active(tx, ty) || is_rim(tx, ty, rim);
+      int y1 = std::min((ty + 1) * tile_size_, sizey_);
+      for (int y = ty * tile_size_; y < y1; ++y)
+        for (int tx = 0; tx < tiles_x_; ++tx)
+          if (visit[tx])
+            f(y, tx * tile_size_, std::min((tx + 1) * tile_size_, sizex_));
+    }
+  }
+
+  /** Call a function for the site ranges of all occupied tiles
+   *
+   * The function is called as f(x0, y0, x1, y1), where [x0, x1) x [y0, y1) is
+   * the part of the lattice covered by the tile.
+   *
+   * @param f The function to call.
+   */
+  template <typename F> void for_each_occupied_tile(F f) const {
+    for (int tx = 0; tx < tiles_x_; ++tx)
+      for (int ty = 0; ty < tiles_y_; ++ty)
+        if (count(tx, ty) > 0)
+          f(tx * tile_size_, ty * tile_size_,
+            std::min((tx + 1) * tile_size_, sizex_),
+            std::min((ty + 1) * tile_size_, sizey_));
+  }
+
+  /// Return whether tile (tx, ty) has a site within margin of the lattice edge.
+  bool is_rim(int tx, int ty, int margin) const;
+
+private:
+  int sizex_;
+  int sizey_;
+  int tile_size_;
+  int tiles_x_;
+  int tiles_y_;
+
+  std::vector<int> counts_;
+  std::vector<bool> emptied_;
+  std::vector<int> emptied_list_;
+  long occupied_sites_;
+  int occupied_tiles_;
+};
@@ -0,0 +1,203 @@
+#include "checkpoint.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+char const magic[8] = {'T', 'S', 'T', 'C', 'K', 'P', 'T', '\0'};
+std::uint32_t const byte_order_mark = 0x01020304;
+
+// Header: magic, version, byte order mark. Section header: tag, padding,
+// length. Both are multiples of 8 bytes, and sections are padded to 8 bytes,
+// so that section contents start 8-byte aligned in the mapped file.
+std::size_t const header_size = 16;
+std::size_t const section_header_size = 16;
+
+std::size_t padding(std::size_t length) { return (8 - length % 8) % 8; }
+
+} // namespace
+
+CheckpointWriter::CheckpointWriter(std::string const &path)
+    : path_(path), tmp_path_(path + ".tmp") {
+  file_ = std::fopen(tmp_path_.c_str(), "wb");
+  if (!file_)
+    throw std::runtime_error("Could not open " + tmp_path_ +
+                             " for writing a checkpoint");
+
+  std::uint32_t version = checkpoint_version;
+  write_bytes(magic, sizeof(magic));
+  write(version);
+  write(byte_order_mark);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  if (file_)
+    std::fclose(file_);
+  if (!committed_)
+    std::remove(tmp_path_.c_str());
+}
+
+void CheckpointWriter::begin_section(char const (&tag)[5]) {
+  if (section_start_ >= 0)
+    end_section();
+
+  std::uint32_t reserved = 0;
+  std::uint64_t length = 0;
+  write_bytes(tag, 4);
+  write(reserved);
+  section_start_ = std::ftell(file_);
+  write(length);
+}
+
+void CheckpointWriter::end_section() {
+  if (section_start_ < 0)
+    return;
+
+  long end = std::ftell(file_);
+  std::uint64_t length = end - section_start_ - sizeof(std::uint64_t);
+  check_(std::fseek(file_, section_start_, SEEK_SET) == 0, "seeking");
+  write(length);
+  check_(std::fseek(file_, end, SEEK_SET) == 0, "seeking");
+
+  char const zeros[8] = {};
+  write_bytes(zeros, padding(length));
+  section_start_ = -1;
+}
+
+void CheckpointWriter::write_string(std::string const &value) {
+  write<std::uint64_t>(value.size());
+  write_bytes(value.data(), value.size());
+}
+
+void CheckpointWriter::write_bytes(void const *data, std::size_t bytes) {
+  if (bytes)
+    check_(std::fwrite(data, 1, bytes, file_) == bytes, "writing");
+}
+
+void CheckpointWriter::commit() {
+  end_section();
+  check_(std::fflush(file_) == 0, "flushing");
+  check_(fsync(fileno(file_)) == 0, "syncing");
+  check_(std::fclose(file_) == 0, "closing");
+  file_ = nullptr;
+
+  // rename() replaces the old checkpoint atomically
+  check_(std::rename(tmp_path_.c_str(), path_.c_str()) == 0, "renaming");
+  committed_ = true;
+}
+
+void CheckpointWriter::check_(bool ok, char const *what) {
+  if (!ok)
+    throw std::runtime_error(std::string("Error ") + what + " checkpoint " +
+                             tmp_path_ + ": " + std::strerror(errno));
+}
+
+CheckpointReader::CheckpointReader(std::string const &path) : path_(path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    fail_(std::string("could not open: ") + std::strerror(errno));
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    fail_(std::string("could not stat: ") + std::strerror(errno));
+  }
+  size_ = st.st_size;
+
+  if (size_ > 0) {
+    void *mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      fail_(std::string("could not map: ") + std::strerror(errno));
+    }
+    // the whole file is read once, sequentially. Advice values are not
+    // flags, so each needs a call of its own.
+    if (madvise(mapping, size_, MADV_SEQUENTIAL) != 0 ||
+        madvise(mapping, size_, MADV_WILLNEED) != 0) {
+      int error = errno;
+      munmap(mapping, size_);
+      close(fd);
+      fail_(std::string("could not advise: ") + std::strerror(error));
+    }
+    data_ = static_cast<unsigned char const *>(mapping);
+  }
+  close(fd);
+
+  if (size_ < header_size || std::memcmp(data_, magic, sizeof(magic)) != 0)
+    fail_("not a checkpoint file");
+  std::memcpy(&version_, data_ + 8, sizeof(version_));
+  std::uint32_t mark;
+  std::memcpy(&mark, data_ + 12, sizeof(mark));
+  if (mark != byte_order_mark)
+    fail_("written on a machine with a different byte order");
+  if (version_ == 0 || version_ > checkpoint_version)
+    fail_("unsupported version " + std::to_string(version_));
+
+  // index the sections
+  std::size_t pos = header_size;
+  while (pos < size_) {
+    if (size_ - pos < section_header_size)
+      fail_("truncated section header");
+    std::string tag(reinterpret_cast<char const *>(data_ + pos), 4);
+    std::uint64_t length;
+    std::memcpy(&length, data_ + pos + 8, sizeof(length));
+    pos += section_header_size;
+    if (length > size_ - pos)
+      fail_("section " + tag + " is truncated");
+    sections_[tag] = Section{pos, length};
+    pos += length + padding(length);
+  }
+}
+
+CheckpointReader::~CheckpointReader() {
+  if (data_)
+    munmap(const_cast<unsigned char *>(data_), size_);
+}
+
+bool CheckpointReader::has_section(char const (&tag)[5]) const {
+  return sections_.count(std::string(tag, 4)) != 0;
+}
+
+void CheckpointReader::begin_section(char const (&tag)[5]) {
+  auto section = sections_.find(std::string(tag, 4));
+  if (section == sections_.end())
+    fail_(std::string("missing section ") + tag);
+  section_tag_ = section->first;
+  pos_ = section->second.offset;
+  end_ = pos_ + section->second.length;
+}
+
+void CheckpointReader::end_section() {
+  if (pos_ != end_)
+    fail_("unexpected data at the end of section " + section_tag_);
+}
+
+std::string CheckpointReader::read_string() {
+  std::uint64_t size = read<std::uint64_t>();
+  check_size_(size, 1);
+  return std::string(static_cast<char const *>(read_bytes(size)), size);
+}
+
+void const *CheckpointReader::read_bytes(std::size_t bytes) {
+  if (bytes > end_ - pos_)
+    fail_("section " + section_tag_ + " is shorter than expected");
+  void const *result = data_ + pos_;
+  pos_ += bytes;
+  return result;
+}
+
+void CheckpointReader::check_size_(std::uint64_t count,
+                                   std::size_t element_size) const {
+  if (count > (end_ - pos_) / element_size)
+    fail_("section " + section_tag_ + " is shorter than expected");
+}
+
+void CheckpointReader::fail_(std::string const &what) const {
+  throw std::runtime_error("Checkpoint " + path_ + ": " + what);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/** Version of the checkpoint format written by CheckpointWriter.
+ *
+ * Increase this when the contents of a section change, and keep reading
+ * older versions where possible, using CheckpointReader::version().
+ */
+constexpr std::uint32_t checkpoint_version = 1;
+
+/** Writes a binary checkpoint file
+ *
+ * A checkpoint consists of a header, followed by a sequence of sections. Each
+ * section has a four-character tag and a length, so that readers can look up
+ * sections by tag and skip those they do not know. Data is stored in native
+ * byte order, the header records it so that a checkpoint from a machine with
+ * a different byte order is rejected rather than misread.
+ *
+ * The file is written under a temporary name and moved into place by
+ * commit(), so that an interrupted write never replaces an existing
+ * checkpoint with a partial one.
+ */
+class CheckpointWriter {
+public:
+  /** Start writing a checkpoint
+   *
+   * @param path Where the checkpoint should end up.
+   * @throws std::runtime_error if the temporary file cannot be created.
+   */
+  explicit CheckpointWriter(std::string const &path);
+
+  /// Removes the temporary file if commit() was not called.
+  ~CheckpointWriter();
+
+  CheckpointWriter(CheckpointWriter const &) = delete;
+  CheckpointWriter &operator=(CheckpointWriter const &) = delete;
+
+  /** Start a new section
+   *
+   * @param tag Four-character name of the section.
+   */
+  void begin_section(char const (&tag)[5]);
+
+  /// Finish the current section.
+  void end_section();
+
+  /// Write a single value of a trivially copyable type.
+  template <typename T> void write(T const &value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be written directly");
+    write_bytes(&value, sizeof(T));
+  }
+
+  /// Write a vector, preceded by its size.
+  template <typename T> void write_vector(std::vector<T> const &values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be written directly");
+    write<std::uint64_t>(values.size());
+    write_bytes(values.data(), values.size() * sizeof(T));
+  }
+
+  /// Write a string, preceded by its length.
+  void write_string(std::string const &value);
+
+  /// Write raw bytes.
+  void write_bytes(void const *data, std::size_t bytes);
+
+  /** Flush the data to disk and move the file into place
+   *
+   * @throws std::runtime_error if writing failed.
+   */
+  void commit();
+
+private:
+  void check_(bool ok, char const *what);
+
+  std::string path_;
+  std::string tmp_path_;
+  std::FILE *file_ = nullptr;
+  long section_start_ = -1;
+  bool committed_ = false;
+};
+
+/** Reads a binary checkpoint file written by CheckpointWriter
+ *
+ * The file is memory mapped, so opening it is cheap, and large blocks can be
+ * copied straight from the page cache using read_bytes(). Reads are checked
+ * against the section boundaries, so that a truncated or mismatched file
+ * results in an exception rather than garbage.
+ */
+class CheckpointReader {
+public:
+  /** Open and map a checkpoint
+   *
+   * @param path The checkpoint file.
+   * @throws std::runtime_error if the file cannot be read, is not a
+   *         checkpoint, or has an unsupported version or byte order.
+   */
+  explicit CheckpointReader(std::string const &path);
+  ~CheckpointReader();
+
+  CheckpointReader(CheckpointReader const &) = delete;
+  CheckpointReader &operator=(CheckpointReader const &) = delete;
+
+  /// Return the version of the format the file was written with.
+  std::uint32_t version() const { return version_; }
+
+  /// Return whether the file has a section with the given tag.
+  bool has_section(char const (&tag)[5]) const;
+
+  /** Start reading a section
+   *
+   * @param tag Four-character name of the section.
+   * @throws std::runtime_error if there is no such section.
+   */
+  void begin_section(char const (&tag)[5]);
+
+  /** Finish reading the current section
+   *
+   * @throws std::runtime_error if not all of its contents were read.
+   */
+  void end_section();
+
+  /// Read a single value of a trivially copyable type.
+  template <typename T> T read() {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be read directly");
+    T value;
+    std::memcpy(&value, read_bytes(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  /// Read a vector written by CheckpointWriter::write_vector().
+  template <typename T> std::vector<T> read_vector() {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable types can be read directly");
+    std::uint64_t size = read<std::uint64_t>();
+    check_size_(size, sizeof(T));
+    std::vector<T> values(size);
+    std::memcpy(values.data(), read_bytes(size * sizeof(T)), size * sizeof(T));
+    return values;
+  }
+
+  /// Read a string written by CheckpointWriter::write_string().
+  std::string read_string();
+
+  /** Read raw bytes
+   *
+   * @return A pointer into the mapped file, valid as long as the reader
+   *         exists. It is aligned to 8 bytes if all previous reads in the
+   *         section were multiples of 8 bytes.
+   */
+  void const *read_bytes(std::size_t bytes);
+
+private:
+  struct Section {
+    std::size_t offset;
+    std::size_t length;
+  };
+
+  void check_size_(std::uint64_t count, std::size_t element_size) const;
+  [[noreturn]] void fail_(std::string const &what) const;
+
+  std::string path_;
+  unsigned char const *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::uint32_t version_ = 0;
+  std::unordered_map<std::string, Section> sections_;
+
+  std::string section_tag_;
+  std::size_t pos_ = 0;
+  std::size_t end_ = 0;
+};
@@ -22,18 +22,24 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 */
 #include "inputoutput.hpp"
 #include "cell.hpp"
+#include "checkpoint.hpp"
 #include "dish.hpp"
+#include "output_writer.hpp"
 #include "parameter.hpp"
 #include "pde.hpp"
 #include "warning.hpp"
+#include <charconv>
 #include <errno.h>
+#include <fcntl.h>
 #include <fstream>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "../lib/json/json.hpp"
 using json = nlohmann::json_abi_v3_11_2::json;
@@ -242,9 +248,18 @@ void IO::CountSigma(std::ostream &os) {
   for (int i = 0; i < Cell::MaxSigma(); i++) {
     sum_sigma[i] = 0;
   }
-  for (int x = 1; x < par.sizex - 1; x++) {
-    for (int y = 1; y < par.sizey - 1; y++) {
-      sum_sigma[dish->CPM->getSigma()[x][y]]++;
+  Observables const &observables = dish->CPM->GetObservables();
+  if (observables.valid()) {
+    // the cells keep track of their areas, the rest is medium
+    for (int i = 1; i < Cell::MaxSigma(); i++)
+      sum_sigma[i] = dish->getCell(i).Area();
+    sum_sigma[0] = (par.sizex - 2) * (par.sizey - 2) -
+                   observables.occupied_area();
+  } else {
+    for (int x = 1; x < par.sizex - 1; x++) {
+      for (int y = 1; y < par.sizey - 1; y++) {
+        sum_sigma[dish->CPM->Sigma(x, y)]++;
+      }
     }
   }
   for (int i = 0; i < Cell::MaxSigma(); i++) {
@@ -253,53 +268,317 @@ void IO::CountSigma(std::ostream &os) {
   delete[] sum_sigma;
 }
 
-void IO::WriteContactInterfaces(void) {
-  int RedRedSurface = 0;
-  int RedYellowSurface = 0;
-  int YellowYellowSurface = 0;
-  for (int x = 1; x < par.sizex - 1; x++)
-    for (int y = 1; y < par.sizey - 1; y++) {
-      for (int i = 1; i <= 4; i++) {
-        int x2, y2;
-        x2 = x + dish->CPM->getNbhx(i);
-        y2 = y + dish->CPM->getNbhy(i);
-        if (dish->CPM->getSigma()[x][y] != dish->CPM->getSigma()[x2][y2]) {
-          // dish->CPM->getCell())[dish->CPM->getSigma()[x][y]] returns the cell
-          // corresponding to the sigma found on position (x,y)
-          if ((dish->CPM->getCell(dish->CPM->getSigma()[x][y])).getTau() == 1 &&
-              (dish->CPM->getCell(dish->CPM->getSigma()[x2][y2])).getTau() == 1)
-            RedRedSurface++;
-          if ((dish->CPM->getCell(dish->CPM->getSigma()[x][y])).getTau() == 2 &&
-              (dish->CPM->getCell(dish->CPM->getSigma()[x2][y2])).getTau() == 1)
-            RedYellowSurface++;
-          if ((dish->CPM->getCell(dish->CPM->getSigma()[x][y])).getTau() == 1 &&
-              (dish->CPM->getCell(dish->CPM->getSigma()[x2][y2])).getTau() == 2)
-            RedYellowSurface++;
-          if ((dish->CPM->getCell(dish->CPM->getSigma()[x][y])).getTau() == 2 &&
-              (dish->CPM->getCell(dish->CPM->getSigma()[x2][y2])).getTau() == 2)
-            YellowYellowSurface++;
-        }
-      }
+void IO::WriteContactInterfaces(int time) {
+  if (par.contact_interfaces_stride <= 0 ||
+      time % par.contact_interfaces_stride)
+    return;
+
+  CellularPotts *cpm = dish->CPM;
+  if (!cpm->GetObservables().valid())
+    cpm->RebuildObservables();
+  Observables const &observables = cpm->GetObservables();
+  if (!observables.valid())
+    throw "In IO::WriteContactInterfaces, the lattice contains unknown cells";
+
+  if (!contact_interfaces.is_open()) {
+    contact_interfaces.open(par.contact_interfaces_file);
+    if (!contact_interfaces) {
+      char *message = (char *)malloc(2000 * sizeof(char));
+      snprintf(message, 2000, " Could not open file %s for writing",
+               par.contact_interfaces_file.c_str());
+      throw(message);
+    }
+  }
+
+  int n_types = observables.n_types();
+  if (n_types != contact_interfaces_types) {
+    contact_interfaces << "time";
+    for (int t1 = 0; t1 < n_types; t1++)
+      for (int t2 = t1; t2 < n_types; t2++)
+        contact_interfaces << " " << t1 << "-" << t2;
+    contact_interfaces << "\n";
+    contact_interfaces_types = n_types;
+  }
+
+  contact_interfaces << time;
+  for (int t1 = 0; t1 < n_types; t1++)
+    for (int t2 = t1; t2 < n_types; t2++)
+      contact_interfaces << " " << observables.interfaces(t1, t2);
+  // flush, the IO object may not be destroyed when the simulation ends
+  contact_interfaces << endl;
+}
+
+void IO::WriteTrajectory(int time) {
+  if (par.trajectory_stride <= 0 || time % par.trajectory_stride ||
+      trajectory_closed)
+    return;
+
+  CellularPotts *cpm = dish->CPM;
+  PDE *pde = dish->PDEfield;
+  bool with_pde = pde && par.trajectory_pde != "none" &&
+                  pde->SizeX() == cpm->SizeX() && pde->SizeY() == cpm->SizeY();
+
+  if (!trajectory) {
+    TrajectoryPDE pde_type = TrajectoryPDE::float32;
+    if (par.trajectory_pde == "float64")
+      pde_type = TrajectoryPDE::float64;
+    else if (par.trajectory_pde == "uint16")
+      pde_type = TrajectoryPDE::uint16;
+    else if (par.trajectory_pde == "uint8")
+      pde_type = TrajectoryPDE::uint8;
+    try {
+      trajectory = std::make_unique<TrajectoryWriter>(
+          par.trajectory_file, cpm->SizeX(), cpm->SizeY(),
+          with_pde ? pde->Layers() : 0, pde_type,
+          par.trajectory_chunk_frames);
+    } catch (std::exception const &e) {
+      char *message = (char *)malloc(2000 * sizeof(char));
+      snprintf(message, 2000, " %s", e.what());
+      throw(message);
     }
-  // cout << "Red-red surface = " << RedRedSurface << endl;
-  // cout << "Red-yellow surface = " << RedYellowSurface << endl;
-  // cout << "Yellow-yellow surface = " << YellowYellowSurface << endl;
-
-  ofstream myfile;
-  myfile.open("Data_original.txt", std::ofstream::out | std::ofstream::app);
-  myfile << RedYellowSurface << endl;
-  myfile.close();
+  }
+
+  trajectory->begin_frame(time);
+  cpm->VisitSigma(
+      [this](auto const &lattice) { trajectory->set_sigma(lattice.data()); });
+  if (with_pde)
+    trajectory->set_pde(pde->getPDEvars()[0][0]);
+
+  std::vector<TrajectoryCell> cells;
+  cells.reserve(cpm->getCellArray()->size());
+  for (Cell &c : *cpm->getCellArray()) {
+    if (c.Sigma() == 0)
+      continue;
+    int area = c.Area();
+    cells.push_back(TrajectoryCell{
+        c.Sigma(), c.getTau(), c.AliveP(), area, c.TargetArea(), c.Perimeter(),
+        area ? c.getCenterX() : 0., area ? c.getCenterY() : 0.});
+  }
+  trajectory->set_cells(cells);
+  trajectory->end_frame();
+
+  if (time + par.trajectory_stride >= par.mcs) {
+    trajectory->close();
+    trajectory.reset();
+    trajectory_closed = true;
+  }
+}
+
+namespace {
+
+[[noreturn]] void ConfigurationError(const string &fname, const string &what) {
+  char *message = (char *)malloc(2000 * sizeof(char));
+  snprintf(message, 2000, " Could not read configuration %s: %s",
+           fname.c_str(), what.c_str());
+  throw(message);
 }
 
+/* The binary configuration that goes with a json configuration. */
+string SidecarFile(const string &fname) { return fname + ".bin"; }
+
+bool IsBinaryConfiguration(const string &fname) {
+  return fname.size() >= 4 && fname.compare(fname.size() - 4, 4, ".bin") == 0;
+}
+
+/* Whether the sidecar exists and was written after the json file. */
+bool SidecarIsCurrent(const string &fname) {
+  struct stat json_stat, sidecar_stat;
+  if (stat(SidecarFile(fname).c_str(), &sidecar_stat) != 0)
+    return false;
+  if (stat(fname.c_str(), &json_stat) != 0)
+    return true;
+  return sidecar_stat.st_mtim.tv_sec > json_stat.st_mtim.tv_sec ||
+         (sidecar_stat.st_mtim.tv_sec == json_stat.st_mtim.tv_sec &&
+          sidecar_stat.st_mtim.tv_nsec >= json_stat.st_mtim.tv_nsec);
+}
+
+/* Write a configuration as json, formatted like json::dump() does, without
+   building a json document first. */
+void WriteJSONConfiguration(const string &fname, const int *sigma, size_t size,
+                            const vector<int> &tau) {
+  FILE *fp = fopen(fname.c_str(), "w");
+  if (fp == NULL) {
+    cerr << "Could not open " << fname << " for writing a configuration\n";
+    return;
+  }
+
+  vector<char> buffer(1 << 20);
+  size_t used = 0;
+  bool ok = true;
+  auto flush = [&]() {
+    ok = ok && fwrite(buffer.data(), 1, used, fp) == used;
+    used = 0;
+  };
+  auto put = [&](const char *text, size_t n) {
+    if (used + n > buffer.size())
+      flush();
+    memcpy(buffer.data() + used, text, n);
+    used += n;
+  };
+  auto put_array = [&](const int *values, size_t n) {
+    put("[", 1);
+    for (size_t i = 0; i < n; i++) {
+      char number[16];
+      char *end = to_chars(number, number + sizeof(number), values[i]).ptr;
+      if (i + 1 < n)
+        *end++ = ',';
+      put(number, end - number);
+    }
+    put("]", 1);
+  };
+
+  put("{\"sigma\":", 9);
+  put_array(sigma, size);
+  put(",\"tau\":", 7);
+  put_array(tau.data(), tau.size());
+  put("}", 1);
+  flush();
+  if (fclose(fp) != 0 || !ok)
+    cerr << "Error writing configuration " << fname << "\n";
+}
+
+/* Write a configuration in binary form, see IO::ReadConfiguration(). */
+void WriteBinaryConfiguration(const string &fname, const int *sigma,
+                              int sizex, int sizey, const vector<int> &tau) {
+  CheckpointWriter out(fname);
+  out.begin_section("CNFG");
+  out.write<int32_t>(sizex);
+  out.write<int32_t>(sizey);
+  out.begin_section("SGMA");
+  out.write_bytes(sigma, (size_t)sizex * sizey * sizeof(int32_t));
+  out.begin_section("TAU ");
+  out.write_vector(vector<int32_t>(tau.begin(), tau.end()));
+  out.commit();
+}
+
+/* A file mapped into memory, read-only. */
+class MappedFile {
+public:
+  MappedFile(const string &fname) {
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+      ConfigurationError(fname, strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      size = st.st_size;
+      void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+        data = (const char *)mapping;
+        madvise(mapping, size, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+    if (data == NULL)
+      ConfigurationError(fname, "empty or unreadable file");
+  }
+  ~MappedFile() { munmap((void *)data, size); }
+
+  const char *data = NULL;
+  size_t size = 0;
+};
+
+/* Receives the parts of a json configuration from the parser, and stores the
+   sigma array straight into the lattice, so that no json document is built.
+   See the nlohmann::json_sax documentation for the interface. */
+class ConfigurationParser {
+public:
+  ConfigurationParser(CellularPotts &cpm, vector<int> &tau)
+      : cpm(cpm), tau(tau), sizey(cpm.SizeY()),
+        sites((size_t)cpm.SizeX() * cpm.SizeY()) {}
+
+  bool null() { return Other(); }
+  bool boolean(bool) { return Other(); }
+  bool number_integer(json::number_integer_t value) { return Integer(value); }
+  bool number_unsigned(json::number_unsigned_t value) {
+    return Integer(value);
+  }
+  bool number_float(json::number_float_t, const string &) { return Other(); }
+  bool string(json::string_t &) { return Other(); }
+  bool binary(json::binary_t &) { return Other(); }
+  bool start_object(size_t) { return Start(); }
+  bool end_object() { return End(); }
+  bool start_array(size_t) { return Start(); }
+  bool end_array() { return End(); }
+  bool key(json::string_t &name) {
+    if (depth == 1)
+      current = name;
+    return true;
+  }
+  bool parse_error(size_t, const std::string &, const json::exception &e) {
+    error = e.what();
+    return false;
+  }
+
+  size_t sigma_count = 0;
+  bool sigma_found = false;
+  bool tau_found = false;
+  std::string error;
+
+private:
+  bool InSigma() const { return depth == 2 && current == "sigma"; }
+  bool InTau() const { return depth == 2 && current == "tau"; }
+
+  bool Integer(long long value) {
+    if (InSigma()) {
+      if (sigma_count == sites) {
+        error = "sigma has more values than the lattice has sites";
+        return false;
+      }
+      cpm.SetSigma(x, y, (int)value);
+      if (++y == sizey) {
+        y = 0;
+        x++;
+      }
+      sigma_count++;
+    } else if (InTau()) {
+      tau.push_back((int)value);
+    }
+    return true;
+  }
+
+  bool Other() {
+    if (InSigma() || InTau()) {
+      error = current + " contains a value that is not an integer";
+      return false;
+    }
+    return true;
+  }
+
+  bool Start() {
+    // arrays and objects inside sigma or tau are errors too
+    bool ok = Other();
+    depth++;
+    if (depth == 2) {
+      sigma_found = sigma_found || current == "sigma";
+      tau_found = tau_found || current == "tau";
+    }
+    return ok;
+  }
+
+  bool End() {
+    depth--;
+    return true;
+  }
+
+  CellularPotts &cpm;
+  vector<int> &tau;
+  int sizey;
+  size_t sites;
+  std::string current;
+  int depth = 0;
+  int x = 0, y = 0;
+};
+
+} // namespace
+
 void IO::WriteConfiguration(char *write_loc) {
-  // Write the current configuration in json format
-  json Configuration;
-  // Convert sigmafield to vector
-  int *sigmafieldarray = dish->CPM->getSigma()[0];
-  int size = par.sizex * par.sizey;
-  vector<int> sigmafieldvector(sigmafieldarray, sigmafieldarray + size);
-  // Write sigmafield to json
-  Configuration["sigma"] = sigmafieldvector;
+  // Take a snapshot of the configuration, and convert it to json and write it
+  // in the background
+  OutputWriter &writer = SharedOutputWriter();
+  size_t size = (size_t)par.sizex * par.sizey;
+  OutputWriter::Buffer sigma = writer.buffer(size * sizeof(int));
+  vector<int> spins;
+  memcpy(sigma->data(), dish->CPM->SigmaInts(spins), size * sizeof(int));
 
   // Construct a cell types matrix
   vector<int> celltypes;
@@ -308,33 +587,107 @@ void IO::WriteConfiguration(char *write_loc) {
   for (; c != dish->CPM->getCellArray()->end(); c++) {
     celltypes.push_back(c->getTau());
   }
-  // Write celltypes to json
-  Configuration["tau"] = celltypes;
-
-  // Write configuration to file
-  ofstream myfile;
-  myfile.open(write_loc, std::ofstream::out);
-  myfile << Configuration;
-  myfile.close();
+
+  string fname(write_loc);
+  bool sidecar = par.configuration_sidecar;
+  int sizex = par.sizex, sizey = par.sizey;
+  writer.submit([sigma, size, celltypes, fname, sidecar, sizex, sizey]() {
+    const int *sigmafield = reinterpret_cast<const int *>(sigma->data());
+    WriteJSONConfiguration(fname, sigmafield, size, celltypes);
+    // written second, so that it is newer than the json file
+    if (sidecar)
+      WriteBinaryConfiguration(SidecarFile(fname), sigmafield, sizex, sizey,
+                               celltypes);
+  });
 }
 
 void IO::ReadConfiguration(void) {
-  ifstream f(par.initial_configuration_file);
-  json Configuration = json::parse(f);
+  const std::string &fname = par.initial_configuration_file;
+  CellularPotts *cpm = dish->CPM;
+  vector<int> tau;
+
+  bool parse = false;
+  if (IsBinaryConfiguration(fname)) {
+    ReadBinaryConfiguration(fname, tau);
+  } else if (par.configuration_sidecar && SidecarIsCurrent(fname)) {
+    // the sidecar is only a cache, so if it is damaged we use the json file
+    try {
+      ReadBinaryConfiguration(SidecarFile(fname), tau);
+    } catch (const char *error) {
+      warning("%s, reading %s instead", error, fname.c_str());
+      free((void *)error);
+      tau.clear();
+      parse = true;
+    }
+  } else {
+    parse = true;
+  }
+
+  if (parse) {
+    /* Fill CA plane with imported configuration, while parsing */
+    {
+      MappedFile file(fname);
+      ConfigurationParser parser(*cpm, tau);
+      json::sax_parse(file.data, file.data + file.size, &parser);
+      if (!parser.error.empty())
+        ConfigurationError(fname, parser.error);
+      if (!parser.sigma_found || !parser.tau_found)
+        ConfigurationError(fname, "sigma or tau is missing");
+      if (parser.sigma_count != (size_t)par.sizex * par.sizey)
+        ConfigurationError(fname, "the size of sigma does not match the "
+                                  "lattice size");
+    }
 
-  /* Fill CA plane with imported configuration */
-  {
-    for (int i = 0; i < par.sizex * par.sizey; i++)
-      dish->CPM->getSigma()[0][i] = Configuration["sigma"][i];
+    if (par.configuration_sidecar) {
+      try {
+        vector<int> spins;
+        WriteBinaryConfiguration(SidecarFile(fname), cpm->SigmaInts(spins),
+                                 par.sizex, par.sizey, tau);
+      } catch (const std::exception &e) {
+        warning("Could not write a binary configuration: %s", e.what());
+      }
+    }
   }
 
   // Construct the cells
-  dish->CPM->ConstructInitCells(*dish);
+  cpm->ConstructInitCells(*dish);
 
   // Assign celltypes
-  vector<Cell>::iterator c = dish->CPM->getCellArray()->begin();
+  vector<Cell>::iterator c = cpm->getCellArray()->begin();
   ++c;
-  for (; c != dish->CPM->getCellArray()->end(); c++) {
-    c->setTau(Configuration["tau"][c->sigma - 1]);
+  for (; c != cpm->getCellArray()->end(); c++) {
+    if (c->sigma > (int)tau.size())
+      ConfigurationError(fname, "tau has fewer entries than there are cells");
+    c->setTau(tau[c->sigma - 1]);
+  }
+}
+
+void IO::ReadBinaryConfiguration(const std::string &fname, vector<int> &tau) {
+  try {
+    CheckpointReader in(fname);
+    in.begin_section("CNFG");
+    int sx = in.read<int32_t>();
+    int sy = in.read<int32_t>();
+    in.end_section();
+    if (sx != par.sizex || sy != par.sizey)
+      ConfigurationError(fname, "the lattice size does not match");
+
+    // copied straight from the page cache into the lattice
+    in.begin_section("SGMA");
+    dish->CPM->SetSigmaField(static_cast<const int32_t *>(
+        in.read_bytes((size_t)sx * sy * sizeof(int32_t))));
+    in.end_section();
+
+    in.begin_section("TAU ");
+    vector<int32_t> types = in.read_vector<int32_t>();
+    in.end_section();
+    tau.assign(types.begin(), types.end());
+  } catch (const std::exception &e) {
+    ConfigurationError(fname, e.what());
   }
 }
+
+OutputWriter &SharedOutputWriter(void) {
+  static OutputWriter writer(par.output_threads, par.output_queue_length);
+  return writer;
+}
@@ -25,6 +25,11 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "cell.hpp"
 #include "dish.hpp"
 #include "pde.hpp"
+#include "trajectory.hpp"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #ifndef OUTPUT_H_
 #define OUTPUT_H_
@@ -51,14 +56,56 @@ public:
   bool CanWeWriteP(char *filename);
   /*! A simple method to count all sigma's and write the output to an ostream */
   void CountSigma(std::ostream &os);
-  // Write contact surfaces to a file.
-  void WriteContactInterfaces(void);
-  // Read and write json files
+  /*! \brief Write the interface lengths between cell types to a file
+
+  If time is a multiple of par.contact_interfaces_stride, appends a line to
+  par.contact_interfaces_file with the time and the number of orthogonal
+  neighbour pairs of different cells, for every pair of types including the
+  medium. The file is truncated on the first call, and a header naming the
+  pairs is written whenever the number of types changes. The counts are kept
+  up to date by the CPM, so this does not scan the lattice.
+  */
+  void WriteContactInterfaces(int time);
+  /*! \brief Add a frame to the trajectory
+
+  If time is a multiple of par.trajectory_stride, adds the lattice, the PDE
+  layers (as set by par.trajectory_pde) and a summary of each cell to
+  par.trajectory_file. See TrajectoryWriter for the format, and
+  cpm_ecm/trajectory.py for reading it from Python. The file is created on
+  the first call. It is closed after the last frame before par.mcs, because
+  the IO object may not be destroyed when the simulation ends.
+  */
+  void WriteTrajectory(int time);
+  /*! \brief Write the lattice and the cell types to a json file
+
+  The configuration is copied, and written in the background by the
+  SharedOutputWriter(). If par.configuration_sidecar is set, a binary copy is
+  written next to it, see ReadConfiguration().
+  */
   void WriteConfiguration(char *write_loc);
+  /*! \brief Read the configuration in par.initial_configuration_file
+
+  A json configuration is parsed as a stream, and the lattice is filled in
+  while parsing, so no json document is built in memory. Binary
+  configurations are memory-mapped, and copied into the lattice directly,
+  which is much faster for large lattices. A file name ending in .bin is read
+  as a binary configuration. Otherwise, if par.configuration_sidecar is set
+  and there is a binary sidecar (the file name with .bin appended) that is
+  newer than the json file, the sidecar is read instead. If the sidecar is
+  missing, older than the json file or damaged, the json file is read and a
+  new sidecar written.
+  */
   void ReadConfiguration(void);
 
 private:
+  void ReadBinaryConfiguration(const std::string &fname,
+                               std::vector<int> &tau);
+
   Dish *dish;
+  std::ofstream contact_interfaces;
+  int contact_interfaces_types = 0;
+  std::unique_ptr<TrajectoryWriter> trajectory;
+  bool trajectory_closed = false;
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,115 @@
+#include "output_writer.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+struct OutputWriter::Pool {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<std::vector<unsigned char>>> free;
+};
+
+OutputWriter::OutputWriter(int threads, int max_pending)
+    : max_pending_(std::max(max_pending, 1)), pool_(std::make_shared<Pool>()) {
+  for (int i = 0; i < threads; ++i)
+    threads_.emplace_back(&OutputWriter::run_, this);
+}
+
+OutputWriter::~OutputWriter() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_available_.notify_all();
+  for (auto &thread : threads_)
+    thread.join();
+}
+
+OutputWriter::Buffer OutputWriter::buffer(std::size_t bytes) {
+  std::unique_ptr<std::vector<unsigned char>> storage;
+  {
+    std::lock_guard<std::mutex> lock(pool_->mutex);
+    if (!pool_->free.empty()) {
+      storage = std::move(pool_->free.back());
+      pool_->free.pop_back();
+    }
+  }
+  if (!storage)
+    storage.reset(new std::vector<unsigned char>());
+  storage->resize(bytes);
+
+  std::shared_ptr<Pool> pool = pool_;
+  return Buffer(storage.release(), [pool](std::vector<unsigned char> *buf) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->free.emplace_back(buf);
+  });
+}
+
+void OutputWriter::submit(std::function<void()> job) {
+  if (threads_.empty()) {
+    run_job_(job);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (pending_ >= max_pending_) {
+    auto start = std::chrono::steady_clock::now();
+    slot_available_.wait(lock, [this] { return pending_ < max_pending_; });
+    stall_time_ += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  }
+  queue_.push_back(std::move(job));
+  ++pending_;
+  lock.unlock();
+  job_available_.notify_one();
+}
+
+void OutputWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  slot_available_.wait(lock, [this] { return pending_ == 0; });
+}
+
+double OutputWriter::stall_time() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stall_time_;
+}
+
+void OutputWriter::run_() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_available_.wait(lock,
+                          [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    run_job_(job);
+    // release the snapshot before making room for the next one
+    job = nullptr;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --pending_;
+    }
+    slot_available_.notify_all();
+  }
+}
+
+void OutputWriter::run_job_(std::function<void()> const &job) {
+  PROFILE_ZONE(output_job)
+  try {
+    job();
+  } catch (std::exception const &e) {
+    std::cerr << "Error writing output: " << e.what() << std::endl;
+  } catch (const char *error) {
+    std::cerr << "Error writing output: " << error << std::endl;
+  }
+}
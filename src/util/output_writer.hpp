@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Writes output on background threads
+ *
+ * Writing images and configurations takes time, for compression and for
+ * waiting on the disk. To keep the simulation from stalling, output is
+ * written in two steps: the simulation copies the data it wants to write
+ * into a buffer, and submits a job that formats and writes that snapshot.
+ * Jobs are run by background threads while the simulation continues.
+ *
+ * At most a fixed number of jobs can be pending. If the simulation produces
+ * output faster than it can be written, submit() waits for a job to finish,
+ * so that snapshots cannot pile up in memory.
+ *
+ * Buffers for the snapshots come from a pool, so that writing the same kind
+ * of output every few steps does not allocate new memory each time.
+ */
+class OutputWriter {
+public:
+  /// A buffer from the pool, it is returned to the pool when released.
+  using Buffer = std::shared_ptr<std::vector<unsigned char>>;
+
+  /** Create a writer
+   *
+   * @param threads Number of background threads. With 0 threads, jobs are
+   *        run immediately by submit().
+   * @param max_pending Number of jobs that may be queued or running before
+   *        submit() waits, at least 1.
+   */
+  OutputWriter(int threads, int max_pending);
+
+  /// Waits for all jobs to finish.
+  ~OutputWriter();
+
+  OutputWriter(OutputWriter const &) = delete;
+  OutputWriter &operator=(OutputWriter const &) = delete;
+
+  /** Get a buffer for a snapshot
+   *
+   * The contents of the buffer are undefined.
+   *
+   * @param bytes Size of the buffer.
+   */
+  Buffer buffer(std::size_t bytes);
+
+  /** Run a job in the background
+   *
+   * Exceptions thrown by the job are caught and reported on std::cerr, as
+   * there is nobody to pass them on to.
+   *
+   * @param job The job, which must only use data it owns, e.g. buffers
+   *        captured by value.
+   */
+  void submit(std::function<void()> job);
+
+  /// Wait until all submitted jobs have finished.
+  void flush();
+
+  /// Return the total time submit() spent waiting for a free slot, in s.
+  double stall_time() const;
+
+private:
+  void run_();
+  void run_job_(std::function<void()> const &job);
+
+  std::size_t max_pending_;
+  std::vector<std::thread> threads_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable job_available_;
+  std::condition_variable slot_available_;
+  std::deque<std::function<void()>> queue_;
+  std::size_t pending_ = 0;
+  bool stopping_ = false;
+  double stall_time_ = 0.0;
+
+  // shared with the buffers, which may outlive the writer
+  struct Pool;
+  std::shared_ptr<Pool> pool_;
+};
+
+/** Return the writer shared by all output of the simulation
+ *
+ * It is created on first use, with par.output_threads threads and at most
+ * par.output_queue_length pending jobs, and it is flushed at exit. This is
+ * defined in inputoutput.cpp, together with the rest of the output code.
+ */
+OutputWriter &SharedOutputWriter(void);
@@ -1,56 +1,607 @@
 #include "profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
 #include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+#if defined(PROFILING_TSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define PROFILER_USE_TSC
+#endif
 
 #ifdef PROFILING_ENABLED
-Profiler profiler = Profiler();
+#include "parameter.hpp"
+
+#include <cstdlib>
 #endif
 
-int Profiler::new_timer(std::string name) {
-  timer new_timer;
-  new_timer.name = name;
-  new_timer.count = 0;
-  int dex = index;
-  index++;
-  timers.push_back(new_timer);
-  return dex;
+namespace profiler_detail {
+
+/* A list that one thread appends to, while others read it
+ *
+ * Items are stored in blocks that never move, so that readers can use the
+ * items before the published size while the owner adds more. An item must
+ * not be changed after it has been appended, unless the fields that change
+ * are atomic.
+ */
+template <typename T, std::size_t block_size> class AppendLog {
+public:
+  static constexpr std::size_t max_blocks = 4096;
+  static constexpr std::size_t capacity = max_blocks * block_size;
+
+  ~AppendLog() {
+    for (auto &block : blocks_)
+      delete[] block.load(std::memory_order_relaxed);
+  }
+
+  /// Return the number of items, for any thread.
+  std::size_t size() const { return size_.load(std::memory_order_acquire); }
+
+  /// Return item i < size(), for any thread.
+  T const &operator[](std::size_t i) const {
+    T const *block = blocks_[i / block_size].load(std::memory_order_acquire);
+    return block[i % block_size];
+  }
+
+  /// Return item i < size(), for the owner.
+  T &operator[](std::size_t i) {
+    T *block = blocks_[i / block_size].load(std::memory_order_relaxed);
+    return block[i % block_size];
+  }
+
+  /// Return the next free item for the owner to fill in, or nullptr if full.
+  T *next() {
+    std::size_t n = size_.load(std::memory_order_relaxed);
+    if (n == capacity)
+      return nullptr;
+    auto &block = blocks_[n / block_size];
+    if (block.load(std::memory_order_relaxed) == nullptr)
+      block.store(new T[block_size], std::memory_order_release);
+    return &block.load(std::memory_order_relaxed)[n % block_size];
+  }
+
+  /// Make the item returned by next() visible to readers.
+  void publish() {
+    size_.store(size_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+private:
+  std::array<std::atomic<T *>, max_blocks> blocks_{};
+  std::atomic<std::size_t> size_{0};
+};
+
+} // namespace profiler_detail
+
+namespace {
+
+std::uint64_t steady_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::uint64_t ticks() {
+#ifdef PROFILER_USE_TSC
+  return __rdtsc();
+#else
+  return steady_ns();
+#endif
 }
 
-int Profiler::start_new_timer(std::string name) {
-  int timer = new_timer(name);
-  start_timer(timer);
-  return timer;
+// Adds to a value only written by one thread, and read by others.
+template <typename T> void add_relaxed(std::atomic<T> &value, T amount) {
+  value.store(value.load(std::memory_order_relaxed) + amount,
+              std::memory_order_relaxed);
 }
 
-void Profiler::start_timer(int timer) {
-  timers[timer].start = std::chrono::system_clock::now();
+// Orders paths so that zones come right after their parent
+bool path_less(std::string const &a, std::string const &b) {
+  return std::lexicographical_compare(
+      a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+        return (x == '/' ? '\0' : x) < (y == '/' ? '\0' : y);
+      });
 }
 
-void Profiler::stop_timer(int timer) {
-  timers[timer].stop = std::chrono::system_clock::now();
-  timers[timer].delta = timers[timer].stop - timers[timer].start;
-  timers[timer].sum += timers[timer].delta;
-  timers[timer].count++;
-  timers[timer].avg = timers[timer].sum / timers[timer].count;
+void write_json_string(std::FILE *file, std::string const &text) {
+  std::fputc('"', file);
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      std::fputc('\\', file);
+    if (static_cast<unsigned char>(c) < 0x20)
+      std::fprintf(file, "\\u%04x", c);
+    else
+      std::fputc(c, file);
+  }
+  std::fputc('"', file);
 }
 
-timer Profiler::get_timer(int timer) { return timers[timer]; }
+void write_csv_string(std::FILE *file, std::string const &text) {
+  std::fputc('"', file);
+  for (char c : text) {
+    if (c == '"')
+      std::fputc('"', file);
+    std::fputc(c, file);
+  }
+  std::fputc('"', file);
+}
 
-void Profiler::print_timer(int timer) {
-  std::cout << std::left << std::setw(20) << timers[timer].name
-            << "  last: " << std::setw(13) << timers[timer].delta.count()
-            << "     sum: " << std::setw(13) << timers[timer].sum.count()
-            << "     avg: " << std::setw(13) << timers[timer].avg.count()
-            << std::endl;
+std::FILE *open_output(std::string const &path) {
+  std::FILE *file = std::fopen(path.c_str(), "w");
+  if (!file)
+    throw std::runtime_error("Could not open profile output " + path);
+  return file;
 }
 
-void Profiler::stop_print(int timer) {
-  stop_timer(timer);
-  print_timer(timer);
+void close_output(std::FILE *file, std::string const &path) {
+  bool failed = std::ferror(file);
+  if (std::fclose(file) != 0 || failed)
+    throw std::runtime_error("Could not write profile output " + path);
 }
 
-void Profiler::print_all() {
-  for (int i = 0; i < index; i++) {
-    print_timer(i);
+std::atomic<std::uint64_t> next_profiler_id(1);
+
+// The profilers that exist, so that exiting threads can find their logs
+std::mutex live_profilers_mutex;
+std::unordered_map<std::uint64_t, Profiler *> live_profilers;
+
+constexpr int max_counters = 256;
+
+} // namespace
+
+struct Profiler::ThreadLog {
+  // a path through the zone tree of this thread
+  struct Node {
+    int zone;
+    int parent;
+    int depth;
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> min{UINT64_MAX};
+    std::atomic<std::uint64_t> max{0};
+  };
+
+  // a zone, as logged for the trace
+  struct Event {
+    int node;
+    std::uint64_t start;
+    std::uint64_t end;
+  };
+
+  std::thread::id thread; // the default id if the log is free
+  int index;
+
+  profiler_detail::AppendLog<Node, 256> nodes;
+  profiler_detail::AppendLog<Event, 4096> events;
+  std::atomic<std::uint64_t> dropped{0};
+  std::array<std::atomic<std::int64_t>, max_counters> counter_totals{};
+  std::array<std::atomic<std::uint64_t>, max_counters> counter_additions{};
+
+  // only used by the thread itself
+  std::vector<std::pair<int, std::uint64_t>> running; // node, start time
+  // (zone, node) of the children of each node, the roots first
+  std::vector<std::vector<std::pair<int, int>>> children{1};
+};
+
+// Hands the logs of a thread back to their profilers when it exits
+struct Profiler::ThreadExit {
+  ~ThreadExit() {
+    std::lock_guard<std::mutex> lock(live_profilers_mutex);
+    for (auto const &entry : logs) {
+      auto it = live_profilers.find(entry.first);
+      if (it != live_profilers.end())
+        it->second->release_log_(*entry.second);
+    }
+  }
+
+  std::vector<std::pair<std::uint64_t, ThreadLog *>> logs;
+};
+
+Profiler::Profiler()
+    : id_(next_profiler_id++), origin_(ticks()), origin_ns_(steady_ns()) {
+  std::lock_guard<std::mutex> lock(live_profilers_mutex);
+  live_profilers[id_] = this;
+}
+
+Profiler::~Profiler() {
+  std::lock_guard<std::mutex> lock(live_profilers_mutex);
+  live_profilers.erase(id_);
+}
+
+int Profiler::zone(std::string const &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = zone_ids_.find(name);
+  if (it != zone_ids_.end())
+    return it->second;
+  zones_.push_back(name);
+  zone_ids_[name] = zones_.size() - 1;
+  return zones_.size() - 1;
+}
+
+int Profiler::counter(std::string const &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = counter_ids_.find(name);
+  if (it != counter_ids_.end())
+    return it->second;
+  if (counters_.size() == max_counters)
+    throw std::runtime_error("Too many profiler counters");
+  counters_.push_back(name);
+  counter_ids_[name] = counters_.size() - 1;
+  step_totals_.push_back(0);
+  return counters_.size() - 1;
+}
+
+Profiler::ThreadLog &Profiler::local_log_() {
+  // the log of this thread for the profiler used last, which is usually
+  // the only one
+  thread_local std::uint64_t cached_id = 0;
+  thread_local ThreadLog *cached_log = nullptr;
+  if (cached_id == id_)
+    return *cached_log;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::thread::id thread = std::this_thread::get_id();
+  auto it = std::find_if(threads_.begin(), threads_.end(),
+                         [thread](std::unique_ptr<ThreadLog> const &log) {
+                           return log->thread == thread;
+                         });
+  if (it == threads_.end()) {
+    // take over the log of a thread that has exited, or start a new one
+    it = std::find_if(threads_.begin(), threads_.end(),
+                      [](std::unique_ptr<ThreadLog> const &log) {
+                        return log->thread == std::thread::id();
+                      });
+    if (it == threads_.end()) {
+      threads_.emplace_back(new ThreadLog);
+      threads_.back()->index = threads_.size() - 1;
+      it = threads_.end() - 1;
+    }
+    (*it)->thread = thread;
+    thread_local ThreadExit exit;
+    exit.logs.emplace_back(id_, it->get());
+  }
+  cached_id = id_;
+  cached_log = it->get();
+  return *cached_log;
+}
+
+void Profiler::release_log_(ThreadLog &log) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  log.running.clear();
+  log.thread = std::thread::id();
+}
+
+void Profiler::begin(int zone) {
+  ThreadLog &log = local_log_();
+  int parent = log.running.empty() ? -1 : log.running.back().first;
+
+  // there are usually only a few children, so a linear search is fastest
+  int node = -1;
+  auto &children = log.children[parent + 1];
+  for (auto const &child : children)
+    if (child.first == zone)
+      node = child.second;
+
+  if (node == -1) {
+    // if there is no space left, the zone is not recorded
+    if (ThreadLog::Node *added = log.nodes.next()) {
+      added->zone = zone;
+      added->parent = parent;
+      added->depth = parent == -1 ? 0 : log.nodes[parent].depth + 1;
+      log.nodes.publish();
+      node = log.nodes.size() - 1;
+      children.emplace_back(zone, node);
+      log.children.emplace_back();
+    }
   }
-  std::cout << std::endl;
+  log.running.emplace_back(node, ticks());
 }
+
+void Profiler::end() {
+  std::uint64_t now = ticks();
+  ThreadLog &log = local_log_();
+  if (log.running.empty())
+    return;
+  int node = log.running.back().first;
+  std::uint64_t start = log.running.back().second;
+  log.running.pop_back();
+  if (node == -1)
+    return;
+
+  // only this thread writes the statistics, so there is no need for
+  // read-modify-write operations
+  std::uint64_t elapsed = now - start;
+  ThreadLog::Node &stats = log.nodes[node];
+  add_relaxed<std::uint64_t>(stats.calls, 1);
+  add_relaxed(stats.total, elapsed);
+  if (elapsed < stats.min.load(std::memory_order_relaxed))
+    stats.min.store(elapsed, std::memory_order_relaxed);
+  if (elapsed > stats.max.load(std::memory_order_relaxed))
+    stats.max.store(elapsed, std::memory_order_relaxed);
+
+  ThreadLog::Event *event = nullptr;
+  if (log.events.size() < max_trace_events_.load(std::memory_order_relaxed))
+    event = log.events.next();
+  if (event) {
+    *event = {node, start, now};
+    log.events.publish();
+  } else {
+    add_relaxed<std::uint64_t>(log.dropped, 1);
+  }
+}
+
+void Profiler::count(int counter, std::int64_t amount) {
+  ThreadLog &log = local_log_();
+  add_relaxed(log.counter_totals[counter], amount);
+  add_relaxed<std::uint64_t>(log.counter_additions[counter], 1);
+}
+
+void Profiler::end_step() {
+  bool print;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::uint64_t now = ticks();
+    for (std::size_t c = 0; c < counters_.size(); ++c) {
+      std::int64_t total = 0;
+      for (auto const &log : threads_)
+        total += log->counter_totals[c].load(std::memory_order_relaxed);
+      samples_.push_back({now, static_cast<int>(c), total - step_totals_[c]});
+      step_totals_[c] = total;
+    }
+    ++steps_;
+    print = print_interval_ > 0 && steps_ % print_interval_ == 0;
+  }
+  if (print)
+    print_summary(std::cerr);
+}
+
+void Profiler::set_print_interval(int steps) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  print_interval_ = steps;
+}
+
+void Profiler::set_max_trace_events(std::size_t events) {
+  max_trace_events_.store(events, std::memory_order_relaxed);
+}
+
+std::uint64_t Profiler::steps() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return steps_;
+}
+
+double Profiler::seconds_(std::uint64_t ticks_) const {
+#ifdef PROFILER_USE_TSC
+  // calibrate against the steady clock over the run so far
+  double ns_per_tick = static_cast<double>(steady_ns() - origin_ns_) /
+                       static_cast<double>(ticks() - origin_);
+  return ticks_ * ns_per_tick * 1e-9;
+#else
+  return ticks_ * 1e-9;
+#endif
+}
+
+std::vector<Profiler::ZoneSummary> Profiler::zone_summary() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  struct Merged {
+    ZoneSummary summary;
+    std::uint64_t children = 0;
+    std::uint64_t total = 0;
+    std::uint64_t min = UINT64_MAX;
+    std::uint64_t max = 0;
+  };
+  std::map<std::string, Merged, decltype(&path_less)> merged(&path_less);
+
+  for (auto const &log : threads_) {
+    std::size_t n_nodes = log->nodes.size();
+    std::vector<std::string> paths(n_nodes);
+    for (std::size_t i = 0; i < n_nodes; ++i) {
+      auto const &node = log->nodes[i];
+      std::string const &name = zones_[node.zone];
+      paths[i] = node.parent == -1 ? name : paths[node.parent] + "/" + name;
+
+      std::uint64_t calls = node.calls.load(std::memory_order_relaxed);
+      if (calls == 0)
+        continue;
+      std::uint64_t total = node.total.load(std::memory_order_relaxed);
+      Merged &m = merged[paths[i]];
+      m.summary.path = paths[i];
+      m.summary.depth = node.depth;
+      m.summary.calls += calls;
+      m.summary.threads += 1;
+      m.total += total;
+      m.min = std::min(m.min, node.min.load(std::memory_order_relaxed));
+      m.max = std::max(m.max, node.max.load(std::memory_order_relaxed));
+      if (node.parent != -1)
+        merged[paths[node.parent]].children += total;
+    }
+  }
+
+  std::vector<ZoneSummary> result;
+  for (auto &entry : merged) {
+    Merged &m = entry.second;
+    // a parent that was still running has no calls yet
+    if (m.summary.calls == 0)
+      continue;
+    m.summary.total = seconds_(m.total);
+    m.summary.self = seconds_(m.total - std::min(m.total, m.children));
+    m.summary.min = seconds_(m.min);
+    m.summary.max = seconds_(m.max);
+    result.push_back(m.summary);
+  }
+  return result;
+}
+
+std::vector<Profiler::CounterSummary> Profiler::counter_summary() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<CounterSummary> result;
+  for (std::size_t c = 0; c < counters_.size(); ++c) {
+    CounterSummary summary{counters_[c], 0, 0};
+    for (auto const &log : threads_) {
+      summary.total += log->counter_totals[c].load(std::memory_order_relaxed);
+      summary.additions +=
+          log->counter_additions[c].load(std::memory_order_relaxed);
+    }
+    result.push_back(summary);
+  }
+  return result;
+}
+
+std::uint64_t Profiler::dropped_events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::uint64_t dropped = 0;
+  for (auto const &log : threads_)
+    dropped += log->dropped.load(std::memory_order_relaxed);
+  return dropped;
+}
+
+void Profiler::print_summary(std::ostream &out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  out << std::left << std::setw(40) << "zone" << std::right << std::setw(10)
+      << "calls" << std::setw(13) << "total (s)" << std::setw(13)
+      << "self (s)" << std::setw(13) << "mean (s)" << std::setw(13)
+      << "max (s)" << '\n';
+  for (ZoneSummary const &zone : zone_summary()) {
+    std::string name = zone.path.substr(zone.path.find_last_of('/') + 1);
+    out << std::left << std::setw(40)
+        << std::string(2 * zone.depth, ' ') + name << std::right
+        << std::setw(10) << zone.calls << std::setw(13) << zone.total
+        << std::setw(13) << zone.self << std::setw(13)
+        << zone.total / zone.calls << std::setw(13) << zone.max << '\n';
+  }
+  for (CounterSummary const &counter : counter_summary()) {
+    out << std::left << std::setw(40) << counter.name << std::right
+        << std::setw(10) << counter.additions << std::setw(13)
+        << counter.total << std::setw(13) << ' ' << std::setw(13)
+        << (counter.additions ? static_cast<double>(counter.total) /
+                                    counter.additions
+                              : 0.0)
+        << '\n';
+  }
+  out << std::endl;
+  out.flags(flags);
+}
+
+void Profiler::write_chrome_trace(std::string const &path) const {
+  std::FILE *file = open_output(path);
+  std::fprintf(file, "{\"traceEvents\":[\n");
+  bool first = true;
+  auto separator = [&]() {
+    if (!first)
+      std::fprintf(file, ",\n");
+    first = false;
+  };
+
+  std::uint64_t dropped = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const &log : threads_) {
+      separator();
+      std::fprintf(file,
+                   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                   log->index, log->index);
+
+      std::size_t n_events = log->events.size();
+      for (std::size_t i = 0; i < n_events; ++i) {
+        auto const &event = log->events[i];
+        separator();
+        std::fprintf(file, "{\"name\":");
+        write_json_string(file, zones_[log->nodes[event.node].zone]);
+        std::fprintf(file,
+                     ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+                     "\"dur\":%.3f}",
+                     log->index, seconds_(event.start - origin_) * 1e6,
+                     seconds_(event.end - event.start) * 1e6);
+      }
+      dropped += log->dropped.load(std::memory_order_relaxed);
+    }
+
+    // counters, as the amount added in each step
+    for (CounterSample const &sample : samples_) {
+      separator();
+      std::fprintf(file, "{\"name\":");
+      write_json_string(file, counters_[sample.counter]);
+      std::fprintf(file,
+                   ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+                   "\"args\":{\"value\":%lld}}",
+                   seconds_(sample.time - origin_) * 1e6,
+                   static_cast<long long>(sample.value));
+    }
+  }
+
+  std::fprintf(file,
+               "\n],\"displayTimeUnit\":\"ms\","
+               "\"otherData\":{\"dropped_events\":%llu}}\n",
+               static_cast<unsigned long long>(dropped));
+  close_output(file, path);
+}
+
+void Profiler::write_summary_csv(std::string const &path) const {
+  std::vector<ZoneSummary> zones = zone_summary();
+  std::vector<CounterSummary> counters = counter_summary();
+
+  std::FILE *file = open_output(path);
+  std::fprintf(file, "kind,name,depth,count,total,self,mean,min,max\n");
+  for (ZoneSummary const &zone : zones) {
+    std::fprintf(file, "zone,");
+    write_csv_string(file, zone.path);
+    std::fprintf(file, ",%d,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", zone.depth,
+                 static_cast<unsigned long long>(zone.calls),
+                 zone.total * 1e6, zone.self * 1e6,
+                 zone.total / zone.calls * 1e6, zone.min * 1e6,
+                 zone.max * 1e6);
+  }
+  for (CounterSummary const &counter : counters) {
+    std::fprintf(file, "counter,");
+    write_csv_string(file, counter.name);
+    std::fprintf(file, ",0,%llu,%lld,,%.3f,,\n",
+                 static_cast<unsigned long long>(counter.additions),
+                 static_cast<long long>(counter.total),
+                 counter.additions ? static_cast<double>(counter.total) /
+                                         counter.additions
+                                   : 0.0);
+  }
+  close_output(file, path);
+}
+
+#ifdef PROFILING_ENABLED
+Profiler profiler;
+
+extern Parameter par;
+
+namespace {
+
+void write_profile() {
+  // unless it was just printed
+  int interval = par.profile_print_interval;
+  if (interval == 0 || profiler.steps() % interval != 0)
+    profiler.print_summary(std::cerr);
+  if (par.profile_output == "None")
+    return;
+  try {
+    profiler.write_chrome_trace(par.profile_output + ".json");
+    profiler.write_summary_csv(par.profile_output + ".csv");
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
+} // namespace
+
+void profile_end_step() {
+  static bool configured = [] {
+    profiler.set_print_interval(par.profile_print_interval);
+    std::atexit(write_profile);
+    return true;
+  }();
+  (void)configured;
+  profiler.end_step();
+}
+#endif
@@ -1,44 +1,221 @@
-#include <chrono>
-#include <iostream>
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+/* Instrumentation macros
+ *
+ * PROFILE_ZONE(name)   times the rest of the enclosing scope as zone name
+ * PROFILE(name, code)  times code as zone name
+ * PROFILE_COUNT(name, n) adds n to counter name
+ * PROFILE_PRINT        marks the end of a time step, see profile_end_step()
+ *
+ * Zones started while another zone is running on the same thread are nested
+ * in it. Without PROFILING_ENABLED, the macros compile to nothing (PROFILE
+ * to just the code, in a block of its own either way), so they can be left in
+ * hot loops.
+ */
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
 #ifdef PROFILING_ENABLED
+#define PROFILE_ZONE(name)                                                     \
+  static const int PROFILE_CONCAT(profile_zone_id_, __LINE__) =                \
+      profiler.zone(#name);                                                    \
+  ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(                         \
+      profiler, PROFILE_CONCAT(profile_zone_id_, __LINE__));
 #define PROFILE(a, b)                                                          \
-  static int a = profiler.new_timer(#a);                                       \
-  profiler.start_timer(a);                                                     \
-  b profiler.stop_timer(a);
-#define PROFILE_PRINT profiler.print_all();
+  {                                                                            \
+    PROFILE_ZONE(a)                                                            \
+    b                                                                          \
+  }
+#define PROFILE_COUNT(a, n)                                                    \
+  {                                                                            \
+    static const int a = profiler.counter(#a);                                 \
+    profiler.count(a, n);                                                      \
+  }
+#define PROFILE_PRINT profile_end_step();
 #else
-#define PROFILE(a, b) b
+#define PROFILE_ZONE(name)
+#define PROFILE(a, b)                                                          \
+  {                                                                            \
+    b                                                                          \
+  }
+#define PROFILE_COUNT(a, n)
 #define PROFILE_PRINT
 #endif
 
-struct timer {
-  std::string name;
-  std::chrono::time_point<std::chrono::system_clock> start;
-  std::chrono::time_point<std::chrono::system_clock> stop;
-  std::chrono::duration<double> delta;
-  std::chrono::duration<double> sum;
-  std::chrono::duration<double> avg;
-  int count;
+/** Records how long zones of code take, and counts events
+ *
+ * Every thread records into its own buffers, so recording takes no locks and
+ * threads do not slow each other down. Zones are kept as a tree per thread,
+ * with the number of calls and the total, minimum and maximum time of each
+ * path through the tree. In addition, the start and end of every zone are
+ * logged for the trace, up to a maximum number per thread.
+ *
+ * When a thread exits, its buffers are handed to the next thread that starts
+ * recording. Threads that are started over and over again, such as workers
+ * that live for a single time step, therefore share buffers rather than use
+ * ever more memory, and appear in the results as one thread.
+ *
+ * The results of all threads are merged when they are read, which may
+ * happen while other threads are still recording. Zones that are still
+ * running are not included.
+ *
+ * Times are taken from std::chrono::steady_clock, or from the time stamp
+ * counter of the CPU if PROFILING_TSC is defined on x86. The latter is
+ * cheaper to read, and is converted to time using the steady clock.
+ */
+class Profiler {
+public:
+  /// Summary of a zone, merged over all threads. Times are in s.
+  struct ZoneSummary {
+    std::string path; // names of the enclosing zones and this one, with /
+    int depth;
+    std::uint64_t calls;
+    double total;
+    double self; // total minus the time spent in nested zones
+    double min;
+    double max;
+    int threads; // number of thread buffers the zone was recorded in
+  };
+
+  /// Summary of a counter, merged over all threads
+  struct CounterSummary {
+    std::string name;
+    std::int64_t total;
+    std::uint64_t additions;
+  };
+
+  Profiler();
+  ~Profiler();
+
+  Profiler(Profiler const &) = delete;
+  Profiler &operator=(Profiler const &) = delete;
+
+  /// Return the id of the zone with the given name, creating it if needed.
+  int zone(std::string const &name);
+
+  /// Return the id of the counter with the given name, creating it if needed.
+  int counter(std::string const &name);
+
+  /// Start zone on this thread, see also ProfileZone.
+  void begin(int zone);
+
+  /// End the innermost running zone on this thread.
+  void end();
+
+  /// Add amount to counter, on this thread.
+  void count(int counter, std::int64_t amount);
+
+  /** Mark the end of a time step
+   *
+   * Records how much each counter went up during the step, for the trace,
+   * and prints the summary to std::cerr if the print interval has passed.
+   */
+  void end_step();
+
+  /// Print the summary every steps calls to end_step(), 0 to never.
+  void set_print_interval(int steps);
+
+  /// Set the maximum number of zones logged for the trace per thread.
+  void set_max_trace_events(std::size_t events);
+
+  /// Return the number of calls to end_step() so far.
+  std::uint64_t steps() const;
+
+  /// Return the zones, ordered so that every zone follows its parent.
+  std::vector<ZoneSummary> zone_summary() const;
+
+  /// Return the counters, in the order they were created.
+  std::vector<CounterSummary> counter_summary() const;
+
+  /// Return the number of zones that were not logged for the trace.
+  std::uint64_t dropped_events() const;
+
+  /// Print the zones and counters as a table.
+  void print_summary(std::ostream &out) const;
+
+  /** Write the logged zones and counters in Chrome trace format
+   *
+   * The file can be opened in chrome://tracing or ui.perfetto.dev.
+   *
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  void write_chrome_trace(std::string const &path) const;
+
+  /** Write the summary as CSV
+   *
+   * The columns are kind (zone or counter), name, depth, count, total, self,
+   * mean, min and max. For zones, the name is the path, count is the number
+   * of calls and the times are in microseconds. For counters, count is the
+   * number of additions, total their sum and mean the average addition.
+   *
+   * @throws std::runtime_error if the file cannot be written.
+   */
+  void write_summary_csv(std::string const &path) const;
+
+private:
+  struct ThreadLog;
+  struct ThreadExit;
+  struct CounterSample {
+    std::uint64_t time;
+    int counter;
+    std::int64_t value;
+  };
+
+  ThreadLog &local_log_();
+  void release_log_(ThreadLog &log);
+  double seconds_(std::uint64_t ticks) const;
+
+  std::uint64_t id_;
+  std::uint64_t origin_;
+  std::uint64_t origin_ns_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadLog>> threads_;
+  std::vector<std::string> zones_;
+  std::unordered_map<std::string, int> zone_ids_;
+  std::vector<std::string> counters_;
+  std::unordered_map<std::string, int> counter_ids_;
+  std::vector<std::int64_t> step_totals_;
+  std::vector<CounterSample> samples_;
+  std::uint64_t steps_ = 0;
+  int print_interval_ = 0;
+  std::atomic<std::size_t> max_trace_events_{1 << 20};
 };
 
-class Profiler {
+/// Times the scope it lives in as a zone.
+class ProfileZone {
 public:
-  int start_new_timer(std::string name);
-  int new_timer(std::string name);
-  void start_timer(int timer);
-  void stop_timer(int timer);
-  void stop_print(int timer);
-  timer get_timer(int timer);
-  void print_timer(int timer);
-  void print_all();
+  ProfileZone(Profiler &profiler, int zone) : profiler_(profiler) {
+    profiler_.begin(zone);
+  }
+  ~ProfileZone() { profiler_.end(); }
+
+  ProfileZone(ProfileZone const &) = delete;
+  ProfileZone &operator=(ProfileZone const &) = delete;
 
 private:
-  std::vector<timer> timers;
-  int index;
+  Profiler &profiler_;
 };
 
 #ifdef PROFILING_ENABLED
 extern Profiler profiler;
+
+/** End a time step of the global profiler
+ *
+ * The first call reads profile_print_interval and profile_output from the
+ * parameters. At exit, the summary is printed, and if profile_output is set,
+ * the trace and the summary are written to <profile_output>.json and
+ * <profile_output>.csv.
+ */
+void profile_end_step();
 #endif
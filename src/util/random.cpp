@@ -21,6 +21,7 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 
 */
 #include "random.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
@@ -31,13 +32,19 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 
 static long idum = -1;
 
+/* State of RANDOM(), at file scope so that it can be saved and restored */
+static int inext, inextp;
+static long ma[56];
+static int iff = 0;
+
+/* State of generateGaussianNoise() */
+static thread_local double gaussian_z1;
+static thread_local bool gaussian_generate;
+
 /*! \return A random double between 0 and 1
  **/
 double RANDOM(void) {
   /* Knuth's substractive method, see Numerical Recipes */
-  static int inext, inextp;
-  static long ma[56];
-  static int iff = 0;
   long mj, mk;
   int i, ii, k;
 
@@ -145,12 +152,10 @@ double generateGaussianNoise(double mu, double sigma) {
   static const double epsilon = std::numeric_limits<double>::min();
   static const double two_pi = 2.0 * 3.14159265358979323846;
 
-  thread_local double z1;
-  thread_local bool generate;
-  generate = !generate;
+  gaussian_generate = !gaussian_generate;
 
-  if (!generate)
-    return z1 * sigma + mu;
+  if (!gaussian_generate)
+    return gaussian_z1 * sigma + mu;
 
   double u1, u2;
   do {
@@ -160,6 +165,32 @@ double generateGaussianNoise(double mu, double sigma) {
 
   double z0;
   z0 = sqrt(-2.0 * log(u1)) * cos(two_pi * u2);
-  z1 = sqrt(-2.0 * log(u1)) * sin(two_pi * u2);
+  gaussian_z1 = sqrt(-2.0 * log(u1)) * sin(two_pi * u2);
   return z0 * sigma + mu;
 }
+
+/*! \return The current state of the random number generator
+**/
+RandomState GetRandomState(void) {
+  RandomState state{};
+  state.idum = idum;
+  state.iff = iff;
+  state.inext = inext;
+  state.inextp = inextp;
+  std::copy(ma, ma + 56, state.ma);
+  state.gaussian_generate = gaussian_generate;
+  state.gaussian_z1 = gaussian_z1;
+  return state;
+}
+
+/*! \param state A state obtained from GetRandomState()
+**/
+void SetRandomState(const RandomState &state) {
+  idum = state.idum;
+  iff = state.iff;
+  inext = state.inext;
+  inextp = state.inextp;
+  std::copy(state.ma, state.ma + 56, ma);
+  gaussian_generate = state.gaussian_generate;
+  gaussian_z1 = state.gaussian_z1;
+}
@@ -20,6 +20,9 @@ Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 02110-1301 USA
 
 */
+#ifndef _RANDOM_HPP_
+#define _RANDOM_HPP_
+
 #define MBIG 1000000000
 #define MSEED 161803398
 #define MZ 0
@@ -31,3 +34,24 @@ long RandomNumber(long max);
 void AskSeed();
 long Randomize(void);
 double generateGaussianNoise(double mu, double sigma);
+
+/*! \brief The complete state of the random number generator
+
+  Used to save and restore the generator in checkpoints, so that a restarted
+  simulation continues with the same random numbers. The state of
+  generateGaussianNoise() is that of the calling thread.
+*/
+struct RandomState {
+  long idum;
+  int iff;
+  int inext;
+  int inextp;
+  long ma[56];
+  bool gaussian_generate;
+  double gaussian_z1;
+};
+
+RandomState GetRandomState(void);
+void SetRandomState(const RandomState &state);
+
+#endif
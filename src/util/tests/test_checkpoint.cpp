@@ -0,0 +1,143 @@
+// Load the code to be tested
+#include "checkpoint.cpp"
+#include "random.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string const test_file = "build/test_checkpoint.tst";
+
+bool file_exists(std::string const &path)
+{
+    return std::ifstream(path).good();
+}
+
+} // namespace
+
+TEST_CASE("Checkpoint round trip", "[checkpoint]")
+{
+    std::vector<std::array<int, 2>> pixels = {{1, 2}, {3, 4}, {5, 6}};
+    std::vector<double> empty;
+
+    {
+        CheckpointWriter writer(test_file);
+        writer.begin_section("ONE ");
+        writer.write<int32_t>(42);
+        writer.write(2.5);
+        writer.write_vector(pixels);
+        writer.write_vector(empty);
+        writer.end_section();
+
+        // starting a section ends the previous one
+        writer.begin_section("TWO ");
+        writer.write_string("hello");
+        writer.begin_section("NIL ");
+        writer.commit();
+    }
+    REQUIRE(!file_exists(test_file + ".tmp"));
+
+    CheckpointReader reader(test_file);
+    REQUIRE(reader.version() == checkpoint_version);
+    REQUIRE(reader.has_section("ONE "));
+    REQUIRE(reader.has_section("NIL "));
+    REQUIRE(!reader.has_section("FOUR"));
+
+    // sections can be read in any order
+    reader.begin_section("TWO ");
+    REQUIRE(reader.read_string() == "hello");
+    reader.end_section();
+
+    reader.begin_section("ONE ");
+    REQUIRE(reader.read<int32_t>() == 42);
+    REQUIRE(reader.read<double>() == 2.5);
+    REQUIRE(reader.read_vector<std::array<int, 2>>() == pixels);
+    REQUIRE(reader.read_vector<double>().empty());
+    reader.end_section();
+
+    reader.begin_section("NIL ");
+    reader.end_section();
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("Checkpoint reads are checked", "[checkpoint]")
+{
+    {
+        CheckpointWriter writer(test_file);
+        writer.begin_section("DATA");
+        writer.write<int32_t>(1);
+        writer.write<int32_t>(2);
+        writer.commit();
+    }
+
+    CheckpointReader reader(test_file);
+    REQUIRE_THROWS_AS(reader.begin_section("MISS"), std::runtime_error);
+
+    reader.begin_section("DATA");
+    REQUIRE(reader.read<int32_t>() == 1);
+    REQUIRE_THROWS_AS(reader.end_section(), std::runtime_error);
+    REQUIRE(reader.read<int32_t>() == 2);
+    REQUIRE_THROWS_AS(reader.read<int32_t>(), std::runtime_error);
+    reader.end_section();
+
+    reader.begin_section("DATA");
+    REQUIRE_THROWS_AS(reader.read_vector<double>(), std::runtime_error);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("Uncommitted checkpoints are discarded", "[checkpoint]")
+{
+    std::remove(test_file.c_str());
+    {
+        CheckpointWriter writer(test_file);
+        writer.begin_section("DATA");
+        writer.write<int32_t>(1);
+        REQUIRE(file_exists(test_file + ".tmp"));
+    }
+    REQUIRE(!file_exists(test_file + ".tmp"));
+    REQUIRE(!file_exists(test_file));
+}
+
+TEST_CASE("Invalid checkpoints are rejected", "[checkpoint]")
+{
+    REQUIRE_THROWS_AS(CheckpointReader("build/does_not_exist.tst"),
+                      std::runtime_error);
+
+    std::ofstream(test_file) << "This is not a checkpoint";
+    REQUIRE_THROWS_AS(CheckpointReader(test_file), std::runtime_error);
+
+    std::remove(test_file.c_str());
+}
+
+TEST_CASE("Random state round trip", "[checkpoint]")
+{
+    Seed(12345);
+    RANDOM();
+    generateGaussianNoise(0.0, 1.0);
+
+    RandomState state = GetRandomState();
+    std::vector<double> expected;
+    for (int i = 0; i < 10; ++i)
+    {
+        expected.push_back(RANDOM());
+        expected.push_back(generateGaussianNoise(0.0, 1.0));
+    }
+
+    Seed(1);
+    SetRandomState(state);
+    for (int i = 0; i < 10; ++i)
+    {
+        REQUIRE(RANDOM() == expected[2 * i]);
+        REQUIRE(generateGaussianNoise(0.0, 1.0) == expected[2 * i + 1]);
+    }
+}
@@ -0,0 +1,275 @@
+// Load the code to be tested, and what it needs
+#include "inputoutput.cpp"
+#include "adhesion_index.cpp"
+#include "adhesion_mover.cpp"
+#include "adhesion_movement.cpp"
+#include "ca.cpp"
+#include "cell.cpp"
+#include "cell_ecm_interactions.cpp"
+#include "checkpoint.cpp"
+#include "crash.cpp"
+#include "ecm_boundary_state.cpp"
+#include "ecm_interaction_tracker.cpp"
+#include "hull.cpp"
+#include "lattice_memory.cpp"
+#include "move_statistics.cpp"
+#include "neighbours.cpp"
+#include "observables.cpp"
+#include "output_writer.cpp"
+#include "parameter_file.cpp"
+#include "parameter.cpp"
+#include "random.cpp"
+#include "spin_lattice.cpp"
+#include "tile_index.cpp"
+#include "vec2.cpp"
+#include "warning.cpp"
+#include "worker_pool.cpp"
+
+// A bare dish that holds the lattice, and that the cells ask for the time
+Dish::Dish(bool) {}
+Dish::~Dish() {}
+int Dish::Time(void) const { return 0; }
+
+// IO can also write trajectories, which is tested in test_trajectory.cpp
+TrajectoryWriter::TrajectoryWriter(std::string const &, int, int, int,
+                                   TrajectoryPDE, int)
+    : writer_(0, 1) {}
+TrajectoryWriter::~TrajectoryWriter() {}
+void TrajectoryWriter::begin_frame(int) {}
+void TrajectoryWriter::set_cells(std::vector<TrajectoryCell> const &) {}
+void TrajectoryWriter::end_frame() {}
+void TrajectoryWriter::close() {}
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string const json_file = "build/test_inputoutput.json";
+std::string const sidecar_file = json_file + ".bin";
+
+/* A lattice with an IO object to read configurations into it. */
+struct Reader {
+    Reader() : ca(&cells, par.sizex, par.sizey), io(dish) {
+        dish.CPM = &ca;
+        cells.push_back(Cell(dish, 0));
+    }
+
+    /* Read par.initial_configuration_file, and return the error, if any. */
+    std::string read() {
+        try {
+            io.ReadConfiguration();
+        } catch (const char *error) {
+            std::string message(error);
+            free((void *)error);
+            return message;
+        }
+        return "";
+    }
+
+    std::vector<int> sigma() const {
+        std::vector<int> buffer;
+        const int *spins = ca.SigmaInts(buffer);
+        return std::vector<int>(spins, spins + par.sizex * par.sizey);
+    }
+
+    Dish dish;
+    std::vector<Cell> cells;
+    CellularPotts ca;
+    IO io;
+};
+
+void set_up(bool sidecar)
+{
+    par = Parameter();
+    par.Jtable = "../../../data/J.dat";
+    par.sizex = 4;
+    par.sizey = 3;
+    par.initial_configuration_file = json_file;
+    par.configuration_sidecar = sidecar;
+    Quiet = 1;
+    remove(json_file.c_str());
+    remove(sidecar_file.c_str());
+}
+
+void write_file(std::string const &path, std::string const &contents)
+{
+    std::ofstream(path, std::ios::binary) << contents;
+}
+
+std::string read_file(std::string const &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+void set_mtime(std::string const &path, time_t seconds)
+{
+    struct timespec times[2] = {{seconds, 0}, {seconds, 0}};
+    REQUIRE(utimensat(AT_FDCWD, path.c_str(), times, 0) == 0);
+}
+
+std::vector<int> const sigma_a = {1, 1, 0, 1, 2, 0, 0, 2, 2, 0, 0, 0};
+std::vector<int> const sigma_b = {0, 0, 0, 2, 2, 0, 1, 1, 0, 1, 1, 0};
+std::vector<int> const tau = {1, 2};
+
+} // namespace
+
+
+TEST_CASE("Configurations are written like json::dump()", "[inputoutput]")
+{
+    // large enough to need more than one buffer
+    std::vector<int> sigma(400000);
+    for (std::size_t i = 0; i < sigma.size(); i++)
+        sigma[i] = (i * 7919) % 100003 - 3;
+    std::vector<int> types = {1, -2, 2147483647, -2147483647 - 1};
+
+    WriteJSONConfiguration(json_file, sigma.data(), sigma.size(), types);
+    REQUIRE(read_file(json_file) == json({{"sigma", sigma}, {"tau", types}}).dump());
+
+    WriteJSONConfiguration(json_file, nullptr, 0, {});
+    REQUIRE(read_file(json_file) == R"({"sigma":[],"tau":[]})");
+}
+
+
+TEST_CASE("Configuration parse errors", "[inputoutput]")
+{
+    set_up(false);
+    Reader reader;
+
+    SECTION("invalid json") {
+        write_file(json_file, R"({"sigma":[1,2,)");
+        REQUIRE(reader.read().find("parse error") != std::string::npos);
+    }
+
+    SECTION("values that are not integers") {
+        write_file(json_file, R"({"sigma":[1,2,0.5,0,0,0,0,0,0,0,0,0],"tau":[1,2]})");
+        REQUIRE(reader.read().find("sigma contains a value that is not an integer") !=
+                std::string::npos);
+        write_file(json_file, R"({"sigma":[0,0,0,0,0,0,0,0,0,0,0,0],"tau":[[1]]})");
+        REQUIRE(reader.read().find("tau contains a value") != std::string::npos);
+    }
+
+    SECTION("missing arrays") {
+        write_file(json_file, R"({"sigma":[0,0,0,0,0,0,0,0,0,0,0,0]})");
+        REQUIRE(reader.read().find("sigma or tau is missing") != std::string::npos);
+    }
+
+    SECTION("a sigma of the wrong size") {
+        write_file(json_file, R"({"sigma":[0,0,0],"tau":[]})");
+        REQUIRE(reader.read().find("does not match the lattice size") !=
+                std::string::npos);
+        write_file(json_file, R"({"sigma":[0,0,0,0,0,0,0,0,0,0,0,0,0],"tau":[]})");
+        REQUIRE(reader.read().find("more values than the lattice has sites") !=
+                std::string::npos);
+    }
+
+    SECTION("too few cell types") {
+        write_file(json_file, R"({"sigma":[1,2,0,0,0,0,0,0,0,0,0,0],"tau":[1]})");
+        REQUIRE(reader.read().find("tau has fewer entries") != std::string::npos);
+    }
+
+    SECTION("a binary configuration of another size") {
+        WriteBinaryConfiguration(sidecar_file, sigma_a.data(), 3, 4, tau);
+        par.initial_configuration_file = sidecar_file;
+        REQUIRE(reader.read().find("the lattice size does not match") !=
+                std::string::npos);
+    }
+}
+
+
+TEST_CASE("Configuration round trip", "[inputoutput]")
+{
+    set_up(true);
+    WriteJSONConfiguration(json_file, sigma_a.data(), sigma_a.size(), tau);
+    std::string original = read_file(json_file);
+
+    {
+        Reader reader;
+        REQUIRE(reader.read() == "");
+        REQUIRE(reader.sigma() == sigma_a);
+    }
+    REQUIRE(read_file(sidecar_file).size() > 0);
+
+    // read the binary configuration itself, and write it back as json
+    par.initial_configuration_file = sidecar_file;
+    Reader reader;
+    REQUIRE(reader.read() == "");
+    REQUIRE(reader.sigma() == sigma_a);
+    REQUIRE(reader.cells.size() == 3);
+    REQUIRE(reader.cells[1].getTau() == 1);
+    REQUIRE(reader.cells[2].getTau() == 2);
+
+    std::vector<int> types;
+    for (std::size_t i = 1; i < reader.cells.size(); i++)
+        types.push_back(reader.cells[i].getTau());
+    WriteJSONConfiguration(json_file, reader.sigma().data(), sigma_a.size(), types);
+    REQUIRE(read_file(json_file) == original);
+}
+
+
+TEST_CASE("Configuration sidecars", "[inputoutput]")
+{
+    set_up(true);
+
+    // a sidecar for configuration a, next to a json file with configuration b
+    WriteBinaryConfiguration(sidecar_file, sigma_a.data(), 4, 3, tau);
+    WriteJSONConfiguration(json_file, sigma_b.data(), sigma_b.size(), tau);
+
+    SECTION("are used when current") {
+        set_mtime(json_file, 1000);
+        set_mtime(sidecar_file, 2000);
+        Reader reader;
+        REQUIRE(reader.read() == "");
+        REQUIRE(reader.sigma() == sigma_a);
+    }
+
+    SECTION("are not used when disabled") {
+        set_mtime(json_file, 1000);
+        set_mtime(sidecar_file, 2000);
+        par.configuration_sidecar = false;
+        Reader reader;
+        REQUIRE(reader.read() == "");
+        REQUIRE(reader.sigma() == sigma_b);
+        REQUIRE(read_file(sidecar_file).size() > 0);
+    }
+
+    SECTION("are replaced when stale") {
+        set_mtime(json_file, 2000);
+        set_mtime(sidecar_file, 1000);
+        {
+            Reader reader;
+            REQUIRE(reader.read() == "");
+            REQUIRE(reader.sigma() == sigma_b);
+        }
+
+        par.initial_configuration_file = sidecar_file;
+        Reader reader;
+        REQUIRE(reader.read() == "");
+        REQUIRE(reader.sigma() == sigma_b);
+    }
+
+    SECTION("are replaced when truncated") {
+        std::string sidecar = read_file(sidecar_file);
+        write_file(sidecar_file, sidecar.substr(0, sidecar.size() / 2));
+        set_mtime(json_file, 1000);
+        set_mtime(sidecar_file, 2000);
+        {
+            Reader reader;
+            REQUIRE(reader.read() == "");
+            REQUIRE(reader.sigma() == sigma_b);
+            REQUIRE(reader.cells.size() == 3);
+        }
+
+        par.initial_configuration_file = sidecar_file;
+        Reader reader;
+        REQUIRE(reader.read() == "");
+        REQUIRE(reader.sigma() == sigma_b);
+    }
+}
@@ -0,0 +1,89 @@
+// Load the code to be tested
+#include "output_writer.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Jobs run immediately without threads", "[output_writer]")
+{
+    OutputWriter writer(0, 1);
+    int runs = 0;
+    writer.submit([&runs]() { ++runs; });
+    REQUIRE(runs == 1);
+    writer.flush();
+    REQUIRE(writer.stall_time() == 0.0);
+}
+
+TEST_CASE("Jobs run in the background", "[output_writer]")
+{
+    std::atomic<int> runs(0);
+    {
+        OutputWriter writer(2, 3);
+        for (int i = 0; i < 10; ++i)
+            writer.submit([&runs]() { ++runs; });
+        writer.flush();
+        REQUIRE(runs == 10);
+
+        for (int i = 0; i < 5; ++i)
+            writer.submit([&runs]() { ++runs; });
+    }
+    // destruction waits for the remaining jobs
+    REQUIRE(runs == 15);
+}
+
+TEST_CASE("Submitting waits for a free slot", "[output_writer]")
+{
+    OutputWriter writer(1, 1);
+    std::atomic<bool> release(false);
+    writer.submit([&release]() {
+        while (!release)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+
+    std::thread releaser([&release]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release = true;
+    });
+    writer.submit([]() {});
+    releaser.join();
+
+    REQUIRE(writer.stall_time() > 0.02);
+    writer.flush();
+}
+
+TEST_CASE("Failing jobs do not stop the writer", "[output_writer]")
+{
+    OutputWriter writer(1, 2);
+    int runs = 0;
+    writer.submit([]() { throw std::runtime_error("test failure"); });
+    writer.submit([]() { throw "test failure"; });
+    writer.submit([&runs]() { ++runs; });
+    writer.flush();
+    REQUIRE(runs == 1);
+}
+
+TEST_CASE("Buffers are reused", "[output_writer]")
+{
+    OutputWriter writer(1, 2);
+
+    OutputWriter::Buffer buffer = writer.buffer(100);
+    REQUIRE(buffer->size() == 100);
+    unsigned char const *data = buffer->data();
+
+    writer.submit([buffer]() {});
+    buffer.reset();
+    writer.flush();
+
+    OutputWriter::Buffer again = writer.buffer(50);
+    REQUIRE(again->size() == 50);
+    REQUIRE(again->data() == data);
+
+    OutputWriter::Buffer other = writer.buffer(50);
+    REQUIRE(other->data() != data);
+}
@@ -0,0 +1,277 @@
+// Load the code to be tested
+#include "profiler.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string read_file(std::string const &path)
+{
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+std::size_t occurrences(std::string const &text, std::string const &what)
+{
+    std::size_t n = 0;
+    for (auto pos = text.find(what); pos != std::string::npos;
+         pos = text.find(what, pos + 1))
+        ++n;
+    return n;
+}
+
+}
+
+TEST_CASE("Nested zones form a tree", "[profiler]")
+{
+    Profiler profiler;
+    int outer = profiler.zone("outer");
+    int inner = profiler.zone("inner");
+    REQUIRE(profiler.zone("outer") == outer);
+
+    for (int i = 0; i < 3; ++i) {
+        ProfileZone o(profiler, outer);
+        for (int j = 0; j < 2; ++j) {
+            ProfileZone n(profiler, inner);
+        }
+    }
+    {
+        // the same zone elsewhere in the tree is counted separately
+        ProfileZone n(profiler, inner);
+    }
+
+    auto zones = profiler.zone_summary();
+    REQUIRE(zones.size() == 3);
+    REQUIRE(zones[0].path == "inner");
+    REQUIRE(zones[0].calls == 1);
+    REQUIRE(zones[1].path == "outer");
+    REQUIRE(zones[1].depth == 0);
+    REQUIRE(zones[1].calls == 3);
+    REQUIRE(zones[2].path == "outer/inner");
+    REQUIRE(zones[2].depth == 1);
+    REQUIRE(zones[2].calls == 6);
+
+    for (auto const &zone : zones) {
+        REQUIRE(zone.threads == 1);
+        REQUIRE(zone.min <= zone.max);
+        REQUIRE(zone.max <= zone.total);
+        REQUIRE(zone.self <= zone.total);
+    }
+    REQUIRE(zones[1].self <= zones[1].total - zones[2].total + 1e-9);
+}
+
+TEST_CASE("Running zones are not reported", "[profiler]")
+{
+    Profiler profiler;
+    ProfileZone running(profiler, profiler.zone("running"));
+    {
+        ProfileZone done(profiler, profiler.zone("done"));
+    }
+
+    auto zones = profiler.zone_summary();
+    REQUIRE(zones.size() == 1);
+    REQUIRE(zones[0].path == "running/done");
+}
+
+TEST_CASE("Threads are merged", "[profiler]")
+{
+    Profiler profiler;
+    int work = profiler.zone("work");
+    int items = profiler.counter("items");
+
+    // the threads wait for each other, so that they do not share buffers
+    std::atomic<int> done(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&profiler, &done, work, items]() {
+            for (int i = 0; i < 100; ++i) {
+                ProfileZone zone(profiler, work);
+                profiler.count(items, 2);
+            }
+            ++done;
+            while (done < 4)
+                std::this_thread::yield();
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    auto zones = profiler.zone_summary();
+    REQUIRE(zones.size() == 1);
+    REQUIRE(zones[0].calls == 400);
+    REQUIRE(zones[0].threads == 4);
+
+    auto counters = profiler.counter_summary();
+    REQUIRE(counters.size() == 1);
+    REQUIRE(counters[0].name == "items");
+    REQUIRE(counters[0].total == 800);
+    REQUIRE(counters[0].additions == 400);
+}
+
+TEST_CASE("Threads that have exited hand over their buffers", "[profiler]")
+{
+    Profiler profiler;
+    int work = profiler.zone("work");
+    int items = profiler.counter("items");
+
+    // like workers that are started again in every time step
+    for (int step = 0; step < 50; ++step) {
+        std::thread worker([&profiler, work, items]() {
+            ProfileZone zone(profiler, work);
+            profiler.count(items, 1);
+        });
+        worker.join();
+    }
+
+    auto zones = profiler.zone_summary();
+    REQUIRE(zones.size() == 1);
+    REQUIRE(zones[0].calls == 50);
+    REQUIRE(zones[0].threads == 1);
+    REQUIRE(profiler.counter_summary()[0].total == 50);
+
+    SECTION("even if the profiler is gone by then") {
+        std::thread worker([]() {
+            Profiler short_lived;
+            ProfileZone zone(short_lived, short_lived.zone("brief"));
+        });
+        worker.join();
+    }
+}
+
+TEST_CASE("Summaries can be read while threads record", "[profiler]")
+{
+    Profiler profiler;
+    int work = profiler.zone("work");
+    std::atomic<bool> stop(false);
+
+    std::thread worker([&]() {
+        while (!stop) {
+            ProfileZone zone(profiler, work);
+        }
+    });
+    std::uint64_t last = 0;
+    for (int i = 0; i < 100; ++i) {
+        auto zones = profiler.zone_summary();
+        if (!zones.empty()) {
+            REQUIRE(zones[0].calls >= last);
+            last = zones[0].calls;
+        }
+    }
+    stop = true;
+    worker.join();
+}
+
+TEST_CASE("The trace is limited in size", "[profiler]")
+{
+    Profiler profiler;
+    profiler.set_max_trace_events(10);
+    int zone = profiler.zone("zone");
+    for (int i = 0; i < 25; ++i)
+        ProfileZone z(profiler, zone);
+
+    REQUIRE(profiler.dropped_events() == 15);
+    // the summary still has everything
+    REQUIRE(profiler.zone_summary()[0].calls == 25);
+
+    std::string path = "test_profiler_limited.json";
+    profiler.write_chrome_trace(path);
+    std::string trace = read_file(path);
+    REQUIRE(occurrences(trace, "\"ph\":\"X\"") == 10);
+    REQUIRE(trace.find("\"dropped_events\":15") != std::string::npos);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("Chrome trace has zones, threads and counters", "[profiler]")
+{
+    Profiler profiler;
+    int step = profiler.zone("step");
+    int quoted = profiler.zone("say \"hi\"");
+    int moves = profiler.counter("moves");
+
+    for (int i = 0; i < 3; ++i) {
+        {
+            ProfileZone z(profiler, step);
+            ProfileZone q(profiler, quoted);
+            profiler.count(moves, i + 1);
+        }
+        profiler.end_step();
+    }
+    REQUIRE(profiler.steps() == 3);
+
+    std::string path = "test_profiler_trace.json";
+    profiler.write_chrome_trace(path);
+    std::string trace = read_file(path);
+    std::remove(path.c_str());
+
+    REQUIRE(trace.rfind("{\"traceEvents\":[", 0) == 0);
+    REQUIRE(occurrences(trace, "\"ph\":\"X\"") == 6);
+    REQUIRE(occurrences(trace, "\"ph\":\"M\"") == 1);
+    REQUIRE(occurrences(trace, "\"name\":\"say \\\"hi\\\"\"") == 3);
+    // counters are recorded per step
+    REQUIRE(trace.find("\"args\":{\"value\":1}") != std::string::npos);
+    REQUIRE(trace.find("\"args\":{\"value\":2}") != std::string::npos);
+    REQUIRE(trace.find("\"args\":{\"value\":3}") != std::string::npos);
+}
+
+TEST_CASE("Summary CSV has zones and counters", "[profiler]")
+{
+    Profiler profiler;
+    int outer = profiler.zone("outer");
+    int inner = profiler.zone("inner");
+    int moves = profiler.counter("moves");
+    {
+        ProfileZone o(profiler, outer);
+        ProfileZone i(profiler, inner);
+        profiler.count(moves, 5);
+        profiler.count(moves, 7);
+    }
+
+    std::string path = "test_profiler_summary.csv";
+    profiler.write_summary_csv(path);
+    std::ifstream in(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    std::remove(path.c_str());
+
+    REQUIRE(lines.size() == 4);
+    REQUIRE(lines[0] == "kind,name,depth,count,total,self,mean,min,max");
+    REQUIRE(lines[1].rfind("zone,\"outer\",0,1,", 0) == 0);
+    REQUIRE(lines[2].rfind("zone,\"outer/inner\",1,1,", 0) == 0);
+    REQUIRE(lines[3] == "counter,\"moves\",0,2,12,,6.000,,");
+}
+
+TEST_CASE("Unwritable output throws", "[profiler]")
+{
+    Profiler profiler;
+    REQUIRE_THROWS_AS(profiler.write_summary_csv("/nonexistent/x.csv"),
+                      std::runtime_error);
+    REQUIRE_THROWS_AS(profiler.write_chrome_trace("/nonexistent/x.json"),
+                      std::runtime_error);
+}
+
+TEST_CASE("Summary prints a table", "[profiler]")
+{
+    Profiler profiler;
+    {
+        ProfileZone z(profiler, profiler.zone("outer"));
+        ProfileZone i(profiler, profiler.zone("inner"));
+    }
+    profiler.count(profiler.counter("moves"), 3);
+
+    std::ostringstream out;
+    profiler.print_summary(out);
+    std::string table = out.str();
+    REQUIRE(table.find("\nouter ") != std::string::npos);
+    REQUIRE(table.find("\n  inner ") != std::string::npos);
+    REQUIRE(table.find("\nmoves ") != std::string::npos);
+}
@@ -0,0 +1,173 @@
+// Load the code to be tested
+#include "output_writer.cpp"
+#include "trajectory.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string const test_file = "build/test_trajectory.tst";
+
+int const sizex = 7;
+int const sizey = 5;
+
+// A lattice in which a few sites change every frame
+std::vector<int> lattice(int frame)
+{
+    std::vector<int> sigma(sizex * sizey, 0);
+    for (int i = 0; i < frame && i < sizex * sizey; ++i)
+        sigma[(i * 3) % (sizex * sizey)] = 1 + i % 4;
+    return sigma;
+}
+
+std::vector<double> planes(int frame)
+{
+    std::vector<double> pde(2 * sizex * sizey);
+    for (std::size_t i = 0; i < pde.size(); ++i)
+        pde[i] = 0.25 * frame + 0.5 * i;
+    return pde;
+}
+
+void write_trajectory(TrajectoryPDE pde_type, int frames)
+{
+    TrajectoryWriter writer(test_file, sizex, sizey, 2, pde_type, 4);
+    for (int frame = 0; frame < frames; ++frame) {
+        std::vector<int> sigma = lattice(frame);
+        std::vector<double> pde = planes(frame);
+        writer.begin_frame(10 * frame);
+        writer.set_sigma(sigma.data());
+        // PDE and cells are optional
+        if (frame % 2 == 0)
+            writer.set_pde(pde.data());
+        if (frame % 3 == 0)
+            writer.set_cells({{1, 2, 1, 10, 20, 14, 1.5, 2.5},
+                              {2, 1, 0, 0, 20, 0, 0.0, 0.0}});
+        writer.end_frame();
+    }
+    REQUIRE(writer.frames() == static_cast<std::size_t>(frames));
+    writer.close();
+    std::streamoff file_size = std::ifstream(
+            test_file, std::ios::binary | std::ios::ate).tellg();
+    REQUIRE(writer.bytes_written() ==
+            static_cast<std::uint64_t>(file_size));
+}
+
+void check_frame(TrajectoryReader &reader, int frame, double tolerance)
+{
+    TrajectoryFrame f = reader.frame(frame);
+    REQUIRE(f.time == 10 * frame);
+    std::vector<int> sigma = lattice(frame);
+    REQUIRE(f.sigma == std::vector<std::int32_t>(sigma.begin(), sigma.end()));
+    REQUIRE(f.has_pde == (frame % 2 == 0));
+    if (f.has_pde) {
+        std::vector<double> pde = planes(frame);
+        REQUIRE(f.pde.size() == pde.size());
+        for (std::size_t i = 0; i < pde.size(); ++i)
+            REQUIRE(std::abs(f.pde[i] - pde[i]) <= tolerance);
+    }
+    REQUIRE(f.has_cells == (frame % 3 == 0));
+    if (f.has_cells) {
+        REQUIRE(f.cells.size() == 2);
+        REQUIRE(f.cells[0].sigma == 1);
+        REQUIRE(f.cells[0].perimeter == 14);
+        REQUIRE(f.cells[0].y == 2.5);
+        REQUIRE(f.cells[1].alive == 0);
+    }
+}
+
+} // namespace
+
+TEST_CASE("Trajectory round trip", "[trajectory]")
+{
+    write_trajectory(TrajectoryPDE::float64, 11);
+
+    TrajectoryReader reader(test_file);
+    REQUIRE(reader.sizex() == sizex);
+    REQUIRE(reader.sizey() == sizey);
+    REQUIRE(reader.layers() == 2);
+    REQUIRE(reader.frames() == 11);
+    REQUIRE(reader.time(7) == 70);
+
+    // in order, across chunk boundaries
+    for (int frame = 0; frame < 11; ++frame)
+        check_frame(reader, frame, 0.0);
+
+    // and in random order
+    for (int frame : {9, 2, 3, 10, 0, 5, 5})
+        check_frame(reader, frame, 0.0);
+
+    REQUIRE_THROWS_AS(reader.frame(11), std::out_of_range);
+}
+
+TEST_CASE("Trajectory PDE storage", "[trajectory]")
+{
+    // the planes span 0 to 40, quantisation error is at most half a step
+    SECTION("float32") {
+        write_trajectory(TrajectoryPDE::float32, 5);
+        TrajectoryReader reader(test_file);
+        for (int frame = 0; frame < 5; ++frame)
+            check_frame(reader, frame, 1e-5);
+    }
+    SECTION("uint16") {
+        write_trajectory(TrajectoryPDE::uint16, 5);
+        TrajectoryReader reader(test_file);
+        for (int frame = 0; frame < 5; ++frame)
+            check_frame(reader, frame, 0.5 * 40.0 / 65535.0 + 1e-9);
+    }
+    SECTION("uint8") {
+        write_trajectory(TrajectoryPDE::uint8, 5);
+        TrajectoryReader reader(test_file);
+        for (int frame = 0; frame < 5; ++frame)
+            check_frame(reader, frame, 0.5 * 40.0 / 255.0 + 1e-9);
+    }
+}
+
+TEST_CASE("Trajectory without index", "[trajectory]")
+{
+    // drop the index and the last, incomplete chunk, as after a crash
+    write_trajectory(TrajectoryPDE::float32, 10);
+    std::ifstream in(test_file, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+    in.close();
+
+    // index: header, 3 chunks, frame count, 10 times, trailer
+    std::size_t index = 16 + 3 * 24 + 8 + 10 * 4 + 16;
+    std::size_t cut = data.size() - index - 10;
+    {
+        std::ofstream out(test_file, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), cut);
+    }
+
+    TrajectoryReader reader(test_file);
+    // two complete chunks of four frames, the third chunk is cut
+    REQUIRE(reader.frames() == 8);
+    REQUIRE(reader.time(7) == 70);
+    for (int frame = 7; frame >= 0; --frame)
+        check_frame(reader, frame, 1e-5);
+}
+
+TEST_CASE("Trajectory errors", "[trajectory]")
+{
+    REQUIRE_THROWS_AS(TrajectoryReader("build/does_not_exist.tst"),
+                      std::runtime_error);
+
+    {
+        std::ofstream out(test_file, std::ios::binary | std::ios::trunc);
+        out << "This is not a trajectory, but it is long enough to be one.";
+    }
+    REQUIRE_THROWS_AS(TrajectoryReader(test_file), std::runtime_error);
+
+    TrajectoryWriter writer(test_file, sizex, sizey, 0);
+    REQUIRE_THROWS_AS(writer.end_frame(), std::logic_error);
+    writer.begin_frame(0);
+    REQUIRE_THROWS_AS(writer.end_frame(), std::logic_error);
+}
@@ -0,0 +1,59 @@
+// Load the code to be tested
+#include "worker_pool.cpp"
+
+// Dependencies for the test itself
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE("Loops cover the range in chunks", "[worker_pool]")
+{
+    for (int threads : {1, 2, 5}) {
+        WorkerPool pool(threads);
+        REQUIRE(pool.size() == static_cast<std::size_t>(threads));
+
+        // reuse the threads for several loops, including ones with fewer
+        // items than threads
+        for (std::size_t n : {0u, 3u, 100u, 1001u}) {
+            std::vector<int> visits(n, 0);
+            std::atomic<int> chunks(0);
+            pool.parallel_for(n, [&](std::size_t begin, std::size_t end) {
+                ++chunks;
+                for (std::size_t i = begin; i < end; ++i)
+                    ++visits[i];
+            });
+            REQUIRE(chunks == threads);
+            REQUIRE(visits == std::vector<int>(n, 1));
+        }
+    }
+}
+
+TEST_CASE("Exceptions are passed to the caller", "[worker_pool]")
+{
+    for (int threads : {1, 3}) {
+        WorkerPool pool(threads);
+
+        // thrown by the calling thread, and by one of the pool's
+        for (std::size_t thrower : {0u, 2u}) {
+            if (thrower >= pool.size())
+                continue;
+            std::atomic<int> finished(0);
+            REQUIRE_THROWS_AS(
+                pool.parallel_for(pool.size(),
+                                  [&](std::size_t begin, std::size_t) {
+                                      if (begin == thrower)
+                                          throw std::runtime_error("Failed");
+                                      ++finished;
+                                  }),
+                std::runtime_error);
+            REQUIRE(finished == threads - 1);
+        }
+
+        // the pool still works afterwards
+        std::atomic<int> chunks(0);
+        pool.parallel_for(10u, [&](std::size_t, std::size_t) { ++chunks; });
+        REQUIRE(chunks == threads);
+    }
+}
@@ -0,0 +1,539 @@
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace {
+
+char const magic[8] = {'T', 'S', 'T', 'T', 'R', 'A', 'J', '\0'};
+char const index_magic[8] = {'T', 'S', 'T', 'T', 'I', 'D', 'X', '\0'};
+char const chunk_tag[4] = {'C', 'H', 'N', 'K'};
+char const index_tag[4] = {'T', 'I', 'D', 'X'};
+std::uint32_t const byte_order_mark = 0x01020304;
+
+// Header: magic, version, byte order mark, sizex, sizey, layers, PDE type,
+// frames per chunk, reserved. Chunk header: tag, frames, first frame,
+// reserved, raw size, compressed size. Index entry: offset, compressed size,
+// first frame, frames. Trailer: index offset, index magic.
+std::size_t const header_size = 40;
+std::size_t const chunk_header_size = 32;
+std::size_t const index_entry_size = 24;
+std::size_t const trailer_size = 16;
+
+// Frame flags, the lattice is a delta against the previous frame if
+// full_sigma is not set
+std::uint32_t const full_sigma = 1;
+std::uint32_t const has_pde = 2;
+std::uint32_t const has_cells = 4;
+
+// A chunk is written early if it grows beyond this, to bound the memory
+// used by frames with large PDE planes
+std::size_t const max_chunk_bytes = 32 << 20;
+
+// Speed matters more than size here: lattice deltas and cell records
+// compress well at any level, and PDE planes barely compress at all
+int const compression_level = Z_BEST_SPEED;
+
+} // namespace
+
+TrajectoryWriter::TrajectoryWriter(std::string const &path, int sizex,
+                                   int sizey, int layers, TrajectoryPDE pde,
+                                   int chunk_frames)
+    : path_(path), sigma_size_(static_cast<std::size_t>(sizex) * sizey),
+      layers_(layers), pde_type_(pde), chunk_frames_(std::max(chunk_frames, 1)),
+      writer_(1, 2) {
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_)
+    throw std::runtime_error("Could not open " + path +
+                             " for writing a trajectory");
+
+  put_bytes_(magic, sizeof(magic));
+  put_(trajectory_version);
+  put_(byte_order_mark);
+  put_<std::int32_t>(sizex);
+  put_<std::int32_t>(sizey);
+  put_<std::int32_t>(layers);
+  put_(static_cast<std::uint32_t>(pde));
+  put_<std::uint32_t>(chunk_frames_);
+  put_<std::uint32_t>(0);
+  write_(chunk_.data(), chunk_.size());
+  chunk_.clear();
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+  try {
+    close();
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
+void TrajectoryWriter::begin_frame(int time) {
+  time_ = time;
+  in_frame_ = true;
+  has_sigma_ = false;
+  pde_.clear();
+  has_cells_ = false;
+}
+
+void TrajectoryWriter::set_cells(std::vector<TrajectoryCell> const &cells) {
+  cells_ = cells;
+  has_cells_ = true;
+}
+
+void TrajectoryWriter::end_frame() {
+  if (!in_frame_ || !file_)
+    throw std::logic_error("TrajectoryWriter: end_frame() without a frame");
+  if (!has_sigma_)
+    throw std::logic_error("TrajectoryWriter: frame without a lattice");
+  in_frame_ = false;
+
+  bool keyframe = chunk_frame_count_ == 0;
+  bool pde = layers_ > 0 && !pde_.empty();
+  std::uint32_t flags = (keyframe ? full_sigma : 0) | (pde ? has_pde : 0) |
+                        (has_cells_ ? has_cells : 0);
+  put_<std::int32_t>(time_);
+  put_(flags);
+
+  if (keyframe) {
+    put_bytes_(current_.data(), sigma_size_ * sizeof(std::int32_t));
+  } else {
+    // gaps between the changed sites, then their new values
+    gaps_.clear();
+    values_.clear();
+    std::size_t last = 0;
+    for (std::size_t i = 0; i < sigma_size_; ++i)
+      if (current_[i] != previous_[i]) {
+        gaps_.push_back(i - last);
+        values_.push_back(current_[i]);
+        last = i;
+      }
+    put_<std::uint32_t>(gaps_.size());
+    put_bytes_(gaps_.data(), gaps_.size() * sizeof(std::uint32_t));
+    put_bytes_(values_.data(), values_.size() * sizeof(std::int32_t));
+  }
+  previous_.swap(current_);
+
+  if (pde) {
+    for (int layer = 0; layer < layers_; ++layer) {
+      double const *plane = pde_.data() + layer * sigma_size_;
+      switch (pde_type_) {
+      case TrajectoryPDE::float32:
+        put_converted_<float>(plane, [](double value) {
+          return static_cast<float>(value);
+        });
+        break;
+      case TrajectoryPDE::float64:
+        put_bytes_(plane, sigma_size_ * sizeof(double));
+        break;
+      case TrajectoryPDE::uint8:
+        quantise_<std::uint8_t>(plane);
+        break;
+      case TrajectoryPDE::uint16:
+        quantise_<std::uint16_t>(plane);
+        break;
+      }
+    }
+  }
+
+  if (has_cells_) {
+    put_<std::uint32_t>(cells_.size());
+    put_bytes_(cells_.data(), cells_.size() * sizeof(TrajectoryCell));
+  }
+
+  times_.push_back(time_);
+  if (++chunk_frame_count_ == static_cast<std::uint32_t>(chunk_frames_) ||
+      chunk_.size() >= max_chunk_bytes)
+    flush_chunk_();
+}
+
+void TrajectoryWriter::close() {
+  if (!file_)
+    return;
+  flush_chunk_();
+  writer_.flush();
+  FILE *file = file_;
+  file_ = nullptr;
+  if (!error_.empty()) {
+    std::fclose(file);
+    throw std::runtime_error(error_);
+  }
+
+  // the index, in one piece at the end of the file
+  std::vector<unsigned char> index;
+  auto put = [&index](void const *data, std::size_t bytes) {
+    auto p = static_cast<unsigned char const *>(data);
+    index.insert(index.end(), p, p + bytes);
+  };
+  std::uint64_t index_offset = offset_;
+  std::uint32_t reserved = 0;
+  std::uint64_t n_chunks = chunks_.size(), n_frames = times_.size();
+  put(index_tag, 4);
+  put(&reserved, sizeof(reserved));
+  put(&n_chunks, sizeof(n_chunks));
+  for (ChunkInfo const &chunk : chunks_) {
+    put(&chunk.offset, sizeof(chunk.offset));
+    put(&chunk.compressed_size, sizeof(chunk.compressed_size));
+    put(&chunk.first_frame, sizeof(chunk.first_frame));
+    put(&chunk.frames, sizeof(chunk.frames));
+  }
+  put(&n_frames, sizeof(n_frames));
+  put(times_.data(), times_.size() * sizeof(std::int32_t));
+  put(&index_offset, sizeof(index_offset));
+  put(index_magic, sizeof(index_magic));
+
+  bool ok = std::fwrite(index.data(), 1, index.size(), file) == index.size();
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok)
+    throw std::runtime_error("Error writing trajectory " + path_ + ": " +
+                             std::strerror(errno));
+  offset_ += index.size();
+}
+
+template <typename T, typename Convert>
+void TrajectoryWriter::put_converted_(double const *values, Convert convert) {
+  // the values may not be aligned in the chunk, so they are copied bytewise,
+  // which compilers turn into plain stores
+  std::size_t start = chunk_.size();
+  chunk_.resize(start + sigma_size_ * sizeof(T));
+  unsigned char *out = chunk_.data() + start;
+  for (std::size_t i = 0; i < sigma_size_; ++i) {
+    T value = convert(values[i]);
+    std::memcpy(out + i * sizeof(T), &value, sizeof(T));
+  }
+}
+
+template <typename T> void TrajectoryWriter::put_(T const &value) {
+  put_bytes_(&value, sizeof(value));
+}
+
+void TrajectoryWriter::put_bytes_(void const *data, std::size_t bytes) {
+  auto p = static_cast<unsigned char const *>(data);
+  chunk_.insert(chunk_.end(), p, p + bytes);
+}
+
+template <typename Q> void TrajectoryWriter::quantise_(double const *plane) {
+  auto range = std::minmax_element(plane, plane + sigma_size_);
+  double lo = *range.first, hi = *range.second;
+  double levels = std::numeric_limits<Q>::max();
+  double scale = hi > lo ? levels / (hi - lo) : 0.;
+  put_(lo);
+  put_(hi);
+
+  put_converted_<Q>(plane, [lo, scale](double value) {
+    return static_cast<Q>((value - lo) * scale + 0.5);
+  });
+}
+
+void TrajectoryWriter::write_(void const *data, std::size_t bytes) {
+  if (std::fwrite(data, 1, bytes, file_) != bytes)
+    throw std::runtime_error("Error writing trajectory " + path_ + ": " +
+                             std::strerror(errno));
+  offset_ += bytes;
+}
+
+void TrajectoryWriter::flush_chunk_() {
+  if (chunk_frame_count_ == 0)
+    return;
+
+  // Compressed and written by a single background thread, so chunks are
+  // written in order. Only that thread touches the file until close().
+  auto raw = std::make_shared<std::vector<unsigned char>>();
+  raw->swap(chunk_);
+  std::uint32_t first_frame = chunk_first_frame_;
+  std::uint32_t frames = chunk_frame_count_;
+  writer_.submit([this, raw, first_frame, frames]() {
+    if (!error_.empty())
+      return;
+    try {
+      uLongf compressed_size = compressBound(raw->size());
+      std::vector<unsigned char> data(chunk_header_size + compressed_size);
+      if (compress2(data.data() + chunk_header_size, &compressed_size,
+                    raw->data(), raw->size(), compression_level) != Z_OK)
+        throw std::runtime_error("Error compressing trajectory " + path_);
+
+      std::uint32_t reserved = 0;
+      std::uint64_t raw_size = raw->size(), size = compressed_size;
+      unsigned char *header = data.data();
+      std::memcpy(header, chunk_tag, 4);
+      std::memcpy(header + 4, &frames, 4);
+      std::memcpy(header + 8, &first_frame, 4);
+      std::memcpy(header + 12, &reserved, 4);
+      std::memcpy(header + 16, &raw_size, 8);
+      std::memcpy(header + 24, &size, 8);
+
+      chunks_.push_back(ChunkInfo{offset_, size, first_frame, frames});
+      write_(data.data(), chunk_header_size + compressed_size);
+    } catch (std::exception const &e) {
+      error_ = e.what();
+    }
+  });
+
+  chunk_ = std::vector<unsigned char>();
+  chunk_first_frame_ += chunk_frame_count_;
+  chunk_frame_count_ = 0;
+}
+
+TrajectoryReader::TrajectoryReader(std::string const &path) : path_(path) {
+  file_ = std::fopen(path.c_str(), "rb");
+  if (!file_)
+    fail_(std::string("could not open: ") + std::strerror(errno));
+  if (std::fseek(file_, 0, SEEK_END) != 0)
+    fail_("could not seek");
+  size_ = std::ftell(file_);
+
+  unsigned char header[header_size];
+  if (size_ < header_size)
+    fail_("not a trajectory file");
+  read_at_(0, header, header_size);
+  if (std::memcmp(header, magic, sizeof(magic)) != 0)
+    fail_("not a trajectory file");
+
+  std::uint32_t version, mark, pde_type;
+  std::memcpy(&version, header + 8, 4);
+  std::memcpy(&mark, header + 12, 4);
+  if (mark != byte_order_mark)
+    fail_("written on a machine with a different byte order");
+  if (version == 0 || version > trajectory_version)
+    fail_("unsupported version " + std::to_string(version));
+  std::memcpy(&sizex_, header + 16, 4);
+  std::memcpy(&sizey_, header + 20, 4);
+  std::memcpy(&layers_, header + 24, 4);
+  std::memcpy(&pde_type, header + 28, 4);
+  pde_type_ = static_cast<TrajectoryPDE>(pde_type);
+  if (sizex_ <= 0 || sizey_ <= 0 || layers_ < 0)
+    fail_("invalid header");
+
+  if (!read_index_())
+    scan_chunks_();
+}
+
+TrajectoryReader::~TrajectoryReader() {
+  if (file_)
+    std::fclose(file_);
+}
+
+TrajectoryFrame TrajectoryReader::frame(std::size_t i) {
+  if (i >= times_.size())
+    throw std::out_of_range("Trajectory " + path_ + ": no frame " +
+                            std::to_string(i));
+
+  auto after = std::upper_bound(
+      chunks_.begin(), chunks_.end(), i,
+      [](std::size_t i, ChunkInfo const &c) { return i < c.first_frame; });
+  std::size_t chunk = after - chunks_.begin() - 1;
+
+  // deltas can only be applied going forward from the start of the chunk
+  if (chunk != loaded_chunk_ || next_frame_ > i)
+    load_chunk_(chunk);
+  while (next_frame_ <= i)
+    decode_frame_(state_);
+  return state_;
+}
+
+bool TrajectoryReader::read_index_() {
+  if (size_ < header_size + trailer_size)
+    return false;
+  unsigned char trailer[trailer_size];
+  read_at_(size_ - trailer_size, trailer, trailer_size);
+  if (std::memcmp(trailer + 8, index_magic, sizeof(index_magic)) != 0)
+    return false;
+
+  std::uint64_t offset, n_chunks, n_frames;
+  std::memcpy(&offset, trailer, 8);
+  if (offset < header_size || offset + 16 > size_ - trailer_size)
+    fail_("invalid index");
+  unsigned char head[16];
+  read_at_(offset, head, 16);
+  std::memcpy(&n_chunks, head + 8, 8);
+  if (std::memcmp(head, index_tag, 4) != 0 ||
+      n_chunks > (size_ - offset) / index_entry_size)
+    fail_("invalid index");
+
+  std::vector<unsigned char> entries(n_chunks * index_entry_size + 8);
+  read_at_(offset + 16, entries.data(), entries.size());
+  for (std::uint64_t c = 0; c < n_chunks; ++c) {
+    unsigned char const *entry = entries.data() + c * index_entry_size;
+    ChunkInfo chunk;
+    std::memcpy(&chunk.offset, entry, 8);
+    std::memcpy(&chunk.compressed_size, entry + 8, 8);
+    std::memcpy(&chunk.first_frame, entry + 16, 4);
+    std::memcpy(&chunk.frames, entry + 20, 4);
+    chunks_.push_back(chunk);
+  }
+  std::memcpy(&n_frames, entries.data() + n_chunks * index_entry_size, 8);
+  if (n_frames > size_ / sizeof(std::int32_t))
+    fail_("invalid index");
+  times_.resize(n_frames);
+  read_at_(offset + 16 + entries.size(), times_.data(),
+           n_frames * sizeof(std::int32_t));
+  return true;
+}
+
+void TrajectoryReader::scan_chunks_() {
+  // The trajectory was not closed, e.g. because the simulation crashed.
+  // Read the complete chunks, decompressing them for the frame times.
+  std::uint64_t pos = header_size;
+  while (size_ - pos >= chunk_header_size) {
+    unsigned char header[chunk_header_size];
+    read_at_(pos, header, chunk_header_size);
+    ChunkInfo chunk;
+    chunk.offset = pos;
+    std::memcpy(&chunk.frames, header + 4, 4);
+    std::memcpy(&chunk.first_frame, header + 8, 4);
+    std::memcpy(&chunk.compressed_size, header + 24, 8);
+    if (std::memcmp(header, chunk_tag, 4) != 0 ||
+        chunk.compressed_size > size_ - pos - chunk_header_size)
+      break;
+    chunks_.push_back(chunk);
+    pos += chunk_header_size + chunk.compressed_size;
+  }
+
+  times_.clear();
+  for (std::size_t c = 0; c < chunks_.size(); ++c) {
+    load_chunk_(c);
+    for (std::uint32_t f = 0; f < chunks_[c].frames; ++f) {
+      decode_frame_(state_);
+      times_.push_back(state_.time);
+    }
+  }
+  loaded_chunk_ = SIZE_MAX;
+}
+
+void TrajectoryReader::load_chunk_(std::size_t c) {
+  ChunkInfo const &chunk = chunks_.at(c);
+  unsigned char header[chunk_header_size];
+  read_at_(chunk.offset, header, chunk_header_size);
+  std::uint64_t raw_size;
+  std::memcpy(&raw_size, header + 16, 8);
+  if (std::memcmp(header, chunk_tag, 4) != 0)
+    fail_("invalid chunk at offset " + std::to_string(chunk.offset));
+
+  std::vector<unsigned char> compressed(chunk.compressed_size);
+  read_at_(chunk.offset + chunk_header_size, compressed.data(),
+           compressed.size());
+  data_.resize(raw_size);
+  uLongf size = raw_size;
+  if (uncompress(data_.data(), &size, compressed.data(), compressed.size()) !=
+          Z_OK ||
+      size != raw_size)
+    fail_("corrupt chunk at offset " + std::to_string(chunk.offset));
+
+  loaded_chunk_ = c;
+  pos_ = 0;
+  next_frame_ = chunk.first_frame;
+}
+
+void TrajectoryReader::decode_frame_(TrajectoryFrame &frame) {
+  std::size_t const n = static_cast<std::size_t>(sizex_) * sizey_;
+  auto take = [this](void *out, std::size_t bytes) {
+    if (bytes > data_.size() - pos_)
+      fail_("frame " + std::to_string(next_frame_) + " is truncated");
+    if (bytes)
+      std::memcpy(out, data_.data() + pos_, bytes);
+    pos_ += bytes;
+  };
+
+  std::int32_t time;
+  std::uint32_t flags;
+  take(&time, 4);
+  take(&flags, 4);
+  frame.time = time;
+
+  if (flags & full_sigma) {
+    frame.sigma.resize(n);
+    take(frame.sigma.data(), n * sizeof(std::int32_t));
+  } else {
+    if (frame.sigma.size() != n)
+      fail_("frame " + std::to_string(next_frame_) + " has no keyframe");
+    std::uint32_t changes;
+    take(&changes, 4);
+    if (changes > n)
+      fail_("frame " + std::to_string(next_frame_) + " is corrupt");
+    std::vector<std::uint32_t> gaps(changes);
+    std::vector<std::int32_t> values(changes);
+    take(gaps.data(), changes * sizeof(std::uint32_t));
+    take(values.data(), changes * sizeof(std::int32_t));
+    std::size_t site = 0;
+    for (std::uint32_t k = 0; k < changes; ++k) {
+      site += gaps[k];
+      if (site >= n)
+        fail_("frame " + std::to_string(next_frame_) + " is corrupt");
+      frame.sigma[site] = values[k];
+    }
+  }
+
+  frame.has_pde = flags & has_pde;
+  frame.pde.clear();
+  if (frame.has_pde) {
+    frame.pde.resize(layers_ * n);
+    for (int layer = 0; layer < layers_; ++layer) {
+      double *plane = frame.pde.data() + layer * n;
+      switch (pde_type_) {
+      case TrajectoryPDE::float32: {
+        std::vector<float> values(n);
+        take(values.data(), n * sizeof(float));
+        std::copy(values.begin(), values.end(), plane);
+        break;
+      }
+      case TrajectoryPDE::float64:
+        take(plane, n * sizeof(double));
+        break;
+      case TrajectoryPDE::uint8:
+      case TrajectoryPDE::uint16: {
+        double lo, hi;
+        take(&lo, 8);
+        take(&hi, 8);
+        double levels = pde_type_ == TrajectoryPDE::uint8 ? 255. : 65535.;
+        double step = (hi - lo) / levels;
+        if (pde_type_ == TrajectoryPDE::uint8) {
+          std::vector<std::uint8_t> q(n);
+          take(q.data(), n);
+          for (std::size_t i = 0; i < n; ++i)
+            plane[i] = lo + q[i] * step;
+        } else {
+          std::vector<std::uint16_t> q(n);
+          take(q.data(), n * sizeof(std::uint16_t));
+          for (std::size_t i = 0; i < n; ++i)
+            plane[i] = lo + q[i] * step;
+        }
+        break;
+      }
+      default:
+        fail_("unknown PDE type " +
+              std::to_string(static_cast<std::uint32_t>(pde_type_)));
+      }
+    }
+  }
+
+  frame.has_cells = flags & has_cells;
+  frame.cells.clear();
+  if (frame.has_cells) {
+    std::uint32_t count;
+    take(&count, 4);
+    if (count > (data_.size() - pos_) / sizeof(TrajectoryCell))
+      fail_("frame " + std::to_string(next_frame_) + " is truncated");
+    frame.cells.resize(count);
+    take(frame.cells.data(), count * sizeof(TrajectoryCell));
+  }
+  ++next_frame_;
+}
+
+void TrajectoryReader::read_at_(std::uint64_t offset, void *data,
+                                std::size_t bytes) {
+  if (offset > size_ || bytes > size_ - offset ||
+      std::fseek(file_, offset, SEEK_SET) != 0 ||
+      std::fread(data, 1, bytes, file_) != bytes)
+    fail_("unexpected end of file");
+}
+
+void TrajectoryReader::fail_(std::string const &what) const {
+  throw std::runtime_error("Trajectory " + path_ + ": " + what);
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include "output_writer.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/** Version of the trajectory format written by TrajectoryWriter. */
+constexpr std::uint32_t trajectory_version = 1;
+
+/** Summary of a cell, as stored in a trajectory frame
+ *
+ * The centroid is in lattice coordinates, it is (0, 0) for cells without
+ * area.
+ */
+struct TrajectoryCell {
+  std::int32_t sigma;
+  std::int32_t tau;
+  std::int32_t alive;
+  std::int32_t area;
+  std::int32_t target_area;
+  std::int32_t perimeter;
+  double x;
+  double y;
+};
+
+/** How the PDE planes are stored in a trajectory */
+enum class TrajectoryPDE : std::uint32_t {
+  float32 = 0,
+  float64 = 1,
+  // linearly quantised between the minimum and maximum of each layer
+  uint8 = 8,
+  uint16 = 16
+};
+
+/** A frame of a trajectory, as read by TrajectoryReader
+ *
+ * The lattice and the PDE layers are stored x-major, like the CPM stores
+ * them, so that site (x, y) is at index x * sizey + y.
+ */
+struct TrajectoryFrame {
+  int time = 0;
+  std::vector<std::int32_t> sigma;
+  std::vector<double> pde;
+  std::vector<TrajectoryCell> cells;
+  bool has_pde = false;
+  bool has_cells = false;
+};
+
+/** Writes a trajectory of CPM lattices, PDE planes and cells
+ *
+ * Frames are grouped into chunks, which are compressed with zlib. The first
+ * frame of each chunk stores the whole lattice, the other frames only the
+ * sites that changed since the previous frame, which is usually a small
+ * fraction. When the trajectory is closed, an index of the chunks and the
+ * frame times is appended, so that readers can find any frame by
+ * decompressing a single chunk. If the program stops before that, the
+ * chunks written so far can still be read by scanning the file.
+ *
+ * Chunks are compressed and written by a background thread, so that the
+ * simulation only pays for copying the frame and finding the changed sites.
+ *
+ * A frame is written as
+ *
+ *   writer.begin_frame(time);
+ *   writer.set_sigma(...);
+ *   writer.set_pde(...);   // optional
+ *   writer.set_cells(...); // optional
+ *   writer.end_frame();
+ */
+class TrajectoryWriter {
+public:
+  /** Create a trajectory file
+   *
+   * @param path File to write, replaced if it exists.
+   * @param sizex Size of the lattice in the x direction.
+   * @param sizey Size of the lattice in the y direction.
+   * @param layers Number of PDE layers, 0 if there is no PDE.
+   * @param pde How to store the PDE layers.
+   * @param chunk_frames Number of frames per chunk.
+   * @throws std::runtime_error if the file cannot be created.
+   */
+  TrajectoryWriter(std::string const &path, int sizex, int sizey, int layers,
+                   TrajectoryPDE pde = TrajectoryPDE::float32,
+                   int chunk_frames = 64);
+
+  /// Closes the trajectory, see close().
+  ~TrajectoryWriter();
+
+  TrajectoryWriter(TrajectoryWriter const &) = delete;
+  TrajectoryWriter &operator=(TrajectoryWriter const &) = delete;
+
+  /// Start a new frame.
+  void begin_frame(int time);
+
+  /** Set the lattice of the current frame
+   *
+   * Every frame must have a lattice.
+   *
+   * @param sigma sizex * sizey spins, x-major.
+   */
+  template <typename Spin> void set_sigma(Spin const *sigma) {
+    current_.resize(sigma_size_);
+    for (std::size_t i = 0; i < sigma_size_; ++i)
+      current_[i] = sigma[i];
+    has_sigma_ = true;
+  }
+
+  /** Set the PDE planes of the current frame
+   *
+   * @param pde layers * sizex * sizey values, layer by layer, x-major.
+   */
+  template <typename Value> void set_pde(Value const *pde) {
+    pde_.assign(pde, pde + layers_ * sigma_size_);
+  }
+
+  /// Set the cells of the current frame.
+  void set_cells(std::vector<TrajectoryCell> const &cells);
+
+  /// Finish the current frame.
+  void end_frame();
+
+  /// Return the number of frames written so far.
+  std::size_t frames() const { return times_.size(); }
+
+  /// Return the number of bytes written to the file so far.
+  std::uint64_t bytes_written() const { return offset_.load(); }
+
+  /** Write the remaining frames and the index, and close the file
+   *
+   * @throws std::runtime_error if writing fails.
+   */
+  void close();
+
+private:
+  struct ChunkInfo {
+    std::uint64_t offset;
+    std::uint64_t compressed_size;
+    std::uint32_t first_frame;
+    std::uint32_t frames;
+  };
+
+  template <typename T> void put_(T const &value);
+  void put_bytes_(void const *data, std::size_t bytes);
+  template <typename T, typename Convert>
+  void put_converted_(double const *values, Convert convert);
+  template <typename Q> void quantise_(double const *plane);
+  void write_(void const *data, std::size_t bytes);
+  void flush_chunk_();
+
+  std::FILE *file_ = nullptr;
+  std::string path_;
+  std::size_t sigma_size_;
+  int layers_;
+  TrajectoryPDE pde_type_;
+  int chunk_frames_;
+
+  // frame being built
+  int time_ = 0;
+  bool in_frame_ = false;
+  std::vector<std::int32_t> current_;
+  std::vector<double> pde_;
+  std::vector<TrajectoryCell> cells_;
+  bool has_sigma_ = false;
+  bool has_cells_ = false;
+
+  // previous frame in this chunk, for delta encoding
+  std::vector<std::int32_t> previous_;
+  std::vector<std::uint32_t> gaps_;
+  std::vector<std::int32_t> values_;
+  std::uint32_t chunk_first_frame_ = 0;
+  std::uint32_t chunk_frame_count_ = 0;
+  std::vector<unsigned char> chunk_;
+  std::vector<std::int32_t> times_;
+
+  // used by the background thread until close()
+  std::atomic<std::uint64_t> offset_{0};
+  std::vector<ChunkInfo> chunks_;
+  std::string error_;
+  OutputWriter writer_;
+};
+
+/** Reads a trajectory written by TrajectoryWriter
+ *
+ * Uses the index if there is one, and scans the chunks otherwise. The most
+ * recently used chunk is kept decompressed, so reading consecutive frames
+ * only decompresses each chunk once.
+ */
+class TrajectoryReader {
+public:
+  /** Open a trajectory
+   *
+   * @throws std::runtime_error if the file cannot be read or is not a
+   *         trajectory.
+   */
+  explicit TrajectoryReader(std::string const &path);
+  ~TrajectoryReader();
+
+  TrajectoryReader(TrajectoryReader const &) = delete;
+  TrajectoryReader &operator=(TrajectoryReader const &) = delete;
+
+  int sizex() const { return sizex_; }
+  int sizey() const { return sizey_; }
+  int layers() const { return layers_; }
+
+  /// Return the number of frames.
+  std::size_t frames() const { return times_.size(); }
+
+  /// Return the time of frame i.
+  int time(std::size_t i) const { return times_.at(i); }
+
+  /** Read frame i
+   *
+   * @throws std::runtime_error if the file is damaged.
+   */
+  TrajectoryFrame frame(std::size_t i);
+
+private:
+  struct ChunkInfo {
+    std::uint64_t offset;
+    std::uint64_t compressed_size;
+    std::uint32_t first_frame;
+    std::uint32_t frames;
+  };
+
+  bool read_index_();
+  void scan_chunks_();
+  void load_chunk_(std::size_t chunk);
+  void decode_frame_(TrajectoryFrame &frame);
+  void read_at_(std::uint64_t offset, void *data, std::size_t bytes);
+  [[noreturn]] void fail_(std::string const &what) const;
+
+  std::FILE *file_ = nullptr;
+  std::string path_;
+  std::uint64_t size_ = 0;
+  int sizex_ = 0, sizey_ = 0, layers_ = 0;
+  TrajectoryPDE pde_type_ = TrajectoryPDE::float32;
+
+  std::vector<ChunkInfo> chunks_;
+  std::vector<std::int32_t> times_;
+
+  // decoding state of the loaded chunk
+  std::size_t loaded_chunk_ = SIZE_MAX;
+  std::vector<unsigned char> data_;
+  std::size_t pos_ = 0;
+  std::size_t next_frame_ = 0;
+  TrajectoryFrame state_;
+};
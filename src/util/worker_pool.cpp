@@ -0,0 +1,92 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threads) {
+  if (threads < 1)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  num_threads_ = static_cast<std::size_t>(threads);
+  for (std::size_t i = 1u; i < num_threads_; ++i)
+    workers_.emplace_back(&WorkerPool::work_, this, i);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (auto &worker : workers_)
+    worker.join();
+}
+
+void WorkerPool::parallel_for(
+    std::size_t n, std::function<void(std::size_t, std::size_t)> const &body) {
+  if (workers_.empty()) {
+    body(0u, n);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    body_ = &body;
+    body_size_ = n;
+    busy_ = workers_.size();
+    error_ = nullptr;
+    ++generation_;
+  }
+  work_available_.notify_all();
+
+  std::exception_ptr error;
+  try {
+    body(0u, n / num_threads_);
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this] { return busy_ == 0u; });
+  body_ = nullptr;
+  if (!error)
+    error = error_;
+  error_ = nullptr;
+  lock.unlock();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void WorkerPool::work_(std::size_t worker) {
+  std::uint64_t seen = 0u;
+  while (true) {
+    std::function<void(std::size_t, std::size_t)> const *body;
+    std::size_t n;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(
+          lock, [this, seen] { return stopping_ || generation_ != seen; });
+      if (stopping_)
+        return;
+      seen = generation_;
+      body = body_;
+      n = body_size_;
+    }
+
+    std::exception_ptr error;
+    try {
+      (*body)(n * worker / num_threads_, n * (worker + 1u) / num_threads_);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    bool done;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error && !error_)
+        error_ = error;
+      done = --busy_ == 0u;
+    }
+    if (done)
+      work_done_.notify_one();
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Runs loops on a fixed set of threads
+ *
+ * The threads are started when the pool is created, and wait in between
+ * loops, so that a loop can be run in parallel every time step without
+ * starting and stopping threads each time.
+ *
+ * Loops are run by one thread at a time, the pool cannot be shared between
+ * threads that run loops concurrently.
+ */
+class WorkerPool {
+public:
+  /** Create a pool
+   *
+   * @param threads Number of threads to run loops on, including the thread
+   *        that runs the loop, 0 means one per core.
+   */
+  explicit WorkerPool(int threads = 0);
+
+  /// Stops the threads.
+  ~WorkerPool();
+
+  WorkerPool(WorkerPool const &) = delete;
+  WorkerPool &operator=(WorkerPool const &) = delete;
+
+  /// Return the number of threads, including the one that runs the loop.
+  std::size_t size() const { return num_threads_; }
+
+  /** Run body over [0, n) in chunks, one per thread.
+   *
+   * body(begin, end) is called once for each chunk, by the calling thread
+   * for the first one and the pool for the others. If any of the calls
+   * throw, one of their exceptions is rethrown once all of them have
+   * finished.
+   */
+  void parallel_for(std::size_t n,
+                    std::function<void(std::size_t, std::size_t)> const &body);
+
+private:
+  void work_(std::size_t worker);
+
+  std::size_t num_threads_ = 1u;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable work_done_;
+  std::function<void(std::size_t, std::size_t)> const *body_ = nullptr;
+  std::size_t body_size_ = 0u;
+  std::uint64_t generation_ = 0u;
+  std::size_t busy_ = 0u;
+  std::exception_ptr error_;
+  bool stopping_ = false;
+};